@@ -28,6 +28,17 @@ option(ENABLE_TESTS "Enable Tests" NO)
 option(WITH_STATIC "Enable static linkage of external libraries" NO)
 option(GPL "Produce GNU GPLv2 source and binaries" YES)
 
+# Logging; for example INFO removes all debug logging of hot paths
+set(LOGGER_COMPILED_LEVEL "DEBUG"
+  CACHE STRING "Least severe log level compiled in: DEBUG, INFO, WARNING or ERROR")
+string(TOUPPER "${LOGGER_COMPILED_LEVEL}" _logger_compiled_level)
+if(NOT _logger_compiled_level MATCHES "^(DEBUG|INFO|WARNING|ERROR)$")
+  message(FATAL_ERROR "LOGGER_COMPILED_LEVEL must be DEBUG, INFO, WARNING or ERROR")
+endif()
+if(NOT _logger_compiled_level STREQUAL "DEBUG")
+  add_definitions(-DLOGGER_COMPILED_LEVEL=LOG_LEVEL_${_logger_compiled_level})
+endif()
+
 # MySQL Harness
 set(HARNESS_NAME "mysqlrouter" CACHE STRING "Name of Harness")
 
@@ -0,0 +1,134 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * Compares the cost of logging for the logging threads: writing each
+ * message synchronously with writing it from the background thread of
+ * mode=async, and formatting a disabled debug message with checking the
+ * level first, like LOGGER_DEBUG() does.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+#include "mysql/harness/config_parser.h"
+#include "mysql/harness/filesystem.h"
+#include "mysql/harness/plugin.h"
+
+using mysql_harness::AppInfo;
+using mysql_harness::Config;
+using mysql_harness::Path;
+
+extern "C" {
+  extern mysql_harness::Plugin logger;
+}
+
+namespace {
+
+const char *kProgram = "bench_harness_logger";
+
+// logs into the current directory while alive
+class ScopedLogger {
+ public:
+  explicit ScopedLogger(const std::string &mode) : config_(Config::allow_keys) {
+    std::istringstream input("[logger]\nlevel = info\nmode = " + mode + "\n");
+    config_.read(input);
+    info_ = AppInfo();
+    info_.program = kProgram;
+    info_.logging_folder = ".";
+    info_.config = &config_;
+    logger.init(&info_);
+  }
+
+  ~ScopedLogger() {
+    logger.deinit(&info_);
+    std::remove(Path::make_path(".", kProgram, "log").c_str());
+  }
+
+ private:
+  Config config_;
+  AppInfo info_;
+};
+
+void log_from_threads(int threads, int messages) {
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([t, messages]() {
+      for (int i = 0; i < messages; ++i) {
+        log_info("benchmark message %d from thread %d", i, t);
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+// what routing did for every connection before logging it at debug level
+std::string format_route(int connection) {
+  std::string client = "127.0.0." + std::to_string(connection % 250 + 1);
+  std::string server = "192.168.0." + std::to_string(connection % 3 + 1);
+  char info[256];
+  snprintf(info, sizeof(info), "[routing:test] source [%s]:%d - dest [%s]:%d",
+           client.c_str(), 40000 + connection % 20000, server.c_str(), 3306);
+  return info;
+}
+
+}
+
+// arguments: threads, messages logged by each thread
+static void BM_Logging(benchmark::State &state, const std::string &mode) {
+  const int threads = static_cast<int>(state.range(0));
+  const int messages = static_cast<int>(state.range(1));
+  ScopedLogger scoped(mode);
+  uint64_t dropped = log_dropped_messages();
+  while (state.KeepRunning()) {
+    log_from_threads(threads, messages);
+  }
+  state.SetItemsProcessed(state.iterations() * threads * messages);
+  state.counters["dropped"] = static_cast<double>(log_dropped_messages() - dropped);
+}
+BENCHMARK_CAPTURE(BM_Logging, sync, std::string("sync"))
+    ->Args({64, 500})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Logging, async, std::string("async"))
+    ->Args({64, 500})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_DisabledDebugFormatted(benchmark::State &state) {
+  ScopedLogger scoped("sync");
+  int connection = 0;
+  while (state.KeepRunning()) {
+    log_debug("%s", format_route(connection++).c_str());
+  }
+}
+BENCHMARK(BM_DisabledDebugFormatted);
+
+static void BM_DisabledDebugLevelCheckedFirst(benchmark::State &state) {
+  ScopedLogger scoped("sync");
+  int connection = 0;
+  while (state.KeepRunning()) {
+    LOGGER_DEBUG("%s", format_route(connection++).c_str());
+  }
+}
+BENCHMARK(BM_DisabledDebugLevelCheckedFirst);
+
+BENCHMARK_MAIN();
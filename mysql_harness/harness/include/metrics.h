@@ -0,0 +1,264 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQL_HARNESS_METRICS_INCLUDED
+#define MYSQL_HARNESS_METRICS_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "harness_export.h"
+
+namespace mysql_harness {
+
+namespace metrics {
+
+/** @brief Labels of a metric, like {"route", "routing:ro"} */
+using Labels = std::map<std::string, std::string>;
+
+/** @brief Number of slots each metric spreads its writes over */
+constexpr size_t kSlots = 16;
+
+/** @brief Size of a cache line; each slot gets its own */
+constexpr size_t kCacheLineSize = 64;
+
+/** @brief Returns the slot the calling thread writes to
+ *
+ * Threads get slots round-robin when they first write a metric. With more
+ * threads than slots, several threads share a slot.
+ */
+HARNESS_EXPORT size_t thread_slot() noexcept;
+
+/** @class Counter
+ * @brief Value which only goes up, like the number of accepted clients
+ *
+ * Writers only touch the slot of their thread, so that threads do not
+ * fight over a cache line; value() adds up all slots.
+ */
+class HARNESS_EXPORT Counter {
+ public:
+  Counter() noexcept;
+
+  /** @brief Adds n to the counter */
+  void inc(uint64_t n = 1) noexcept {
+    slots_[thread_slot()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  /** @brief Returns the current value */
+  uint64_t value() const noexcept;
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> value;
+    char padding[kCacheLineSize - sizeof(std::atomic<uint64_t>)];
+  };
+  Slot slots_[kSlots];
+};
+
+/** @class Gauge
+ * @brief Value which goes up and down, like the number of open connections
+ *
+ * Use either add() or set() on a gauge, but not both: set() is not
+ * atomic with respect to concurrent add().
+ */
+class HARNESS_EXPORT Gauge {
+ public:
+  Gauge() noexcept;
+
+  /** @brief Adds n, which might be negative, to the gauge */
+  void add(int64_t n) noexcept {
+    slots_[thread_slot()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  /** @brief Sets the gauge */
+  void set(int64_t value) noexcept;
+
+  /** @brief Returns the current value */
+  int64_t value() const noexcept;
+
+ private:
+  struct Slot {
+    std::atomic<int64_t> value;
+    char padding[kCacheLineSize - sizeof(std::atomic<int64_t>)];
+  };
+  Slot slots_[kSlots];
+};
+
+/** @class Histogram
+ * @brief Distribution of values over fixed buckets, like connection durations
+ *
+ * Each bucket counts the values less than or equal to its upper bound
+ * which did not fit a previous bucket; the last bucket counts everything
+ * above the largest bound.
+ */
+class HARNESS_EXPORT Histogram {
+ public:
+  /** @brief Values read from a histogram */
+  struct Snapshot {
+    /** @brief Upper bounds of all buckets but the last one */
+    std::vector<uint64_t> bounds;
+    /** @brief Number of values in each bucket (bounds.size() + 1) */
+    std::vector<uint64_t> counts;
+    /** @brief Sum of all values */
+    uint64_t sum;
+    /** @brief Number of values */
+    uint64_t count;
+  };
+
+  /** @brief Constructor
+   *
+   * @param bounds increasing upper bounds of the buckets
+   * @throws std::invalid_argument when bounds are empty or not increasing
+   */
+  explicit Histogram(const std::vector<uint64_t> &bounds);
+
+  /** @brief Adds a value */
+  void observe(uint64_t value) noexcept;
+
+  /** @brief Returns the counts of all buckets */
+  Snapshot snapshot() const;
+
+  /** @brief Returns the upper bounds of the buckets */
+  const std::vector<uint64_t> &bounds() const noexcept {
+    return bounds_;
+  }
+
+ private:
+  // values of a slot: the buckets, then the sum; padded to whole cache lines
+  size_t stride_;
+  std::vector<uint64_t> bounds_;
+  std::unique_ptr<std::atomic<uint64_t>[]> values_;
+};
+
+/** @brief Type of a registered metric */
+enum class MetricType {
+  kCounter,
+  kGauge,
+  kHistogram,
+  /** Rows of labels describing state, like the members of a cluster; each has value 1 */
+  kInfo,
+};
+
+/** @brief Value of a registered metric at the time it was read */
+struct MetricSample {
+  std::string name;
+  std::string help;
+  MetricType type;
+  Labels labels;
+  /** @brief Value of a counter or gauge; 1 for info */
+  int64_t value;
+  /** @brief Buckets of a histogram */
+  Histogram::Snapshot histogram;
+};
+
+/** @class MetricsRegistry
+ * @brief Metrics registered by name and labels
+ *
+ * Metrics are created on first use and live as long as the registry.
+ * Callers keep the returned reference, so that the registry is only
+ * searched once and writing a metric takes no lock.
+ */
+class HARNESS_EXPORT MetricsRegistry {
+ public:
+  MetricsRegistry() = default;
+
+  MetricsRegistry(const MetricsRegistry &) = delete;
+  MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+
+  /** @brief Returns the registry used by the whole process */
+  static MetricsRegistry &instance();
+
+  /** @brief Returns the counter with the given name and labels
+   *
+   * @throws std::invalid_argument when the name is used by another type of metric
+   */
+  Counter &counter(const std::string &name, const Labels &labels = Labels(),
+                   const std::string &help = "");
+
+  /** @brief Returns the gauge with the given name and labels
+   *
+   * @throws std::invalid_argument when the name is used by another type of metric
+   */
+  Gauge &gauge(const std::string &name, const Labels &labels = Labels(),
+               const std::string &help = "");
+
+  /** @brief Returns the histogram with the given name and labels
+   *
+   * Bounds only matter when the histogram is created.
+   *
+   * @throws std::invalid_argument when the name is used by another type of metric
+   */
+  Histogram &histogram(const std::string &name, const std::vector<uint64_t> &bounds,
+                       const Labels &labels = Labels(), const std::string &help = "");
+
+  /** @brief Replaces the rows of an info metric
+   *
+   * Info metrics describe state which comes and goes, like blocked hosts
+   * or the members of a cluster. Each owner, like a route, replaces all
+   * its rows at once; collect() returns each row merged with the labels
+   * of its owner.
+   *
+   * @param name name of the metric
+   * @param owner labels of the owner of the rows, like {"route", "routing:ro"}
+   * @param rows labels of each row; empty to remove all rows of the owner
+   * @param help description of the metric
+   * @throws std::invalid_argument when the name is used by another type of metric
+   */
+  void set_info(const std::string &name, const Labels &owner, const std::vector<Labels> &rows,
+                const std::string &help = "");
+
+  /** @brief Reads all metrics, ordered by name and labels */
+  std::vector<MetricSample> collect() const;
+
+ private:
+  struct Entry {
+    MetricType type;
+    std::string help;
+    Labels labels;
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+  };
+
+  struct InfoEntry {
+    std::string help;
+    // rows by owner
+    std::map<Labels, std::vector<Labels>> rows;
+  };
+
+  Entry &get_entry(const std::string &name, const Labels &labels, MetricType type,
+                   const std::string &help);
+
+  void check_type(const std::string &name, MetricType type) const;
+
+  mutable std::mutex mutex_;
+  // name, then labels
+  std::map<std::pair<std::string, Labels>, Entry> entries_;
+  // info metrics by name
+  std::map<std::string, InfoEntry> infos_;
+};
+
+} // namespace metrics
+
+} // namespace mysql_harness
+
+#endif // MYSQL_HARNESS_METRICS_INCLUDED
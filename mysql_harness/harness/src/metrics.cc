@@ -0,0 +1,257 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace mysql_harness {
+
+namespace metrics {
+
+static const char *type_name(MetricType type) {
+  switch (type) {
+    case MetricType::kCounter:
+      return "counter";
+    case MetricType::kGauge:
+      return "gauge";
+    case MetricType::kHistogram:
+      return "histogram";
+    case MetricType::kInfo:
+      return "info";
+  }
+  return "unknown";
+}
+
+size_t thread_slot() noexcept {
+  static std::atomic<size_t> next_slot(0);
+  static thread_local size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed) % kSlots;
+  return slot;
+}
+
+Counter::Counter() noexcept {
+  for (auto &slot : slots_) {
+    slot.value.store(0, std::memory_order_relaxed);
+  }
+}
+
+uint64_t Counter::value() const noexcept {
+  uint64_t result = 0;
+  for (const auto &slot : slots_) {
+    result += slot.value.load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+Gauge::Gauge() noexcept {
+  for (auto &slot : slots_) {
+    slot.value.store(0, std::memory_order_relaxed);
+  }
+}
+
+void Gauge::set(int64_t value) noexcept {
+  slots_[0].value.store(value, std::memory_order_relaxed);
+  for (size_t i = 1; i < kSlots; ++i) {
+    slots_[i].value.store(0, std::memory_order_relaxed);
+  }
+}
+
+int64_t Gauge::value() const noexcept {
+  int64_t result = 0;
+  for (const auto &slot : slots_) {
+    result += slot.value.load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+Histogram::Histogram(const std::vector<uint64_t> &bounds) : bounds_(bounds) {
+  if (bounds_.empty()) {
+    throw std::invalid_argument("histogram needs at least one bucket bound");
+  }
+  if (!std::is_sorted(bounds_.begin(), bounds_.end()) ||
+      std::adjacent_find(bounds_.begin(), bounds_.end()) != bounds_.end()) {
+    throw std::invalid_argument("histogram bucket bounds must be increasing");
+  }
+  // buckets and sum of a slot, padded to whole cache lines
+  const size_t per_line = kCacheLineSize / sizeof(std::atomic<uint64_t>);
+  const size_t values = bounds_.size() + 2;
+  stride_ = (values + per_line - 1) / per_line * per_line;
+  values_.reset(new std::atomic<uint64_t>[stride_ * kSlots]);
+  for (size_t i = 0; i < stride_ * kSlots; ++i) {
+    values_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::observe(uint64_t value) noexcept {
+  size_t bucket = static_cast<size_t>(
+      std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin());
+  std::atomic<uint64_t> *slot = &values_[thread_slot() * stride_];
+  slot[bucket].fetch_add(1, std::memory_order_relaxed);
+  slot[bounds_.size() + 1].fetch_add(value, std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+  Snapshot result;
+  result.bounds = bounds_;
+  result.counts.assign(bounds_.size() + 1, 0);
+  result.sum = 0;
+  result.count = 0;
+  for (size_t s = 0; s < kSlots; ++s) {
+    const std::atomic<uint64_t> *slot = &values_[s * stride_];
+    for (size_t b = 0; b <= bounds_.size(); ++b) {
+      uint64_t count = slot[b].load(std::memory_order_relaxed);
+      result.counts[b] += count;
+      result.count += count;
+    }
+    result.sum += slot[bounds_.size() + 1].load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+MetricsRegistry &MetricsRegistry::instance() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+void MetricsRegistry::check_type(const std::string &name, MetricType type) const {
+  // a name has one type, whatever its labels
+  MetricType existing = type;
+  auto first = entries_.lower_bound(std::make_pair(name, Labels()));
+  if (first != entries_.end() && first->first.first == name) {
+    existing = first->second.type;
+  } else if (infos_.count(name)) {
+    existing = MetricType::kInfo;
+  }
+  if (existing != type) {
+    throw std::invalid_argument("metric '" + name + "' is a " + type_name(existing) +
+                                ", not a " + type_name(type));
+  }
+}
+
+MetricsRegistry::Entry &MetricsRegistry::get_entry(const std::string &name, const Labels &labels,
+                                                   MetricType type, const std::string &help) {
+  check_type(name, type);
+  Entry &entry = entries_[std::make_pair(name, labels)];
+  if (!entry.counter && !entry.gauge && !entry.histogram) {
+    entry.type = type;
+    entry.help = help;
+    entry.labels = labels;
+  }
+  return entry;
+}
+
+Counter &MetricsRegistry::counter(const std::string &name, const Labels &labels,
+                                  const std::string &help) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry &entry = get_entry(name, labels, MetricType::kCounter, help);
+  if (!entry.counter) {
+    entry.counter.reset(new Counter());
+  }
+  return *entry.counter;
+}
+
+Gauge &MetricsRegistry::gauge(const std::string &name, const Labels &labels,
+                              const std::string &help) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry &entry = get_entry(name, labels, MetricType::kGauge, help);
+  if (!entry.gauge) {
+    entry.gauge.reset(new Gauge());
+  }
+  return *entry.gauge;
+}
+
+Histogram &MetricsRegistry::histogram(const std::string &name, const std::vector<uint64_t> &bounds,
+                                      const Labels &labels, const std::string &help) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry &entry = get_entry(name, labels, MetricType::kHistogram, help);
+  if (!entry.histogram) {
+    try {
+      entry.histogram.reset(new Histogram(bounds));
+    } catch (...) {
+      entries_.erase(std::make_pair(name, labels));
+      throw;
+    }
+  }
+  return *entry.histogram;
+}
+
+void MetricsRegistry::set_info(const std::string &name, const Labels &owner,
+                               const std::vector<Labels> &rows, const std::string &help) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  check_type(name, MetricType::kInfo);
+  InfoEntry &info = infos_[name];
+  if (info.help.empty()) {
+    info.help = help;
+  }
+  if (rows.empty()) {
+    info.rows.erase(owner);
+  } else {
+    info.rows[owner] = rows;
+  }
+}
+
+std::vector<MetricSample> MetricsRegistry::collect() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<MetricSample> result;
+  result.reserve(entries_.size() + infos_.size());
+  for (const auto &it : entries_) {
+    const Entry &entry = it.second;
+    MetricSample sample;
+    sample.name = it.first.first;
+    sample.help = entry.help;
+    sample.type = entry.type;
+    sample.labels = entry.labels;
+    sample.value = 0;
+    switch (entry.type) {
+      case MetricType::kCounter:
+        sample.value = static_cast<int64_t>(entry.counter->value());
+        break;
+      case MetricType::kGauge:
+        sample.value = entry.gauge->value();
+        break;
+      case MetricType::kHistogram:
+        sample.histogram = entry.histogram->snapshot();
+        break;
+      case MetricType::kInfo:
+        break;
+    }
+    result.push_back(std::move(sample));
+  }
+  for (const auto &info : infos_) {
+    for (const auto &owner : info.second.rows) {
+      for (const auto &row : owner.second) {
+        MetricSample sample;
+        sample.name = info.first;
+        sample.help = info.second.help;
+        sample.type = MetricType::kInfo;
+        sample.labels = row;
+        sample.labels.insert(owner.first.begin(), owner.first.end());
+        sample.value = 1;
+        result.push_back(std::move(sample));
+      }
+    }
+  }
+  // keep all samples of a name together
+  std::stable_sort(result.begin(), result.end(),
+                   [](const MetricSample &a, const MetricSample &b) { return a.name < b.name; });
+  return result;
+}
+
+} // namespace metrics
+
+} // namespace mysql_harness
@@ -0,0 +1,256 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "logger.h"
+
+#include "mysql/harness/config_parser.h"
+#include "mysql/harness/filesystem.h"
+#include "mysql/harness/plugin.h"
+
+// Third-party include files
+#include "gtest/gtest.h"
+
+// Standard include files
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using mysql_harness::AppInfo;
+using mysql_harness::Config;
+using mysql_harness::Path;
+
+extern "C" {
+  extern mysql_harness::Plugin logger;
+}
+
+static Path g_here;
+
+static const char *kProgram = "test_logger";
+
+class LoggerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    logging_folder_ = g_here.join("var").join("log").join("harness").str();
+    log_file_ = Path::make_path(logging_folder_, kProgram, "log").str();
+    std::remove(log_file_.c_str());
+  }
+
+  void TearDown() override {
+    std::remove(log_file_.c_str());
+  }
+
+  void init_logger(const std::string &mode, const std::string &options = "") {
+    config_.reset(new Config(Config::allow_keys));
+    std::istringstream input("[logger]\nlevel = info\nmode = " + mode + "\n" + options);
+    config_->read(input);
+
+    info_ = AppInfo();
+    info_.program = kProgram;
+    info_.logging_folder = logging_folder_.c_str();
+    info_.config = config_.get();
+    ASSERT_EQ(0, logger.init(&info_));
+  }
+
+  void deinit_logger() {
+    logger.deinit(&info_);
+  }
+
+  // returns number of lines logged with the given text
+  size_t count_lines(const std::string &text) {
+    std::ifstream file(log_file_);
+    std::string line;
+    size_t count = 0;
+    while (std::getline(file, line)) {
+      if (line.find(text) != std::string::npos) {
+        ++count;
+      }
+    }
+    return count;
+  }
+
+  // logs from many threads at the same time
+  void log_from_threads(int threads, int messages) {
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+      workers.emplace_back([t, messages]() {
+        for (int i = 0; i < messages; ++i) {
+          log_info("benchmark message %d from thread %d", i, t);
+        }
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  std::string logging_folder_;
+  std::string log_file_;
+  std::unique_ptr<Config> config_;
+  AppInfo info_;
+};
+
+TEST_F(LoggerTest, InvalidMode) {
+  Config config(Config::allow_keys);
+  std::istringstream input("[logger]\nmode = later\n");
+  config.read(input);
+  AppInfo info = AppInfo();
+  info.program = kProgram;
+  info.logging_folder = logging_folder_.c_str();
+  info.config = &config;
+  try {
+    logger.init(&info);
+    FAIL() << "Expected std::invalid_argument";
+  } catch (const std::invalid_argument &exc) {
+    EXPECT_STREQ("Log mode 'later' is not valid; valid are sync or async", exc.what());
+  }
+}
+
+TEST_F(LoggerTest, AsyncWritesAllMessages) {
+  init_logger("async");
+  uint64_t dropped = log_dropped_messages();
+  log_from_threads(4, 100);
+  deinit_logger();
+
+  // the queue is larger than what was logged, so nothing was dropped
+  EXPECT_EQ(dropped, log_dropped_messages());
+  EXPECT_EQ(400u, count_lines("INFO    ["));
+}
+
+TEST_F(LoggerTest, AsyncRestart) {
+  init_logger("async");
+  log_from_threads(4, 10);
+  deinit_logger();
+  // the queue of the first run is used again
+  init_logger("async");
+  log_from_threads(4, 10);
+  deinit_logger();
+
+  EXPECT_EQ(80u, count_lines("INFO    ["));
+}
+
+TEST_F(LoggerTest, AsyncExitWithoutDeinit) {
+  // the router exits without deinit(), also after init() ran twice
+  EXPECT_EXIT({
+    init_logger("async");
+    init_logger("async");
+    log_info("last message before exit");
+    exit(0);
+  }, ::testing::ExitedWithCode(0), "");
+
+  EXPECT_EQ(1u, count_lines("last message before exit"));
+}
+
+TEST_F(LoggerTest, AsyncWritesOrDropsEveryMessage) {
+  init_logger("async");
+  uint64_t dropped = log_dropped_messages();
+  // more than the queue holds at once
+  log_from_threads(64, 500);
+  deinit_logger();
+
+  EXPECT_EQ(64u * 500u, count_lines("benchmark message") + (log_dropped_messages() - dropped));
+}
+
+TEST_F(LoggerTest, DisabledLevelDoesNotEvaluateArguments) {
+  init_logger("sync");
+  int evaluated = 0;
+  auto argument = [&evaluated]() { ++evaluated; return "argument"; };
+
+  LOGGER_DEBUG("%s", argument());
+  EXPECT_EQ(0, evaluated);
+  LOGGER_INFO("%s", argument());
+  EXPECT_EQ(1, evaluated);
+  deinit_logger();
+
+  EXPECT_EQ(0u, count_lines("DEBUG"));
+  EXPECT_EQ(1u, count_lines("argument"));
+}
+
+static void log_from_one_site(int messages) {
+  for (int i = 0; i < messages; ++i) {
+    LOGGER_WARNING_LIMITED("limited message %d", i);
+  }
+}
+
+TEST_F(LoggerTest, RateLimited) {
+  init_logger("sync", "rate_limit_burst = 3\nrate_limit_interval = 3600\n");
+  uint64_t suppressed = log_suppressed_messages();
+
+  log_from_one_site(10);
+  // another call site has its own limit
+  LOGGER_WARNING_LIMITED("limited message %d", 100);
+  EXPECT_EQ(suppressed + 7, log_suppressed_messages());
+  deinit_logger();
+
+  EXPECT_EQ(1u, count_lines("limited message 0"));
+  EXPECT_EQ(1u, count_lines("limited message 2"));
+  EXPECT_EQ(0u, count_lines("limited message 3"));
+  EXPECT_EQ(1u, count_lines("limited message 100"));
+  // the suppressed messages are summed up when the logger stops
+  EXPECT_EQ(1u, count_lines("Suppressed 7 similar message(s) from test_logger.cc:"));
+}
+
+TEST_F(LoggerTest, RateLimitSummaryAfterInterval) {
+  init_logger("sync", "rate_limit_burst = 3\nrate_limit_interval = 1\n");
+  log_from_one_site(10);
+
+  // without another message of the call site
+  const std::string summary = "Suppressed 7 similar message(s) from test_logger.cc:";
+  for (int i = 0; i < 50 && count_lines(summary) == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  EXPECT_EQ(1u, count_lines(summary));
+  deinit_logger();
+  EXPECT_EQ(1u, count_lines(summary));
+}
+
+TEST_F(LoggerTest, RateLimitDisabled) {
+  init_logger("sync", "rate_limit_burst = 0\n");
+  uint64_t suppressed = log_suppressed_messages();
+  log_from_one_site(20);
+  deinit_logger();
+
+  EXPECT_EQ(suppressed, log_suppressed_messages());
+  EXPECT_EQ(20u, count_lines("limited message"));
+}
+
+TEST_F(LoggerTest, InvalidRateLimitInterval) {
+  Config config(Config::allow_keys);
+  std::istringstream input("[logger]\nrate_limit_interval = 0\n");
+  config.read(input);
+  AppInfo info = AppInfo();
+  info.program = kProgram;
+  info.logging_folder = logging_folder_.c_str();
+  info.config = &config;
+  try {
+    logger.init(&info);
+    FAIL() << "Expected std::invalid_argument";
+  } catch (const std::invalid_argument &exc) {
+    EXPECT_STREQ("option rate_limit_interval in [logger] needs value between 1 and 3600 inclusive, was '0'",
+                 exc.what());
+  }
+}
+
+int main(int argc, char *argv[]) {
+  g_here = Path(argv[0]).dirname();
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,148 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "gtest/gtest.h"
+
+#include "metrics.h"
+
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using mysql_harness::metrics::Counter;
+using mysql_harness::metrics::Gauge;
+using mysql_harness::metrics::Histogram;
+using mysql_harness::metrics::MetricType;
+using mysql_harness::metrics::MetricsRegistry;
+
+TEST(MetricsTest, CounterFromManyThreads) {
+  Counter counter;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 40; ++t) {
+    threads.emplace_back([&counter]() {
+      for (int i = 0; i < 1000; ++i) {
+        counter.inc();
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(40000u, counter.value());
+}
+
+TEST(MetricsTest, Gauge) {
+  Gauge gauge;
+  gauge.add(5);
+  std::thread([&gauge]() { gauge.add(-2); }).join();
+  EXPECT_EQ(3, gauge.value());
+  gauge.set(-7);
+  EXPECT_EQ(-7, gauge.value());
+}
+
+TEST(MetricsTest, Histogram) {
+  Histogram histogram({10, 100});
+  histogram.observe(0);
+  histogram.observe(10);
+  histogram.observe(11);
+  histogram.observe(1000);
+
+  auto snapshot = histogram.snapshot();
+  ASSERT_EQ(3u, snapshot.counts.size());
+  EXPECT_EQ(2u, snapshot.counts[0]);  // <= 10
+  EXPECT_EQ(1u, snapshot.counts[1]);  // <= 100
+  EXPECT_EQ(1u, snapshot.counts[2]);  // everything above
+  EXPECT_EQ(4u, snapshot.count);
+  EXPECT_EQ(1021u, snapshot.sum);
+}
+
+TEST(MetricsTest, HistogramInvalidBounds) {
+  EXPECT_THROW(Histogram({}), std::invalid_argument);
+  EXPECT_THROW(Histogram({10, 10}), std::invalid_argument);
+  EXPECT_THROW(Histogram({10, 5}), std::invalid_argument);
+}
+
+TEST(MetricsTest, RegistrySameNameAndLabels) {
+  MetricsRegistry registry;
+  Counter &a = registry.counter("accepted_total", {{"route", "a"}}, "Accepted clients");
+  Counter &b = registry.counter("accepted_total", {{"route", "b"}});
+  EXPECT_EQ(&a, &registry.counter("accepted_total", {{"route", "a"}}));
+  EXPECT_NE(&a, &b);
+
+  a.inc(2);
+  b.inc();
+  auto samples = registry.collect();
+  ASSERT_EQ(2u, samples.size());
+  EXPECT_EQ("accepted_total", samples[0].name);
+  EXPECT_EQ("Accepted clients", samples[0].help);
+  EXPECT_EQ(MetricType::kCounter, samples[0].type);
+  EXPECT_EQ("a", samples[0].labels.at("route"));
+  EXPECT_EQ(2, samples[0].value);
+  EXPECT_EQ("b", samples[1].labels.at("route"));
+  EXPECT_EQ(1, samples[1].value);
+}
+
+TEST(MetricsTest, RegistryTypeMismatch) {
+  MetricsRegistry registry;
+  registry.counter("connections", {{"route", "a"}});
+  try {
+    registry.gauge("connections", {{"route", "b"}});
+    FAIL() << "Expected std::invalid_argument";
+  } catch (const std::invalid_argument &exc) {
+    EXPECT_STREQ("metric 'connections' is a counter, not a gauge", exc.what());
+  }
+}
+
+TEST(MetricsTest, RegistryHistogram) {
+  MetricsRegistry registry;
+  registry.histogram("duration_ms", {1, 10}).observe(5);
+  auto samples = registry.collect();
+  ASSERT_EQ(1u, samples.size());
+  EXPECT_EQ(MetricType::kHistogram, samples[0].type);
+  EXPECT_EQ(1u, samples[0].histogram.counts[1]);
+
+  // invalid bounds do not leave an entry behind
+  EXPECT_THROW(registry.histogram("invalid_ms", {}), std::invalid_argument);
+  EXPECT_EQ(1u, registry.collect().size());
+}
+
+TEST(MetricsTest, RegistryInfo) {
+  MetricsRegistry registry;
+  registry.counter("accepted_total");
+  registry.set_info("blocked_host", {{"route", "b"}}, {{{"host", "10.0.0.1"}}}, "Blocked hosts");
+  registry.set_info("blocked_host", {{"route", "a"}}, {{{"host", "10.0.0.2"}}, {{"host", "10.0.0.3"}}});
+
+  auto samples = registry.collect();
+  ASSERT_EQ(4u, samples.size());
+  EXPECT_EQ("accepted_total", samples[0].name);
+  EXPECT_EQ("blocked_host", samples[1].name);
+  EXPECT_EQ(MetricType::kInfo, samples[1].type);
+  EXPECT_EQ("Blocked hosts", samples[1].help);
+  EXPECT_EQ("a", samples[1].labels.at("route"));
+  EXPECT_EQ("10.0.0.2", samples[1].labels.at("host"));
+  EXPECT_EQ(1, samples[1].value);
+  EXPECT_EQ("b", samples[3].labels.at("route"));
+
+  // an owner replaces all its rows
+  registry.set_info("blocked_host", {{"route", "a"}}, {});
+  samples = registry.collect();
+  ASSERT_EQ(2u, samples.size());
+  EXPECT_EQ("b", samples[1].labels.at("route"));
+
+  EXPECT_THROW(registry.counter("blocked_host"), std::invalid_argument);
+  EXPECT_THROW(registry.set_info("accepted_total", {}, {}), std::invalid_argument);
+}
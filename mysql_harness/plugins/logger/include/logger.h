@@ -36,11 +36,95 @@
 extern "C" {
 #endif
 
+/* Log levels, from most to least severe */
+enum LogLevel {
+  LOG_LEVEL_FATAL,
+  LOG_LEVEL_ERROR,
+  LOG_LEVEL_WARNING,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_DEBUG
+};
+
 void LOGGER_API log_error(const char *fmt, ...);
 void LOGGER_API log_warning(const char *fmt, ...);
 void LOGGER_API log_info(const char *fmt, ...);
 void LOGGER_API log_debug(const char *fmt, ...);
 
+/**
+ * Returns the number of messages dropped by asynchronous logging.
+ *
+ * With `mode = async` in the `[logger]` section, messages are written by
+ * a background thread. When it can not keep up, messages are dropped
+ * instead of blocking the logging thread.
+ */
+unsigned long long LOGGER_API log_dropped_messages(void);
+
+/**
+ * Returns non-zero when messages of the given level are logged.
+ *
+ * @param level one of the LOG_LEVEL_* values
+ */
+int LOGGER_API log_level_is_handled(int level);
+
+/*
+ * Least severe level which is compiled in. Building with, for example,
+ * LOGGER_COMPILED_LEVEL=LOG_LEVEL_INFO removes all LOGGER_DEBUG()
+ * statements from the binary.
+ */
+#ifndef LOGGER_COMPILED_LEVEL
+#define LOGGER_COMPILED_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/* Whether messages of the given level are logged */
+#define LOGGER_LEVEL_ENABLED(level) \
+  ((level) <= LOGGER_COMPILED_LEVEL && log_level_is_handled(level))
+
+/*
+ * Like log_debug() and log_info(), but the arguments are only evaluated
+ * when the message is logged. Use these where building the arguments
+ * costs something, or in code run for every connection.
+ */
+#define LOGGER_DEBUG(...) \
+  do { if (LOGGER_LEVEL_ENABLED(LOG_LEVEL_DEBUG)) log_debug(__VA_ARGS__); } while (0)
+#define LOGGER_INFO(...) \
+  do { if (LOGGER_LEVEL_ENABLED(LOG_LEVEL_INFO)) log_info(__VA_ARGS__); } while (0)
+
+/**
+ * Logs a message, unless its call site already logged too many.
+ *
+ * Messages are counted per call site and message template. Each logs
+ * at most `rate_limit_burst` messages per `rate_limit_interval` seconds
+ * (both set in the `[logger]` section); further messages are suppressed.
+ * The number of suppressed messages is logged with the first message of
+ * the next interval, or when the logger shuts down.
+ *
+ * Use the LOGGER_*_LIMITED() macros, which pass the call site.
+ *
+ * @param level one of the LOG_LEVEL_* values
+ * @param site call site, must be a string literal
+ * @param fmt message template, must be a string literal
+ */
+void LOGGER_API log_limited(int level, const char *site, const char *fmt, ...);
+
+/** Returns the number of messages suppressed by log_limited() */
+unsigned long long LOGGER_API log_suppressed_messages(void);
+
+#define LOGGER_STRINGIFY_(x) #x
+#define LOGGER_STRINGIFY(x) LOGGER_STRINGIFY_(x)
+#define LOGGER_SITE __FILE__ ":" LOGGER_STRINGIFY(__LINE__)
+
+/*
+ * Rate limited variants of log_error(), log_warning() and log_info(),
+ * for messages which can be logged for every connection.
+ */
+#define LOGGER_ERROR_LIMITED(...) \
+  log_limited(LOG_LEVEL_ERROR, LOGGER_SITE, __VA_ARGS__)
+#define LOGGER_WARNING_LIMITED(...) \
+  log_limited(LOG_LEVEL_WARNING, LOGGER_SITE, __VA_ARGS__)
+#define LOGGER_INFO_LIMITED(...) \
+  do { if (LOGGER_LEVEL_ENABLED(LOG_LEVEL_INFO)) \
+      log_limited(LOG_LEVEL_INFO, LOGGER_SITE, __VA_ARGS__); } while (0)
+
 #ifdef WITH_DEBUG
 #define log_debug2(args) log_debug args
 #define log_debug3(args) log_debug args
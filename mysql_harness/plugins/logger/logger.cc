@@ -25,14 +25,27 @@
 #include <atomic>
 #include <cassert>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <ctime>
+#include <cstdlib>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#  include <sys/uio.h>
+#  include <unistd.h>
+#endif
 
 using mysql_harness::ARCHITECTURE_DESCRIPTOR;
 using mysql_harness::AppInfo;
@@ -57,6 +70,10 @@ enum Level {
   LEVEL_COUNT
 };
 
+static_assert(static_cast<int>(LVL_DEBUG) == static_cast<int>(LOG_LEVEL_DEBUG) &&
+              static_cast<int>(LVL_FATAL) == static_cast<int>(LOG_LEVEL_FATAL),
+              "Level must match LogLevel");
+
 static const char *const level_str[] = {
   "FATAL", "ERROR", "WARNING", "INFO", "DEBUG", 0
 };
@@ -72,8 +89,401 @@ static const std::map<std::string, Level> map_level_str = {
 static std::atomic<FILE*> g_log_file(stdout);
 static std::atomic<int> g_log_level(LVL_DEBUG);
 
+// Messages longer than this are truncated
+static const size_t kMaxMessageLength = 256;
+
+/**
+ * Writes log messages from a background thread.
+ *
+ * Logging threads put fixed-size records into a bounded lock-free queue
+ * (multiple producers, one consumer) and return without touching the
+ * log file. The writer thread formats the records in batches, writing
+ * each batch with a single writev(). The formatted time is cached and
+ * only updated when the second changes.
+ *
+ * When the queue is full, messages are dropped and counted instead of
+ * blocking the logging thread. The number of dropped messages is logged
+ * with the next batch.
+ *
+ * Logging threads still filling a record are counted; stop() waits for
+ * them before writing what is left, so that no message gets lost and the
+ * queue is not reused while they write into it.
+ */
+class AsyncLogWriter {
+ public:
+  AsyncLogWriter()
+      : queue_size_(0), mask_(0), enqueue_pos_(0), dequeue_pos_(0), running_(false), producers_(0),
+        writer_idle_(false), out_(nullptr), dropped_(0), dropped_reported_(0),
+        cached_time_(0) {
+    time_buf_[0] = '\0';
+  }
+
+  // the router may exit without calling deinit()
+  ~AsyncLogWriter() { stop(); }
+
+  /**
+   * Starts the writer thread.
+   *
+   * @param out file to write to
+   * @param queue_size number of records in the queue, rounded up to a power of 2
+   */
+  void start(FILE *out, size_t queue_size) {
+    // init() may run again without deinit() when the router failed to start
+    stop();
+    size_t size = 2;
+    while (size < queue_size) {
+      size <<= 1;
+    }
+    // kept across restarts; no logging thread uses it while stopped
+    if (size != queue_size_) {
+      records_.reset(new Record[size]);
+      queue_size_ = size;
+    }
+    for (size_t i = 0; i < size; ++i) {
+      records_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mask_ = size - 1;
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_ = 0;
+    out_ = out;
+    fflush(out_);
+    running_.store(true, std::memory_order_release);
+    writer_ = std::thread(&AsyncLogWriter::run, this);
+  }
+
+  /** Stops the writer thread after it wrote all queued messages */
+  void stop() {
+    if (!running_.exchange(false)) {
+      return;
+    }
+    condvar_.notify_one();
+    writer_.join();
+    // logging threads which saw the writer running finish their records
+    while (producers_.load() > 0) {
+      std::this_thread::yield();
+    }
+    // messages queued while we were stopping
+    while (write_batch() > 0) {}
+  }
+
+  /**
+   * Queues a message.
+   *
+   * @return false when the writer is not running; the message was not queued
+   */
+  bool push(Level level, time_t time, const char *thread_id, const char *message) noexcept {
+    // sequentially consistent with stop(): either it waits for us, or we
+    // see that the writer stopped
+    producers_.fetch_add(1);
+    if (!running_.load()) {
+      producers_.fetch_sub(1, std::memory_order_release);
+      return false;
+    }
+    push_record(level, time, thread_id, message);
+    producers_.fetch_sub(1, std::memory_order_release);
+    return true;
+  }
+
+  /** Returns the number of messages dropped because the queue was full */
+  uint64_t dropped() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void push_record(Level level, time_t time, const char *thread_id, const char *message) noexcept {
+    Record *record;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      record = &records_[pos & mask_];
+      size_t sequence = record->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // queue is full; the writer is behind
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    record->level = level;
+    record->time = time;
+    snprintf(record->thread_id, sizeof(record->thread_id), "%s", thread_id);
+    snprintf(record->message, sizeof(record->message), "%s", message);
+    record->sequence.store(pos + 1, std::memory_order_release);
+
+    if (writer_idle_.load(std::memory_order_relaxed)) {
+      condvar_.notify_one();
+    }
+  }
+
+  // records written with a single writev()
+  static const size_t kBatchSize = 64;
+  // longest formatted line: time, level, thread ID and message
+  static const size_t kMaxLineLength = kMaxMessageLength + 64;
+  // how long the writer sleeps at most when there is nothing to write
+  static constexpr std::chrono::milliseconds kIdleWait{10};
+
+  struct Record {
+    std::atomic<size_t> sequence;
+    Level level;
+    time_t time;
+    char thread_id[32];
+    char message[kMaxMessageLength];
+  };
+
+  void run() {
+    while (true) {
+      if (write_batch() > 0) {
+        continue;
+      }
+      if (!running_.load(std::memory_order_acquire)) {
+        break;
+      }
+      // a message pushed before the flag is seen waits at most kIdleWait
+      std::unique_lock<std::mutex> lock(mutex_);
+      writer_idle_.store(true, std::memory_order_relaxed);
+      condvar_.wait_for(lock, kIdleWait);
+      writer_idle_.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  const char *format_time(time_t time) {
+    if (time != cached_time_ || time_buf_[0] == '\0') {
+      struct tm local;
+#ifdef _WIN32
+      localtime_s(&local, &time);
+#else
+      localtime_r(&time, &local);
+#endif
+      strftime(time_buf_, sizeof(time_buf_), "%Y-%m-%d %H:%M:%S", &local);
+      cached_time_ = time;
+    }
+    return time_buf_;
+  }
+
+  /** Writes queued records; returns how many were written */
+  size_t write_batch() {
+    size_t count = 0;
+    size_t lines = 0;
+
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != dropped_reported_) {
+      lengths_[lines] = static_cast<size_t>(snprintf(lines_[lines], kMaxLineLength,
+          "%-19s %-7s [logger] %llu message(s) dropped, log queue full\n",
+          format_time(time(nullptr)), level_str[LVL_WARNING],
+          static_cast<unsigned long long>(dropped - dropped_reported_)));
+      dropped_reported_ = dropped;
+      ++lines;
+    }
+
+    while (lines < kBatchSize) {
+      Record &record = records_[dequeue_pos_ & mask_];
+      if (record.sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1) {
+        break;  // empty
+      }
+      int length = snprintf(lines_[lines], kMaxLineLength, "%-19s %-7s [%s] %s\n",
+                            format_time(record.time), level_str[record.level],
+                            record.thread_id, record.message);
+      lengths_[lines] = std::min(static_cast<size_t>(length), kMaxLineLength - 1);
+      record.sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+      ++dequeue_pos_;
+      ++lines;
+      ++count;
+    }
+
+    if (lines > 0) {
+      write_lines(lines);
+    }
+    return count;
+  }
+
+  void write_lines(size_t lines) {
+#ifndef _WIN32
+    struct iovec iov[kBatchSize];
+    for (size_t i = 0; i < lines; ++i) {
+      iov[i].iov_base = lines_[i];
+      iov[i].iov_len = lengths_[i];
+    }
+    int fd = fileno(out_);
+    struct iovec *next = iov;
+    int remaining = static_cast<int>(lines);
+    while (remaining > 0) {
+      ssize_t written = writev(fd, next, remaining);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;  // nowhere left to report it
+      }
+      // skip what was written, which might end in the middle of a line
+      while (remaining > 0 && static_cast<size_t>(written) >= next->iov_len) {
+        written -= static_cast<ssize_t>(next->iov_len);
+        ++next;
+        --remaining;
+      }
+      if (remaining > 0) {
+        next->iov_base = static_cast<char*>(next->iov_base) + written;
+        next->iov_len -= static_cast<size_t>(written);
+      }
+    }
+#else
+    for (size_t i = 0; i < lines; ++i) {
+      fwrite(lines_[i], 1, lengths_[i], out_);
+    }
+    fflush(out_);
+#endif
+  }
+
+  std::unique_ptr<Record[]> records_;
+  size_t queue_size_;
+  size_t mask_;
+  std::atomic<size_t> enqueue_pos_;
+  // only used by the writer
+  size_t dequeue_pos_;
+
+  std::atomic<bool> running_;
+  // logging threads in push()
+  std::atomic<unsigned> producers_;
+  std::atomic<bool> writer_idle_;
+  std::mutex mutex_;
+  std::condition_variable condvar_;
+  std::thread writer_;
+  FILE *out_;
+
+  std::atomic<uint64_t> dropped_;
+  uint64_t dropped_reported_;
+
+  // formatting buffers of the writer
+  time_t cached_time_;
+  char time_buf_[20];
+  char lines_[kBatchSize][kMaxLineLength];
+  size_t lengths_[kBatchSize];
+};
+
+constexpr std::chrono::milliseconds AsyncLogWriter::kIdleWait;
+
+// Never destroyed while the program runs, so that logging threads racing
+// with deinit() do not use a destroyed object. Destroying it at exit
+// writes what is still queued.
+static AsyncLogWriter g_async_writer;
+
+// Default number of records in the queue of asynchronous logging
+static const size_t kDefaultAsyncQueueSize = 8192;
+
+// Rate limiting of LOGGER_*_LIMITED(): each call site logs at most
+// g_rate_limit_burst messages per g_rate_limit_interval
+static const unsigned kDefaultRateLimitBurst = 10;
+static const std::chrono::seconds kDefaultRateLimitInterval(10);
+static std::atomic<unsigned> g_rate_limit_burst(kDefaultRateLimitBurst);
+static std::atomic<int64_t> g_rate_limit_interval_s(kDefaultRateLimitInterval.count());
+static std::atomic<uint64_t> g_suppressed_messages(0);
+
+struct RateLimitState {
+  std::chrono::steady_clock::time_point window_start;
+  uint64_t logged = 0;
+  uint64_t suppressed = 0;
+  int level = LVL_WARNING;
+};
+
+// a summary of suppressed messages, logged after g_rate_limits_mutex is
+// released so that rate limited callers do not wait for the log file
+struct SuppressedSummary {
+  int level;
+  const char *site;
+  const char *fmt;
+  uint64_t suppressed;
+};
+
+// keyed by call site and message template, which are both literals
+static std::mutex g_rate_limits_mutex;
+static std::map<std::pair<const char*, const char*>, RateLimitState> g_rate_limits;
+
+static void log_suppressed_summary(int level, const char *site, const char *fmt,
+                                   uint64_t suppressed);
+static void flush_suppressed_summaries();
+static void flush_due_summaries(std::chrono::steady_clock::time_point now);
+
+/**
+ * Logs the summaries of suppressed messages once the interval of their
+ * call site ended, also when the call site does not log again.
+ */
+class SummaryFlusher {
+ public:
+  SummaryFlusher() : stopping_(false) {}
+
+  // the router may exit without calling deinit()
+  ~SummaryFlusher() { stop(); }
+
+  void start() {
+    // init() may run again without deinit() when the router failed to start
+    stop();
+    stopping_ = false;
+    thread_ = std::thread(&SummaryFlusher::run, this);
+  }
+
+  void stop() {
+    if (!thread_.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    condvar_.notify_one();
+    thread_.join();
+  }
+
+ private:
+  // how late a summary may be after its interval ended
+  static constexpr std::chrono::seconds kCheckInterval{1};
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!condvar_.wait_for(lock, kCheckInterval, [this] { return stopping_; })) {
+      lock.unlock();
+      flush_due_summaries(std::chrono::steady_clock::now());
+      lock.lock();
+    }
+  }
+
+  bool stopping_;
+  std::mutex mutex_;
+  std::condition_variable condvar_;
+  std::thread thread_;
+};
+
+constexpr std::chrono::seconds SummaryFlusher::kCheckInterval;
+
+static SummaryFlusher g_summary_flusher;
+
+// Reads an unsigned option of the [logger] section
+static unsigned get_unsigned_option(const mysql_harness::ConfigSection *section,
+                                    const std::string &option, unsigned default_value,
+                                    unsigned min_value, unsigned max_value) {
+  if (!section->has(option)) {
+    return default_value;
+  }
+  std::string value = section->get(option);
+  char *rest;
+  errno = 0;
+  long long result = std::strtoll(value.c_str(), &rest, 10);
+  if (value.empty() || errno > 0 || *rest != '\0' || result < min_value || result > max_value) {
+    throw std::invalid_argument(
+        "option " + option + " in [logger] needs value between " + std::to_string(min_value) +
+        " and " + std::to_string(max_value) + " inclusive, was '" + value + "'");
+  }
+  return static_cast<unsigned>(result);
+}
+
 static int init(const AppInfo* info) {
   g_log_level = LVL_INFO;  // Default log level is INFO
+  bool async = false;
+  g_rate_limit_burst = kDefaultRateLimitBurst;
+  g_rate_limit_interval_s = kDefaultRateLimitInterval.count();
 
   if (info && info->config) {
     auto sections = info->config->get("logger");
@@ -96,6 +506,24 @@ static int init(const AppInfo* info) {
       }
       g_log_level = level->second;
     }
+
+    if (section->has("mode")) {
+      auto mode = section->get("mode");
+      std::transform(mode.begin(), mode.end(), mode.begin(), ::tolower);
+      if (mode == "async") {
+        async = true;
+      } else if (mode != "sync") {
+        throw std::invalid_argument(
+            "Log mode '" + mode + "' is not valid; valid are sync or async");
+      }
+    }
+
+    // 0 disables rate limiting
+    g_rate_limit_burst = get_unsigned_option(section, "rate_limit_burst", kDefaultRateLimitBurst,
+                                             0, 1000000);
+    g_rate_limit_interval_s = get_unsigned_option(section, "rate_limit_interval",
+                                                  static_cast<unsigned>(kDefaultRateLimitInterval.count()),
+                                                  1, 3600);
   }
   // We allow the log directory to be NULL or empty, meaning that all
   // will go to the standard output.
@@ -114,32 +542,57 @@ static int init(const AppInfo* info) {
     g_log_file.store(fp, std::memory_order_release);
   }
 
+  if (async) {
+    // stdout is written to directly, bypassing std::cout
+    std::cout << std::flush;
+    g_async_writer.start(g_log_file.load(), kDefaultAsyncQueueSize);
+  }
+  if (g_rate_limit_burst > 0) {
+    g_summary_flusher.start();
+  } else {
+    g_summary_flusher.stop();
+  }
+
   return 0;
 }
 
 static int deinit(const AppInfo*) {
   assert(g_log_file.load());
+  g_summary_flusher.stop();
+  flush_suppressed_summaries();
+  g_async_writer.stop();
   return fclose(g_log_file.exchange(nullptr, std::memory_order_acq_rel));
 }
 
+static const char *get_thread_id() {
+  // formatting it is expensive, so do it once per thread
+  static thread_local std::string thread_id;
+  if (thread_id.empty()) {
+    std::stringstream ss;
+    ss << std::hex << std::noshowbase << std::this_thread::get_id();
+    thread_id = ss.str();
+  }
+  return thread_id.c_str();
+}
+
 static void log_message(Level level, const char* fmt, va_list ap) {
   assert(level < LEVEL_COUNT);
 
   // Format the message
-  char message[256];
+  char message[kMaxMessageLength];
   vsnprintf(message, sizeof(message), fmt, ap);
 
-  // Format the time (19 characters)
-  char time_buf[20];
   time_t now;
   time(&now);
-  strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
+  const char *thread_id = get_thread_id();
 
-  // Get the thread ID
-  std::stringstream ss;
-  ss << std::hex << std::noshowbase << std::this_thread::get_id();
+  if (g_async_writer.push(level, now, thread_id, message)) {
+    return;
+  }
 
-  std::string thread_id = ss.str();
+  // Format the time (19 characters)
+  char time_buf[20];
+  strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
 
   // Emit a message on log file (or stdout).
   FILE *outfp = g_log_file.load(std::memory_order_consume);
@@ -148,14 +601,14 @@ static void log_message(Level level, const char* fmt, va_list ap) {
   // testing for stdout.  TODO review this, it is a hack!!!
   if (outfp != stdout) {
     fprintf(outfp ? outfp : stdout, "%-19s %-7s [%s] %s\n",
-            time_buf, level_str[level], thread_id.c_str(), message);
+            time_buf, level_str[level], thread_id, message);
     fflush(outfp);
   } else {
     // For unit tests, we need to use cout, so we can use its rdbuf() mechanism
     // to intercept the output.
     char buf[1024];
     snprintf(buf, sizeof(buf), "%-19s %-7s [%s] %s\n",
-            time_buf, level_str[level], thread_id.c_str(), message);
+            time_buf, level_str[level], thread_id, message);
     std::cout << buf << std::flush;
   }
 }
@@ -204,6 +657,116 @@ void log_debug(const char *fmt, ...) {
 }
 
 
+static void log_formatted(Level level, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  log_message(level, fmt, args);
+  va_end(args);
+}
+
+static void log_suppressed_summary(int level, const char *site, const char *fmt,
+                                   uint64_t suppressed) {
+  // file name without directories
+  const char *file = site;
+  for (const char *p = site; *p != '\0'; ++p) {
+    if (*p == '/' || *p == '\\') {
+      file = p + 1;
+    }
+  }
+  log_formatted(static_cast<Level>(level), "Suppressed %llu similar message(s) from %s: %s",
+                static_cast<unsigned long long>(suppressed), file, fmt);
+}
+
+static void log_suppressed_summaries(const std::vector<SuppressedSummary> &summaries) {
+  for (auto &summary : summaries) {
+    log_suppressed_summary(summary.level, summary.site, summary.fmt, summary.suppressed);
+  }
+}
+
+static void flush_suppressed_summaries() {
+  std::vector<SuppressedSummary> summaries;
+  {
+    std::lock_guard<std::mutex> lock(g_rate_limits_mutex);
+    for (auto &it : g_rate_limits) {
+      if (it.second.suppressed > 0) {
+        summaries.push_back({it.second.level, it.first.first, it.first.second, it.second.suppressed});
+      }
+    }
+    g_rate_limits.clear();
+  }
+  log_suppressed_summaries(summaries);
+}
+
+static void flush_due_summaries(std::chrono::steady_clock::time_point now) {
+  std::chrono::seconds interval(g_rate_limit_interval_s.load(std::memory_order_relaxed));
+  std::vector<SuppressedSummary> summaries;
+  {
+    std::lock_guard<std::mutex> lock(g_rate_limits_mutex);
+    for (auto &it : g_rate_limits) {
+      auto &state = it.second;
+      if (state.suppressed > 0 && now - state.window_start >= interval) {
+        summaries.push_back({state.level, it.first.first, it.first.second, state.suppressed});
+        // the next message of the call site starts a new interval
+        state.logged = 0;
+        state.suppressed = 0;
+      }
+    }
+  }
+  log_suppressed_summaries(summaries);
+}
+
+void log_limited(int level, const char *site, const char *fmt, ...) {
+  if (g_log_level < level)
+    return;
+
+  unsigned burst = g_rate_limit_burst.load(std::memory_order_relaxed);
+  bool log = true;
+  uint64_t summary = 0;
+  if (burst > 0) {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::seconds interval(g_rate_limit_interval_s.load(std::memory_order_relaxed));
+    std::lock_guard<std::mutex> lock(g_rate_limits_mutex);
+    auto &state = g_rate_limits[std::make_pair(site, fmt)];
+    state.level = level;
+    if (state.logged == 0 || now - state.window_start >= interval) {
+      summary = state.suppressed;
+      state.window_start = now;
+      state.logged = 0;
+      state.suppressed = 0;
+    }
+    if (state.logged < burst) {
+      ++state.logged;
+    } else {
+      ++state.suppressed;
+      g_suppressed_messages.fetch_add(1, std::memory_order_relaxed);
+      log = false;
+    }
+  }
+
+  if (summary > 0) {
+    log_suppressed_summary(level, site, fmt, summary);
+  }
+  if (log) {
+    va_list args;
+    va_start(args, fmt);
+    log_message(static_cast<Level>(level), fmt, args);
+    va_end(args);
+  }
+}
+
+unsigned long long log_suppressed_messages() {
+  return g_suppressed_messages.load(std::memory_order_relaxed);
+}
+
+int log_level_is_handled(int level) {
+  return level <= g_log_level.load(std::memory_order_relaxed);
+}
+
+unsigned long long log_dropped_messages() {
+  return g_async_writer.dropped();
+}
+
+
 extern "C" {
   Plugin LOGGER_API logger = {
     PLUGIN_ABI_VERSION,
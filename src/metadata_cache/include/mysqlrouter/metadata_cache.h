@@ -18,8 +18,10 @@
 #ifndef MYSQLROUTER_METADATA_CACHE_INCLUDED
 #define MYSQLROUTER_METADATA_CACHE_INCLUDED
 
+#include <chrono>
 #include <stdexcept>
 #include <exception>
+#include <functional>
 #include <vector>
 #include <map>
 #include <string>
@@ -47,7 +49,7 @@ extern const uint16_t kDefaultMetadataPort;
 extern const std::string kDefaultMetadataAddress;
 extern const std::string kDefaultMetadataUser;
 extern const std::string kDefaultMetadataPassword;
-extern const unsigned int kDefaultMetadataTTL;
+extern const std::chrono::milliseconds kDefaultMetadataTTL;
 extern const std::string kDefaultMetadataCluster;
 
 enum class METADATA_API ReplicasetStatus {
@@ -183,7 +185,8 @@ public:
  */
 void METADATA_API cache_init(const std::vector<mysqlrouter::TCPAddress> &bootstrap_servers,
                 const std::string &user, const std::string &password,
-                unsigned int ttl, const mysqlrouter::SSLOptions &ssl_options, const std::string &cluster_name);
+                std::chrono::milliseconds ttl, const mysqlrouter::SSLOptions &ssl_options,
+                const std::string &cluster_name);
 
 /** @brief Returns list of managed server in a HA replicaset
  *
@@ -213,11 +216,39 @@ void METADATA_API mark_instance_reachability(const std::string &instance_id,
  * To be called when the master of a single-master replicaset is down and
  * we want to wait until one becomes elected.
  *
- * @param timeout - amount of time to wait for a failover, in seconds
+ * @param timeout - amount of time to wait for a failover
  * @return true if a primary member exists
  */
 bool METADATA_API wait_primary_failover(const std::string &replicaset_name,
-                                        int timeout);
+                                        std::chrono::milliseconds timeout);
+
+/** @brief Function called with the members of a replicaset which changed */
+using ReplicasetListener = std::function<void(const std::vector<ManagedInstance> &members)>;
+
+/** @brief Registers a function called when the members of a replicaset change
+ *
+ * The listener is called by the refresh thread of the Metadata Cache, after
+ * the cache was updated, with the members fetched from the metadata. It is
+ * not called when the cache is cleared because the metadata servers can't
+ * be reached: the topology is unknown then, not empty. Listeners should
+ * return quickly.
+ *
+ * Listeners can be registered before the Metadata Cache is initialized.
+ *
+ * @param replicaset_name name of the replicaset
+ * @param listener function to call
+ * @return id to give to remove_replicaset_listener()
+ */
+unsigned METADATA_API add_replicaset_listener(const std::string &replicaset_name,
+                                              ReplicasetListener listener);
+
+/** @brief Unregisters a function registered with add_replicaset_listener()
+ *
+ * Once this returns, the listener is not running and is not called anymore.
+ *
+ * @param id id returned by add_replicaset_listener()
+ */
+void METADATA_API remove_replicaset_listener(unsigned id);
 
 } // namespace metadata_cache
 
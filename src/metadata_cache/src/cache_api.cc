@@ -23,13 +23,20 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 
 static std::unique_ptr<MetadataCache> g_metadata_cache(nullptr);
 
+// replicaset listeners by id; the mutex is held while calling them, so that
+// once removed, a listener does not run anymore
+static std::mutex g_listeners_mutex;
+static unsigned g_next_listener_id = 0;
+static std::map<unsigned, std::pair<std::string, metadata_cache::ReplicasetListener>> g_listeners;
+
 namespace metadata_cache {
 
 const uint16_t kDefaultMetadataPort = 32275;
-const unsigned int kDefaultMetadataTTL = 5 * 60;
+const std::chrono::milliseconds kDefaultMetadataTTL = std::chrono::minutes(5);
 const std::string kDefaultMetadataAddress{"127.0.0.1:" + mysqlrouter::to_string(
     kDefaultMetadataPort)};
 const std::string kDefaultMetadataUser = "";
@@ -50,11 +57,13 @@ const std::string kDefaultMetadataCluster = ""; // blank cluster name means pick
 void cache_init(const std::vector<mysqlrouter::TCPAddress> &bootstrap_servers,
                   const std::string &user,
                   const std::string &password,
-                  unsigned int ttl,
+                  std::chrono::milliseconds ttl,
                   const mysqlrouter::SSLOptions &ssl_options,
                   const std::string &cluster_name) {
+  // the metadata connection only keeps the TTL for reference, in seconds
+  auto ttl_seconds = static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::seconds>(ttl).count());
   g_metadata_cache.reset(new MetadataCache(bootstrap_servers,
-    get_instance(user, password, 1, 1, ttl, ssl_options), ttl, ssl_options, cluster_name));
+    get_instance(user, password, 1, 1, ttl_seconds, ssl_options), ttl, ssl_options, cluster_name));
   g_metadata_cache->start();
 }
 
@@ -86,11 +95,40 @@ void mark_instance_reachability(const std::string &instance_id,
   g_metadata_cache->mark_instance_reachability(instance_id, status);
 }
 
-bool wait_primary_failover(const std::string &replicaset_name, int timeout) {
+bool wait_primary_failover(const std::string &replicaset_name,
+                           std::chrono::milliseconds timeout) {
   if (g_metadata_cache == nullptr) {
     throw std::runtime_error("Metadata Cache not initialized");
   }
 
   return g_metadata_cache->wait_primary_failover(replicaset_name, timeout);
 }
+
+unsigned add_replicaset_listener(const std::string &replicaset_name,
+                                 ReplicasetListener listener) {
+  std::lock_guard<std::mutex> lock(g_listeners_mutex);
+  unsigned id = ++g_next_listener_id;
+  g_listeners[id] = std::make_pair(replicaset_name, listener);
+  return id;
+}
+
+void remove_replicaset_listener(unsigned id) {
+  std::lock_guard<std::mutex> lock(g_listeners_mutex);
+  g_listeners.erase(id);
+}
+
+void notify_replicaset_listeners(const std::map<std::string, ManagedReplicaSet> &replicasets) {
+  std::lock_guard<std::mutex> lock(g_listeners_mutex);
+  for (auto &it : g_listeners) {
+    auto replicaset = replicasets.find(it.second.first);
+    if (replicaset == replicasets.end()) {
+      continue;
+    }
+    try {
+      it.second.second(replicaset->second.members);
+    } catch (const std::exception &exc) {
+      log_error("Replicaset listener for '%s' failed: %s", it.second.first.c_str(), exc.what());
+    }
+  }
+}
 } // namespace metadata_cache
@@ -150,7 +150,7 @@ bool ClusterMetadata::connect(const std::vector<metadata_cache::ManagedInstance>
 
 void ClusterMetadata::update_replicaset_status(const std::string &name,
     metadata_cache::ManagedReplicaSet &replicaset) { // throws metadata_cache::metadata_error
-  log_debug("Updating replicaset status from GR for '%s'", name.c_str());
+  LOGGER_DEBUG("Updating replicaset status from GR for '%s'", name.c_str());
   // iterate over all cadidate nodes until we find the node that is part of quorum
   bool found_quorum = false;
 
@@ -190,7 +190,7 @@ void ClusterMetadata::update_replicaset_status(const std::string &name,
       std::map<std::string, GroupReplicationMember> member_status =
           fetch_group_replication_members(*gr_member_connection,
                                           single_primary_mode); // throws metadata_cache::metadata_error
-      log_debug("Replicaset '%s' has %i members in metadata, %i in status table",
+      LOGGER_DEBUG("Replicaset '%s' has %i members in metadata, %i in status table",
                 name.c_str(), replicaset.members.size(), member_status.size());
 
       // check status of all nodes; updates instances ------------------vvvvvvvvvvvvvvvvvv
@@ -223,7 +223,7 @@ void ClusterMetadata::update_replicaset_status(const std::string &name,
     }
 
   } // for (const metadata_cache::ManagedInstance& mi : instances)
-  log_debug("End updating replicaset for '%s'", name.c_str());
+  LOGGER_DEBUG("End updating replicaset for '%s'", name.c_str());
 
   if (!found_quorum) {
     std::string msg("Unable to fetch live group_replication member data from any server in replicaset '");
@@ -328,7 +328,7 @@ metadata_cache::ReplicasetStatus ClusterMetadata::check_replicaset_status(
 // throws metadata_cache::metadata_error
 ClusterMetadata::ReplicaSetsByName ClusterMetadata::fetch_instances(
     const std::string &cluster_name) {
-  log_debug("Updating metadata information for cluster '%s'", cluster_name.c_str());
+  LOGGER_DEBUG("Updating metadata information for cluster '%s'", cluster_name.c_str());
 
   assert(metadata_connection_->is_connected());
 
@@ -17,12 +17,48 @@
 
 #include "common.h"
 #include "metadata_cache.h"
+#include "metrics.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <vector>
 #include <memory>
 #include <cmath>  // fabs()
 
+// While a replicaset has lost its primary, how often we check (and refresh
+// the metadata) for a new one
+static const std::chrono::milliseconds kLostPrimaryPollInterval(100);
+
+// refresh durations, from 1ms up to a minute
+static const std::vector<uint64_t> kRefreshDurationBounds{
+    1, 5, 10, 50, 100, 500, 1000, 5000, 10000, 60000};
+
+/**
+ * Records the outcome and duration of a metadata refresh.
+ *
+ * @param cluster name of the cluster
+ * @param started when the refresh started
+ * @param ok whether the metadata was fetched
+ */
+static void record_refresh(const std::string &cluster,
+                           std::chrono::steady_clock::time_point started,
+                           bool ok) {
+  using mysql_harness::metrics::MetricsRegistry;
+  MetricsRegistry &registry = MetricsRegistry::instance();
+  registry.counter("metadata_cache_refreshes_total",
+                   {{"cluster", cluster}, {"outcome", ok ? "ok" : "failed"}},
+                   "Metadata refreshes, by outcome").inc();
+  registry.gauge("metadata_cache_last_refresh_ok", {{"cluster", cluster}},
+                 "Whether the last metadata refresh succeeded (1) or not (0)").set(ok ? 1 : 0);
+  registry.histogram("metadata_cache_refresh_duration_ms", kRefreshDurationBounds,
+                     {{"cluster", cluster}},
+                     "How long metadata refreshes took, in milliseconds")
+      .observe(static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now() - started).count()));
+}
+
 /**
  * Initialize a connection to the MySQL Metadata server.
  *
@@ -35,7 +71,7 @@
 MetadataCache::MetadataCache(
   const std::vector<mysqlrouter::TCPAddress> &bootstrap_servers,
   std::shared_ptr<MetaData> cluster_metadata, // this could be changed to UniquePtr
-  unsigned int ttl,
+  std::chrono::milliseconds ttl,
   const mysqlrouter::SSLOptions &ssl_options,
   const std::string &cluster) {
   std::string host;
@@ -73,12 +109,15 @@ void MetadataCache::start() {
       refresh();
 
       // wait for up to TTL until next refresh, unless some replicaset
-      // loses the primary server.. in that case, we refresh every 1s
-      // until we detect a new one was elected
-      unsigned int seconds_waited = 0;
-      while (seconds_waited < ttl_) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        seconds_waited++;
+      // loses the primary server.. in that case, we refresh every
+      // kLostPrimaryPollInterval until we detect a new one was elected
+      auto next_refresh = std::chrono::steady_clock::now() + ttl_;
+      while (!terminate_) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            next_refresh - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+          break;
+        std::this_thread::sleep_for(std::min(remaining, kLostPrimaryPollInterval));
         {
           std::lock_guard<std::mutex> lock(lost_primary_replicasets_mutex_);
           if (!lost_primary_replicasets_.empty())
@@ -111,7 +150,7 @@ std::vector<metadata_cache::ManagedInstance> MetadataCache::replicaset_lookup(
   auto replicaset = replicaset_data_.find(replicaset_name);
 
   if (replicaset == replicaset_data_.end()) {
-    log_warning("Replicaset '%s' not available", replicaset_name.c_str());
+    LOGGER_WARNING_LIMITED("Replicaset '%s' not available", replicaset_name.c_str());
     return {};
   }
   return replicaset_data_[replicaset_name].members;
@@ -158,10 +197,34 @@ static const char *str_mode(metadata_cache::ServerMode mode) {
   }
 }
 
+/**
+ * Publishes the members of all replicasets of a cluster as metrics.
+ *
+ * @param cluster name of the cluster
+ * @param replicasets the replicasets; empty to remove all members
+ */
+static void record_topology(
+    const std::string &cluster,
+    const std::map<std::string, metadata_cache::ManagedReplicaSet> &replicasets) {
+  std::vector<mysql_harness::metrics::Labels> rows;
+  for (auto &rs : replicasets) {
+    for (auto &mi : rs.second.members) {
+      rows.push_back({{"replicaset", rs.first},
+                      {"address", mi.host + ":" + std::to_string(mi.port)},
+                      {"role", mi.role},
+                      {"mode", str_mode(mi.mode)}});
+    }
+  }
+  mysql_harness::metrics::MetricsRegistry::instance().set_info(
+      "metadata_cache_instance", {{"cluster", cluster}}, rows,
+      "Members of the replicasets of clusters");
+}
+
 /**
  * Refresh the metadata information in the cache.
  */
 void MetadataCache::refresh() {
+  auto started = std::chrono::steady_clock::now();
 
   {
     #if 0 // not used anywhere else so far
@@ -177,8 +240,11 @@ void MetadataCache::refresh() {
         if (clearing)
           replicaset_data_.clear();
       }
-      if (clearing)
+      if (clearing) {
         log_info("... cleared current routing table as a precaution");
+        record_topology(cluster_name_, {});
+      }
+      record_refresh(cluster_name_, started, false);
       return;
     }
   }
@@ -200,6 +266,7 @@ void MetadataCache::refresh() {
     }
 
     if (changed) {
+      record_topology(cluster_name_, replicaset_data_temp);
       log_info("Changes detected in cluster '%s' after metadata refresh",
           cluster_name_.c_str());
       // dump some informational/debugging information about the replicasets
@@ -232,6 +299,7 @@ void MetadataCache::refresh() {
           }
         }
       }
+      metadata_cache::notify_replicaset_listeners(replicaset_data_temp);
     }
 
     /* Not sure about this, the metadata server could be stored elsewhere
@@ -248,7 +316,10 @@ void MetadataCache::refresh() {
     }*/
   } catch (const std::runtime_error &exc) {
     log_error("Failed fetching metadata: %s", exc.what());
+    record_refresh(cluster_name_, started, false);
+    return;
   }
+  record_refresh(cluster_name_, started, true);
 }
 
 void MetadataCache::mark_instance_reachability(const std::string &instance_id,
@@ -298,18 +369,22 @@ void MetadataCache::mark_instance_reachability(const std::string &instance_id,
 }
 
 bool MetadataCache::wait_primary_failover(const std::string &replicaset_name,
-                                          int timeout) {
-  log_debug("Waiting for failover to happen in '%s' for %is",
-            replicaset_name.c_str(), timeout);
-  time_t stime = std::time(NULL);
-  while (std::time(NULL) - stime <= timeout) {
+                                          std::chrono::milliseconds timeout) {
+  LOGGER_DEBUG("Waiting for failover to happen in '%s' for %lldms",
+            replicaset_name.c_str(), static_cast<long long>(timeout.count()));
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
     {
       std::lock_guard<std::mutex> lock(cache_refreshing_mutex_);
       if (lost_primary_replicasets_.find(replicaset_name) == lost_primary_replicasets_.end()) {
         return true;
       }
     }
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (remaining.count() < 0)
+      break;
+    std::this_thread::sleep_for(std::min(remaining, kLostPrimaryPollInterval));
   }
   return false;
 }
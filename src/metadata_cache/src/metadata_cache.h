@@ -46,7 +46,7 @@ public:
   /** @brief Constructor */
   MetadataCache(const std::vector<mysqlrouter::TCPAddress> &bootstrap_servers,
                 std::shared_ptr<MetaData> cluster_metadata,
-                unsigned int ttl, const mysqlrouter::SSLOptions &ssl_options,
+                std::chrono::milliseconds ttl, const mysqlrouter::SSLOptions &ssl_options,
                 const std::string &cluster_name);
 
   /** @brief Destructor */
@@ -92,10 +92,10 @@ public:
    * we want to wait until one becomes elected.
    *
    * @param replicaset_name name of the replicaset
-   * @param timeout - amount of time to wait for a failover, in seconds
+   * @param timeout - amount of time to wait for a failover
    * @return true if a primary member exists
    */
-  bool wait_primary_failover(const std::string &replicaset_name, int timeout);
+  bool wait_primary_failover(const std::string &replicaset_name, std::chrono::milliseconds timeout);
 private:
 
   /** @brief Refreshes the cache
@@ -116,7 +116,7 @@ private:
   std::vector<metadata_cache::ManagedInstance> metadata_servers_;
 
   // The time to live of the metadata cache.
-  unsigned int ttl_;
+  std::chrono::milliseconds ttl_;
 
   // SSL options for MySQL connections
   mysqlrouter::SSLOptions ssl_options_;
@@ -150,9 +150,20 @@ private:
 #ifdef FRIEND_TEST
   FRIEND_TEST(FailoverTest, basics);
   FRIEND_TEST(FailoverTest, primary_failover);
+  FRIEND_TEST(FailoverTest, replicaset_listener);
   FRIEND_TEST(MetadataCacheTest2, basic_test);
   FRIEND_TEST(MetadataCacheTest2, metadata_server_connection_failures);
 #endif
 };
 
+namespace metadata_cache {
+
+/** @brief Calls the listeners of the given replicasets
+ *
+ * @param replicasets replicasets which changed, by name
+ */
+void notify_replicaset_listeners(const std::map<std::string, ManagedReplicaSet> &replicasets);
+
+} // namespace metadata_cache
+
 #endif // METADATA_CACHE_METADATA_CACHE_INCLUDED
@@ -96,11 +96,11 @@ static mysqlrouter::SSLOptions make_ssl_options(
 static void start(const mysql_harness::ConfigSection *section) {
  try {
     MetadataCachePluginConfig config(section);
-    unsigned int ttl{config.ttl};
+    std::chrono::milliseconds ttl{config.ttl};
     string metadata_cluster{config.metadata_cluster};
 
     // Initialize the defaults.
-    ttl = ttl == 0 ? metadata_cache::kDefaultMetadataTTL : ttl;
+    ttl = ttl.count() == 0 ? metadata_cache::kDefaultMetadataTTL : ttl;
     metadata_cluster = metadata_cluster.empty()?
       metadata_cache::kDefaultMetadataCluster : metadata_cluster;
 
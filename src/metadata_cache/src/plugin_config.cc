@@ -37,7 +37,7 @@ std::string MetadataCachePluginConfig::get_default(const std::string &option) {
 
   static const std::map<std::string, std::string> defaults{
       {"address",  metadata_cache::kDefaultMetadataAddress},
-      {"ttl", to_string(metadata_cache::kDefaultMetadataTTL)},
+      {"ttl", mysqlrouter::ms_to_string(metadata_cache::kDefaultMetadataTTL)},
   };
   auto it = defaults.find(option);
   if (it == defaults.end()) {
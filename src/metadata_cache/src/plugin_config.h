@@ -20,6 +20,7 @@
 
 #include "mysqlrouter/metadata_cache.h"
 
+#include <chrono>
 #include <map>
 #include <string>
 #include <vector>
@@ -47,7 +48,8 @@ public:
                               section, "bootstrap_server_addresses",
                               metadata_cache::kDefaultMetadataPort)),
         user(get_option_string(section, "user")),
-        ttl(get_uint_option<unsigned int>(section, "ttl")),
+        ttl(get_option_milliseconds(section, "ttl", std::chrono::milliseconds(0),
+                                    std::chrono::seconds(UINT32_MAX))),
         metadata_cluster(get_option_string(section, "metadata_cluster"))
         { }
 
@@ -62,7 +64,7 @@ public:
   /** @brief User used for authenticating with MySQL Metadata */
   const std::string user;
   /** @brief TTL used for storing data in the cache */
-  const unsigned int ttl;
+  const std::chrono::milliseconds ttl;
   /** @brief Cluster in the metadata */
   const std::string metadata_cluster;
 
@@ -55,7 +55,7 @@ public:
 
   void init_cache() {
     cache.reset(new MetadataCache({mysqlrouter::TCPAddress("localhost", 32275)},
-                                  cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1"));
+                                  cmeta, std::chrono::seconds(10), mysqlrouter::SSLOptions(), "cluster-1"));
   }
 
 
@@ -155,7 +155,7 @@ TEST_F(FailoverTest, basics) {
 
   // this should succeed right away
   DelayCheck t;
-  EXPECT_TRUE(cache->wait_primary_failover("default", 2));
+  EXPECT_TRUE(cache->wait_primary_failover("default", std::chrono::seconds(2)));
   EXPECT_LE(t.time_elapsed(), 1);
 
   // ensure no expected queries leftover
@@ -186,7 +186,7 @@ TEST_F(FailoverTest, primary_failover) {
   // this should succeed right away
   {
     DelayCheck t;
-    EXPECT_TRUE(cache->wait_primary_failover("default", 2));
+    EXPECT_TRUE(cache->wait_primary_failover("default", std::chrono::seconds(2)));
     EXPECT_LE(t.time_elapsed(), 1);
   }
 
@@ -204,7 +204,7 @@ TEST_F(FailoverTest, primary_failover) {
   // this should fail with timeout b/c no primary yet
   {
     DelayCheck t;
-    EXPECT_FALSE(cache->wait_primary_failover("default", 1));
+    EXPECT_FALSE(cache->wait_primary_failover("default", std::chrono::seconds(1)));
     EXPECT_GE(t.time_elapsed(), 1);
   }
 
@@ -229,7 +229,7 @@ TEST_F(FailoverTest, primary_failover) {
   // this should succeed
   {
     DelayCheck t;
-    EXPECT_TRUE(cache->wait_primary_failover("default", 2));
+    EXPECT_TRUE(cache->wait_primary_failover("default", std::chrono::seconds(2)));
     EXPECT_LE(t.time_elapsed(), 1);
   }
 
@@ -243,3 +243,41 @@ TEST_F(FailoverTest, primary_failover) {
   EXPECT_EQ("uuid-server3", instances[2].mysql_server_uuid);
   EXPECT_EQ(ServerMode::ReadOnly, instances[2].mode);
 }
+
+
+TEST_F(FailoverTest, replicaset_listener) {
+  std::vector<std::vector<ManagedInstance>> notified;
+  unsigned id = add_replicaset_listener("default",
+      [&notified](const std::vector<ManagedInstance> &members) { notified.push_back(members); });
+  unsigned other_id = add_replicaset_listener("other",
+      [](const std::vector<ManagedInstance> &) { FAIL() << "not a replicaset of the cluster"; });
+
+  expect_metadata_1();
+  expect_group_members_1();
+  init_cache();
+  ASSERT_EQ(1U, notified.size());
+  EXPECT_EQ(3U, notified[0].size());
+
+  // nothing changed, nobody is told
+  expect_metadata_1();
+  expect_group_members_1();
+  cache->refresh();
+  EXPECT_EQ(1U, notified.size());
+
+  // the primary left the group and a new one was elected
+  expect_metadata_1();
+  expect_group_members_1_primary_fail(nullptr, "uuid-server2");
+  cache->refresh();
+  ASSERT_EQ(2U, notified.size());
+  ASSERT_EQ(3U, notified[1].size());
+  EXPECT_EQ(ServerMode::Unavailable, notified[1][0].mode);
+  EXPECT_EQ(ServerMode::ReadWrite, notified[1][1].mode);
+
+  remove_replicaset_listener(id);
+  remove_replicaset_listener(other_id);
+  expect_metadata_1();
+  expect_group_members_1();
+  cache->refresh();
+  EXPECT_EQ(2U, notified.size());
+  ASSERT_FALSE(session->print_expected());
+}
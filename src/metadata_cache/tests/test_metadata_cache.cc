@@ -42,7 +42,7 @@ public:
                       cache({mysqlrouter::TCPAddress("localhost", 32275)},
                               get_instance("admin", "admin", 1, 1, 10,
                                            mysqlrouter::SSLOptions()),
-                              10, mysqlrouter::SSLOptions(), "replicaset-1") {}
+                              std::chrono::seconds(10), mysqlrouter::SSLOptions(), "replicaset-1") {}
 };
 
 /**
@@ -153,7 +153,7 @@ TEST_F(MetadataCacheTest2, basic_test) {
   // start off with all metadata servers up
   expect_sql_metadata();
   expect_sql_members();
-  MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1");
+  MetadataCache mc(metadata_servers, cmeta, std::chrono::seconds(10), mysqlrouter::SSLOptions(), "cluster-1");
 
   // verify that cluster can be seen
   expect_cluster_routable(mc);
@@ -181,7 +181,7 @@ TEST_F(MetadataCacheTest2, metadata_server_connection_failures) {
   // start off with all metadata servers up
   expect_sql_metadata();
   expect_sql_members();
-  MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1");
+  MetadataCache mc(metadata_servers, cmeta, std::chrono::seconds(10), mysqlrouter::SSLOptions(), "cluster-1");
   expect_cluster_routable(mc);
 
   // refresh: fail connecting to first metadata server
@@ -52,7 +52,7 @@ struct GoodTestData {
 
   struct {
     std::string user;
-    unsigned int ttl;
+    std::chrono::milliseconds ttl;
     std::string metadata_cluster;
     std::vector<mysqlrouter::TCPAddress> bootstrap_addresses;
   } expected;
@@ -85,7 +85,7 @@ std::ostream& operator<<(std::ostream& os, const std::vector<T>& container) {
 
 std::ostream& operator<<(std::ostream& os, const GoodTestData& test_data) {
   return os << "user=" << test_data.expected.user << ", "
-    << "ttl=" << test_data.expected.ttl << ", "
+    << "ttl=" << test_data.expected.ttl.count() << "ms, "
     << "metadata_cluster=" << test_data.expected.metadata_cluster << ", "
     << "bootstrap_server_addresses=" << test_data.expected.bootstrap_addresses;
 }
@@ -139,7 +139,23 @@ INSTANTIATE_TEST_CASE_P(SomethingUseful, MetadataCachePluginConfigGoodTest,
 
       {
         "foo",
-        123,
+        std::chrono::seconds(123),
+        "",
+        std::vector<mysqlrouter::TCPAddress>()
+      }
+    },
+    // TTL value can be given in milliseconds
+    {
+      {
+        std::map<std::string, std::string>({
+          { "user", "foo", }, // required
+          { "ttl", "250ms", },
+        })
+      },
+
+      {
+        "foo",
+        std::chrono::milliseconds(250),
         "",
         std::vector<mysqlrouter::TCPAddress>()
       }
@@ -155,7 +171,7 @@ INSTANTIATE_TEST_CASE_P(SomethingUseful, MetadataCachePluginConfigGoodTest,
       },
       {
         "foo",
-        123,
+        std::chrono::seconds(123),
         "",
         std::vector<mysqlrouter::TCPAddress>({
           { mysqlrouter::TCPAddress("foobar", metadata_cache::kDefaultMetadataPort), },
@@ -194,7 +210,7 @@ INSTANTIATE_TEST_CASE_P(SomethingUseful, MetadataCachePluginConfigGoodTest,
 
       {
         "foo",
-        123,
+        std::chrono::seconds(123),
         "whatisthis",
         std::vector<mysqlrouter::TCPAddress>({
           { mysqlrouter::TCPAddress("foobar", metadata_cache::kDefaultMetadataPort), },
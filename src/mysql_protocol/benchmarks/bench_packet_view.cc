@@ -0,0 +1,118 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * Compares parsing packets copying them (Packet, ErrorPacket) with
+ * parsing them in place (PacketView, ErrorPacketView).
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mysqlrouter/mysql_protocol.h"
+
+using mysql_protocol::ErrorPacket;
+using mysql_protocol::ErrorPacketView;
+using mysql_protocol::HandshakePacket;
+using mysql_protocol::Packet;
+using mysql_protocol::PacketView;
+
+namespace {
+
+// as read by routing: a net_buffer_length sized buffer holding one packet
+const size_t kBufferSize = 16384;
+
+std::vector<uint8_t> make_buffer(const Packet &packet) {
+  std::vector<uint8_t> buffer(packet.begin(), packet.end());
+  buffer.resize(kBufferSize);
+  return buffer;
+}
+
+std::vector<uint8_t> make_handshake() {
+  Packet packet{0x00, 0x00, 0x00, 0x00, 0x0a};
+  packet.add(std::string("5.7.19-log"));
+  packet.add_int<uint8_t>(0);
+  packet.add_int<uint32_t>(42);  // connection id
+  packet.add(std::string("abcdefgh"));
+  packet.add_int<uint8_t>(0);
+  packet.add_int<uint16_t>(0xf7ff);
+  packet.add_int<uint8_t>(8);
+  packet.add_int<uint16_t>(2);
+  packet.add_int<uint16_t>(0x81ff);
+  packet.add_int<uint8_t>(21);
+  packet.add(std::vector<uint8_t>(10, 0));
+  packet.add(std::string("ijklmnopqrst"));
+  packet.add_int<uint8_t>(0);
+  packet.add(std::string("mysql_native_password"));
+  packet.add_int<uint8_t>(0);
+  Packet::write_int<uint32_t>(packet, 0, static_cast<uint32_t>(packet.size() - 4), 3);
+  return std::vector<uint8_t>(packet.begin(), packet.end());
+}
+
+}
+
+static void BM_CapabilitiesPacket(benchmark::State &state) {
+  auto buffer = make_buffer(Packet{0x04, 0x00, 0x00, 0x01, 0x0d, 0xa2, 0x0a, 0x00});
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(Packet(buffer).get_int<uint32_t>(4));
+  }
+}
+BENCHMARK(BM_CapabilitiesPacket);
+
+static void BM_CapabilitiesPacketView(benchmark::State &state) {
+  auto buffer = make_buffer(Packet{0x04, 0x00, 0x00, 0x01, 0x0d, 0xa2, 0x0a, 0x00});
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(PacketView(buffer.data(), 8).get_int<uint32_t>(4));
+  }
+}
+BENCHMARK(BM_CapabilitiesPacketView);
+
+static void BM_ErrorPacket(benchmark::State &state) {
+  ErrorPacket error(2, 1045, "Access denied for user 'root'@'localhost' (using password: YES)",
+                    "28000", mysql_protocol::kClientProtocol41);
+  std::vector<uint8_t> buffer(error.begin(), error.end());
+  while (state.KeepRunning()) {
+    ErrorPacket parsed(buffer, mysql_protocol::kClientProtocol41);
+    benchmark::DoNotOptimize(parsed.get_message().data());
+  }
+}
+BENCHMARK(BM_ErrorPacket);
+
+static void BM_ErrorPacketView(benchmark::State &state) {
+  ErrorPacket error(2, 1045, "Access denied for user 'root'@'localhost' (using password: YES)",
+                    "28000", mysql_protocol::kClientProtocol41);
+  std::vector<uint8_t> buffer(error.begin(), error.end());
+  while (state.KeepRunning()) {
+    ErrorPacketView parsed(PacketView(buffer), mysql_protocol::kClientProtocol41);
+    benchmark::DoNotOptimize(parsed.get_message().data());
+  }
+}
+BENCHMARK(BM_ErrorPacketView);
+
+static void BM_HandshakePacket(benchmark::State &state) {
+  auto buffer = make_handshake();
+  while (state.KeepRunning()) {
+    HandshakePacket parsed(buffer);
+    benchmark::DoNotOptimize(parsed.get_auth_data().data());
+  }
+}
+BENCHMARK(BM_HandshakePacket);
+
+BENCHMARK_MAIN();
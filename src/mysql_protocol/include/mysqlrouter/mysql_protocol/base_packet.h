@@ -26,6 +26,8 @@
 #include <string>
 #include <vector>
 
+#include "packet_view.h"
+
 namespace mysql_protocol {
 
 /** @class Packet
@@ -34,6 +36,9 @@ namespace mysql_protocol {
  * This class is the base class for all the types of MySQL packets
  * such as ErrorPacket and HandshakeResponsePacket.
  *
+ * A Packet owns a copy of its bytes. To parse bytes without copying them,
+ * for example when forwarding, use PacketView and PacketReader.
+ *
  */
 class MYSQL_PROTOCOL_API Packet : public std::vector<uint8_t> {
  public:
@@ -143,21 +148,7 @@ class MYSQL_PROTOCOL_API Packet : public std::vector<uint8_t> {
   template<typename Type, typename = std::enable_if<std::is_integral<Type>::value>>
   Type get_int(size_t position, size_t length = sizeof(Type)) const {
     assert((length >= 1 && length <= 4) || length == 8);
-    assert(size() >= length);
-    assert(position + length <= size());
-
-    if (length == 1) {
-      return static_cast<Type>((*this)[position]);
-    }
-
-    uint64_t result = 0;
-    auto it = begin() + static_cast<long>(position + length);
-    while (length-- > 0) {
-      result <<= 8;
-      result |= *--it;
-    }
-
-    return static_cast<Type>(result);
+    return view().get_int<Type>(position, length);
   }
 
   /** @brief Gets a length encoded integer from given packet
@@ -292,6 +283,16 @@ class MYSQL_PROTOCOL_API Packet : public std::vector<uint8_t> {
     return payload_size_;
   }
 
+  /** @brief Gets a view on the bytes of the packet
+   *
+   * The view is invalidated when the packet changes.
+   *
+   * @return PacketView
+   */
+  PacketView view() const noexcept {
+    return PacketView(data(), size());
+  }
+
  protected:
 
   /** @brief Resets packet
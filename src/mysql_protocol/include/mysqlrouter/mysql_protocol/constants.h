@@ -27,6 +27,13 @@ namespace mysql_protocol {
 // - See also MySQL Server source include/mysql_com.h
 // - using uint32_t because transmitted as 4 byte long integer
 
+/** @brief CLIENT_CONNECT_WITH_DB
+ *
+ * Server: Supports a schema in the handshake response.
+ * Client: Handshake response contains a schema.
+ */
+const uint32_t kClientConnectWithDb = 0x00000008;
+
 /** @brief CLIENT_PROTOCOL_41
  *
  * Server: Supports the 4.1 protocol.
@@ -41,6 +48,60 @@ const uint32_t kClientProtocol41 = 0x00000200;
  */
 const uint32_t kClientSSL = 0x00000800;
 
+/** @brief CLIENT_SECURE_CONNECTION
+ *
+ * Authentication data in the handshake response is length encoded.
+ */
+const uint32_t kClientSecureConnection = 0x00008000;
+
+/** @brief CLIENT_PLUGIN_AUTH
+ *
+ * Handshake packets carry the name of the authentication plugin.
+ */
+const uint32_t kClientPluginAuth = 0x00080000;
+
+/** @brief CLIENT_PLUGIN_AUTH_LENENC_CLIENT_DATA
+ *
+ * Authentication data in the handshake response is length encoded,
+ * allowing more than 255 bytes.
+ */
+const uint32_t kClientPluginAuthLenencClientData = 0x00200000;
+
+/** @brief CLIENT_DEPRECATE_EOF
+ *
+ * Result sets end with an OK packet instead of an EOF packet.
+ */
+const uint32_t kClientDeprecateEOF = 0x01000000;
+
+// Status flags are prefixed with `SERVER_`; found in OK and EOF packets.
+// - See MySQL Server source include/mysql_com.h
+
+/** @brief SERVER_STATUS_IN_TRANS: a transaction is active */
+const uint16_t kServerStatusInTrans = 0x0001;
+
+/** @brief SERVER_STATUS_AUTOCOMMIT: autocommit is enabled */
+const uint16_t kServerStatusAutocommit = 0x0002;
+
+/** @brief SERVER_MORE_RESULTS_EXISTS: another result set follows */
+const uint16_t kServerMoreResultsExists = 0x0008;
+
+/** @brief SERVER_STATUS_IN_TRANS_READONLY: the active transaction is read-only */
+const uint16_t kServerStatusInTransReadonly = 0x2000;
+
+// Commands are prefixed with `COM_`.
+
+/** @brief COM_QUIT */
+const uint8_t kComQuit = 0x01;
+
+/** @brief COM_INIT_DB */
+const uint8_t kComInitDb = 0x02;
+
+/** @brief COM_QUERY */
+const uint8_t kComQuery = 0x03;
+
+/** @brief COM_PING */
+const uint8_t kComPing = 0x0e;
+
 } // mysql_protocol
 
 #endif // MYSQLROUTER_MYSQL_PROTOCOL_CONSTANTS_INCLUDED
@@ -22,6 +22,44 @@
 
 namespace mysql_protocol {
 
+/** @class ErrorPacketView
+ * @brief Parses a MySQL error packet without copying it
+ *
+ * Like ErrorPacket parsing a buffer, but the message and SQL state are
+ * views on the given bytes, which have to outlive this object.
+ *
+ */
+class MYSQL_PROTOCOL_API ErrorPacketView {
+ public:
+  /** @brief Constructor
+   *
+   * @param packet bytes of the error packet, including the header
+   * @param capabilities Server/Client capability flags (default 0)
+   * @throws packet_error when the bytes are not an error packet
+   */
+  explicit ErrorPacketView(const PacketView &packet, uint32_t capabilities = 0);
+
+  /** @brief Gets error code */
+  uint16_t get_code() const noexcept {
+    return code_;
+  }
+
+  /** @brief Gets error message */
+  PacketView get_message() const noexcept {
+    return message_;
+  }
+
+  /** @brief Gets SQL state; empty when the packet has none */
+  PacketView get_sql_state() const noexcept {
+    return sql_state_;
+  }
+
+ private:
+  uint16_t code_;
+  PacketView message_;
+  PacketView sql_state_;
+};
+
 /** @class ErrorPacket
  * @brief Creates a MySQL error packet
  *
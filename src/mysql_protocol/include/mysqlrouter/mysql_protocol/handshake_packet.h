@@ -22,6 +22,55 @@
 
 namespace mysql_protocol {
 
+/** @class HandshakePacket
+ * @brief Parses the initial MySQL handshake packet
+ *
+ * This class parses the handshake packet (protocol version 10) which
+ * the MySQL server sends first on each connection.
+ *
+ */
+class MYSQL_PROTOCOL_API HandshakePacket final : public Packet {
+ public:
+  /** @brief Constructor
+   *
+   * @param buffer bytes of the packet, including the header
+   * @throws packet_error when the packet is no handshake or is incomplete
+   */
+  explicit HandshakePacket(const vector_t &buffer);
+
+  /** @brief Returns the version of the server */
+  const std::string &get_server_version() const noexcept { return server_version_; }
+
+  /** @brief Returns the connection id given by the server */
+  uint32_t get_connection_id() const noexcept { return connection_id_; }
+
+  /** @brief Returns the salt for the authentication (without trailing nil byte) */
+  const std::vector<unsigned char> &get_auth_data() const noexcept { return auth_data_; }
+
+  /** @brief Returns the capability flags of the server */
+  uint32_t get_server_capabilities() const noexcept { return server_capabilities_; }
+
+  /** @brief Returns the default character set of the server */
+  unsigned char get_char_set() const noexcept { return char_set_; }
+
+  /** @brief Returns the status flags of the server */
+  uint16_t get_status_flags() const noexcept { return status_flags_; }
+
+  /** @brief Returns the name of the default authentication plugin */
+  const std::string &get_auth_plugin() const noexcept { return auth_plugin_; }
+
+ private:
+  void parse_payload();
+
+  std::string server_version_;
+  uint32_t connection_id_;
+  std::vector<unsigned char> auth_data_;
+  uint32_t server_capabilities_;
+  unsigned char char_set_;
+  uint16_t status_flags_;
+  std::string auth_plugin_;
+};
+
 /** @class HandshakeResponsePacket
  * @brief Creates a MySQL handshake response packet
  *
@@ -50,7 +99,8 @@ class MYSQL_PROTOCOL_API HandshakeResponsePacket final : public Packet {
 
   /** @brief Constructor */
   HandshakeResponsePacket() : Packet(0), auth_data_({}), username_(""), password_(""),
-                              char_set_(8), auth_plugin_("mysql_native_password") {
+                              char_set_(8), auth_plugin_("mysql_native_password"),
+                              capabilities_(kDefaultClientCapabilities) {
     prepare_packet();
   }
 
@@ -63,12 +113,38 @@ class MYSQL_PROTOCOL_API HandshakeResponsePacket final : public Packet {
    * @param database MySQL database to use when connecting (default is empty)
    * @param char_set MySQL character set code (default 8, latin1)
    * @param auth_plugin MySQL authentication plugin name (default 'mysql_native_password')
+   * @param capabilities MySQL capability flags (default kDefaultClientCapabilities)
    */
   HandshakeResponsePacket(uint8_t sequence_id,
                           std::vector<unsigned char> auth_data, const std::string &username,
                           const std::string &password, const std::string &database = "",
                           unsigned char char_set = 8,
-                          const std::string &auth_plugin = "mysql_native_password");
+                          const std::string &auth_plugin = "mysql_native_password",
+                          uint32_t capabilities = kDefaultClientCapabilities);
+
+  /** @brief Computes the mysql_native_password authentication response
+   *
+   * SHA1(password) XOR SHA1(salt + SHA1(SHA1(password))). An empty password
+   * gives an empty response.
+   *
+   * @param auth_data salt sent by the server (20 bytes)
+   * @param password password in clear text
+   * @return authentication response (20 bytes)
+   */
+  static std::vector<unsigned char> scramble_native_password(const std::vector<unsigned char> &auth_data,
+                                                             const std::string &password);
+
+  /** @brief Computes the fast authentication response of caching_sha2_password
+   *
+   * SHA256(password) XOR SHA256(SHA256(SHA256(password)) + nonce). An empty
+   * password gives an empty response.
+   *
+   * @param auth_data nonce sent by the server (20 bytes)
+   * @param password password in clear text
+   * @return authentication response (32 bytes)
+   */
+  static std::vector<unsigned char> scramble_caching_sha2_password(const std::vector<unsigned char> &auth_data,
+                                                                   const std::string &password);
 
  private:
   /** @brief Prepares the packet
@@ -95,6 +171,9 @@ class MYSQL_PROTOCOL_API HandshakeResponsePacket final : public Packet {
 
   /** @brief MySQL authentication plugin name */
   std::string auth_plugin_;
+
+  /** @brief MySQL capability flags */
+  uint32_t capabilities_;
 };
 
 } // namespace mysql_protocol
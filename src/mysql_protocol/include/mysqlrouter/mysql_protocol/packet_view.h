@@ -0,0 +1,264 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQLROUTER_MYSQL_PROTOCOL_PACKET_VIEW_INCLUDED
+#define MYSQLROUTER_MYSQL_PROTOCOL_PACKET_VIEW_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace mysql_protocol {
+
+/** @class PacketView
+ * @brief Read-only view on the bytes of a MySQL packet, or a part of it
+ *
+ * A view neither owns nor copies the bytes, which have to outlive it.
+ * Strings and byte sequences read from a view are views themselves;
+ * use str() to get a copy.
+ *
+ * Unlike Packet, all accessors check the bounds: reading past the end
+ * throws packet_error, so views can be used on bytes as read from the
+ * network.
+ *
+ */
+class MYSQL_PROTOCOL_API PacketView {
+ public:
+  /** @brief Header length of packets */
+  static const size_t kHeaderSize{4};
+
+  /** @brief Constructor; an empty view */
+  PacketView() noexcept : data_(nullptr), size_(0) { }
+
+  /** @overload
+   *
+   * @param data first byte
+   * @param size number of bytes
+   */
+  PacketView(const uint8_t *data, size_t size) noexcept : data_(data), size_(size) { }
+
+  /** @overload
+   *
+   * @param buffer bytes; the view is invalidated when the vector changes
+   */
+  explicit PacketView(const std::vector<uint8_t> &buffer) noexcept
+      : data_(buffer.data()), size_(buffer.size()) { }
+
+  /** @brief Returns the first byte */
+  const uint8_t *data() const noexcept { return data_; }
+
+  /** @brief Returns the number of bytes */
+  size_t size() const noexcept { return size_; }
+
+  /** @brief Returns whether the view has no bytes */
+  bool empty() const noexcept { return size_ == 0; }
+
+  const uint8_t *begin() const noexcept { return data_; }
+  const uint8_t *end() const noexcept { return data_ + size_; }
+
+  /** @brief Returns the byte at the given position, without checking the bounds */
+  uint8_t operator[](size_t position) const noexcept { return data_[position]; }
+
+  /** @brief Returns the byte at the given position
+   *
+   * @throws packet_error when position is past the end
+   */
+  uint8_t at(size_t position) const {
+    check_range(position, 1);
+    return data_[position];
+  }
+
+  /** @brief Gets the payload size from the packet header
+   *
+   * @throws packet_error when the view is shorter than a header
+   */
+  uint32_t get_payload_size() const { return get_int<uint32_t>(0, 3); }
+
+  /** @brief Gets the sequence ID from the packet header
+   *
+   * @throws packet_error when the view is shorter than a header
+   */
+  uint8_t get_sequence_id() const { return at(3); }
+
+  /** @brief Gets an integral
+   *
+   * Works like Packet::get_int(), reading little-endian integrals of 1, 2,
+   * 3, 4 or 8 bytes.
+   *
+   * @param position Position where to start reading
+   * @param length size of the integer to parse
+   * @return integer type
+   * @throws packet_error when reading past the end
+   */
+  template<typename Type, typename = std::enable_if<std::is_integral<Type>::value>>
+  Type get_int(size_t position, size_t length = sizeof(Type)) const {
+    check_range(position, length);
+    uint64_t result = 0;
+    for (size_t i = length; i > 0; --i) {
+      result = (result << 8) | data_[position + i - 1];
+    }
+    return static_cast<Type>(result);
+  }
+
+  /** @brief Gets a length encoded integer
+   *
+   * @param position Position where to start reading
+   * @param length when not null, set to the number of bytes used by the integer
+   * @return uint64_t
+   * @throws packet_error when reading past the end, or on 0xfb (NULL) and 0xff
+   */
+  uint64_t get_lenenc_uint(size_t position, size_t *length = nullptr) const;
+
+  /** @brief Gets a string
+   *
+   * Works like Packet::get_string(): reads up to the nil byte, to length
+   * bytes, or to the end, whatever comes first. When position is past the
+   * end, the string is empty.
+   *
+   * @param position Position from which to start reading
+   * @param length maximum length of the string
+   * @return view on the string, without the nil byte
+   */
+  PacketView get_string(size_t position,
+                        size_t length = std::numeric_limits<size_t>::max()) const noexcept;
+
+  /** @brief Gets bytes using length encoded size
+   *
+   * @param position Position from which to start reading
+   * @return view on the bytes, without the length
+   * @throws packet_error when reading past the end
+   */
+  PacketView get_lenenc_bytes(size_t position) const;
+
+  /** @brief Gets a part of the view
+   *
+   * @param position Position of the first byte
+   * @param length number of bytes
+   * @throws packet_error when the part does not fit
+   */
+  PacketView sub(size_t position, size_t length) const {
+    check_range(position, length);
+    return PacketView(data_ + position, length);
+  }
+
+  /** @brief Returns a copy of the bytes as string */
+  std::string str() const { return std::string(data_, data_ + size_); }
+
+ private:
+  void check_range(size_t position, size_t length) const {
+    if (position > size_ || length > size_ - position) {
+      throw_out_of_range(position, length);
+    }
+  }
+
+  [[noreturn]] void throw_out_of_range(size_t position, size_t length) const;
+
+  const uint8_t *data_;
+  size_t size_;
+};
+
+/** @class PacketReader
+ * @brief Reads the fields of a packet one after the other
+ *
+ * Keeps the position in a PacketView; each read moves past what it read.
+ * Like the view, reading past the end throws packet_error.
+ *
+ */
+class MYSQL_PROTOCOL_API PacketReader {
+ public:
+  /** @brief Constructor
+   *
+   * @param view bytes to read
+   * @param position where to start reading
+   */
+  explicit PacketReader(const PacketView &view, size_t position = 0) noexcept
+      : view_(view), position_(position) { }
+
+  /** @brief Reads an integral; see PacketView::get_int() */
+  template<typename Type, typename = std::enable_if<std::is_integral<Type>::value>>
+  Type read_int(size_t length = sizeof(Type)) {
+    Type value = view_.get_int<Type>(position_, length);
+    position_ += length;
+    return value;
+  }
+
+  /** @brief Reads a length encoded integer */
+  uint64_t read_lenenc_uint() {
+    size_t length = 0;
+    uint64_t value = view_.get_lenenc_uint(position_, &length);
+    position_ += length;
+    return value;
+  }
+
+  /** @brief Reads length bytes */
+  PacketView read_bytes(size_t length) {
+    PacketView bytes = view_.sub(position_, length);
+    position_ += length;
+    return bytes;
+  }
+
+  /** @brief Reads a string ending with a nil byte, or with the view
+   *
+   * @return view on the string, without the nil byte
+   */
+  PacketView read_nul_string() {
+    PacketView value = view_.get_string(position_);
+    position_ = std::min(position_ + value.size() + 1, view_.size());
+    return value;
+  }
+
+  /** @brief Reads bytes with a length encoded size */
+  PacketView read_lenenc_bytes() {
+    return read_bytes(static_cast<size_t>(read_lenenc_uint()));
+  }
+
+  /** @brief Reads everything up to the end */
+  PacketView read_rest() noexcept {
+    size_t position = std::min(position_, view_.size());
+    position_ = view_.size();
+    return PacketView(view_.data() + position, view_.size() - position);
+  }
+
+  /** @brief Moves past length bytes
+   *
+   * @throws packet_error when moving past the end
+   */
+  void skip(size_t length) {
+    view_.sub(position_, length);
+    position_ += length;
+  }
+
+  /** @brief Returns the position of the next read */
+  size_t get_position() const noexcept { return position_; }
+
+  /** @brief Returns the number of bytes left */
+  size_t get_remaining() const noexcept {
+    return position_ < view_.size() ? view_.size() - position_ : 0;
+  }
+
+ private:
+  PacketView view_;
+  size_t position_;
+};
+
+} // namespace mysql_protocol
+
+#endif // MYSQLROUTER_MYSQL_PROTOCOL_PACKET_VIEW_INCLUDED
@@ -40,7 +40,7 @@ void Packet::parse_header(bool allow_partial) {
     return;
   }
 
-  payload_size_ = get_int<uint32_t>(0, 3);
+  payload_size_ = view().get_payload_size();
 
   if (!allow_partial && this->size() < payload_size_ + 4) {
     throw packet_error("Incorrect payload size (was " +
@@ -58,64 +58,16 @@ void Packet::update_packet_size() {
 }
 
 uint64_t Packet::get_lenenc_uint(size_t position) const {
-  assert(size() >= 1);
-  assert(position < size());
-  assert((*this)[position] != 0xff); // 0xff is undefined in length encoded integers
-  assert((*this)[position] != 0xfb); // 0xfb represents NULL and not used in length encoded integers
-
-  if ((*this)[position] < 0xfb) {
-    return (*this)[position];
-  }
-
-  size_t length = 2;
-  switch ((*this)[position]) {
-    case 0xfc:
-      length = 2;
-      break;
-    case 0xfd:
-      length = 3;
-      break;
-    case 0xfe:
-      length = 8;
-  }
-  assert(size() >= length + 1);
-  assert(position + length < size());
-  return get_int<uint64_t>(position + 1, length);
+  return view().get_lenenc_uint(position);
 }
 
 std::string Packet::get_string(unsigned long position, unsigned long length) const {
-
-  if (static_cast<size_t>(position) > size()) {
-    return "";
-  }
-
-  auto start = begin() + static_cast<vector_t::difference_type>(position);
-  auto finish = (length == UINT_MAX) ? size() : position + length;
-  auto it = std::find(start, begin() + static_cast<vector_t::difference_type>(finish), 0);
-  return std::string(start, it);
+  return view().get_string(position, length == UINT_MAX ? std::numeric_limits<size_t>::max() : length).str();
 }
 
 Packet::vector_t Packet::get_lenenc_bytes(size_t position) const {
-  // Cast to long so we can use it on iterators
-  auto length = static_cast<long>(get_lenenc_uint(position));
-  auto start = static_cast<long>(position);
-
-  // Where does the actual data start
-  switch ((*this)[position]) {
-    case 0xfc:
-      start += 3;
-      break;
-    case 0xfd:
-      start += 4;
-      break;
-    case 0xfe:
-      start += 9;
-      break;
-    default:
-      start += 1;
-  }
-
-  return std::vector<uint8_t>(begin() + start, begin() + start + length);
+  PacketView bytes = view().get_lenenc_bytes(position);
+  return vector_t(bytes.begin(), bytes.end());
 }
 
 void Packet::add(const Packet::vector_t &value) {
@@ -18,6 +18,7 @@
 #include "mysqlrouter/mysql_protocol.h"
 #include "mysqlrouter/utils.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -70,30 +71,36 @@ void ErrorPacket::prepare_packet() {
   update_packet_size();
 }
 
-void ErrorPacket::parse_payload() {
-  bool prot41 = capability_flags_ > 0 && (capability_flags_ & kClientProtocol41);
+ErrorPacketView::ErrorPacketView(const PacketView &packet, uint32_t capabilities) {
+  bool prot41 = capabilities > 0 && (capabilities & kClientProtocol41);
   // Sanity checks
-  if (!((*this)[4] == 0xff && (*this)[6])) {
+  if (packet.size() < Packet::kHeaderSize + 3 || packet[4] != 0xff || !packet[6]) {
     throw packet_error("Error packet marker 0xff not found");
   }
   // Check if SQLState is available when CLIENT_PROTOCOL_41 flag is set
-  if (prot41 && (*this)[7] != 0x23) {
+  bool has_sql_state = packet.size() > 7 && packet[7] == 0x23;
+  if (prot41 && !has_sql_state) {
     throw packet_error("Error packet does not contain SQL state");
   }
 
-  unsigned long pos = 5;
-  code_ = get_int<uint16_t>(pos);
-  pos += 2;
-  if ((*this)[7] == 0x23) {
+  PacketReader reader(packet, 5);
+  code_ = reader.read_int<uint16_t>();
+  if (has_sql_state) {
     // We get the SQLState even when CLIENT_PROTOCOL_41 flag was not set
     // This is needed in cases when the server sends an
     // error to the client instead of the handshake.
-    sql_state_ = get_string(++pos, 5); // We skip 0x23
-    pos += 5;
-  } else {
-    sql_state_ = "";
+    reader.skip(1); // We skip 0x23
+    sql_state_ = packet.get_string(reader.get_position(), 5);
+    reader.skip(std::min<size_t>(5, reader.get_remaining()));
   }
-  message_ = get_string(pos);
+  message_ = packet.get_string(reader.get_position());
+}
+
+void ErrorPacket::parse_payload() {
+  ErrorPacketView error(view(), capability_flags_);
+  code_ = error.get_code();
+  sql_state_ = error.get_sql_state().str();
+  message_ = error.get_message().str();
 }
 
 } // namespace mysql_protocol
@@ -16,6 +16,8 @@
 */
 
 #include "mysqlrouter/mysql_protocol.h"
+#include "mysqlrouter/sha1.h"
+#include "mysqlrouter/sha256.h"
 #include "mysqlrouter/utils.h"
 
 #include <cassert>
@@ -29,23 +31,115 @@ namespace mysql_protocol {
 
 const unsigned int HandshakeResponsePacket::kDefaultClientCapabilities = 238221;
 
+HandshakePacket::HandshakePacket(const vector_t &buffer)
+    : Packet(buffer), connection_id_(0), server_capabilities_(0), char_set_(0), status_flags_(0) {
+  parse_payload();
+}
+
+void HandshakePacket::parse_payload() {
+  if (size() < kHeaderSize + 1 || (*this)[kHeaderSize] != 10) {
+    throw packet_error("Not a protocol version 10 handshake packet");
+  }
+  PacketReader reader(view(), kHeaderSize + 1);
+
+  server_version_ = reader.read_nul_string().str();
+
+  // connection id, first part of the salt, filler, lower capabilities
+  if (reader.get_remaining() < 4 + 8 + 1 + 2) {
+    throw packet_error("Handshake packet too short");
+  }
+  connection_id_ = reader.read_int<uint32_t>();
+  PacketView salt = reader.read_bytes(8);
+  auth_data_.assign(salt.begin(), salt.end());
+  reader.skip(1);
+  server_capabilities_ = reader.read_int<uint32_t>(2);
+
+  if (reader.get_remaining() < 1 + 2 + 2 + 1 + 10) {
+    return;  // pre-4.1 servers stop here
+  }
+  char_set_ = reader.read_int<uint8_t>();
+  status_flags_ = reader.read_int<uint16_t>();
+  server_capabilities_ |= reader.read_int<uint32_t>(2) << 16;
+  size_t auth_data_length = reader.read_int<uint8_t>();
+  reader.skip(10);  // reserved
+
+  if (server_capabilities_ & kClientSecureConnection) {
+    // second part of the salt, ending with a nil byte
+    size_t length = std::max<size_t>(13, auth_data_length > 8 ? auth_data_length - 8 : 0);
+    if (reader.get_remaining() < length) {
+      throw packet_error("Handshake packet too short");
+    }
+    salt = reader.read_bytes(length);
+    auth_data_.insert(auth_data_.end(), salt.begin(), salt.end() - 1);
+  }
+
+  if (server_capabilities_ & kClientPluginAuth) {
+    auth_plugin_ = reader.read_nul_string().str();
+  }
+}
+
 HandshakeResponsePacket::HandshakeResponsePacket(uint8_t sequence_id,
                                                  std::vector<unsigned char> auth_data,
                                                  const std::string &username,
                                                  const std::string &password, const std::string &database,
                                                  unsigned char char_set,
-                                                 const std::string &auth_plugin)
+                                                 const std::string &auth_plugin,
+                                                 uint32_t capabilities)
     : Packet(sequence_id), auth_data_(auth_data), username_(username), password_(password),
-      database_(database), char_set_(char_set), auth_plugin_(auth_plugin) {
+      database_(database), char_set_(char_set), auth_plugin_(auth_plugin),
+      capabilities_(capabilities) {
   prepare_packet();
 }
 
+std::vector<unsigned char> HandshakeResponsePacket::scramble_native_password(
+    const std::vector<unsigned char> &auth_data, const std::string &password) {
+  if (password.empty()) {
+    return {};
+  }
+  uint8_t hash_stage1[SHA1_HASH_SIZE];
+  my_sha1::compute_sha1_hash(hash_stage1, password.c_str(), password.size());
+  uint8_t hash_stage2[SHA1_HASH_SIZE];
+  my_sha1::compute_sha1_hash(hash_stage2, reinterpret_cast<const char *>(hash_stage1), SHA1_HASH_SIZE);
+  uint8_t result[SHA1_HASH_SIZE];
+  my_sha1::compute_sha1_hash_multi(result, reinterpret_cast<const char *>(auth_data.data()),
+                                   static_cast<int>(std::min<size_t>(auth_data.size(), SHA1_HASH_SIZE)),
+                                   reinterpret_cast<const char *>(hash_stage2), SHA1_HASH_SIZE);
+  std::vector<unsigned char> scramble(SHA1_HASH_SIZE);
+  for (size_t i = 0; i < SHA1_HASH_SIZE; ++i) {
+    scramble[i] = result[i] ^ hash_stage1[i];
+  }
+  return scramble;
+}
+
+std::vector<unsigned char> HandshakeResponsePacket::scramble_caching_sha2_password(
+    const std::vector<unsigned char> &auth_data, const std::string &password) {
+  if (password.empty()) {
+    return {};
+  }
+  uint8_t digest_stage1[SHA256_HASH_SIZE];
+  my_sha256::compute_sha256_hash(digest_stage1, password.c_str(), password.size());
+  uint8_t digest_stage2[SHA256_HASH_SIZE];
+  my_sha256::compute_sha256_hash(digest_stage2, reinterpret_cast<const char *>(digest_stage1),
+                                 SHA256_HASH_SIZE);
+  uint8_t result[SHA256_HASH_SIZE];
+  my_sha256::compute_sha256_hash_multi(result, reinterpret_cast<const char *>(digest_stage2),
+                                       SHA256_HASH_SIZE,
+                                       reinterpret_cast<const char *>(auth_data.data()),
+                                       std::min<size_t>(auth_data.size(), 20));
+  std::vector<unsigned char> scramble(SHA256_HASH_SIZE);
+  for (size_t i = 0; i < SHA256_HASH_SIZE; ++i) {
+    scramble[i] = digest_stage1[i] ^ result[i];
+  }
+  return scramble;
+}
+
 /** @fn HandshakeResponsePacket::prepare_packet()
  *
  * @devnote
- * Password is currently not used and 'incorrect' authentication data is
- * being set in this packet (making the packet currently unusable for authentication.
- * This is to satisfy fix for BUG22020088.
+ * Without password, 'incorrect' authentication data is being set in this
+ * packet (making the packet unusable for authentication). This is to satisfy
+ * fix for BUG22020088. With a password, the mysql_native_password response
+ * to the given authentication data is set.
  * @enddevnote
  */
 void HandshakeResponsePacket::prepare_packet() {
@@ -53,7 +147,7 @@ void HandshakeResponsePacket::prepare_packet() {
   reset();
 
   // capabilities
-  add_int<uint32_t>(kDefaultClientCapabilities);
+  add_int<uint32_t>(capabilities_);
 
   // max packet size
   add_int<uint32_t>(kMaxAllowedSize);
@@ -71,14 +165,22 @@ void HandshakeResponsePacket::prepare_packet() {
   push_back(0x0);
 
   // Auth Data
-  add_int<uint8_t>(20);
-  insert(end(), 20, 0x71);  // 0x71 is fake data; can be anything
+  if (password_.empty()) {
+    add_int<uint8_t>(20);
+    insert(end(), 20, 0x71);  // 0x71 is fake data; can be anything
+  } else {
+    auto scramble = scramble_native_password(auth_data_, password_);
+    add_int<uint8_t>(static_cast<uint8_t>(scramble.size()));
+    add(scramble);
+  }
 
   // Database
-  if (!database_.empty()) {
-    add(database_);
+  if (capabilities_ & kClientConnectWithDb) {
+    if (!database_.empty()) {
+      add(database_);
+    }
+    push_back(0x0);
   }
-  push_back(0x0);
 
   // Authentication plugin name
   add(auth_plugin_);
@@ -0,0 +1,78 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "mysqlrouter/mysql_protocol.h"
+
+#include <algorithm>
+#include <string>
+
+namespace mysql_protocol {
+
+const size_t PacketView::kHeaderSize;
+
+void PacketView::throw_out_of_range(size_t position, size_t length) const {
+  throw packet_error("Reading " + std::to_string(length) + " bytes at position " +
+                     std::to_string(position) + " past the end of the packet (size " +
+                     std::to_string(size_) + ")");
+}
+
+uint64_t PacketView::get_lenenc_uint(size_t position, size_t *length) const {
+  uint8_t first = at(position);
+
+  if (first < 0xfb) {
+    if (length) *length = 1;
+    return first;
+  }
+
+  size_t int_length;
+  switch (first) {
+    case 0xfc:
+      int_length = 2;
+      break;
+    case 0xfd:
+      int_length = 3;
+      break;
+    case 0xfe:
+      int_length = 8;
+      break;
+    default:
+      // 0xfb represents NULL, 0xff is undefined in length encoded integers
+      throw packet_error("Invalid length encoded integer (first byte " + std::to_string(first) + ")");
+  }
+
+  uint64_t value = get_int<uint64_t>(position + 1, int_length);
+  if (length) *length = int_length + 1;
+  return value;
+}
+
+PacketView PacketView::get_string(size_t position, size_t length) const noexcept {
+  if (position > size_) {
+    return PacketView();
+  }
+
+  const uint8_t *start = data_ + position;
+  const uint8_t *finish = start + std::min(length, size_ - position);
+  return PacketView(start, static_cast<size_t>(std::find(start, finish, 0) - start));
+}
+
+PacketView PacketView::get_lenenc_bytes(size_t position) const {
+  size_t int_length = 0;
+  uint64_t length = get_lenenc_uint(position, &int_length);
+  return sub(position + int_length, static_cast<size_t>(length));
+}
+
+} // namespace mysql_protocol
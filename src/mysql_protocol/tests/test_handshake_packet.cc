@@ -119,3 +119,68 @@ TEST_F(HandshakeResponsePacketTest, Constructor) {
   }
 }
 
+
+TEST_F(HandshakeResponsePacketTest, ScrambleNativePassword) {
+  std::string salt = "abcdefghijklmnopqrst";
+  std::vector<unsigned char> auth_data(salt.begin(), salt.end());
+
+  std::vector<unsigned char> exp {
+      0x88, 0x17, 0xc5, 0x0f, 0xa7, 0x79, 0xda, 0xef, 0x01, 0x0e, 0xe7, 0x57, 0x78, 0x25, 0xb0, 0x84,
+      0x7d, 0xf9, 0x84, 0x2e,
+  };
+  ASSERT_THAT(mysql_protocol::HandshakeResponsePacket::scramble_native_password(auth_data, "secret"),
+              ContainerEq(exp));
+  ASSERT_TRUE(mysql_protocol::HandshakeResponsePacket::scramble_native_password(auth_data, "").empty());
+
+  // the scramble replaces the fake authentication data
+  mysql_protocol::HandshakeResponsePacket p(1, auth_data, "ROUTERTEST", "secret");
+  ASSERT_EQ(20, p[4 + 32 + 11]);
+  ASSERT_TRUE(std::equal(exp.begin(), exp.end(), p.begin() + 4 + 32 + 12));
+}
+
+TEST_F(HandshakeResponsePacketTest, ScrambleCachingSha2Password) {
+  std::string nonce = "abcdefghijklmnopqrst";
+  std::vector<unsigned char> auth_data(nonce.begin(), nonce.end());
+
+  std::vector<unsigned char> exp {
+      0xc7, 0x6e, 0x28, 0x98, 0x61, 0x2a, 0x4c, 0xf0, 0x42, 0xc7, 0x7f, 0xa8, 0xc4, 0x70, 0x2c, 0x4c,
+      0x64, 0xc0, 0xc2, 0xc5, 0x57, 0xc5, 0x3c, 0x4d, 0x75, 0x59, 0x5a, 0xaa, 0x6a, 0xba, 0xe8, 0x09,
+  };
+  ASSERT_THAT(mysql_protocol::HandshakeResponsePacket::scramble_caching_sha2_password(auth_data, "secret"),
+              ContainerEq(exp));
+  ASSERT_TRUE(mysql_protocol::HandshakeResponsePacket::scramble_caching_sha2_password(auth_data, "").empty());
+}
+
+class HandshakePacketTest : public ::testing::Test {
+};
+
+TEST_F(HandshakePacketTest, Parse) {
+  std::vector<unsigned char> greeting {
+      0x4a, 0x00, 0x00, 0x00,
+      0x0a, '8', '.', '0', '.', '1', '1', 0x00,  // protocol version, server version
+      0x05, 0x00, 0x00, 0x00,  // connection id
+      'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 0x00,  // salt, first part
+      0xff, 0xff, 0x21, 0x02, 0x00, 0xff, 0xc3, 0x15,  // capabilities, character set, status
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // reserved
+      'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 0x00,  // salt, second part
+      'm', 'y', 's', 'q', 'l', '_', 'n', 'a', 't', 'i', 'v', 'e', '_',
+      'p', 'a', 's', 's', 'w', 'o', 'r', 'd', 0x00,
+  };
+  greeting[0] = static_cast<unsigned char>(greeting.size() - 4);
+
+  mysql_protocol::HandshakePacket p(greeting);
+  ASSERT_EQ("8.0.11", p.get_server_version());
+  ASSERT_EQ(5u, p.get_connection_id());
+  std::string salt(p.get_auth_data().begin(), p.get_auth_data().end());
+  ASSERT_EQ("abcdefghijklmnopqrst", salt);
+  ASSERT_EQ(0xc3ffffffu, p.get_server_capabilities());
+  ASSERT_EQ(0x21, p.get_char_set());
+  ASSERT_EQ(0x0002, p.get_status_flags());
+  ASSERT_EQ("mysql_native_password", p.get_auth_plugin());
+}
+
+TEST_F(HandshakePacketTest, NotAHandshake) {
+  // an error packet
+  std::vector<unsigned char> error {0x03, 0x00, 0x00, 0x00, 0xff, 0x10, 0x04};
+  ASSERT_THROW(mysql_protocol::HandshakePacket p(error), mysql_protocol::packet_error);
+}
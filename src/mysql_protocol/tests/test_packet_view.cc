@@ -0,0 +1,169 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gmock/gmock.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mysqlrouter/mysql_protocol.h"
+
+using mysql_protocol::ErrorPacketView;
+using mysql_protocol::PacketReader;
+using mysql_protocol::PacketView;
+using mysql_protocol::packet_error;
+using std::string;
+
+class PacketViewTest : public ::testing::Test {
+public:
+  std::vector<uint8_t> error_packet = {
+      0x1d, 0x00, 0x00, 0x02, 0xff, 0x9f, 0x0f, 0x23,
+      0x58, 0x59, 0x31, 0x32, 0x33, 0x54, 0x68, 0x69,
+      0x73, 0x20, 0x69, 0x73, 0x20, 0x61, 0x20, 0x74,
+      0x65, 0x73, 0x74, 0x20, 0x65, 0x72, 0x72, 0x6f,
+      0x72,
+  };
+};
+
+TEST_F(PacketViewTest, Header) {
+  PacketView view(error_packet);
+  EXPECT_EQ(error_packet.data(), view.data());
+  EXPECT_EQ(error_packet.size(), view.size());
+  EXPECT_EQ(29U, view.get_payload_size());
+  EXPECT_EQ(2U, view.get_sequence_id());
+
+  EXPECT_TRUE(PacketView().empty());
+  EXPECT_THROW(PacketView(error_packet.data(), 3).get_sequence_id(), packet_error);
+}
+
+TEST_F(PacketViewTest, GetInt) {
+  std::vector<uint8_t> buffer{0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+  PacketView view(buffer);
+
+  EXPECT_EQ(0x01U, view.get_int<uint8_t>(0));
+  EXPECT_EQ(0x0302U, view.get_int<uint16_t>(1));
+  EXPECT_EQ(0x040302U, view.get_int<uint32_t>(1, 3));
+  EXPECT_EQ(0x0807060504030201ULL, view.get_int<uint64_t>(0));
+
+  EXPECT_THROW(view.get_int<uint32_t>(5), packet_error);
+  EXPECT_THROW(view.get_int<uint8_t>(8), packet_error);
+  // does not overflow
+  EXPECT_THROW(view.get_int<uint16_t>(SIZE_MAX), packet_error);
+}
+
+TEST_F(PacketViewTest, GetLenencUint) {
+  size_t length = 0;
+  {
+    std::vector<uint8_t> buffer{0xfa};
+    EXPECT_EQ(250U, PacketView(buffer).get_lenenc_uint(0, &length));
+    EXPECT_EQ(1U, length);
+  }
+  {
+    std::vector<uint8_t> buffer{0xfc, 0xfb, 0x00};
+    EXPECT_EQ(251U, PacketView(buffer).get_lenenc_uint(0, &length));
+    EXPECT_EQ(3U, length);
+  }
+  {
+    std::vector<uint8_t> buffer{0xfd, 0x00, 0x00, 0x01};
+    EXPECT_EQ(65536U, PacketView(buffer).get_lenenc_uint(0, &length));
+    EXPECT_EQ(4U, length);
+  }
+  {
+    std::vector<uint8_t> buffer{0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    EXPECT_EQ(UINT64_MAX, PacketView(buffer).get_lenenc_uint(0, &length));
+    EXPECT_EQ(9U, length);
+  }
+  {
+    // NULL, undefined, and truncated
+    std::vector<uint8_t> buffer{0xfb, 0xff, 0xfe, 0x01};
+    PacketView view(buffer);
+    EXPECT_THROW(view.get_lenenc_uint(0), packet_error);
+    EXPECT_THROW(view.get_lenenc_uint(1), packet_error);
+    EXPECT_THROW(view.get_lenenc_uint(2), packet_error);
+    EXPECT_THROW(view.get_lenenc_uint(4), packet_error);
+  }
+}
+
+TEST_F(PacketViewTest, GetString) {
+  std::vector<uint8_t> buffer{'h', 'a', 'm', 0x0, 's', 'p', 'a', 'm'};
+  PacketView view(buffer);
+
+  PacketView ham = view.get_string(0);
+  EXPECT_EQ(buffer.data(), ham.data());
+  EXPECT_EQ(string("ham"), ham.str());
+  EXPECT_EQ(string("spam"), view.get_string(4).str());
+  EXPECT_EQ(string("sp"), view.get_string(4, 2).str());
+  EXPECT_EQ(string("spam"), view.get_string(4, 100).str());
+  EXPECT_TRUE(view.get_string(8).empty());
+  EXPECT_TRUE(view.get_string(30).empty());
+}
+
+TEST_F(PacketViewTest, GetLenencBytes) {
+  std::vector<uint8_t> buffer{0x03, 'a', 'b', 'c', 0x05, 'd'};
+  PacketView view(buffer);
+
+  PacketView bytes = view.get_lenenc_bytes(0);
+  EXPECT_EQ(buffer.data() + 1, bytes.data());
+  EXPECT_EQ(string("abc"), bytes.str());
+  EXPECT_THROW(view.get_lenenc_bytes(4), packet_error);
+}
+
+TEST_F(PacketViewTest, Reader) {
+  std::vector<uint8_t> buffer{0x2a, 0x00, 'r', 'o', 'o', 't', 0x00, 0x02, 'd', 'b', 'x', 'y'};
+  PacketReader reader{PacketView(buffer)};
+
+  EXPECT_EQ(42U, reader.read_int<uint16_t>());
+  EXPECT_EQ(string("root"), reader.read_nul_string().str());
+  EXPECT_EQ(string("db"), reader.read_lenenc_bytes().str());
+  EXPECT_EQ(10U, reader.get_position());
+  EXPECT_EQ(2U, reader.get_remaining());
+  EXPECT_THROW(reader.read_bytes(3), packet_error);
+  EXPECT_THROW(reader.skip(3), packet_error);
+  EXPECT_EQ(string("xy"), reader.read_rest().str());
+  EXPECT_EQ(0U, reader.get_remaining());
+  EXPECT_TRUE(reader.read_nul_string().empty());
+}
+
+TEST_F(PacketViewTest, ErrorPacketView) {
+  ErrorPacketView error(PacketView(error_packet), mysql_protocol::kClientProtocol41);
+  EXPECT_EQ(3999U, error.get_code());
+  EXPECT_EQ(string("XY123"), error.get_sql_state().str());
+  EXPECT_EQ(string("This is a test error"), error.get_message().str());
+  EXPECT_EQ(error_packet.data() + 13, error.get_message().data());
+
+  // same as ErrorPacket
+  mysql_protocol::ErrorPacket copy(error_packet, mysql_protocol::kClientProtocol41);
+  EXPECT_EQ(copy.get_message(), error.get_message().str());
+  EXPECT_EQ(copy.get_sql_state(), error.get_sql_state().str());
+}
+
+TEST_F(PacketViewTest, ErrorPacketViewErrors) {
+  // too short
+  EXPECT_THROW(ErrorPacketView(PacketView(error_packet.data(), 6)), packet_error);
+
+  // not an error packet
+  std::vector<uint8_t> buffer = error_packet;
+  buffer[4] = 0xfe;
+  EXPECT_THROW(ErrorPacketView{PacketView(buffer)}, packet_error);
+
+  // SQL state missing
+  buffer = error_packet;
+  buffer[7] = 0x54;
+  EXPECT_THROW(ErrorPacketView(PacketView(buffer), mysql_protocol::kClientProtocol41), packet_error);
+  EXPECT_TRUE(ErrorPacketView(PacketView(buffer)).get_sql_state().empty());
+}
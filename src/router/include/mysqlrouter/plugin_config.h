@@ -26,6 +26,7 @@
 
 #include <cerrno>
 #include <cassert>
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
@@ -172,6 +173,25 @@ protected:
 
   int get_option_tcp_port(const mysql_harness::ConfigSection *section, const std::string &option);
 
+  /** @brief Gets a duration using the given option
+   *
+   * The option value is an integer with an optional unit, either "ms" for
+   * milliseconds or "s" for seconds. Values without unit are seconds. For
+   * example, "250ms", "2s" and "2" are all valid.
+   *
+   * Throws std::invalid_argument on errors.
+   *
+   * @param section Instance of ConfigSection
+   * @param option Option name in section
+   * @param min_value Minimum value
+   * @param max_value Maximum value
+   * @return duration in milliseconds
+   */
+  std::chrono::milliseconds get_option_milliseconds(const mysql_harness::ConfigSection *section,
+                                                    const std::string &option,
+                                                    std::chrono::milliseconds min_value,
+                                                    std::chrono::milliseconds max_value);
+
   /** @brief Gets location of a named socket
    *
    * Gets location of a named socket. The option value is checked first
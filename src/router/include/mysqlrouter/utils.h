@@ -18,6 +18,7 @@
 #ifndef MYSQLROUTER_UTILS_INCLUDED
 #define MYSQLROUTER_UTILS_INCLUDED
 
+#include <chrono>
 #include <cstdarg>
 #include <cstdint>
 #include <sstream>
@@ -323,6 +324,31 @@ int strtoi_checked(const char* value, int default_result = 0);
  */
 unsigned strtoui_checked(const char* value, unsigned default_result = 0);
 
+/** @brief Converts a duration with optional unit suffix to milliseconds
+ *
+ * Accepted are non-negative integers followed by an optional unit:
+ * "ms" for milliseconds or "s" for seconds. Values without unit are
+ * seconds, so configuration written before units were supported keeps
+ * its meaning. For example "250ms", "2s" and "2" are all valid.
+ *
+ * Throws std::invalid_argument when the value is invalid or too large.
+ *
+ * @param value duration as string
+ * @return duration in milliseconds
+ */
+std::chrono::milliseconds strtoms_checked(const std::string &value);
+
+/** @brief Returns a duration as string using the largest exact unit
+ *
+ * For example, 2000 milliseconds is returned as "2s" and 2500
+ * milliseconds as "2500ms". The result can be parsed by
+ * strtoms_checked().
+ *
+ * @param value duration in milliseconds
+ * @return duration as string
+ */
+std::string ms_to_string(std::chrono::milliseconds value);
+
 #ifndef _WIN32
 
 /** @class SysUserOperationsBase
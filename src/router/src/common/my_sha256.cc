@@ -0,0 +1,75 @@
+/* Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; version 2 of the License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+
+/**
+  @file
+
+  @brief
+  Wrapper functions for the SHA256 implementations of OpenSSL and YaSSL.
+*/
+
+#include <sha256.h>
+
+#if defined(HAVE_YASSL)
+#include "sha.hpp"
+#elif defined(HAVE_OPENSSL)
+#include <openssl/sha.h>
+#endif
+
+namespace my_sha256 {
+
+/**
+  Computes the SHA256 message digest of two messages, as
+  sha256(msg1, msg2).
+
+  @param digest [out]  Computed SHA256 digest
+  @param buf1   [in]   First message
+  @param len1   [in]   Length of first message
+  @param buf2   [in]   Second message; may be null when len2 is 0
+  @param len2   [in]   Length of second message
+*/
+void compute_sha256_hash_multi(uint8_t *digest, const char *buf1, size_t len1,
+                               const char *buf2, size_t len2)
+{
+#if defined(HAVE_YASSL)
+  TaoCrypt::SHA256 hasher;
+  hasher.Update((const TaoCrypt::byte *) buf1, (TaoCrypt::word32) len1);
+  if (len2 > 0)
+    hasher.Update((const TaoCrypt::byte *) buf2, (TaoCrypt::word32) len2);
+  hasher.Final((TaoCrypt::byte *) digest);
+#elif defined(HAVE_OPENSSL)
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  SHA256_Update(&context, buf1, len1);
+  if (len2 > 0)
+    SHA256_Update(&context, buf2, len2);
+  SHA256_Final(digest, &context);
+#endif /* HAVE_YASSL */
+}
+
+/**
+  Computes the SHA256 message digest.
+
+  @param digest [out]  Computed SHA256 digest
+  @param buf    [in]   Message to be computed
+  @param len    [in]   Length of the message
+*/
+void compute_sha256_hash(uint8_t *digest, const char *buf, size_t len)
+{
+  compute_sha256_hash_multi(digest, buf, len, nullptr, 0);
+}
+
+}
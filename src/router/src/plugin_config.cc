@@ -116,6 +116,39 @@ int BasePluginConfig::get_option_tcp_port(const mysql_harness::ConfigSection *se
   return -1;
 }
 
+std::chrono::milliseconds BasePluginConfig::get_option_milliseconds(const mysql_harness::ConfigSection *section,
+                                                                   const string &option,
+                                                                   std::chrono::milliseconds min_value,
+                                                                   std::chrono::milliseconds max_value) {
+  std::string value = get_option_string(section, option);
+
+  std::chrono::milliseconds result{0};
+  bool valid = true;
+  try {
+    result = strtoms_checked(value);
+  } catch (const invalid_argument &) {
+    valid = false;
+  }
+
+  if (!valid || result < min_value || result > max_value) {
+    // values without unit are seconds; report whole-second limits the same way
+    bool whole_seconds = (min_value.count() % 1000 == 0 && max_value.count() % 1000 == 0);
+    std::ostringstream os;
+    os << get_log_prefix(option) << " needs value between ";
+    if (whole_seconds) {
+      os << min_value.count() / 1000 << " and " << max_value.count() / 1000;
+    } else {
+      os << ms_to_string(min_value) << " and " << ms_to_string(max_value);
+    }
+    os << " inclusive";
+    if (!value.empty()) {
+      os << ", was '" << value << "'";
+    }
+    throw std::invalid_argument(os.str());
+  }
+  return result;
+}
+
 mysql_harness::Path BasePluginConfig::get_option_named_socket(const mysql_harness::ConfigSection *section,
                                                               const string &option) {
   std::string value = get_option_string(section, option);
@@ -27,6 +27,7 @@
 #include <iostream>
 #include <fstream>
 #include <cctype>
+#include <cerrno>
 #include <climits>
 #include <stdexcept>
 #include <functional>
@@ -643,6 +644,41 @@ unsigned strtoui_checked(const char* value, unsigned default_value) {
   return strtoX_checked_common(std::strtoul, value, default_value);
 }
 
+std::chrono::milliseconds strtoms_checked(const std::string &value) {
+  size_t digits = 0;
+  while (digits < value.size() && isdigit(static_cast<unsigned char>(value[digits]))) {
+    ++digits;
+  }
+  if (digits == 0) {
+    throw std::invalid_argument("invalid duration '" + value + "'");
+  }
+
+  std::string unit = value.substr(digits);
+  long long multiplier;
+  if (unit.empty() || unit == "s") {
+    multiplier = 1000;
+  } else if (unit == "ms") {
+    multiplier = 1;
+  } else {
+    throw std::invalid_argument("invalid unit in duration '" + value + "'; valid are ms, s");
+  }
+
+  errno = 0;
+  unsigned long long number = std::strtoull(value.substr(0, digits).c_str(), nullptr, 10);
+  if (errno == ERANGE ||
+      number > static_cast<unsigned long long>(std::chrono::milliseconds::max().count() / multiplier)) {
+    throw std::invalid_argument("duration '" + value + "' is too large");
+  }
+  return std::chrono::milliseconds(static_cast<long long>(number) * multiplier);
+}
+
+std::string ms_to_string(std::chrono::milliseconds value) {
+  if (value.count() % 1000 == 0) {
+    return std::to_string(value.count() / 1000) + "s";
+  }
+  return std::to_string(value.count()) + "ms";
+}
+
 #ifndef _WIN32
 
 // class SysUserOperations
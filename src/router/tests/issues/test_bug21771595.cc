@@ -81,7 +81,7 @@ TEST_F(Bug21771595, ExceptionRoutingInvalidTimeout) {
     r.start();
   } catch (const std::invalid_argument &exc) {
     ASSERT_THAT(exc.what(), StrEq(
-      "option connect_timeout in [routing] needs value between 1 and 65535 inclusive, was '0'"));
+      "option connect_timeout in [routing] needs value between 1ms and 65535s inclusive, was '0'"));
   }
 }
 
@@ -111,7 +111,7 @@ TEST_F(Bug21771595, AppExecRoutingInvalidTimeout) {
 
   ASSERT_EQ(1, cmd_result.exit_code);
   ASSERT_THAT(cmd_result.output, HasSubstr(
-    "Configuration error: option connect_timeout in [routing] needs value between 1 and 65535 inclusive, was '0'"));
+    "Configuration error: option connect_timeout in [routing] needs value between 1ms and 65535s inclusive, was '0'"));
 }
 
 TEST_F(Bug21771595, AppExecMetadataCacheInvalidBindAddress) {
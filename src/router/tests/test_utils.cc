@@ -28,6 +28,7 @@
 #endif
 
 #include "mysqlrouter/utils.h"
+#include <chrono>
 #include <fstream>
 #include <vector>
 
@@ -349,3 +350,33 @@ TEST_F(UtilsTests, uint_conversion) {
   EXPECT_EQ(0u,  strtoui_checked("+0", 66));
 }
 
+
+TEST_F(UtilsTests, ms_conversion) {
+  using mysqlrouter::strtoms_checked;
+  using std::chrono::milliseconds;
+  using std::chrono::seconds;
+
+  // no unit means seconds
+  EXPECT_EQ(seconds(12), strtoms_checked("12"));
+  EXPECT_EQ(seconds(0), strtoms_checked("0"));
+  EXPECT_EQ(seconds(3), strtoms_checked("3s"));
+  EXPECT_EQ(milliseconds(250), strtoms_checked("250ms"));
+  EXPECT_EQ(milliseconds(0), strtoms_checked("0ms"));
+
+  EXPECT_THROW(strtoms_checked(""), std::invalid_argument);
+  EXPECT_THROW(strtoms_checked("ms"), std::invalid_argument);
+  EXPECT_THROW(strtoms_checked("-1"), std::invalid_argument);
+  EXPECT_THROW(strtoms_checked("1.5s"), std::invalid_argument);
+  EXPECT_THROW(strtoms_checked("10m"), std::invalid_argument);
+  EXPECT_THROW(strtoms_checked("99999999999999999999"), std::invalid_argument);
+}
+
+TEST_F(UtilsTests, ms_to_string) {
+  using mysqlrouter::ms_to_string;
+  using std::chrono::milliseconds;
+
+  EXPECT_EQ("0s", ms_to_string(milliseconds(0)));
+  EXPECT_EQ("2s", ms_to_string(milliseconds(2000)));
+  EXPECT_EQ("2500ms", ms_to_string(milliseconds(2500)));
+  EXPECT_EQ(milliseconds(2500), mysqlrouter::strtoms_checked(ms_to_string(milliseconds(2500))));
+}
@@ -0,0 +1,140 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * Compares forwarding classic protocol packets from one socket pair to
+ * another, as the routing thread does, with and without following them
+ * with the ClassicFramer: tiny rows, where framing costs a few nanoseconds
+ * per packet, and rows as in most result sets.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "protocol/classic_framer.h"
+
+using Bytes = std::vector<uint8_t>;
+
+namespace {
+
+// forwarded per iteration
+const size_t kTotal = 8 * 1024 * 1024;
+
+// does nothing but follow the packets
+struct NullHandler {
+  void on_header(uint8_t, uint32_t, bool) noexcept {}
+  void on_payload(const uint8_t *, size_t) noexcept {}
+  bool on_packet_end() noexcept { return true; }
+};
+
+// about 1MB of packets with payloads of min_size up to min_size + spread bytes
+Bytes make_stream(size_t min_size, size_t spread) {
+  Bytes stream;
+  uint8_t seq = 0;
+  while (stream.size() < 1024 * 1024) {
+    size_t payload_size = min_size + stream.size() % spread;
+    stream.push_back(static_cast<uint8_t>(payload_size));
+    stream.push_back(static_cast<uint8_t>(payload_size >> 8));
+    stream.push_back(static_cast<uint8_t>(payload_size >> 16));
+    stream.push_back(seq++);
+    stream.insert(stream.end(), payload_size, 'x');
+  }
+  return stream;
+}
+
+// forwards kTotal bytes of the stream; false when a socket failed
+bool forward(const Bytes &stream, bool framed) {
+  int in[2], out[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, in) != 0) {
+    return false;
+  }
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, out) != 0) {
+    close(in[0]);
+    close(in[1]);
+    return false;
+  }
+
+  std::thread writer([&]() {
+    size_t sent = 0;
+    while (sent < kTotal) {
+      ssize_t res = write(in[0], stream.data(), std::min(stream.size(), kTotal - sent));
+      if (res <= 0) {
+        break;
+      }
+      sent += static_cast<size_t>(res);
+    }
+    shutdown(in[0], SHUT_WR);
+  });
+  std::thread reader([&]() {
+    Bytes sink(65536);
+    while (read(out[1], sink.data(), sink.size()) > 0) {
+    }
+  });
+
+  Bytes buffer(16384);
+  ClassicFramer framer;
+  NullHandler handler;
+  size_t forwarded = 0;
+  ssize_t res;
+  while ((res = read(in[1], buffer.data(), buffer.size())) > 0) {
+    if (framed) {
+      framer.feed(buffer.data(), static_cast<size_t>(res), handler);
+    }
+    size_t written = 0;
+    while (written < static_cast<size_t>(res)) {
+      ssize_t n = write(out[0], buffer.data() + written, static_cast<size_t>(res) - written);
+      if (n <= 0) {
+        break;
+      }
+      written += static_cast<size_t>(n);
+    }
+    forwarded += written;
+  }
+  shutdown(out[0], SHUT_WR);
+
+  writer.join();
+  reader.join();
+  for (int fd : {in[0], in[1], out[0], out[1]}) {
+    close(fd);
+  }
+  return forwarded == kTotal;
+}
+
+}  // namespace
+
+static void BM_Forward(benchmark::State &state, bool framed) {
+  Bytes stream = make_stream(static_cast<size_t>(state.range(0)), static_cast<size_t>(state.range(1)));
+  while (state.KeepRunning()) {
+    if (!forward(stream, framed)) {
+      state.SkipWithError("forwarding failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * kTotal));
+}
+// tiny rows and rows as in most result sets; the writer and reader threads
+// run alongside, so wall time is what counts
+BENCHMARK_CAPTURE(BM_Forward, blind, false)->Args({20, 100})->Args({1000, 8000})->UseRealTime();
+BENCHMARK_CAPTURE(BM_Forward, framed, true)->Args({20, 100})->Args({1000, 8000})->UseRealTime();
+
+BENCHMARK_MAIN();
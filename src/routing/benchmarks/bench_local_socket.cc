@@ -0,0 +1,181 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * Compares connections to a server on the same host over loopback TCP
+ * with connections through its Unix socket, both made by
+ * SocketOperations::get_mysql_socket() like routing does: the cost of
+ * connecting, the latency of a small request and response, and the
+ * throughput of large responses.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mysqlrouter/routing.h"
+
+using mysqlrouter::TCPAddress;
+using routing::SocketOperations;
+
+namespace {
+
+enum class Transport {
+  kTcp,
+  kUnixSocket,
+};
+
+bool read_all(int fd, char *buffer, size_t size) {
+  size_t have = 0;
+  while (have < size) {
+    ssize_t res = read(fd, buffer + have, size - have);
+    if (res <= 0) {
+      return false;
+    }
+    have += static_cast<size_t>(res);
+  }
+  return true;
+}
+
+// a server answering each request, a 4 byte size, with that many bytes,
+// like a query and its result; on 127.0.0.1 and a Unix socket
+class Server {
+ public:
+  Server() : socket_path_("/tmp/bench_routing_local_socket_" + std::to_string(getpid()) + ".sock") {
+    int tcp = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t sin_len = sizeof(sin);
+    if (tcp < 0 || bind(tcp, reinterpret_cast<struct sockaddr *>(&sin), sizeof(sin)) < 0 ||
+        listen(tcp, 128) < 0 ||
+        getsockname(tcp, reinterpret_cast<struct sockaddr *>(&sin), &sin_len) < 0) {
+      throw std::runtime_error("listening on 127.0.0.1 failed");
+    }
+    port_ = ntohs(sin.sin_port);
+
+    int local = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strncpy(sun.sun_path, socket_path_.c_str(), sizeof(sun.sun_path) - 1);
+    unlink(socket_path_.c_str());
+    if (local < 0 || bind(local, reinterpret_cast<struct sockaddr *>(&sun), sizeof(sun)) < 0 ||
+        listen(local, 128) < 0) {
+      throw std::runtime_error("listening on " + socket_path_ + " failed");
+    }
+
+    std::thread(&Server::accept_loop, tcp).detach();
+    std::thread(&Server::accept_loop, local).detach();
+  }
+
+  ~Server() {
+    unlink(socket_path_.c_str());
+  }
+
+  TCPAddress get_address(Transport transport) const {
+    return transport == Transport::kTcp ? TCPAddress("127.0.0.1", port_) : TCPAddress(socket_path_, 0);
+  }
+
+ private:
+  static void accept_loop(int listener) {
+    while (true) {
+      int fd = accept(listener, nullptr, nullptr);
+      if (fd >= 0) {
+        std::thread(&Server::answer, fd).detach();
+      }
+    }
+  }
+
+  static void answer(int fd) {
+    std::vector<char> response;
+    uint32_t size;
+    while (read_all(fd, reinterpret_cast<char *>(&size), sizeof(size))) {
+      response.resize(size, 'x');
+      if (SocketOperations::instance()->write_all(fd, response.data(), size) < 0) {
+        break;
+      }
+    }
+    close(fd);
+  }
+
+  const std::string socket_path_;
+  uint16_t port_;
+};
+
+Server &get_server() {
+  static Server server;
+  return server;
+}
+
+int connect_server(Transport transport) {
+  int fd = SocketOperations::instance()->get_mysql_socket(get_server().get_address(transport),
+                                                          std::chrono::seconds(1));
+  if (fd < 0) {
+    throw std::runtime_error("connecting to the server failed");
+  }
+  return fd;
+}
+
+}  // namespace
+
+// connecting and the first packet, like the greeting of the server
+static void BM_Connect(benchmark::State &state, Transport transport) {
+  uint32_t size = 78;
+  std::vector<char> greeting(size);
+  while (state.KeepRunning()) {
+    int fd = connect_server(transport);
+    if (SocketOperations::instance()->write_all(fd, &size, sizeof(size)) < 0 ||
+        !read_all(fd, greeting.data(), size)) {
+      state.SkipWithError("server closed the connection");
+    }
+    SocketOperations::instance()->close(fd);
+  }
+}
+BENCHMARK_CAPTURE(BM_Connect, tcp, Transport::kTcp);
+BENCHMARK_CAPTURE(BM_Connect, unix_socket, Transport::kUnixSocket);
+
+// a request and a response of the given size
+static void BM_RoundTrip(benchmark::State &state, Transport transport) {
+  int fd = connect_server(transport);
+  auto size = static_cast<uint32_t>(state.range(0));
+  std::vector<char> response(size);
+  while (state.KeepRunning()) {
+    if (SocketOperations::instance()->write_all(fd, &size, sizeof(size)) < 0 ||
+        !read_all(fd, response.data(), size)) {
+      state.SkipWithError("server closed the connection");
+      break;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * size);
+  SocketOperations::instance()->close(fd);
+}
+// an OK packet, net_buffer_length and a large result set
+BENCHMARK_CAPTURE(BM_RoundTrip, tcp, Transport::kTcp)->Arg(11)->Arg(16384)->Arg(1 << 20);
+BENCHMARK_CAPTURE(BM_RoundTrip, unix_socket, Transport::kUnixSocket)->Arg(11)->Arg(16384)->Arg(1 << 20);
+
+BENCHMARK_MAIN();
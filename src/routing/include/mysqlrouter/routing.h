@@ -21,6 +21,8 @@
 #include "mysqlrouter/datatypes.h"
 #include "mysqlrouter/plugin_config.h"
 
+#include <chrono>
+#include <cstdint>
 #include <map>
 #include <string>
 
@@ -28,6 +30,8 @@
 typedef long ssize_t;
 #endif
 
+struct pollfd;
+
 namespace routing {
 
 /** @brief Timeout for idling clients (in seconds)
@@ -40,11 +44,19 @@ extern const int kDefaultWaitTimeout;
 /** @brief Max number of active routes for this routing instance */
 extern const int kDefaultMaxConnections;
 
-/** @brief Timeout connecting to destination (in seconds)
+/** @brief Highest value accepted for max_connections
+ *
+ * Each route needs two file descriptors per connection; the actual limit
+ * is usually given by the open files limit of the process (see
+ * raise_open_files_limit()).
+ */
+extern const int kMaxConnectionsLimit;
+
+/** @brief Timeout connecting to destination
  *
  * Constant defining how long we wait to establish connection with the server before we give up.
  */
-extern const int kDefaultDestinationConnectionTimeout;
+extern const std::chrono::milliseconds kDefaultDestinationConnectionTimeout;
 
 /** @brief Maximum connect or handshake errors per host
  *
@@ -79,11 +91,212 @@ extern const unsigned int kDefaultNetBufferLength;
 
 /** @brief Timeout waiting for handshake response from client
  *
- * The number of seconds that MySQL Router waits for a handshake response.
+ * How long MySQL Router waits for a handshake response.
  * The default value is 9 seconds (default MySQL Server minus 1).
  *
  */
-extern const unsigned int kDefaultClientConnectTimeout;
+extern const std::chrono::milliseconds kDefaultClientConnectTimeout;
+
+/** @brief Slow-start period of destinations
+ *
+ * Destinations coming back from quarantine, or rejoining the replicaset,
+ * get a reduced share of new connections during this period. The
+ * default 0 disables slow-start.
+ */
+extern const std::chrono::milliseconds kDefaultSlowStartPeriod;
+
+/** @brief Maximum connections to a single destination
+ *
+ * The default 0 means no limit besides max_connections.
+ */
+extern const unsigned int kDefaultMaxConnectionsPerDestination;
+
+/** @brief Number of clients which can wait for a connection slot
+ *
+ * Clients exceeding max_connections or max_connections_per_destination
+ * wait in a queue of this length. The default 0 rejects them right away.
+ */
+extern const unsigned int kDefaultConnectionQueueLength;
+
+/** @brief How long clients wait for a connection slot */
+extern const std::chrono::milliseconds kDefaultConnectionQueueTimeout;
+
+/** @brief Time given to connections to servers which left the replicaset
+ *
+ * Connections to servers which left the replicaset, or became unavailable,
+ * are closed once this period passed. The default 0 closes them right away.
+ */
+extern const std::chrono::milliseconds kDefaultDrainGracePeriod;
+
+/** @brief Length of the queue of clients not accepted yet */
+extern const int kDefaultListenBacklog;
+
+/** @brief How long connections may idle
+ *
+ * The client idle timeout closes connections on which the server answered
+ * everything and the client sent nothing since; the server idle timeout
+ * closes connections on which the server did not answer the client in
+ * time. The default 0 disables them.
+ */
+extern const std::chrono::milliseconds kDefaultClientIdleTimeout;
+extern const std::chrono::milliseconds kDefaultServerIdleTimeout;
+
+/** @brief Keepalive of connections to destinations
+ *
+ * A destination which vanished without closing its connections is noticed
+ * after the idle time plus count times the interval.
+ */
+extern const std::chrono::milliseconds kDefaultServerKeepaliveIdle;
+extern const std::chrono::milliseconds kDefaultServerKeepaliveInterval;
+extern const int kDefaultServerKeepaliveCount;
+
+/** @brief How long data sent to destinations may stay unacknowledged */
+extern const std::chrono::milliseconds kDefaultServerUserTimeout;
+
+/** @brief Options of connected TCP sockets
+ *
+ * Zero leaves the operating system default.
+ */
+struct SocketOptions {
+  SocketOptions() : keepalive_idle(0), keepalive_interval(0), keepalive_count(0), user_timeout(0),
+                    send_buffer(0), receive_buffer(0) {}
+
+  /** @brief Idle time before keepalive probes are sent; 0 disables keepalive */
+  std::chrono::milliseconds keepalive_idle;
+  /** @brief Time between keepalive probes */
+  std::chrono::milliseconds keepalive_interval;
+  /** @brief Number of unanswered keepalive probes before the connection is dropped */
+  int keepalive_count;
+  /** @brief How long sent data may stay unacknowledged before the connection is dropped */
+  std::chrono::milliseconds user_timeout;
+  /** @brief Size of the send buffer (SO_SNDBUF) */
+  int send_buffer;
+  /** @brief Size of the receive buffer (SO_RCVBUF) */
+  int receive_buffer;
+
+  /** @brief Returns whether all options are left to the operating system */
+  bool is_default() const noexcept {
+    return keepalive_idle.count() == 0 && user_timeout.count() == 0 &&
+           send_buffer == 0 && receive_buffer == 0;
+  }
+};
+
+/** @brief Options of listening TCP sockets */
+struct ListenOptions {
+  ListenOptions() : backlog(kDefaultListenBacklog), defer_accept(0), fastopen(0) {}
+
+  /** @brief Length of the queue of clients not accepted yet */
+  int backlog;
+  /** @brief Accept clients only once they sent data, or after this time (TCP_DEFER_ACCEPT); 0 disables */
+  std::chrono::milliseconds defer_accept;
+  /** @brief Length of the queue of TCP Fast Open requests; 0 disables TCP Fast Open */
+  int fastopen;
+};
+
+/** @brief Load bound of destinations with affinity
+ *
+ * In percent of the even share of connections; a destination carrying
+ * more is skipped for the next one on the hash ring.
+ */
+extern const unsigned int kDefaultAffinityMaxLoad;
+
+/** @brief What keeps clients on the same destination */
+enum class AffinityKey {
+  kNone,
+  kClientAddress,
+  kUser,
+  kSchema,
+  kConnectAttribute,
+};
+
+/** @brief Affinity of clients to destinations */
+struct AffinityOptions {
+  AffinityOptions() : key(AffinityKey::kNone), max_load(kDefaultAffinityMaxLoad) {}
+
+  /** @brief What keeps clients on the same destination */
+  AffinityKey key;
+  /** @brief Name of the connection attribute, with AffinityKey::kConnectAttribute */
+  std::string connect_attribute;
+  /** @brief Load bound of destinations in percent of the even share */
+  unsigned int max_load;
+
+  /** @brief Returns whether the key is only known from the handshake response */
+  bool needs_handshake() const noexcept {
+    return key == AffinityKey::kUser || key == AffinityKey::kSchema ||
+           key == AffinityKey::kConnectAttribute;
+  }
+};
+
+/** @brief Parses an affinity key
+ *
+ * Valid are client_address, user, schema and connect_attribute:<name>,
+ * like connect_attribute:program_name. An empty value means no affinity.
+ *
+ * @param value value to parse
+ * @param options key and connect_attribute are set
+ * @throws std::invalid_argument when the value is invalid
+ */
+void parse_affinity_key(const std::string &value, AffinityOptions *options);
+
+/** @brief Part of the thresholds below which spilling secondaries recover
+ *
+ * In percent; keeps routes from flapping between the secondaries and the
+ * primary while the load hovers around a threshold.
+ */
+extern const unsigned int kSpilloverRecoveryPercent;
+
+/** @brief Spillover of read-only connections to the primary
+ *
+ * Used by read-only metadata-cache routes with allow_primary_reads=spillover.
+ * A threshold of 0 does not saturate secondaries.
+ */
+struct SpilloverOptions {
+  SpilloverOptions() : connections(0), latency(0), max_connections(0) {}
+
+  /** @brief Open connections of the route at which a secondary is saturated */
+  unsigned int connections;
+  /** @brief Recent average time to first byte at which a secondary is saturated */
+  std::chrono::milliseconds latency;
+  /** @brief Spilled connections open on the primary at most; 0 for no limit */
+  unsigned int max_connections;
+
+  /** @brief Returns whether any option is set */
+  bool is_set() const noexcept {
+    return connections > 0 || latency.count() > 0 || max_connections > 0;
+  }
+};
+
+/** @brief Sessions kept for resumption by TLS-terminating routes */
+extern const unsigned int kDefaultTlsSessionCacheSize;
+
+/** @brief How long TLS sessions can be resumed */
+extern const std::chrono::milliseconds kDefaultTlsSessionTimeout;
+
+/** @brief TLS terminated by the router */
+struct TlsOptions {
+  TlsOptions()
+      : enabled(false), session_cache_size(kDefaultTlsSessionCacheSize),
+        session_timeout(kDefaultTlsSessionTimeout), server_tls(false) {}
+
+  /** @brief Whether clients asking for TLS do it with the router */
+  bool enabled;
+  /** @brief PEM file with the certificate shown to clients, and its chain */
+  std::string cert;
+  /** @brief PEM file with the private key of cert */
+  std::string key;
+  /** @brief Sessions kept for resumption, shared by all clients of the route */
+  unsigned int session_cache_size;
+  /** @brief How long sessions can be resumed */
+  std::chrono::milliseconds session_timeout;
+  /** @brief Whether connections to destinations use TLS too
+   *
+   * Plaintext otherwise, which only works for destinations connected through a
+   * Unix socket, either given as one or through local_sockets.
+   */
+  bool server_tls;
+  /** @brief PEM file with the CAs destinations are verified with; empty to not verify */
+  std::string server_ca;
+};
 
 /** @brief Modes supported by Routing plugin */
 enum class AccessMode {
@@ -113,6 +326,83 @@ std::string get_access_mode_name(AccessMode access_mode) noexcept;
  */
 void set_socket_blocking(int sock, bool blocking);
 
+/** @brief Waits for events on sockets
+ *
+ * Wrapper around poll() (WSAPoll() on Windows). Unlike select(), it
+ * handles socket descriptors of any value, not only those below
+ * FD_SETSIZE.
+ *
+ * @param fds sockets and events to wait for
+ * @param nfds number of elements in fds
+ * @param timeout how long to wait; negative waits without timeout
+ * @return number of sockets with events, 0 on timeout, -1 on error
+ */
+int poll_sockets(struct pollfd *fds, size_t nfds, std::chrono::milliseconds timeout);
+
+/** @brief Raises the limit of open files of the process, if needed
+ *
+ * Raises the soft limit of RLIMIT_NOFILE up to `wanted`, but not above
+ * the hard limit. What was done, or why it could not be done, is logged.
+ * Does nothing on Windows.
+ *
+ * @param wanted number of file descriptors needed
+ * @return soft limit in effect after the call
+ */
+uint64_t raise_open_files_limit(uint64_t wanted);
+
+/** @brief Sets options on a connected TCP socket
+ *
+ * Options the platform does not know are left out, like TCP_USER_TIMEOUT
+ * outside Linux. Times are rounded up to whole seconds, except the user
+ * timeout. Unix sockets are left as they are.
+ *
+ * @param sock a socket file descriptor
+ * @param options options to set
+ * @return false when an option could not be set (errno tells why)
+ */
+bool set_socket_options(int sock, const SocketOptions &options) noexcept;
+
+/** @brief Sets options on a TCP socket before it listens
+ *
+ * TCP_DEFER_ACCEPT is only known to Linux, TCP Fast Open to Linux and
+ * macOS; elsewhere they are left out. The backlog is used by listen().
+ *
+ * @param sock a socket file descriptor
+ * @param options options to set
+ * @return false when an option could not be set (errno tells why)
+ */
+bool set_listen_options(int sock, const ListenOptions &options) noexcept;
+
+/** @brief Returns whether a destination is a Unix socket
+ *
+ * Unix sockets are given by absolute path; the path is kept in
+ * TCPAddress::addr with port 0. Always false on Windows.
+ *
+ * @param addr destination
+ */
+bool is_local_socket(const mysqlrouter::TCPAddress &addr) noexcept;
+
+/** @brief Returns whether a host name or IP address is this host
+ *
+ * The host is resolved and its addresses compared with loopback addresses
+ * and those of the network interfaces. Resolving blocks; results are
+ * meant to be kept. Always false on Windows.
+ *
+ * @param host host name or IP address
+ */
+bool is_local_host(const std::string &host);
+
+/** @brief Parses Unix sockets of servers on this host by TCP port
+ *
+ * The value is a comma separated list of port:path, like
+ * `3306:/var/run/mysqld/mysqld.sock`.
+ *
+ * @param value list to parse
+ * @return paths by port
+ * @throws std::invalid_argument when the list is invalid
+ */
+std::map<uint16_t, std::string> parse_local_sockets(const std::string &value);
+
 /** @class SocketOperationsBase
  * @brief Base class to allow multiple SocketOperations implementations
  *        (at least one "real" and one mock for testing purposes)
@@ -120,11 +410,13 @@ void set_socket_blocking(int sock, bool blocking);
 class SocketOperationsBase {
  public:
   virtual ~SocketOperationsBase() = default;
-  virtual int get_mysql_socket(mysqlrouter::TCPAddress addr, int connect_timeout, bool log = true) noexcept = 0;
+  virtual int get_mysql_socket(mysqlrouter::TCPAddress addr, std::chrono::milliseconds connect_timeout,
+                               bool log = true) noexcept = 0;
   virtual ssize_t write(int  fd, void *buffer, size_t nbyte) = 0;
   virtual ssize_t read(int fd, void *buffer, size_t nbyte) = 0;
   virtual void close(int fd) = 0;
   virtual void shutdown(int fd) = 0;
+  virtual void shutdown_read(int fd) = 0;
 
   /** @brief Wrapper around socket library write() with a looping logic
    *         making sure the whole buffer got written
@@ -153,14 +445,16 @@ class SocketOperations : public SocketOperationsBase {
   /** @brief Returns socket descriptor of connected MySQL server
    *
    * Returns a socket descriptor for the connection to the MySQL Server or
-   * -1 when an error occurred.
+   * -1 when an error occurred. Destinations for which is_local_socket()
+   * is true are connected through their Unix socket.
    *
    * @param addr information of the server we connect with
-   * @param connect_timeout number of seconds waiting for connection
+   * @param connect_timeout how long to wait for the connection
    * @param log whether to log errors or not
    * @return a socket descriptor
    */
-  int get_mysql_socket(mysqlrouter::TCPAddress addr, int connect_timeout, bool log = true) noexcept override;
+  int get_mysql_socket(mysqlrouter::TCPAddress addr, std::chrono::milliseconds connect_timeout,
+                       bool log = true) noexcept override;
 
   /** @brief Thin wrapper around socket library write() */
   ssize_t write(int fd, void *buffer, size_t nbyte) override;
@@ -173,6 +467,9 @@ class SocketOperations : public SocketOperationsBase {
 
   /** @brief Thin wrapper around socket library shutdown() */
   void shutdown(int fd)  override;
+
+  /** @brief Shuts down the receiving side only; pending reads see end of file */
+  void shutdown_read(int fd)  override;
  private:
   SocketOperations(const SocketOperations&) = delete;
   SocketOperations operator=(const SocketOperations&) = delete;
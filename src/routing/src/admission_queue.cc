@@ -0,0 +1,107 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "admission_queue.h"
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+constexpr size_t WaitHistogram::kBuckets;
+
+const std::array<milliseconds, WaitHistogram::kBuckets - 1> WaitHistogram::kBucketBounds{{
+    milliseconds(1), milliseconds(5), milliseconds(10), milliseconds(50),
+    milliseconds(100), milliseconds(500), milliseconds(1000), milliseconds(5000),
+}};
+
+void WaitHistogram::add(milliseconds wait) noexcept {
+  size_t bucket = 0;
+  while (bucket < kBucketBounds.size() && wait > kBucketBounds[bucket]) {
+    ++bucket;
+  }
+  counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+WaitHistogram::Counts WaitHistogram::get_counts() const noexcept {
+  Counts result;
+  for (size_t i = 0; i < kBuckets; ++i) {
+    result[i] = counts_[i].load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+void AdmissionQueue::configure(size_t max_length, milliseconds timeout) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_length_ = max_length;
+  timeout_ = timeout;
+}
+
+AdmissionQueue::Result AdmissionQueue::acquire(const std::function<bool()> &try_take) {
+  if (try_take()) {
+    return Result::kAdmitted;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (waiting_ >= max_length_) {
+    ++rejected_;
+    return Result::kQueueFull;
+  }
+  size_t depth = ++waiting_;
+  if (depth > max_waiting_) {
+    max_waiting_ = depth;
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  auto deadline = started + timeout_;
+  Result result = Result::kTimedOut;
+  while (true) {
+    // remember which notify() we saw last before trying, so that a slot
+    // given back while we try is not missed
+    uint64_t seen = generation_;
+    lock.unlock();
+    bool taken = try_take();
+    lock.lock();
+    if (taken) {
+      result = Result::kAdmitted;
+      break;
+    }
+    if (!condvar_.wait_until(lock, deadline, [this, seen] { return generation_ != seen; })) {
+      break;
+    }
+  }
+  --waiting_;
+  lock.unlock();
+
+  wait_histogram_.add(duration_cast<milliseconds>(std::chrono::steady_clock::now() - started));
+  if (result == Result::kAdmitted) {
+    ++admitted_after_wait_;
+  } else {
+    ++timed_out_;
+  }
+  return result;
+}
+
+void AdmissionQueue::notify() {
+  if (max_length_.load(std::memory_order_relaxed) == 0) {
+    return;  // nobody is allowed to wait
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++generation_;
+  }
+  // all waiters try again; those which do not get the slot go back to wait
+  condvar_.notify_all();
+}
@@ -0,0 +1,165 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_ADMISSION_QUEUE_INCLUDED
+#define ROUTING_ADMISSION_QUEUE_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+/** @class WaitHistogram
+ * @brief Histogram of how long clients waited in an admission queue
+ *
+ * Buckets have fixed upper bounds (see kBucketBounds); the last bucket
+ * counts everything above the largest bound. Adding a sample is lock-free.
+ */
+class WaitHistogram {
+ public:
+  static constexpr size_t kBuckets = 9;
+  using Counts = std::array<uint64_t, kBuckets>;
+
+  /** @brief Upper bounds of all buckets but the last one */
+  static const std::array<std::chrono::milliseconds, kBuckets - 1> kBucketBounds;
+
+  WaitHistogram() {
+    for (auto &count : counts_) {
+      count = 0;
+    }
+  }
+
+  /** @brief Adds a sample */
+  void add(std::chrono::milliseconds wait) noexcept;
+
+  /** @brief Returns the number of samples in each bucket */
+  Counts get_counts() const noexcept;
+
+ private:
+  std::array<std::atomic<uint64_t>, kBuckets> counts_;
+};
+
+/** @class AdmissionQueue
+ * @brief Lets clients wait for a free slot instead of failing right away
+ *
+ * What a slot is, is left to the caller: acquire() calls the given
+ * function, which returns true when it could take a slot. When it
+ * could not, the client waits until notify() signals that a slot was
+ * given back, and tries again. At most `max_length` clients wait at the
+ * same time and each of them waits at most `timeout`.
+ *
+ * With a queue length of 0 (the default), acquire() fails as soon as no
+ * slot is available.
+ */
+class AdmissionQueue {
+ public:
+  /** @brief Outcome of acquire() */
+  enum class Result {
+    kAdmitted,
+    kQueueFull,
+    kTimedOut,
+  };
+
+  /** @brief Constructor
+   *
+   * @param max_length maximum number of waiting clients; 0 disables waiting
+   * @param timeout how long a client waits at most
+   */
+  explicit AdmissionQueue(size_t max_length = 0,
+                          std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+      : max_length_(max_length), timeout_(timeout), generation_(0), waiting_(0),
+        max_waiting_(0), admitted_after_wait_(0), rejected_(0), timed_out_(0) {}
+
+  AdmissionQueue(const AdmissionQueue &) = delete;
+  AdmissionQueue &operator=(const AdmissionQueue &) = delete;
+
+  /** @brief Changes queue length and timeout
+   *
+   * @param max_length maximum number of waiting clients; 0 disables waiting
+   * @param timeout how long a client waits at most
+   */
+  void configure(size_t max_length, std::chrono::milliseconds timeout);
+
+  /** @brief Takes a slot, waiting for one if needed
+   *
+   * The function try_take is called without holding any lock of the
+   * queue; it might be called several times.
+   *
+   * @param try_take function returning true when it took a slot
+   * @return kAdmitted when a slot was taken
+   */
+  Result acquire(const std::function<bool()> &try_take);
+
+  /** @brief Signals waiting clients that a slot was given back */
+  void notify();
+
+  /** @brief Returns whether another client could wait for a slot */
+  bool has_room() const noexcept {
+    return waiting_.load(std::memory_order_relaxed) < max_length_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Returns number of clients currently waiting */
+  size_t waiting() const noexcept {
+    return waiting_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Returns the highest number of clients waiting at the same time */
+  size_t max_waiting() const noexcept {
+    return max_waiting_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Returns number of clients which got a slot after waiting */
+  uint64_t admitted_after_wait() const noexcept {
+    return admitted_after_wait_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Returns number of clients rejected because the queue was full */
+  uint64_t rejected() const noexcept {
+    return rejected_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Returns number of clients which waited in vain */
+  uint64_t timed_out() const noexcept {
+    return timed_out_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Returns how long clients waited */
+  const WaitHistogram &wait_histogram() const noexcept {
+    return wait_histogram_;
+  }
+
+ private:
+  std::atomic<size_t> max_length_;
+  std::chrono::milliseconds timeout_;
+
+  std::mutex mutex_;
+  std::condition_variable condvar_;
+  /** @brief Incremented by notify(); lets waiters detect missed signals */
+  uint64_t generation_;
+
+  std::atomic<size_t> waiting_;
+  std::atomic<size_t> max_waiting_;
+  std::atomic<uint64_t> admitted_after_wait_;
+  std::atomic<uint64_t> rejected_;
+  std::atomic<uint64_t> timed_out_;
+  WaitHistogram wait_histogram_;
+};
+
+#endif // ROUTING_ADMISSION_QUEUE_INCLUDED
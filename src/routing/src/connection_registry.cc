@@ -0,0 +1,123 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "connection_registry.h"
+#include "mysqlrouter/routing.h"
+
+#include <algorithm>
+
+ConnectionRegistry::Connection::Connection(int client, int server,
+                                           const std::string &client_address,
+                                           const std::string &destination)
+    : client_(client), server_(server), client_address_(client_address),
+      destination_(destination), started_(clock::now()), handshake_done_(false),
+      bytes_server_to_client_(0), bytes_client_to_server_(0),
+      last_client_activity_(started_.time_since_epoch().count()),
+      last_server_activity_(started_.time_since_epoch().count()),
+      close_reason_(static_cast<int>(CloseReason::kNone)) {}
+
+std::shared_ptr<ConnectionRegistry::Connection> ConnectionRegistry::add(
+    int client, int server, const std::string &client_address, const std::string &destination) {
+  std::shared_ptr<Connection> connection(
+      new Connection(client, server, client_address, destination));
+  std::lock_guard<std::mutex> lock(mutex_);
+  connections_.emplace(connection.get(), connection);
+  return connection;
+}
+
+void ConnectionRegistry::remove(const std::shared_ptr<Connection> &connection) noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  connections_.erase(connection.get());
+}
+
+std::vector<ConnectionRegistry::ConnectionInfo> ConnectionRegistry::get_connections() const {
+  std::vector<ConnectionInfo> result;
+  std::lock_guard<std::mutex> lock(mutex_);
+  result.reserve(connections_.size());
+  for (auto &it : connections_) {
+    const Connection &connection = *it.second;
+    auto last_client = connection.last_client_activity_.load(std::memory_order_relaxed);
+    auto last_server = connection.last_server_activity_.load(std::memory_order_relaxed);
+    result.push_back({
+        connection.client_address_,
+        connection.destination_,
+        connection.started_,
+        connection.handshake_done_.load(std::memory_order_relaxed),
+        connection.bytes_server_to_client_.load(std::memory_order_relaxed),
+        connection.bytes_client_to_server_.load(std::memory_order_relaxed),
+        clock::time_point(clock::duration(std::max(last_client, last_server))),
+    });
+  }
+  return result;
+}
+
+size_t ConnectionRegistry::size() const noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return connections_.size();
+}
+
+size_t ConnectionRegistry::close_connections_to(const std::string &destination) noexcept {
+  size_t closed = 0;
+  // the lock keeps routing threads from closing the sockets meanwhile
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &it : connections_) {
+    Connection &connection = *it.second;
+    if (connection.destination_ != destination || !connection.close(CloseReason::kDrained)) {
+      continue;
+    }
+    socket_operations_->shutdown(connection.client_);
+    socket_operations_->shutdown(connection.server_);
+    ++closed;
+  }
+  return closed;
+}
+
+size_t ConnectionRegistry::close_idle_connections(clock::time_point now,
+                                                  std::chrono::milliseconds client_idle_timeout,
+                                                  std::chrono::milliseconds server_idle_timeout) noexcept {
+  if (client_idle_timeout.count() == 0 && server_idle_timeout.count() == 0) {
+    return 0;
+  }
+  size_t closed = 0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &it : connections_) {
+    Connection &connection = *it.second;
+    if (!connection.handshake_done_.load(std::memory_order_relaxed)) {
+      continue;  // client_connect_timeout applies
+    }
+    clock::time_point last_client(clock::duration(
+        connection.last_client_activity_.load(std::memory_order_relaxed)));
+    clock::time_point last_server(clock::duration(
+        connection.last_server_activity_.load(std::memory_order_relaxed)));
+
+    CloseReason reason = CloseReason::kNone;
+    if (last_client > last_server) {
+      // waiting for the server
+      if (server_idle_timeout.count() > 0 && now - last_client >= server_idle_timeout) {
+        reason = CloseReason::kServerIdle;
+      }
+    } else if (client_idle_timeout.count() > 0 && now - last_server >= client_idle_timeout) {
+      reason = CloseReason::kClientIdle;
+    }
+    if (reason == CloseReason::kNone || !connection.close(reason)) {
+      continue;
+    }
+    socket_operations_->shutdown_read(connection.client_);
+    ++closed;
+  }
+  return closed;
+}
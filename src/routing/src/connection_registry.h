@@ -0,0 +1,194 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_CONNECTION_REGISTRY_INCLUDED
+#define ROUTING_CONNECTION_REGISTRY_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace routing {
+class SocketOperationsBase;
+}
+
+/** @class ConnectionRegistry
+ * @brief Keeps track of the connections routed by a route
+ *
+ * Each routing thread registers its connection with add() and updates
+ * the returned Connection while copying packets; the updates are relaxed
+ * atomic operations and do not take any lock. The registry lock is only
+ * taken to add, remove and enumerate connections.
+ *
+ * Connections are closed by shutting down their sockets: the routing
+ * thread sees the shutdown, stops copying and removes the connection.
+ * As the routing thread removes its connection before closing the
+ * sockets, the registry never shuts down a reused descriptor.
+ *
+ * Idle connections are found by close_idle_connections(), which a single
+ * thread calls now and then for all connections, instead of each routing
+ * thread keeping its own deadline.
+ */
+class ConnectionRegistry {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  /** @brief Why a connection was closed through the registry */
+  enum class CloseReason {
+    kNone,
+    /** @brief its destination is drained */
+    kDrained,
+    /** @brief the client sent nothing for too long */
+    kClientIdle,
+    /** @brief the server did not answer the client for too long */
+    kServerIdle,
+  };
+
+  /** @brief A registered connection, updated by its routing thread */
+  class Connection {
+   public:
+    Connection(int client, int server, const std::string &client_address,
+               const std::string &destination);
+
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+
+    /** @brief Called when the handshake finished */
+    void handshake_done() noexcept {
+      handshake_done_.store(true, std::memory_order_relaxed);
+    }
+
+    /** @brief Called when data from the server was forwarded to the client */
+    void add_bytes_server_to_client(size_t bytes, clock::time_point now) noexcept {
+      bytes_server_to_client_.fetch_add(bytes, std::memory_order_relaxed);
+      last_server_activity_.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    /** @brief Called when data from the client was forwarded to the server */
+    void add_bytes_client_to_server(size_t bytes, clock::time_point now) noexcept {
+      bytes_client_to_server_.fetch_add(bytes, std::memory_order_relaxed);
+      last_client_activity_.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    /** @brief Returns why the connection was closed through the registry */
+    CloseReason get_close_reason() const noexcept {
+      return static_cast<CloseReason>(close_reason_.load(std::memory_order_relaxed));
+    }
+
+   private:
+    /** @brief Sets the reason; false if the connection was closed already */
+    bool close(CloseReason reason) noexcept {
+      int expected = static_cast<int>(CloseReason::kNone);
+      return close_reason_.compare_exchange_strong(expected, static_cast<int>(reason),
+                                                   std::memory_order_relaxed);
+    }
+
+    friend class ConnectionRegistry;
+
+    const int client_;
+    const int server_;
+    const std::string client_address_;
+    const std::string destination_;
+    const clock::time_point started_;
+    std::atomic<bool> handshake_done_;
+    std::atomic<uint64_t> bytes_server_to_client_;
+    std::atomic<uint64_t> bytes_client_to_server_;
+    std::atomic<clock::rep> last_client_activity_;
+    std::atomic<clock::rep> last_server_activity_;
+    std::atomic<int> close_reason_;
+  };
+
+  /** @brief State of a connection, as returned by get_connections() */
+  struct ConnectionInfo {
+    std::string client_address;
+    std::string destination;
+    clock::time_point started;
+    bool handshake_done;
+    uint64_t bytes_server_to_client;
+    uint64_t bytes_client_to_server;
+    clock::time_point last_activity;
+  };
+
+  /** @brief Constructor
+   *
+   * @param socket_operations used to shut down sockets of closed connections
+   */
+  explicit ConnectionRegistry(routing::SocketOperationsBase *socket_operations)
+      : socket_operations_(socket_operations) {}
+
+  /** @brief Registers a connection
+   *
+   * @param client socket of the client
+   * @param server socket of the destination
+   * @param client_address address of the client, for display
+   * @param destination address of the destination, as in its metrics
+   * @return the connection, to be given to remove() when it ends
+   */
+  std::shared_ptr<Connection> add(int client, int server, const std::string &client_address,
+                                  const std::string &destination);
+
+  /** @brief Unregisters a connection; call before closing its sockets */
+  void remove(const std::shared_ptr<Connection> &connection) noexcept;
+
+  /** @brief Returns the state of all registered connections */
+  std::vector<ConnectionInfo> get_connections() const;
+
+  /** @brief Returns the number of registered connections */
+  size_t size() const noexcept;
+
+  /** @brief Closes all connections to a destination
+   *
+   * Shuts down the sockets of the connections; they are removed from the
+   * registry once their routing threads noticed.
+   *
+   * @param destination address of the destination
+   * @return number of connections closed
+   */
+  size_t close_connections_to(const std::string &destination) noexcept;
+
+  /** @brief Closes connections which idled for too long
+   *
+   * Only connections which finished the handshake are considered. A
+   * connection is idle on the client side when the server answered last,
+   * and on the server side when the client sent data the server did not
+   * answer yet.
+   *
+   * Only the receiving side of the client socket is shut down: the
+   * routing thread stops copying, but can still tell the client and the
+   * server why the connection ends.
+   *
+   * @param now current time
+   * @param client_idle_timeout how long clients may idle; 0 disables
+   * @param server_idle_timeout how long servers may take to answer; 0 disables
+   * @return number of connections closed
+   */
+  size_t close_idle_connections(clock::time_point now,
+                                std::chrono::milliseconds client_idle_timeout,
+                                std::chrono::milliseconds server_idle_timeout) noexcept;
+
+ private:
+  routing::SocketOperationsBase *socket_operations_;
+  mutable std::mutex mutex_;
+  std::map<const Connection *, std::shared_ptr<Connection>> connections_;
+};
+
+#endif // ROUTING_CONNECTION_REGISTRY_INCLUDED
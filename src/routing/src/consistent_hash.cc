@@ -0,0 +1,102 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "consistent_hash.h"
+
+#include <algorithm>
+
+const size_t ConsistentHashRing::kDefaultPointsPerMember = 160;
+
+bool ConsistentHashRing::set_members(const std::vector<std::string> &members) {
+  if (members == members_) {
+    return false;
+  }
+  members_ = members;
+  points_.clear();
+  points_.reserve(members_.size() * points_per_member_);
+  for (size_t i = 0; i < members_.size(); ++i) {
+    for (size_t point = 0; point < points_per_member_; ++point) {
+      points_.emplace_back(hash(members_[i] + "#" + std::to_string(point)), i);
+    }
+  }
+  // ties broken by name, not by the order of members
+  std::sort(points_.begin(), points_.end(),
+            [this](const std::pair<uint32_t, size_t> &a, const std::pair<uint32_t, size_t> &b) {
+              if (a.first != b.first) {
+                return a.first < b.first;
+              }
+              return members_[a.second] < members_[b.second];
+            });
+  return true;
+}
+
+size_t ConsistentHashRing::find_point(uint32_t key_hash) const noexcept {
+  auto it = std::lower_bound(points_.begin(), points_.end(), key_hash,
+                             [](const std::pair<uint32_t, size_t> &point, uint32_t value) {
+                               return point.first < value;
+                             });
+  return it == points_.end() ? 0 : static_cast<size_t>(it - points_.begin());
+}
+
+void ConsistentHashRing::get_preference(const std::string &key, std::vector<size_t> *order) const {
+  order->clear();
+  if (points_.empty()) {
+    return;
+  }
+  std::vector<bool> seen(members_.size(), false);
+  size_t start = find_point(hash(key));
+  for (size_t i = 0; i < points_.size() && order->size() < members_.size(); ++i) {
+    size_t member = points_[(start + i) % points_.size()].second;
+    if (!seen[member]) {
+      seen[member] = true;
+      order->push_back(member);
+    }
+  }
+}
+
+size_t ConsistentHashRing::get_owner(const std::string &key) const noexcept {
+  if (points_.empty()) {
+    return 0;
+  }
+  return points_[find_point(hash(key))].second;
+}
+
+uint32_t ConsistentHashRing::hash(const std::string &key) noexcept {
+  uint32_t result = 2166136261u;
+  for (unsigned char c : key) {
+    result ^= c;
+    result *= 16777619u;
+  }
+  result ^= result >> 16;
+  result *= 0x85ebca6bu;
+  result ^= result >> 13;
+  result *= 0xc2b2ae35u;
+  result ^= result >> 16;
+  return result;
+}
+
+size_t ConsistentHashRing::get_load_bound(size_t total_load, size_t members,
+                                          unsigned int max_load) noexcept {
+  if (members == 0) {
+    return 0;
+  }
+  max_load = std::max(max_load, 100u);
+  // ceil(max_load / 100 * (total_load + 1) / members)
+  uint64_t scaled = static_cast<uint64_t>(max_load) * (total_load + 1);
+  uint64_t share = 100u * members;
+  return static_cast<size_t>((scaled + share - 1) / share);
+}
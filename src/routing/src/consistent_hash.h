@@ -0,0 +1,119 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_CONSISTENT_HASH_INCLUDED
+#define ROUTING_CONSISTENT_HASH_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** @class ConsistentHashRing
+ * @brief Maps keys onto members so that few keys move when members change
+ *
+ * Each member is placed on a ring of 32-bit hashes at several points. A
+ * key belongs to the member of the first point at or after the hash of
+ * the key. When a member joins or leaves, only the keys of its points
+ * move; all other keys stay where they were.
+ *
+ * get_preference() gives all members in the order a key tries them,
+ * following the ring. Together with get_load_bound() this gives consistent
+ * hashing with bounded loads: a member which already carries more than
+ * its share is skipped, and the key goes to the next member on the ring.
+ *
+ * The ring is not thread-safe.
+ */
+class ConsistentHashRing {
+ public:
+  /** @brief Points of each member on the ring */
+  static const size_t kDefaultPointsPerMember;
+
+  /** @brief Constructor
+   *
+   * @param points_per_member points of each member; more spread keys more evenly
+   */
+  explicit ConsistentHashRing(size_t points_per_member = kDefaultPointsPerMember)
+      : points_per_member_(points_per_member) {}
+
+  /** @brief Sets the members of the ring
+   *
+   * The ring is only rebuilt when the members changed. The order of members
+   * does not matter for the mapping of keys.
+   *
+   * @param members names of the members, like addresses of servers
+   * @return whether the members changed
+   */
+  bool set_members(const std::vector<std::string> &members);
+
+  /** @brief Returns the members, in the order given to set_members() */
+  const std::vector<std::string> &get_members() const noexcept {
+    return members_;
+  }
+
+  /** @brief Returns whether the ring has no members */
+  bool empty() const noexcept {
+    return members_.empty();
+  }
+
+  /** @brief Gives the members in the order a key tries them
+   *
+   * The first member is the owner of the key.
+   *
+   * @param key key, like the name of a user
+   * @param order set to indexes into get_members()
+   */
+  void get_preference(const std::string &key, std::vector<size_t> *order) const;
+
+  /** @brief Returns the owner of a key
+   *
+   * @param key key, like the name of a user
+   * @return index into get_members(); 0 when the ring is empty
+   */
+  size_t get_owner(const std::string &key) const noexcept;
+
+  /** @brief Hash of keys and points; FNV-1a, finalized like MurmurHash3
+   *
+   * The finalizer spreads keys which differ in a single character, like
+   * addresses of servers, over the whole ring.
+   */
+  static uint32_t hash(const std::string &key) noexcept;
+
+  /** @brief Returns the load a member may take
+   *
+   * With total_load spread evenly, each member takes total_load / members;
+   * a member may take up to max_load percent of that, counting the new
+   * load. At least one member is always below the bound.
+   *
+   * @param total_load load of all members together, before the new load
+   * @param members number of members
+   * @param max_load percent of the even share a member may take; at least 100
+   */
+  static size_t get_load_bound(size_t total_load, size_t members, unsigned int max_load) noexcept;
+
+ private:
+  // first point at or after the hash, wrapping around
+  size_t find_point(uint32_t key_hash) const noexcept;
+
+  size_t points_per_member_;
+  std::vector<std::string> members_;
+  // hash and member index, sorted by hash
+  std::vector<std::pair<uint32_t, size_t>> points_;
+};
+
+#endif // ROUTING_CONSISTENT_HASH_INCLUDED
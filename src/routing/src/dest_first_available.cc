@@ -24,7 +24,8 @@
 #  include <ws2tcpip.h>
 #endif
 
-int DestFirstAvailable::get_server_socket(int connect_timeout, int *error) noexcept {
+int DestFirstAvailable::get_next_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                                               bool *busy, const ConnectionHints & /*hints*/) noexcept {
   // Say for example, that we have three servers: A, B and C.
   // The active server should be failed-over in such fashion:
   //
@@ -39,8 +40,14 @@ int DestFirstAvailable::get_server_socket(int connect_timeout, int *error) noexc
   // We start the list at the currently available server
   for (size_t i = current_pos_; i < destinations_.size(); ++i) {
     auto addr = destinations_.at(i);
-    log_debug("Trying server %s (index %d)", addr.str().c_str(), i);
+    if (!reserve_connection(addr)) {
+      // the active server is busy; we wait for it instead of failing over
+      *busy = true;
+      return -1;
+    }
+    LOGGER_DEBUG("Trying server %s (index %d)", addr.str().c_str(), i);
     auto sock = get_mysql_socket(addr, connect_timeout);
+    commit_connection(addr, sock);
     if (sock != -1) {
       current_pos_ = i;
       return sock;
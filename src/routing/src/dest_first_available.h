@@ -27,7 +27,9 @@ class DestFirstAvailable final : public RouteDestination {
  public:
   using RouteDestination::RouteDestination;
 
-  int get_server_socket(int connect_timeout, int *error) noexcept override;
+ protected:
+  int get_next_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                             bool *busy, const ConnectionHints &hints) noexcept override;
 };
 
 
@@ -43,9 +43,13 @@ using metadata_cache::lookup_replicaset;
 using metadata_cache::ManagedInstance;
 
 // if client wants a primary and there's none, we can wait up to this amount of
-// seconds until giving up and disconnecting the client
+// time until giving up and disconnecting the client
 // TODO: possibly this should be made into a configurable option
-static const int kPrimaryFailoverTimeout = 10;
+static const std::chrono::milliseconds kPrimaryFailoverTimeout = std::chrono::seconds(10);
+
+// how often the recent time to first byte of secondaries is sampled when
+// spilling over on latency
+static const std::chrono::milliseconds kLatencySampleInterval = std::chrono::seconds(1);
 
 
 DestMetadataCacheGroup::DestMetadataCacheGroup(const std::string &metadata_cache, const std::string &replicaset,
@@ -56,7 +60,12 @@ DestMetadataCacheGroup::DestMetadataCacheGroup(const std::string &metadata_cache
     ha_replicaset_(replicaset),
     uri_query_(query),
     allow_primary_reads_(false),
-    current_pos_(0) {
+    spillover_(false),
+    spilling_(false),
+    current_pos_(0),
+    topology_known_(false),
+    affinity_max_load_(0),
+    listener_id_(0) {
   if (mode == "read-only")
     routing_mode_ = ReadOnly;
   else if (mode == "read-write")
@@ -66,14 +75,97 @@ DestMetadataCacheGroup::DestMetadataCacheGroup(const std::string &metadata_cache
   init();
 }
 
-std::vector<mysqlrouter::TCPAddress> DestMetadataCacheGroup::get_available(std::vector<std::string> *server_ids) {
+DestMetadataCacheGroup::~DestMetadataCacheGroup() {
+  if (listener_id_ > 0) {
+    metadata_cache::remove_replicaset_listener(listener_id_);
+  }
+}
+
+void DestMetadataCacheGroup::start() {
+  // before the first lookup, to not miss a change in between
+  listener_id_ = metadata_cache::add_replicaset_listener(ha_replicaset_,
+      [this](const std::vector<ManagedInstance> &members) { on_replicaset_changed(members); });
+  try {
+    on_replicaset_changed(lookup_replicaset(ha_replicaset_).instance_vector);
+  } catch (const std::runtime_error &) {
+    // Metadata Cache not initialized yet; the first change tells the topology
+  }
+}
+
+void DestMetadataCacheGroup::on_replicaset_changed(const std::vector<ManagedInstance> &members) {
+  if (slow_start_.enabled()) {
+    update_slow_start(members);
+  }
+
+  std::map<std::string, metadata_cache::ServerMode> modes;
+  for (auto &it: members) {
+    if (it.role == "HA") {
+      auto port = (protocol_ == Protocol::Type::kXProtocol) ? static_cast<uint16_t>(it.xport) : static_cast<uint16_t>(it.port);
+      modes[mysqlrouter::TCPAddress(it.host, port).str()] = it.mode;
+    }
+  }
+
+  // whether the route sends clients to a server in the given mode
+  auto routed = [this](metadata_cache::ServerMode mode) {
+    if (mode == metadata_cache::ServerMode::Unavailable) {
+      return false;
+    }
+    return routing_mode_ == RoutingMode::ReadOnly || mode == metadata_cache::ServerMode::ReadWrite;
+  };
+
+  std::lock_guard<std::mutex> lock(mutex_topology_);
+  if (topology_known_) {
+    for (auto &previous: topology_modes_) {
+      if (!routed(previous.second)) {
+        continue;
+      }
+      auto current = modes.find(previous.first);
+      if (current == modes.end() || current->second == metadata_cache::ServerMode::Unavailable) {
+        if (drain_grace_period_.count() > 0) {
+          log_info("Server %s left '%s'; closing its connections in %s", previous.first.c_str(),
+                   ha_replicaset_.c_str(), mysqlrouter::ms_to_string(drain_grace_period_).c_str());
+        } else {
+          log_info("Server %s left '%s'; closing its connections", previous.first.c_str(),
+                   ha_replicaset_.c_str());
+        }
+        schedule_drain(previous.first, drain_grace_period_);
+      } else if (!routed(current->second)) {
+        // a primary demoted while the route only wants primaries
+        log_info("Server %s in '%s' is not a primary anymore; closing its connections",
+                 previous.first.c_str(), ha_replicaset_.c_str());
+        schedule_drain(previous.first, std::chrono::milliseconds(0));
+      }
+    }
+  }
+  for (auto &current: modes) {
+    if (routed(current.second) && cancel_drain(current.first)) {
+      log_info("Server %s is back in '%s'; keeping its connections", current.first.c_str(),
+               ha_replicaset_.c_str());
+    }
+  }
+  topology_modes_.swap(modes);
+  topology_known_ = true;
+}
+
+std::vector<mysqlrouter::TCPAddress> DestMetadataCacheGroup::get_available(std::vector<std::string> *server_ids,
+                                                                          const ConnectionHints *hints,
+                                                                          std::vector<mysqlrouter::TCPAddress> *primaries,
+                                                                          std::vector<std::string> *primary_ids) {
   auto managed_servers = lookup_replicaset(ha_replicaset_).instance_vector;
+  // when following the topology, on_replicaset_changed() sees every change
+  if (slow_start_.enabled() && listener_id_ == 0) {
+    update_slow_start(managed_servers);
+  }
   std::vector<mysqlrouter::TCPAddress> available;
   for (auto &it: managed_servers) {
     if (!(it.role == "HA")) {
       continue;
     }
     auto port = (protocol_ == Protocol::Type::kXProtocol) ? static_cast<uint16_t>(it.xport) : static_cast<uint16_t>(it.port);
+    if (hints && ((!hints->location.empty() && it.location != hints->location) ||
+                  !hints->allows(mysqlrouter::TCPAddress(it.host, port).str()))) {
+      continue;
+    }
     if (routing_mode_ == RoutingMode::ReadOnly && it.mode == metadata_cache::ServerMode::ReadOnly) {
       // Secondary read-only
       available.push_back(mysqlrouter::TCPAddress(it.host, port));
@@ -86,12 +178,44 @@ std::vector<mysqlrouter::TCPAddress> DestMetadataCacheGroup::get_available(std::
       available.push_back(mysqlrouter::TCPAddress(it.host, port));
       if (server_ids)
         server_ids->push_back(it.mysql_server_uuid);
+    } else if (primaries && routing_mode_ == RoutingMode::ReadOnly &&
+               it.mode == metadata_cache::ServerMode::ReadWrite) {
+      // Primary taking read-only connections the secondaries can not take
+      primaries->push_back(mysqlrouter::TCPAddress(it.host, port));
+      if (primary_ids)
+        primary_ids->push_back(it.mysql_server_uuid);
     }
   }
 
   return available;
 }
 
+void DestMetadataCacheGroup::update_slow_start(const std::vector<ManagedInstance> &instances) {
+  std::map<std::string, metadata_cache::ServerMode> modes;
+  for (auto &it: instances) {
+    if (it.role == "HA") {
+      modes[it.mysql_server_uuid] = it.mode;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_known_modes_);
+  if (!known_modes_.empty()) {
+    for (auto &it: modes) {
+      if (it.second == metadata_cache::ServerMode::Unavailable) {
+        continue;
+      }
+      auto previous = known_modes_.find(it.first);
+      // member (re)joined the replicaset or became available again
+      if (previous == known_modes_.end() ||
+          previous->second == metadata_cache::ServerMode::Unavailable) {
+        LOGGER_DEBUG("Slow-start of server %s in '%s'", it.first.c_str(), ha_replicaset_.c_str());
+        slow_start_.begin(it.first);
+      }
+    }
+  }
+  known_modes_.swap(modes);
+}
+
 void DestMetadataCacheGroup::init() {
 
   auto query_part = uri_query_.find("allow_primary_reads");
@@ -101,6 +225,8 @@ void DestMetadataCacheGroup::init() {
       std::transform(value.begin(), value.end(), value.begin(), ::tolower);
       if (value == "yes") {
         allow_primary_reads_ = true;
+      } else if (value == "spillover") {
+        spillover_ = true;
       }
     } else {
       log_warning("allow_primary_reads only works with read-only mode");
@@ -108,38 +234,229 @@ void DestMetadataCacheGroup::init() {
   }
 }
 
-int DestMetadataCacheGroup::get_server_socket(int connect_timeout, int *error) noexcept {
+void DestMetadataCacheGroup::set_spillover(const routing::SpilloverOptions &options) {
+  if (options.is_set() && routing_mode_ == RoutingMode::ReadOnly && !spillover_) {
+    log_warning("spillover options of '%s' only work with allow_primary_reads=spillover",
+                ha_replicaset_.c_str());
+  }
+  spillover_options_ = options;
+}
+
+bool DestMetadataCacheGroup::update_spilling(const std::vector<mysqlrouter::TCPAddress> &secondaries) {
+  const auto &options = spillover_options_;
+  if (options.connections == 0 && options.latency.count() == 0) {
+    return false;
+  }
+  // once spilling, secondaries have to get below a part of the thresholds
+  // before clients stay on them again
+  uint64_t percent = spilling_ ? routing::kSpilloverRecoveryPercent : 100;
+  uint64_t latency = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+      options.latency).count());
+
+  std::vector<std::string> names;
+  names.reserve(secondaries.size());
+  for (auto &addr : secondaries) {
+    names.push_back(addr.str());
+  }
+  std::vector<size_t> counts;
+  get_open_connections(names, &counts);
+
+  bool saturated = true;
+  for (size_t i = 0; i < names.size(); ++i) {
+    bool busy = options.connections > 0 && counts[i] * 100 >= options.connections * percent;
+    if (latency > 0) {
+      // sampled for every secondary, to keep the periods of the averages even
+      auto recent = static_cast<uint64_t>(get_recent_latency(names[i]).count());
+      busy = busy || recent * 100 >= latency * percent;
+    }
+    saturated = saturated && busy;
+  }
+
+  if (saturated != spilling_) {
+    spilling_ = saturated;
+    if (saturated) {
+      log_info("Secondaries of '%s' are saturated; spilling read-only connections over to the primary",
+               ha_replicaset_.c_str());
+    } else {
+      log_info("Secondaries of '%s' recovered; read-only connections stay on them again",
+               ha_replicaset_.c_str());
+    }
+  }
+  return spilling_;
+}
+
+std::chrono::microseconds DestMetadataCacheGroup::get_recent_latency(const std::string &destination) {
+  auto now = std::chrono::steady_clock::now();
+  auto &sample = latency_samples_[destination];
+  if (now - sample.taken >= kLatencySampleInterval) {
+    auto snapshot = get_metrics(destination).time_to_first_byte.snapshot();
+    // without answers since the last sample, the previous average stays
+    if (snapshot.count > sample.count) {
+      sample.average = std::chrono::microseconds((snapshot.sum - sample.sum) /
+                                                 (snapshot.count - sample.count));
+    }
+    sample.sum = snapshot.sum;
+    sample.count = snapshot.count;
+    sample.taken = now;
+  }
+  return sample.average;
+}
+
+size_t DestMetadataCacheGroup::pick_by_affinity(const std::vector<mysqlrouter::TCPAddress> &available,
+                                                const std::vector<std::string> &server_ids,
+                                                const std::string &affinity_key, bool *busy) {
+  std::vector<std::string> names;
+  names.reserve(available.size());
+  for (auto &addr : available) {
+    names.push_back(addr.str());
+  }
+  if (affinity_ring_.set_members(names)) {
+    LOGGER_DEBUG("Affinity of '%s' spread over %u servers", ha_replicaset_.c_str(),
+                 static_cast<unsigned>(names.size()));
+  }
+  std::vector<size_t> order;
+  affinity_ring_.get_preference(affinity_key, &order);
+
+  std::vector<size_t> loads;
+  size_t bound = ConsistentHashRing::get_load_bound(get_open_connections(names, &loads),
+                                                    names.size(), affinity_max_load_);
+  // first the servers below the bound which are not in slow-start, in
+  // the order of the ring; then any server which takes connections
+  size_t picked = available.size();
+  for (size_t i : order) {
+    if (loads.at(i) < bound && slow_start_.admit(server_ids.at(i)) &&
+        reserve_connection(available.at(i))) {
+      picked = i;
+      break;
+    }
+  }
+  size_t capped = 0;
+  for (size_t j = 0; picked == available.size() && j < order.size(); ++j) {
+    if (reserve_connection(available.at(order[j]))) {
+      picked = order[j];
+    } else {
+      ++capped;
+    }
+  }
+  if (picked < available.size()) {
+    if (picked != order.front()) {
+      get_metrics(names[picked]).affinity_fallbacks.inc();
+    }
+    return picked;
+  }
+  *busy = capped > 0;
+  return available.size();
+}
+
+int DestMetadataCacheGroup::get_next_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                                                   bool *busy, const ConnectionHints &hints) noexcept {
+  const std::string &affinity_key = hints.affinity_key;
+  bool filtered = !hints.location.empty() || !hints.servers.empty();
+  // secondaries this client failed to connect to, with spillover; they stay
+  // available until the next refresh of the metadata
+  std::vector<std::string> failed_secondaries;
   while (true) {
     try {
       std::vector<std::string> server_ids;
-      auto available = get_available(&server_ids);
+      std::vector<mysqlrouter::TCPAddress> primaries;
+      std::vector<std::string> primary_ids;
+      auto available = get_available(&server_ids, filtered ? &hints : nullptr,
+                                     spillover_ ? &primaries : nullptr, &primary_ids);
+      for (size_t i = available.size(); i-- > 0;) {
+        if (std::find(failed_secondaries.begin(), failed_secondaries.end(), available[i].str()) !=
+            failed_secondaries.end()) {
+          available.erase(available.begin() + i);
+          server_ids.erase(server_ids.begin() + i);
+        }
+      }
+
+      // read-only connections go to the primary only when the secondaries
+      // can not take them, and not beyond its limit, to leave it headroom
+      // for writes
+      bool spilled = false;
+      bool unavailable = available.empty();
+      if (!primaries.empty()) {
+        bool saturated = false;
+        if (!unavailable) {
+          std::lock_guard<std::mutex> lock(mutex_update_);
+          saturated = update_spilling(available);
+        }
+        if (unavailable || saturated) {
+          std::vector<std::string> names;
+          for (auto &addr : primaries) {
+            names.push_back(addr.str());
+          }
+          std::vector<size_t> counts;
+          if (spillover_options_.max_connections == 0 ||
+              get_open_connections(names, &counts) < spillover_options_.max_connections) {
+            available.swap(primaries);
+            server_ids.swap(primary_ids);
+            spilled = true;
+          }
+        }
+      }
+
       if (available.empty()) {
-        log_warning("No available %s servers found for '%s'",
+        LOGGER_WARNING_LIMITED("No available %s servers found for '%s'%s",
             routing_mode_ == RoutingMode::ReadWrite ? "RW" : "RO",
-            ha_replicaset_.c_str());
+            ha_replicaset_.c_str(), filtered ? " matching the routing rule" : "");
         return -1;
       }
 
       size_t next_up = 0;
-      {
+      if (affinity_max_load_ > 0 && !affinity_key.empty()) {
         std::lock_guard<std::mutex> lock(mutex_update_);
-        // round-robin between available nodes
-        next_up = current_pos_;
+        next_up = pick_by_affinity(available, server_ids, affinity_key, busy);
         if (next_up >= available.size()) {
-          next_up = 0;
-          current_pos_ = 0;
+          return -1;
         }
-        ++current_pos_;
-        if (current_pos_ >= available.size()) {
-          current_pos_ = 0;
+      } else {
+        std::lock_guard<std::mutex> lock(mutex_update_);
+        // round-robin between available nodes, skipping nodes in slow-start
+        // until they are admitted (but never more than one round), and
+        // nodes which reached their connection limit
+        size_t capped = 0;
+        for (size_t tries = 0; ; ++tries) {
+          next_up = current_pos_;
+          if (next_up >= available.size()) {
+            next_up = 0;
+            current_pos_ = 0;
+          }
+          ++current_pos_;
+          if (current_pos_ >= available.size()) {
+            current_pos_ = 0;
+          }
+          if (tries < available.size() && !slow_start_.admit(server_ids.at(next_up))) {
+            continue;
+          }
+          if (reserve_connection(available.at(next_up))) {
+            break;
+          }
+          if (++capped >= available.size()) {
+            *busy = true;
+            return -1;
+          }
         }
       }
 
       int fd = get_mysql_socket(available.at(next_up), connect_timeout);
+      commit_connection(available.at(next_up), fd);
+      if (fd >= 0 && spilled) {
+        auto &metrics = get_metrics(available.at(next_up).str());
+        (unavailable ? metrics.spilled_unavailable : metrics.spilled_saturated).inc();
+        LOGGER_DEBUG("Read-only connection of '%s' spilled over to %s", ha_replicaset_.c_str(),
+                     available.at(next_up).str().c_str());
+      }
       if (fd < 0) {
         // Signal that we can't connect to the instance
         metadata_cache::mark_instance_reachability(server_ids.at(next_up),
             metadata_cache::InstanceStatus::Unreachable);
+        // with spillover, the other secondaries are tried first, and the
+        // primary takes the client when none is left
+        if (spillover_ && !spilled) {
+          failed_secondaries.push_back(available.at(next_up).str());
+          continue;
+        }
         // if we're looking for a primary member, wait for there to be at least one
         if (routing_mode_ == RoutingMode::ReadWrite &&
             metadata_cache::wait_primary_failover(ha_replicaset_,
@@ -151,7 +468,7 @@ int DestMetadataCacheGroup::get_server_socket(int connect_timeout, int *error) n
       }
       return fd;
     } catch (std::runtime_error & re) {
-      log_error("Failed getting managed servers from the Metadata server: %s",
+      LOGGER_ERROR_LIMITED("Failed getting managed servers from the Metadata server: %s",
                 re.what());
       break;
     }
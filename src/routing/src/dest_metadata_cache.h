@@ -18,13 +18,18 @@
 #ifndef ROUTING_DEST_METADATA_CACHE_INCLUDED
 #define ROUTING_DEST_METADATA_CACHE_INCLUDED
 
+#include "consistent_hash.h"
 #include "destination.h"
 #include "mysql_routing.h"
 #include "mysqlrouter/uri.h"
 
+#include <chrono>
+#include <map>
+#include <mutex>
 #include <thread>
 
 #include "mysqlrouter/datatypes.h"
+#include "mysqlrouter/metadata_cache.h"
 #include "logger.h"
 
 class DestMetadataCacheGroup final : public RouteDestination {
@@ -41,6 +46,9 @@ public:
                           const mysqlrouter::URIQuery &query,
                           const Protocol::Type protocol);
 
+  /** @brief Destructor */
+  ~DestMetadataCacheGroup();
+
   /** @brief Copy constructor */
   DestMetadataCacheGroup(const DestMetadataCacheGroup &other) = delete;
 
@@ -53,8 +61,6 @@ public:
   /** @brief Move assignment */
   DestMetadataCacheGroup &operator=(DestMetadataCacheGroup &&) = delete;
 
-  int get_server_socket(int connect_timeout, int *error) noexcept override;
-
   void add(const std::string &, uint16_t) override { }
 
 
@@ -80,12 +86,57 @@ public:
     destinations_ = get_available(nullptr);
   }
 
-  /** @brief empty implementation
+  /** @brief Starts following topology changes
+   *
+   * This method also disables the RouteDestination::start(), which launches
+   * Quarantine. For Metadata Cache routing, we don't need it.
+   */
+  void start() override;
+
+  /** @brief Schedules draining of destinations which left the route
+   *
+   * Called with the members of the replicaset after each change. Connections
+   * to members which left the replicaset or became unavailable are closed
+   * after the drain grace period. For read-write routes, connections to a
+   * primary which was demoted are closed right away. Members which became
+   * available again start their slow-start.
+   *
+   * @param members managed servers as returned by the Metadata Cache
+   */
+  void on_replicaset_changed(const std::vector<metadata_cache::ManagedInstance> &members);
+
+  /** @brief Sends clients with the same affinity key to the same server
+   *
+   * Keys are mapped onto the available servers with a ConsistentHashRing;
+   * when servers join or leave, only the keys of those servers move. A
+   * server carrying more than max_load percent of the even share of
+   * connections is skipped for the next one on the ring. Clients without
+   * a key are sent round-robin.
+   *
+   * @param max_load percent of the even share a server may take; 0 disables the affinity
+   */
+  void set_affinity(unsigned int max_load) noexcept {
+    affinity_max_load_ = max_load;
+  }
+
+  /** @brief Sets when read-only connections spill over to the primary
+   *
+   * Only used with allow_primary_reads=spillover. The primary then takes
+   * read-only connections only when no secondary is available, connecting
+   * to a secondary failed, or all secondaries are saturated: they have
+   * options.connections connections of this route open, or an average time
+   * to first byte of options.latency during the last second. Spilling stops
+   * once a secondary is below routing::kSpilloverRecoveryPercent of the
+   * thresholds. While options.max_connections connections of this route are
+   * open to the primary, clients stay on the secondaries.
    *
-   * This method actually does something - it disables the RouteDestination::start(),
-   * which launches Quarantine. For Metadata Cache routing, we don't need it.
+   * @param options thresholds of the secondaries and limit of the primary
    */
-  void start() override {}
+  void set_spillover(const routing::SpilloverOptions &options);
+
+protected:
+  int get_next_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                             bool *busy, const ConnectionHints &hints) noexcept override;
 
 private:
   /** @brief The Metadata Cache to use
@@ -141,12 +192,103 @@ private:
    * the `metadata_cache::lookup_replicaset()` function to get a list of current managed
    * servers.
    *
+   * @param server_ids when not nullptr, gets the UUIDs of the returned servers
+   * @param hints when not nullptr, only servers allowed by its servers and location are returned
+   * @param primaries when not nullptr, gets the primaries which read-only connections may spill over to
+   * @param primary_ids when not nullptr, gets the UUIDs of the primaries
+   */
+  std::vector<mysqlrouter::TCPAddress> get_available(std::vector<std::string> *server_ids,
+                                                     const ConnectionHints *hints = nullptr,
+                                                     std::vector<mysqlrouter::TCPAddress> *primaries = nullptr,
+                                                     std::vector<std::string> *primary_ids = nullptr);
+
+  /** @brief Starts slow-start of servers which became available
+   *
+   * Compares the given managed servers with the ones seen during the
+   * previous topology change, or the previous lookup when not following
+   * the topology. Servers which were Unavailable, or were not part of
+   * the replicaset, get a reduced share of new connections for a while.
+   *
+   * @param instances managed servers as returned by the Metadata Cache
    */
-  std::vector<mysqlrouter::TCPAddress> get_available(std::vector<std::string> *server_ids);
+  void update_slow_start(const std::vector<metadata_cache::ManagedInstance> &instances);
+
+  /** @brief Picks the server of an affinity key
+   *
+   * The caller has to hold mutex_update_. A connection slot of the picked
+   * server is reserved.
+   *
+   * @param available available servers
+   * @param server_ids UUIDs of the available servers
+   * @param affinity_key key of the client
+   * @param busy set to true when servers were skipped because of their connection limit
+   * @return index into available, or available.size() when no server can be used
+   */
+  size_t pick_by_affinity(const std::vector<mysqlrouter::TCPAddress> &available,
+                          const std::vector<std::string> &server_ids,
+                          const std::string &affinity_key, bool *busy);
+
+  /** @brief Returns whether read-only connections spill over to the primary
+   *
+   * Enters or leaves the spilling state depending on the load of the
+   * secondaries. The caller has to hold mutex_update_.
+   *
+   * @param secondaries available secondaries
+   */
+  bool update_spilling(const std::vector<mysqlrouter::TCPAddress> &secondaries);
+
+  /** @brief Returns the average time to first byte of a server during the last second
+   *
+   * The caller has to hold mutex_update_.
+   *
+   * @param destination server as returned by TCPAddress::str()
+   */
+  std::chrono::microseconds get_recent_latency(const std::string &destination);
 
   /** @brief Whether we allow a read operations going to the primary (master) */
   bool allow_primary_reads_;
+  /** @brief Whether read operations go to the primary only when the secondaries can not take them */
+  bool spillover_;
+  /** @brief When read-only connections spill over to the primary */
+  routing::SpilloverOptions spillover_options_;
+  /** @brief Whether the secondaries were saturated; guarded by mutex_update_ */
+  bool spilling_;
   size_t current_pos_;
+
+  /** @brief Mode of managed servers seen during last lookup, by server UUID */
+  std::map<std::string, metadata_cache::ServerMode> known_modes_;
+  std::mutex mutex_known_modes_;
+
+  /** @brief Mode of managed servers seen during last topology change, by address */
+  std::map<std::string, metadata_cache::ServerMode> topology_modes_;
+  /** @brief Whether topology_modes_ was filled yet */
+  bool topology_known_;
+  std::mutex mutex_topology_;
+
+  /** @brief Load bound of servers with affinity in percent; 0 without affinity */
+  std::atomic<unsigned int> affinity_max_load_;
+
+  /** @brief Servers of the affinity keys; guarded by mutex_update_ */
+  ConsistentHashRing affinity_ring_;
+
+  /** @brief Time to first byte of a server, as of the last sample */
+  struct LatencySample {
+    uint64_t sum;
+    uint64_t count;
+    std::chrono::microseconds average;
+    std::chrono::steady_clock::time_point taken;
+  };
+  /** @brief Time to first byte of the secondaries, by address; guarded by mutex_update_ */
+  std::map<std::string, LatencySample> latency_samples_;
+
+  /** @brief Id of the replicaset listener, 0 when not following the topology */
+  unsigned listener_id_;
+
+#ifdef FRIEND_TEST
+  FRIEND_TEST(DestMetadataCacheSpilloverTest, SaturatedByConnections);
+  FRIEND_TEST(DestMetadataCacheSpilloverTest, SaturatedByLatency);
+  FRIEND_TEST(DestMetadataCacheSpilloverTest, WithoutThresholds);
+#endif
 };
 
 
@@ -25,6 +25,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <iostream>
 #ifndef _WIN32
 #  include <netdb.h>
@@ -42,11 +43,11 @@ using mysqlrouter::TCPAddress;
 using std::out_of_range;
 
 // Timeout for trying to connect with quarantined servers
-static const int kQuarantinedConnectTimeout = 1;
-// How long we pause before checking quarantined servers again (seconds)
-static const int kQuarantineCleanupInterval = 3;
+const std::chrono::milliseconds RouteDestination::kQuarantineConnectTimeout(1000);
+// How long we pause before checking quarantined servers again
+const std::chrono::milliseconds RouteDestination::kQuarantineInterval(3000);
 // Make sure Quarantine Manager Thread is run even with nothing in quarantine
-static const int kTimeoutQuarantineConditional = 2;
+static const std::chrono::milliseconds kTimeoutQuarantineConditional(2000);
 
 RouteDestination::~RouteDestination() {
 
@@ -62,8 +63,12 @@ void RouteDestination::add(const TCPAddress dest) {
   auto compare = [&dest](TCPAddress &other) { return dest == other; };
 
   if (std::find_if(destinations_.begin(), dest_end, compare) == dest_end) {
-    std::lock_guard<std::mutex> lock(mutex_update_);
-    destinations_.push_back(dest);
+    {
+      std::lock_guard<std::mutex> lock(mutex_update_);
+      destinations_.push_back(dest);
+    }
+    // destinations show in the metrics before they get connections
+    get_metrics(dest.str());
   }
 }
 
@@ -104,13 +109,169 @@ void RouteDestination::clear() {
   destinations_.clear();
 }
 
-int RouteDestination::get_server_socket(int connect_timeout, int *error) noexcept {
+int RouteDestination::get_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                                        const ConnectionHints &hints) noexcept {
+  bool busy = false;
+  int fd = -1;
+  if (max_connections_per_destination_.load(std::memory_order_relaxed) == 0) {
+    fd = get_next_server_socket(connect_timeout, error, &busy, hints);
+  } else {
+    auto result = admission_queue_.acquire([&]() {
+      busy = false;
+      fd = get_next_server_socket(connect_timeout, error, &busy, hints);
+      return fd >= 0 || !busy;
+    });
+    if (result != AdmissionQueue::Result::kAdmitted) {
+      LOGGER_WARNING_LIMITED("All destinations reached their connection limit (%s)",
+                  result == AdmissionQueue::Result::kQueueFull ? "queue full" : "timed out");
+      *error = EBUSY;
+      return -1;
+    }
+  }
+  if (fd >= 0 && !hints.affinity_key.empty()) {
+    add_affinity_key(fd, hints.affinity_key);
+  }
+  return fd;
+}
+
+void RouteDestination::add_affinity_key(int fd, const std::string &affinity_key) {
+  std::lock_guard<std::mutex> lock(mutex_connections_);
+  auto it = server_sockets_.find(fd);
+  if (it == server_sockets_.end()) {
+    return;
+  }
+  socket_affinity_keys_[fd] = affinity_key;
+  auto &counts = affinity_keys_[it->second];
+  ++counts[affinity_key];
+  // under the lock: set() of another connection must not overtake this one
+  get_metrics(it->second).affinity_keys.set(static_cast<int64_t>(counts.size()));
+}
+
+size_t RouteDestination::get_affinity_keys(const TCPAddress &addr) {
+  std::lock_guard<std::mutex> lock(mutex_connections_);
+  auto it = affinity_keys_.find(addr.str());
+  return it == affinity_keys_.end() ? 0 : it->second.size();
+}
+
+void RouteDestination::release_server_socket(int fd) noexcept {
+  bool limited = max_connections_per_destination_.load(std::memory_order_relaxed) != 0;
+  std::string destination;
+  {
+    std::lock_guard<std::mutex> lock(mutex_connections_);
+    auto it = server_sockets_.find(fd);
+    if (it == server_sockets_.end()) {
+      return;
+    }
+    destination = it->second;
+    auto open = open_connections_.find(destination);
+    if (open != open_connections_.end() && --open->second == 0) {
+      open_connections_.erase(open);
+    }
+    auto key = socket_affinity_keys_.find(fd);
+    if (key != socket_affinity_keys_.end()) {
+      auto &counts = affinity_keys_[destination];
+      auto count = counts.find(key->second);
+      if (count != counts.end() && --count->second == 0) {
+        counts.erase(count);
+      }
+      get_metrics(destination).affinity_keys.set(static_cast<int64_t>(counts.size()));
+      if (counts.empty()) {
+        affinity_keys_.erase(destination);
+      }
+      socket_affinity_keys_.erase(key);
+    }
+    if (limited) {
+      auto count = active_connections_.find(destination);
+      if (count != active_connections_.end() && --count->second == 0) {
+        active_connections_.erase(count);
+      }
+    }
+    server_sockets_.erase(it);
+  }
+  get_metrics(destination).active_connections.add(-1);
+  if (limited) {
+    admission_queue_.notify();
+  }
+}
+
+void RouteDestination::set_connection_limits(size_t max_per_destination, size_t queue_length,
+                                             std::chrono::milliseconds queue_timeout) {
+  max_connections_per_destination_ = max_per_destination;
+  admission_queue_.configure(queue_length, queue_timeout);
+}
+
+size_t RouteDestination::get_active_connections(const TCPAddress &addr) {
+  std::lock_guard<std::mutex> lock(mutex_connections_);
+  auto it = active_connections_.find(addr.str());
+  return it == active_connections_.end() ? 0 : it->second;
+}
+
+bool RouteDestination::reserve_connection(const TCPAddress &addr) noexcept {
+  size_t limit = max_connections_per_destination_.load(std::memory_order_relaxed);
+  if (limit == 0) {
+    return true;
+  }
+  std::lock_guard<std::mutex> lock(mutex_connections_);
+  size_t &count = active_connections_[addr.str()];
+  if (count >= limit) {
+    return false;
+  }
+  ++count;
+  return true;
+}
+
+void RouteDestination::commit_connection(const TCPAddress &addr, int fd) noexcept {
+  if (fd >= 0) {
+    std::string destination = addr.str();
+    {
+      std::lock_guard<std::mutex> lock(mutex_connections_);
+      server_sockets_[fd] = destination;
+      ++open_connections_[destination];
+    }
+    get_metrics(destination).active_connections.add(1);
+    return;
+  }
+  if (max_connections_per_destination_.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_connections_);
+    auto count = active_connections_.find(addr.str());
+    if (count != active_connections_.end() && --count->second == 0) {
+      active_connections_.erase(count);
+    }
+  }
+  admission_queue_.notify();
+}
+
+size_t RouteDestination::get_open_connections(const std::vector<std::string> &destinations,
+                                              std::vector<size_t> *counts) {
+  size_t total = 0;
+  counts->clear();
+  std::lock_guard<std::mutex> lock(mutex_connections_);
+  for (auto &destination : destinations) {
+    auto it = open_connections_.find(destination);
+    counts->push_back(it == open_connections_.end() ? 0 : it->second);
+    total += counts->back();
+  }
+  return total;
+}
+
+int RouteDestination::get_next_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                                             bool *busy, const ConnectionHints & /*hints*/) noexcept {
 
   if (destinations_.empty()) {
-    log_warning("No destinations currently available for routing");
+    LOGGER_WARNING_LIMITED("No destinations currently available for routing");
     return -1;  // no destination is available
   }
 
+  // Servers in slow-start are skipped until they are admitted; once we went
+  // around the whole list, we take whatever is available.
+  size_t visited = 0;
+  // Servers which reached their connection limit are skipped as well; when
+  // we keep finding only those, we give up.
+  size_t capped = 0;
+
   // We start the list at the currently available server
   for (size_t i = current_pos_;
        quarantined_.size() < destinations_.size() && i < destinations_.size();
@@ -127,8 +288,21 @@ int RouteDestination::get_server_socket(int connect_timeout, int *error) noexcep
     // Try server
     TCPAddress addr;
     addr = destinations_.at(i);
-    log_debug("Trying server %s (index %d)", addr.str().c_str(), i);
+    if (++visited <= destinations_.size() && !slow_start_.admit(addr.str())) {
+      LOGGER_DEBUG("Skipping server %s (index %d) in slow-start", addr.str().c_str(), i);
+      continue;
+    }
+    if (!reserve_connection(addr)) {
+      LOGGER_DEBUG("Skipping server %s (index %d) at connection limit", addr.str().c_str(), i);
+      *busy = true;
+      if (++capped >= destinations_.size()) {
+        break;
+      }
+      continue;
+    }
+    LOGGER_DEBUG("Trying server %s (index %d)", addr.str().c_str(), i);
     auto sock = get_mysql_socket(addr, connect_timeout);
+    commit_connection(addr, sock);
 
     if (sock != -1) {
       // Server is available
@@ -145,7 +319,7 @@ int RouteDestination::get_server_socket(int connect_timeout, int *error) noexcep
         std::lock_guard<std::mutex> lock(mutex_quarantine_);
         add_to_quarantine(i);
         if (quarantined_.size() == destinations_.size()) {
-          log_debug("No more destinations: all quarantined");
+          LOGGER_DEBUG("No more destinations: all quarantined");
           break;
         }
         continue; // try another destination
@@ -158,18 +332,122 @@ int RouteDestination::get_server_socket(int connect_timeout, int *error) noexcep
   return -1; // no destination is available
 }
 
-int RouteDestination::get_mysql_socket(const TCPAddress &addr, const int connect_timeout, const bool log_errors) {
-  return socket_operations_->get_mysql_socket(addr, connect_timeout, log_errors);
+TCPAddress RouteDestination::get_connect_address(const TCPAddress &addr) {
+  if (local_sockets_.empty() || routing::is_local_socket(addr)) {
+    return addr;
+  }
+  auto socket = local_sockets_.find(addr.port);
+  if (socket == local_sockets_.end()) {
+    return addr;
+  }
+  auto destination = addr.str();
+  {
+    std::lock_guard<std::mutex> lock(mutex_local_destinations_);
+    auto found = local_destinations_.find(destination);
+    if (found != local_destinations_.end()) {
+      return found->second.empty() ? addr : TCPAddress(found->second, 0);
+    }
+  }
+  // resolving blocks; once per destination
+  bool local = routing::is_local_host(addr.addr);
+  std::lock_guard<std::mutex> lock(mutex_local_destinations_);
+  if (local_destinations_.emplace(destination, local ? socket->second : "").second && local) {
+    log_info("Connecting to %s through Unix socket %s; the server authenticates its clients as user@localhost "
+             "over a secure transport", destination.c_str(), socket->second.c_str());
+  }
+  return local ? TCPAddress(socket->second, 0) : addr;
+}
+
+int RouteDestination::get_mysql_socket(const TCPAddress &addr, const std::chrono::milliseconds connect_timeout,
+                                       const bool log_errors) {
+  auto started = std::chrono::steady_clock::now();
+  int fd = socket_operations_->get_mysql_socket(get_connect_address(addr), connect_timeout, log_errors);
+  // quarantine checks connect without logging; only count connections for clients
+  if (log_errors) {
+    DestinationMetrics &metrics = get_metrics(addr.str());
+    metrics.connect_attempts.inc();
+    if (fd < 0) {
+      metrics.connect_failures.inc();
+    } else {
+      metrics.connect_duration.observe(static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - started).count()));
+    }
+  }
+  return fd;
+}
+
+void RouteDestination::schedule_drain(const std::string &destination,
+                                      std::chrono::milliseconds delay) {
+  auto deadline = std::chrono::steady_clock::now() + delay;
+  std::lock_guard<std::mutex> lock(mutex_drains_);
+  auto it = drains_.find(destination);
+  if (it == drains_.end()) {
+    drains_.emplace(destination, deadline);
+  } else if (deadline < it->second) {
+    it->second = deadline;
+  }
+}
+
+bool RouteDestination::cancel_drain(const std::string &destination) {
+  std::lock_guard<std::mutex> lock(mutex_drains_);
+  return drains_.erase(destination) > 0;
+}
+
+std::vector<std::string> RouteDestination::take_due_drains(std::chrono::steady_clock::time_point now) {
+  std::vector<std::string> due;
+  std::lock_guard<std::mutex> lock(mutex_drains_);
+  for (auto it = drains_.begin(); it != drains_.end();) {
+    if (it->second <= now) {
+      due.push_back(it->first);
+      it = drains_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return due;
+}
+
+std::string RouteDestination::get_socket_destination(int fd) {
+  std::lock_guard<std::mutex> lock(mutex_connections_);
+  auto it = server_sockets_.find(fd);
+  return it == server_sockets_.end() ? std::string() : it->second;
+}
+
+DestinationMetrics *RouteDestination::get_socket_metrics(int fd) {
+  std::string destination = get_socket_destination(fd);
+  if (destination.empty()) {
+    return nullptr;
+  }
+  return &get_metrics(destination);
+}
+
+void RouteDestination::set_route_name(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_metrics_);
+  route_name_ = name;
+}
+
+DestinationMetrics &RouteDestination::get_metrics(const std::string &destination) {
+  std::lock_guard<std::mutex> lock(mutex_metrics_);
+  auto it = metrics_.find(destination);
+  if (it == metrics_.end()) {
+    std::unique_ptr<DestinationMetrics> metrics(new DestinationMetrics(route_name_, destination));
+    it = metrics_.emplace(destination, std::move(metrics)).first;
+  }
+  return *it->second;
 }
 
 void RouteDestination::add_to_quarantine(const size_t index) noexcept {
   assert(index < size());
   if (index >= size()) {
-    log_debug("Impossible server being quarantined (index %d)", index);
+    LOGGER_DEBUG("Impossible server being quarantined (index %d)", index);
     return;
   }
   if (!is_quarantined(index)) {
-    log_debug("Quarantine destination server %s (index %d)", destinations_.at(index).str().c_str(), index);
+    LOGGER_DEBUG("Quarantine destination server %s (index %d)", destinations_.at(index).str().c_str(), index);
+    DestinationMetrics &metrics = get_metrics(destinations_.at(index).str());
+    metrics.quarantined.inc();
+    metrics.in_quarantine.set(1);
     quarantined_.push_back(index);
     condvar_quarantine_.notify_one();
   }
@@ -193,7 +471,7 @@ void RouteDestination::cleanup_quarantine() noexcept {
     }
 
     auto addr = destinations_.at(*it);
-    auto sock = get_mysql_socket(addr, kQuarantinedConnectTimeout, false);
+    auto sock = get_mysql_socket(addr, quarantine_connect_timeout_, false);
 
     if (sock != -1) {
 #ifndef _WIN32
@@ -203,7 +481,9 @@ void RouteDestination::cleanup_quarantine() noexcept {
       shutdown(sock, SD_BOTH);
       closesocket(sock);
 #endif
-      log_debug("Unquarantine destination server %s (index %d)", addr.str().c_str(), *it);
+      LOGGER_DEBUG("Unquarantine destination server %s (index %d)", addr.str().c_str(), *it);
+      slow_start_.begin(addr.str());
+      get_metrics(addr.str()).in_quarantine.set(0);
       std::lock_guard<std::mutex> lock(mutex_quarantine_);
       quarantined_.erase(std::remove(quarantined_.begin(), quarantined_.end(), *it));
     }
@@ -215,13 +495,13 @@ void RouteDestination::quarantine_manager_thread() noexcept {
 
   std::unique_lock<std::mutex> lock(mutex_quarantine_manager_);
   while (!stopping_) {
-    condvar_quarantine_.wait_for(lock, std::chrono::seconds(kTimeoutQuarantineConditional),
+    condvar_quarantine_.wait_for(lock, kTimeoutQuarantineConditional,
                                  [this] { return !quarantined_.empty(); });
 
     if (!stopping_) {
       cleanup_quarantine();
       // Temporize
-      std::this_thread::sleep_for(std::chrono::seconds(kQuarantineCleanupInterval));
+      std::this_thread::sleep_for(quarantine_interval_);
     }
   }
 }
@@ -22,8 +22,11 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -31,8 +34,26 @@
 
 #include "mysqlrouter/datatypes.h"
 #include "mysqlrouter/routing.h"
+#include "admission_queue.h"
 #include "logger.h"
 #include "protocol/protocol.h"
+#include "routing_metrics.h"
+#include "slow_start.h"
+
+/** @brief What a client asks of the destination it is sent to */
+struct ConnectionHints {
+  /** @brief Key of the client for destinations with an affinity, like its user name; empty for none */
+  std::string affinity_key;
+  /** @brief Servers allowed, as host:port; empty allows all */
+  std::vector<std::string> servers;
+  /** @brief Location of Metadata Cache members allowed; empty allows all */
+  std::string location;
+
+  /** @brief Returns whether a server is allowed by servers */
+  bool allows(const std::string &server) const {
+    return servers.empty() || std::find(servers.begin(), servers.end(), server) != servers.end();
+  }
+};
 
 /** @class RouteDestination
  * @brief Manage destinations for a Connection Routing
@@ -55,7 +76,10 @@ public:
   RouteDestination(Protocol::Type protocol = Protocol::get_default(),
                    routing::SocketOperationsBase *sock_ops =
                      routing::SocketOperations::instance()) // default = "real" (not mock) implementation
-      : current_pos_(0), stopping_(false), socket_operations_(sock_ops), protocol_(protocol) {}
+      : current_pos_(0), stopping_(false), socket_operations_(sock_ops), protocol_(protocol),
+        max_connections_per_destination_(0), drain_grace_period_(0),
+        quarantine_connect_timeout_(kQuarantineConnectTimeout),
+        quarantine_interval_(kQuarantineInterval) {}
 
   /** @brief Destructor */
   virtual ~RouteDestination();
@@ -114,11 +138,32 @@ public:
    * -1 when an error occurred, which means that no destination was
    * available.
    *
-   * @param connect_timeout About of seconds before timing out
+   * When all usable destinations reached their maximum number of
+   * connections, waits in the admission queue for one to become free.
+   * If none does, error is set to EBUSY.
+   *
+   * The returned socket has to be given back using release_server_socket()
+   * once the connection is closed.
+   *
+   * Destinations with an affinity send clients with the same key to the
+   * same server; others ignore the key. Only Metadata Cache destinations
+   * restrict servers by the hints.
+   *
+   * @param connect_timeout How long to wait for the connection
    * @param error Pointer to int for storing errno
+   * @param hints affinity key and allowed servers of the client
    * @return a socket descriptor
    */
-  virtual int get_server_socket(int connect_timeout, int *error) noexcept;
+  virtual int get_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                                const ConnectionHints &hints = ConnectionHints()) noexcept;
+
+  /** @brief Gives back a connection returned by get_server_socket()
+   *
+   * Must be called before the socket is closed.
+   *
+   * @param fd socket descriptor
+   */
+  void release_server_socket(int fd) noexcept;
 
   /** @brief Gets the number of destinations
    *
@@ -142,6 +187,20 @@ public:
    */
   size_t size_quarantine();
 
+  /** @brief Paces the probing of quarantined servers by the connect timeout
+   *
+   * Quarantined servers are probed with the connect timeout of the route,
+   * every three connect timeouts. Both are capped at the default pace of
+   * probing, so routes with short timeouts take recovered servers back
+   * sooner. Must be called before start().
+   *
+   * @param connect_timeout connect timeout of the route
+   */
+  void set_quarantine_probing(std::chrono::milliseconds connect_timeout) noexcept {
+    quarantine_connect_timeout_ = std::min(connect_timeout, kQuarantineConnectTimeout);
+    quarantine_interval_ = std::min(connect_timeout * 3, kQuarantineInterval);
+  }
+
   /** @brief Start the destination threads
    *
    */
@@ -149,10 +208,133 @@ public:
     if (!quarantine_thread_.joinable()) {
       quarantine_thread_ = std::thread(&RouteDestination::quarantine_manager_thread, this);
     } else {
-      log_debug("Tried to restart quarantine thread");
+      LOGGER_DEBUG("Tried to restart quarantine thread");
     }
   }
 
+  /** @brief Configures slow-start of destinations
+   *
+   * Destinations which become available again (for example, when they are
+   * removed from quarantine) get a reduced share of new connections during
+   * the given period.
+   *
+   * @param period length of the slow-start period; zero disables it
+   * @param ramp how the share grows during the period
+   */
+  void set_slow_start(std::chrono::milliseconds period, SlowStart::Ramp ramp) {
+    slow_start_.configure(period, ramp);
+  }
+
+  /** @brief Returns number of destinations in slow-start
+   *
+   * @return size_t
+   */
+  size_t size_slow_start() const noexcept {
+    return slow_start_.size();
+  }
+
+  /** @brief Configures per-destination connection limits
+   *
+   * @param max_per_destination maximum connections to a single destination;
+   *        0 means unlimited
+   * @param queue_length number of clients which can wait for a destination
+   *        to accept more connections
+   * @param queue_timeout how long a client waits at most
+   */
+  void set_connection_limits(size_t max_per_destination, size_t queue_length,
+                             std::chrono::milliseconds queue_timeout);
+
+  /** @brief Returns number of open connections to a destination
+   *
+   * Only counted when a per-destination limit is set.
+   *
+   * @param addr destination
+   * @return size_t
+   */
+  size_t get_active_connections(const mysqlrouter::TCPAddress &addr);
+
+  /** @brief Returns the queue of clients waiting for a destination */
+  const AdmissionQueue &get_admission_queue() const noexcept {
+    return admission_queue_;
+  }
+
+  /** @brief Returns the number of distinct affinity keys with connections open to a destination
+   *
+   * Keys are counted for connections made with a key, like the schemas of
+   * tenants on routes with an affinity on the schema.
+   *
+   * @param addr destination
+   * @return size_t
+   */
+  size_t get_affinity_keys(const mysqlrouter::TCPAddress &addr);
+
+  /** @brief Returns the destination of a server socket
+   *
+   * @param fd socket descriptor returned by get_server_socket()
+   * @return address of the destination, or an empty string when the socket is not known
+   */
+  std::string get_socket_destination(int fd);
+
+  /** @brief Returns the metrics of the destination of a server socket
+   *
+   * @param fd socket descriptor returned by get_server_socket()
+   * @return DestinationMetrics, or nullptr when the socket is not known
+   */
+  DestinationMetrics *get_socket_metrics(int fd);
+
+  /** @brief Sets how long connections to destinations which left the topology are kept
+   *
+   * Only destinations which follow a topology, like Metadata Cache
+   * destinations, drain connections.
+   *
+   * @param period time given to connections before they are closed; 0 closes them right away
+   */
+  void set_drain_grace_period(std::chrono::milliseconds period) noexcept {
+    drain_grace_period_ = period;
+  }
+
+  /** @brief Sets Unix sockets of servers on this host
+   *
+   * Destinations whose host is this host, and whose port has a socket,
+   * are connected through the socket instead of over TCP. They keep their
+   * address for everything else, like limits, quarantine and metrics.
+   * The server sees such sessions as coming from localhost over a secure
+   * transport: accounts are matched as user@localhost, and
+   * require_secure_transport and caching_sha2_password full authentication
+   * are satisfied without TLS.
+   * Must be called before start().
+   *
+   * @param sockets paths of sockets by TCP port
+   */
+  void set_local_sockets(const std::map<uint16_t, std::string> &sockets) {
+    local_sockets_ = sockets;
+  }
+
+  /** @brief Returns what a destination is connected to
+   *
+   * @param addr destination
+   * @return the Unix socket set with set_local_sockets() for destinations on
+   *         this host; addr otherwise
+   */
+  mysqlrouter::TCPAddress get_connect_address(const mysqlrouter::TCPAddress &addr);
+
+  /** @brief Returns the destinations whose connections are due to be closed
+   *
+   * Each scheduled drain is returned once.
+   *
+   * @param now current time
+   * @return addresses of the destinations
+   */
+  std::vector<std::string> take_due_drains(std::chrono::steady_clock::time_point now);
+
+  /** @brief Sets the name of the route, used to label metrics
+   *
+   * Has to be called before connections are made.
+   *
+   * @param name name of the route, like "routing:ro"
+   */
+  void set_route_name(const std::string &name);
+
   AddrVector::iterator begin() {
     return destinations_.begin();
   }
@@ -213,6 +395,57 @@ protected:
    */
   virtual void cleanup_quarantine() noexcept;
 
+  /** @brief Connects to the next destination
+   *
+   * Does the work of get_server_socket(), without waiting in the
+   * admission queue. Derived classes change which destination is next.
+   *
+   * @param connect_timeout How long to wait for the connection
+   * @param error Pointer to int for storing errno
+   * @param busy set to true when destinations were skipped because they
+   *        reached their connection limit
+   * @param hints affinity key and allowed servers of the client
+   * @return a socket descriptor or -1
+   */
+  virtual int get_next_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                                     bool *busy, const ConnectionHints &hints) noexcept;
+
+  /** @brief Takes a connection slot of a destination
+   *
+   * Each successful call has to be followed by commit_connection().
+   *
+   * @param addr destination
+   * @return false when the destination reached its connection limit
+   */
+  bool reserve_connection(const mysqlrouter::TCPAddress &addr) noexcept;
+
+  /** @brief Binds a reserved slot to the connected socket
+   *
+   * When connecting failed (fd is -1), the slot is given back.
+   *
+   * @param addr destination passed to reserve_connection()
+   * @param fd socket descriptor
+   */
+  void commit_connection(const mysqlrouter::TCPAddress &addr, int fd) noexcept;
+
+  /** @brief Counts the affinity key of a new server socket
+   *
+   * @param fd socket descriptor returned by get_next_server_socket()
+   * @param affinity_key key of the client
+   */
+  void add_affinity_key(int fd, const std::string &affinity_key);
+
+  /** @brief Returns the number of open connections to destinations
+   *
+   * Counted with and without connection limits.
+   *
+   * @param destinations destinations as returned by TCPAddress::str()
+   * @param counts set to the number of connections of each destination
+   * @return number of connections to the given destinations together
+   */
+  size_t get_open_connections(const std::vector<std::string> &destinations,
+                              std::vector<size_t> *counts);
+
   /** @brief Returns socket descriptor of connected MySQL server
    *
    * Returns a socket descriptor for the connection to the MySQL Server or
@@ -223,11 +456,19 @@ protected:
    * (e.g. a mock counterpart).
    *
    * @param addr information of the server we connect with
-   * @param connect_timeout number of seconds waiting for connection
+   * @param connect_timeout how long to wait for the connection
    * @param log_errors whether to log errors or not
    * @return a socket descriptor
    */
-  virtual int get_mysql_socket(const mysqlrouter::TCPAddress &addr, int connect_timeout, bool log_errors = true);
+  virtual int get_mysql_socket(const mysqlrouter::TCPAddress &addr, std::chrono::milliseconds connect_timeout,
+                               bool log_errors = true);
+
+  /** @brief Returns the metrics of a destination
+   *
+   * @param destination destination as returned by TCPAddress::str()
+   * @return DestinationMetrics
+   */
+  DestinationMetrics &get_metrics(const std::string &destination);
 
   /** @brief List of destinations */
   AddrVector destinations_;
@@ -261,6 +502,85 @@ protected:
 
   /** @brief Protocol for the destination */
   Protocol::Type protocol_;
+
+  /** @brief Slow-start of destinations becoming available again */
+  SlowStart slow_start_;
+
+  /** @brief Maximum connections to a single destination (0 = unlimited) */
+  std::atomic<size_t> max_connections_per_destination_;
+
+  /** @brief Mutex for connection counting */
+  std::mutex mutex_connections_;
+
+  /** @brief Open connections per destination */
+  std::map<std::string, size_t> active_connections_;
+
+  /** @brief Destination of each open server socket; kept also without limits for metrics */
+  std::map<int, std::string> server_sockets_;
+
+  /** @brief Open server sockets per destination; kept also without limits */
+  std::map<std::string, size_t> open_connections_;
+
+  /** @brief Affinity key of each open server socket made with a key */
+  std::map<int, std::string> socket_affinity_keys_;
+
+  /** @brief Open connections per affinity key, per destination */
+  std::map<std::string, std::map<std::string, size_t>> affinity_keys_;
+
+  /** @brief Clients waiting for a destination to accept more connections */
+  AdmissionQueue admission_queue_;
+
+  /** @brief Mutex for route name and destination metrics */
+  std::mutex mutex_metrics_;
+
+  /** @brief Name of the route, used to label metrics */
+  std::string route_name_;
+
+  /** @brief Metrics per destination */
+  std::map<std::string, std::unique_ptr<DestinationMetrics>> metrics_;
+
+  /** @brief Schedules closing the connections to a destination
+   *
+   * A drain which is already scheduled keeps the earlier deadline.
+   *
+   * @param destination address of the destination
+   * @param delay how long to wait before closing the connections
+   */
+  void schedule_drain(const std::string &destination, std::chrono::milliseconds delay);
+
+  /** @brief Cancels a drain scheduled with schedule_drain()
+   *
+   * @param destination address of the destination
+   * @return whether a drain was scheduled
+   */
+  bool cancel_drain(const std::string &destination);
+
+  /** @brief Time given to connections to destinations which left the topology */
+  std::chrono::milliseconds drain_grace_period_;
+
+  /** @brief Default timeout for connecting to quarantined servers */
+  static const std::chrono::milliseconds kQuarantineConnectTimeout;
+  /** @brief Default pause between probes of quarantined servers */
+  static const std::chrono::milliseconds kQuarantineInterval;
+  /** @brief Timeout for connecting to quarantined servers */
+  std::chrono::milliseconds quarantine_connect_timeout_;
+  /** @brief Pause between probes of quarantined servers */
+  std::chrono::milliseconds quarantine_interval_;
+
+  /** @brief Unix sockets of servers on this host, by TCP port */
+  std::map<uint16_t, std::string> local_sockets_;
+
+  /** @brief Mutex for local_destinations_ */
+  std::mutex mutex_local_destinations_;
+
+  /** @brief Unix socket of each destination looked up, empty when not on this host */
+  std::map<std::string, std::string> local_destinations_;
+
+  /** @brief Mutex for drains_ */
+  std::mutex mutex_drains_;
+
+  /** @brief When to close connections to destinations, by address */
+  std::map<std::string, std::chrono::steady_clock::time_point> drains_;
 };
 
 
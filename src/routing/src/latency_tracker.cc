@@ -0,0 +1,57 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "latency_tracker.h"
+
+static uint64_t to_microseconds(LatencyTracker::clock::duration duration) noexcept {
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+  return us < 0 ? 0 : static_cast<uint64_t>(us);
+}
+
+void LatencyTracker::on_client_data(clock::time_point now, bool starts_command) noexcept {
+  if (open_ && !answered_) {
+    // more of the open command
+    return;
+  }
+  if (!starts_command) {
+    // like the contents of a file the server asked for; not a command
+    return;
+  }
+  finish();
+  open_ = true;
+  answered_ = false;
+  command_start_ = now;
+}
+
+void LatencyTracker::on_server_data(clock::time_point now) noexcept {
+  if (!open_) {
+    return;
+  }
+  if (!answered_) {
+    answered_ = true;
+    time_to_first_byte_.observe(to_microseconds(now - command_start_));
+  }
+  last_answer_ = now;
+}
+
+void LatencyTracker::finish() noexcept {
+  if (open_ && answered_) {
+    turnaround_.observe(to_microseconds(last_answer_ - command_start_));
+  }
+  open_ = false;
+  answered_ = false;
+}
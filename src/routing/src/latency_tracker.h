@@ -0,0 +1,85 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_LATENCY_TRACKER_INCLUDED
+#define ROUTING_LATENCY_TRACKER_INCLUDED
+
+#include "metrics.h"
+
+#include <chrono>
+
+/** @class LatencyTracker
+ * @brief Measures command latency of a routed connection from the traffic
+ *
+ * The tracker does not parse the protocol. A command starts when the
+ * client sends data which starts a command (as told by the protocol, see
+ * BaseProtocol::starts_command()) while no command is open, or after the
+ * server answered the open one. For each command it records:
+ *
+ *  - time to first byte: from the start of the command to the first data
+ *    sent by the server
+ *  - turnaround: from the start of the command to the last data sent by
+ *    the server before the next command starts or the connection closes
+ *
+ * Data the client sends before the server answered, like the rest of a
+ * large command, belongs to the open command. Commands the server never
+ * answers are not recorded.
+ *
+ * A tracker belongs to one connection and is not thread-safe.
+ */
+class LatencyTracker {
+ public:
+  using clock = std::chrono::steady_clock;
+  using Histogram = mysql_harness::metrics::Histogram;
+
+  /** @brief Constructor
+   *
+   * @param time_to_first_byte histogram of times to first byte, in microseconds
+   * @param turnaround histogram of command turnarounds, in microseconds
+   */
+  LatencyTracker(Histogram &time_to_first_byte, Histogram &turnaround) noexcept
+      : time_to_first_byte_(time_to_first_byte), turnaround_(turnaround), open_(false),
+        answered_(false) {}
+
+  /** @brief Called when data from the client was forwarded
+   *
+   * @param now when the data was read
+   * @param starts_command whether the data starts a command
+   */
+  void on_client_data(clock::time_point now, bool starts_command) noexcept;
+
+  /** @brief Called when data from the server was forwarded
+   *
+   * @param now when the data was read
+   */
+  void on_server_data(clock::time_point now) noexcept;
+
+  /** @brief Records the open command, if answered; called when the connection closes */
+  void finish() noexcept;
+
+ private:
+  Histogram &time_to_first_byte_;
+  Histogram &turnaround_;
+  // whether a command was started and not recorded yet
+  bool open_;
+  // whether the server sent data for the open command
+  bool answered_;
+  clock::time_point command_start_;
+  clock::time_point last_answer_;
+};
+
+#endif // ROUTING_LATENCY_TRACKER_INCLUDED
@@ -21,6 +21,7 @@
 #include "common.h"
 #include "dest_first_available.h"
 #include "dest_metadata_cache.h"
+#include "latency_tracker.h"
 #include "logger.h"
 #include "mysql_routing.h"
 #include "mysqlrouter/metadata_cache.h"
@@ -28,10 +29,15 @@
 #include "mysqlrouter/uri.h"
 #include "mysqlrouter/utils.h"
 #include "plugin_config.h"
+#include "protocol/classic_framer.h"
 #include "protocol/protocol.h"
+#include "read_write_splitter.h"
+#include "shard_session.h"
+#include "tls_session.h"
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cmath>
 #include <cstring>
 #include <future>
@@ -41,19 +47,11 @@
 
 #include <sys/types.h>
 
-#ifdef _WIN32
-/* before winsock inclusion */
-#  define FD_SETSIZE 4096
-#else
-#  undef __FD_SETSIZE
-#  define __FD_SETSIZE 4096
-#endif
-
 #ifndef _WIN32
 #  include <netinet/in.h>
 #  include <fcntl.h>
 #  include <sys/un.h>
-#  include <sys/select.h>
+#  include <poll.h>
 #  include <sys/socket.h>
 #else
 #  define WIN32_LEAN_AND_MEAN
@@ -74,10 +72,49 @@ using mysqlrouter::URIQuery;
 using mysqlrouter::TCPAddress;
 using mysqlrouter::is_valid_socket_name;
 
-static int kListenQueueSize = 1024;
 
 static const char *kDefaultReplicaSetName = "default";
+// version told to clients of sharded routes until a server told its own
+static const char *kDefaultShardServerVersion = "5.7.0";
 static const int kAcceptorStopPollInterval_ms = 1000;
+// pause of the acceptor while out of file descriptors; doubles on each
+// failed accept() up to the maximum
+static const std::chrono::milliseconds kAcceptPauseMin(10);
+static const std::chrono::milliseconds kAcceptPauseMax(kAcceptorStopPollInterval_ms);
+// while out of file descriptors, errors are logged at most this often
+static const std::chrono::seconds kAcceptErrorLogInterval(10);
+
+/** @brief Returns whether accept() failed because we are out of descriptors */
+static bool is_fd_exhaustion(int err) {
+#ifdef _WIN32
+  return err == WSAEMFILE || err == WSAENOBUFS;
+#else
+  return err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM;
+#endif
+}
+
+/** @brief Opens the descriptor kept in reserve for rejecting clients
+ *
+ * On Windows sockets are not limited by a descriptor table, so nothing
+ * is reserved there.
+ */
+static int open_spare_fd() {
+#ifndef _WIN32
+  return open("/dev/null", O_RDONLY);
+#else
+  return -1;
+#endif
+}
+
+static void close_spare_fd(int fd) {
+#ifndef _WIN32
+  if (fd >= 0) {
+    close(fd);
+  }
+#else
+  (void)fd;
+#endif
+}
 
 MySQLRouting::MySQLRouting(routing::AccessMode mode, uint16_t port,
                            const Protocol::Type protocol,
@@ -85,9 +122,9 @@ MySQLRouting::MySQLRouting(routing::AccessMode mode, uint16_t port,
                            const mysql_harness::Path& named_socket,
                            const string &route_name,
                            int max_connections,
-                           int destination_connect_timeout,
+                           std::chrono::milliseconds destination_connect_timeout,
                            unsigned long long max_connect_errors,
-                           unsigned int client_connect_timeout,
+                           std::chrono::milliseconds client_connect_timeout,
                            unsigned int net_buffer_length,
                            SocketOperationsBase *socket_operations)
     : name(route_name),
@@ -97,6 +134,16 @@ MySQLRouting::MySQLRouting(routing::AccessMode mode, uint16_t port,
       max_connect_errors_(max_connect_errors),
       client_connect_timeout_(client_connect_timeout),
       net_buffer_length_(net_buffer_length),
+      slow_start_period_(0),
+      slow_start_ramp_(SlowStart::Ramp::kLinear),
+      max_connections_per_destination_(0),
+      connection_queue_length_(0),
+      connection_queue_timeout_(0),
+      drain_grace_period_(0),
+      client_idle_timeout_(0),
+      server_idle_timeout_(0),
+      read_write_splitting_(false),
+      shard_server_version_(kDefaultShardServerVersion),
       bind_address_(TCPAddress(bind_address, port)),
       bind_named_socket_(named_socket),
       service_tcp_(0),
@@ -104,6 +151,14 @@ MySQLRouting::MySQLRouting(routing::AccessMode mode, uint16_t port,
       stopping_(false),
       info_active_routes_(0),
       info_handled_routes_(0),
+      admitted_routes_(0),
+      spare_fd_(-1),
+      accept_pause_(0),
+      accept_errors_since_log_(0),
+      refused_accepts_(0),
+      rejected_on_exhaustion_(0),
+      metrics_(route_name),
+      connections_(socket_operations),
       socket_operations_(socket_operations),
       protocol_(Protocol::create(protocol, socket_operations)) {
 
@@ -125,18 +180,32 @@ MySQLRouting::MySQLRouting(routing::AccessMode mode, uint16_t port,
 bool MySQLRouting::block_client_host(const std::array<uint8_t, 16> &client_ip_array,
                                      const string &client_ip_str, int server) {
   bool blocked = false;
+  std::vector<mysql_harness::metrics::Labels> blocked_rows;
   {
     std::lock_guard<std::mutex> lock(mutex_conn_errors_);
 
-    if (++conn_error_counters_[client_ip_array] >= max_connect_errors_) {
-      log_warning("[%s] blocking client host %s", name.c_str(), client_ip_str.c_str());
+    size_t errors = ++conn_error_counters_[client_ip_array];
+    if (errors >= max_connect_errors_) {
+      LOGGER_WARNING_LIMITED("[%s] blocking client host %s", name.c_str(), client_ip_str.c_str());
       blocked = true;
+      if (errors == max_connect_errors_) {
+        blocked_hosts_.push_back(client_ip_str);
+        for (const auto &host : blocked_hosts_) {
+          blocked_rows.push_back({{"host", host}});
+        }
+      }
     } else {
-      log_info("[%s] %d connection errors for %s (max %u)",
+      LOGGER_INFO_LIMITED("[%s] %d connection errors for %s (max %u)",
                name.c_str(), conn_error_counters_[client_ip_array], client_ip_str.c_str(), max_connect_errors_);
     }
   }
 
+  if (!blocked_rows.empty()) {
+    mysql_harness::metrics::MetricsRegistry::instance().set_info(
+        "routing_blocked_host", {{"route", name}}, blocked_rows,
+        "Client hosts blocked for too many connection errors");
+  }
+
   if (server >= 0) {
     protocol_->on_block_client_host(server, name);
   }
@@ -196,10 +265,22 @@ std::string MySQLRouting::make_thread_name(const std::string& config_name, const
   return thread_name;
 }
 
+// finds where commands start in what classic protocol clients send
+struct CommandStartFinder {
+  bool found = false;
+
+  void on_header(uint8_t sequence_id, uint32_t /*payload_size*/, bool continuation) noexcept {
+    if (sequence_id == 0 && !continuation) {
+      found = true;
+    }
+  }
+  void on_payload(const uint8_t * /*data*/, size_t /*size*/) noexcept {}
+  bool on_packet_end() noexcept { return true; }
+};
+
 void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& client_addr) noexcept {
   mysql_harness::rename_thread(make_thread_name(name, "RtS").c_str());  // "Rt select() thread" would be too long :(
 
-  int nfds;
   int res;
   int error = 0;
   size_t bytes_down = 0;
@@ -209,17 +290,107 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
   RoutingProtocolBuffer buffer(net_buffer_length_);
   bool handshake_done = false;
 
-  int server = destination_->get_server_socket(destination_connect_timeout_, &error);
+  if (admission_queue_.acquire([this]() { return take_connection_slot(); }) !=
+      AdmissionQueue::Result::kAdmitted) {
+    metrics_.reject(RejectReason::kMaxConnections);
+    protocol_->send_error(client, 1040, "Too many connections", "HY000", name);
+    socket_operations_->close(client); // no shutdown() before close()
+    LOGGER_WARNING_LIMITED("[%s] reached max active connections (%d max=%d)", name.c_str(),
+                admitted_routes_.load(), max_connections_);
+    return;
+  }
+
+  // with schema sharding, the destination is known once the client told its
+  // schema; an affinity on the handshake needs it before picking a server
+  RouteDestination *destination = destination_.get();
+  std::unique_ptr<ShardSession> shard_session;
+  if (shard_map_) {
+    shard_session.reset(new ShardSession(socket_operations_, client, *shard_map_,
+                                         client_connect_timeout_, name));
+    if (!shard_session->accept_client(get_shard_server_version(), &extra_msg)) {
+      // the client might be gone already; its address is known since accept()
+      auto ip_array = in_addr_to_array(client_addr);
+      std::string client_host = get_address_host(client_addr);
+      LOGGER_DEBUG("[%s] Routing failed for %s: %s", name.c_str(), client_host.c_str(), extra_msg.c_str());
+      block_client_host(ip_array, client_host);
+      socket_operations_->shutdown(client);
+      socket_operations_->close(client);
+      release_connection_slot();
+      return;
+    }
+    auto shard = shard_destinations_.find(shard_session->get_replicaset());
+    if (shard != shard_destinations_.end()) {
+      destination = shard->second.get();
+    }
+  }
+  // errors for clients waiting for the end of the handshake
+  auto send_client_error = [&](unsigned short code, const std::string &message) {
+    if (shard_session) {
+      shard_session->send_handshake_error(code, message);
+    } else {
+      protocol_->send_error(client, code, message, "HY000", name);
+    }
+  };
+
+  // servers the routing rule of the client allows; also for reads
+  ConnectionHints rule_hints;
+  size_t rule = RoutingRules::kNoRule;
+  if (routing_rules_) {
+    RoutingRules::Client rule_client;
+    rule_client.address = &client_addr;
+    if (shard_session) {
+      rule_client.user = shard_session->get_user();
+      rule_client.schema = shard_session->get_schema();
+      if (routing_rules_->needs_attributes()) {
+        rule_client.attributes = shard_session->get_connect_attributes();
+      }
+    }
+    rule = routing_rules_->match(rule_client);
+    if (rule != RoutingRules::kNoRule) {
+      if (!routing_rules_->acquire(rule)) {
+        metrics_.reject(RejectReason::kRuleQuota);
+        send_client_error(1040, "Too many connections");
+        socket_operations_->close(client); // no shutdown() before close()
+        release_connection_slot();
+        LOGGER_WARNING_LIMITED("[%s] routing rule %u reached its quota", name.c_str(),
+                               static_cast<unsigned>(rule + 1));
+        return;
+      }
+      auto &action = routing_rules_->get_action(rule);
+      rule_hints.servers = action.servers;
+      rule_hints.location = action.location;
+    }
+  }
+  auto release_rule = [&]() {
+    if (rule != RoutingRules::kNoRule) {
+      routing_rules_->release(rule);
+    }
+  };
+
+  ConnectionHints hints = rule_hints;
+  hints.affinity_key = get_affinity_key(client_addr, shard_session.get());
+  int server = destination->get_server_socket(destination_connect_timeout_, &error, hints);
+
+  if (server < 0 && error == EBUSY) {
+    // all destinations are at their connection limit
+    metrics_.reject(RejectReason::kDestinationBusy);
+    send_client_error(1040, "Too many connections");
+    socket_operations_->close(client); // no shutdown() before close()
+    release_rule();
+    release_connection_slot();
+    return;
+  }
 
   if (!(server > 0 && client > 0)) {
     std::stringstream os;
     os << "Can't connect to remote MySQL server for client '"
       << bind_address_.addr << ":" << bind_address_.port << "'";
 
-    log_warning("[%s] %s", name.c_str(), os.str().c_str());
+    LOGGER_WARNING_LIMITED("[%s] %s", name.c_str(), os.str().c_str());
+    metrics_.reject(RejectReason::kNoDestination);
 
     // at this point, it does not matter whether client gets the error
-    protocol_->send_error(client, 2003, os.str(), "HY000", name);
+    send_client_error(2003, os.str());
 
     socket_operations_->shutdown(client);
     socket_operations_->shutdown(server);
@@ -228,65 +399,162 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
       socket_operations_->close(client);
     }
     if (server > 0) {
+      destination->release_server_socket(server);
       socket_operations_->close(server);
     }
+    release_rule();
+    release_connection_slot();
     return;
   }
 
-  std::pair<std::string, int> c_ip = get_peer_name(client);
-  std::pair<std::string, int> s_ip = get_peer_name(server);
+  if (!server_socket_options_.is_default() &&
+      !routing::set_socket_options(server, server_socket_options_)) {
+    LOGGER_WARNING_LIMITED("[%s] Failed setting server socket options: %s", name.c_str(),
+                           get_message_error(errno).c_str());
+  }
 
-  std::string info;
-  if (c_ip.second == 0) {
-    // Unix socket/Windows Named pipe
-    info = string_format("[%s] source %s - dest [%s]:%d",
-                         name.c_str(), bind_named_socket_.c_str(),
-                         s_ip.first.c_str(), s_ip.second);
-  } else {
-    info = string_format("[%s] source [%s]:%d - dest [%s]:%d",
-                         name.c_str(), c_ip.first.c_str(), c_ip.second,
-                         s_ip.first.c_str(), s_ip.second);
+  // looking up peer names is not free; only do it when it is logged
+  if (LOGGER_LEVEL_ENABLED(LOG_LEVEL_DEBUG)) {
+    std::pair<std::string, int> c_ip = get_peer_name(client);
+    std::pair<std::string, int> s_ip = get_peer_name(server);
+    if (c_ip.second == 0) {
+      // Unix socket/Windows Named pipe
+      log_debug("[%s] source %s - dest [%s]:%d",
+                name.c_str(), bind_named_socket_.c_str(),
+                s_ip.first.c_str(), s_ip.second);
+    } else {
+      log_debug("[%s] source [%s]:%d - dest [%s]:%d",
+                name.c_str(), c_ip.first.c_str(), c_ip.second,
+                s_ip.first.c_str(), s_ip.second);
+    }
   }
-  log_debug(info.c_str());
 
   ++info_active_routes_;
   ++info_handled_routes_;
-
-  nfds = std::max(client, server) + 1;
+  metrics_.active_connections.add(1);
+  auto connected_at = std::chrono::steady_clock::now();
+
+  // latencies are recorded per destination; unknown for sockets which did
+  // not come from RouteDestination::get_server_socket()
+  std::string destination_name = destination->get_socket_destination(server);
+  DestinationMetrics *destination_metrics = destination->get_socket_metrics(server);
+  std::unique_ptr<LatencyTracker> latency;
+  if (destination_metrics) {
+    latency.reset(new LatencyTracker(destination_metrics->time_to_first_byte,
+                                     destination_metrics->command_turnaround));
+  }
+  // messages of our own would corrupt a TLS stream
+  bool tls = false;
+  // packet boundaries of the classic protocol after the handshake; reads
+  // need not start at a packet
+  const bool classic = protocol_->get_type() == Protocol::Type::kClassicProtocol;
+  ClassicFramer client_framer;
+  // what read/write splitting needs to know about the handshake
+  std::vector<uint8_t> client_handshake;
+  uint8_t last_server_packet = 0;
+  std::vector<uint8_t> last_server_data;
+  std::shared_ptr<ConnectionRegistry::Connection> connection =
+      connections_.add(client, server, get_address_name(client_addr), destination_name);
+
+  // poll() instead of select(): descriptors easily go beyond FD_SETSIZE
+  // with many connections
+  struct pollfd fds[2];
+  fds[0].fd = client;
+  fds[0].events = POLLIN;
+  fds[1].fd = server;
+  fds[1].events = POLLIN;
+  // a hang-up or error is reported as readable: read() tells what happened
+  const short kReadable = POLLIN | POLLHUP | POLLERR;
+
+  // the client has to finish the handshake before this deadline, no matter
+  // how many packets it takes
+  auto handshake_deadline = std::chrono::steady_clock::now() + client_connect_timeout_;
+
+  bool handshake_timed = false;
+  auto time_handshake = [&]() {
+    handshake_timed = true;
+    connection->handshake_done();
+    if (destination_metrics) {
+      destination_metrics->handshake_duration.observe(static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - connected_at).count()));
+    }
+  };
 
   int pktnr = 0;
-  while (true) {
-    fd_set readfds;
-    fd_set errfds;
+  bool copy_traffic = true;
+  if (shard_session) {
+    auto result = shard_session->authenticate(server, &extra_msg);
+    if (!shard_session->get_server_version().empty()) {
+      set_shard_server_version(shard_session->get_server_version());
+    }
+    bytes_down += shard_session->get_handshake_bytes_from_client();
+    bytes_up += shard_session->get_handshake_bytes_to_client();
+    // like copy_packets(), an error of the server ends the handshake
+    handshake_done = (result != ShardSession::AuthResult::kFailed);
+    copy_traffic = (result == ShardSession::AuthResult::kAuthenticated);
+    pktnr = 2;
+    if (copy_traffic) {
+      time_handshake();
+    }
+  } else if (tls_server_context_) {
+    TlsSession tls_session(socket_operations_, client, server, *tls_server_context_,
+                           tls_client_context_.get(), destination_name, client_connect_timeout_,
+                           net_buffer_length_, name);
+    tls_session.set_accounting(connection.get(), &metrics_);
+    switch (tls_session.start(&extra_msg)) {
+      case TlsSession::Result::kTls:
+        tls = true;
+        handshake_done = true;
+        time_handshake();
+        extra_msg = tls_session.run();
+        copy_traffic = false;
+        break;
+      case TlsSession::Result::kPlain:
+        // the client sent its handshake response; the server answers next
+        pktnr = 1;
+        break;
+      case TlsSession::Result::kRefused:
+        handshake_done = true;
+        copy_traffic = false;
+        break;
+      case TlsSession::Result::kFailed:
+        copy_traffic = false;
+        break;
+    }
+    bytes_down += tls_session.get_bytes_client_to_server();
+    bytes_up += tls_session.get_bytes_server_to_client();
+  }
+  while (copy_traffic) {
     // Reset on each loop
-    FD_ZERO(&readfds);
-    FD_ZERO(&errfds);
-    FD_SET(client, &readfds);
-    FD_SET(server, &readfds);
+    fds[0].revents = 0;
+    fds[1].revents = 0;
 
     if (handshake_done) {
-      res = select(nfds, &readfds, nullptr, &errfds, nullptr);
+      res = routing::poll_sockets(fds, 2, std::chrono::milliseconds(-1));
     } else {
       // Handshake reply timeout
-      struct timeval timeout_val;
-      timeout_val.tv_sec = client_connect_timeout_;
-      timeout_val.tv_usec = 0;
-      res = select(nfds, &readfds, nullptr, &errfds, &timeout_val);
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          handshake_deadline - std::chrono::steady_clock::now());
+      if (remaining.count() < 0) {
+        remaining = std::chrono::milliseconds(0);
+      }
+      res = routing::poll_sockets(fds, 2, remaining);
     }
 
     if (res <= 0) {
       if (res == 0) {
-        extra_msg = string("Select timed out");
+        extra_msg = string("Poll timed out");
       } else if (errno > 0) {
         if (errno == EINTR || errno == EAGAIN)
           continue;
-        extra_msg = string("Select failed with error: " + get_strerror(errno));
+        extra_msg = string("Poll failed with error: " + get_strerror(errno));
 #ifdef _WIN32
       } else if (WSAGetLastError() > 0) {
-        extra_msg = string("Select failed with error: " + get_message_error(WSAGetLastError()));
+        extra_msg = string("Poll failed with error: " + get_message_error(WSAGetLastError()));
 #endif
       } else {
-        extra_msg = string("Select failed (" + to_string(res) + ")");
+        extra_msg = string("Poll failed (" + to_string(res) + ")");
       }
 
       break;
@@ -295,7 +563,7 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
     // Handle traffic from Server to Client
     // Note: In classic protocol Server _always_ talks first
     if (protocol_->copy_packets(server, client,
-                                &readfds, buffer, &pktnr,
+                                (fds[1].revents & kReadable) != 0, buffer, &pktnr,
                                 handshake_done, &bytes_read, true) == -1) {
 #ifndef _WIN32
       if (errno > 0) {
@@ -307,35 +575,183 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
       break;
     }
     bytes_up += bytes_read;
+    if (bytes_read > 4 && !handshake_done) {
+      last_server_packet = buffer[4];
+      if (read_write_splitting_) {
+        last_server_data.assign(buffer.begin(), buffer.begin() + static_cast<long>(bytes_read));
+      }
+    }
+    if (bytes_read > 0) {
+      auto now = std::chrono::steady_clock::now();
+      metrics_.bytes_server_to_client.inc(bytes_read);
+      connection->add_bytes_server_to_client(bytes_read, now);
+      if (latency) {
+        latency->on_server_data(now);
+      }
+    }
 
     // Handle traffic from Client to Server
-    if (protocol_->copy_packets(client, server,
-                                &readfds, buffer, &pktnr,
-                                handshake_done, &bytes_read, false) == -1) {
+    bool was_handshake_done = handshake_done;
+    if (shard_session) {
+      if (shard_session->copy_client_data(server, (fds[0].revents & kReadable) != 0, buffer,
+                                          &bytes_read) == -1) {
+        break;
+      }
+    } else if (protocol_->copy_packets(client, server,
+                                       (fds[0].revents & kReadable) != 0, buffer, &pktnr,
+                                       handshake_done, &bytes_read, false) == -1) {
       break;
     }
     bytes_down += bytes_read;
+    if (bytes_read > 0) {
+      auto now = std::chrono::steady_clock::now();
+      metrics_.bytes_client_to_server.inc(bytes_read);
+      connection->add_bytes_client_to_server(bytes_read, now);
+      if (!tls && protocol_->is_tls_record(buffer, bytes_read)) {
+        tls = true;
+      }
+      if (read_write_splitting_ && !was_handshake_done && bytes_read > 4 && buffer[3] == 1) {
+        client_handshake.assign(buffer.begin(), buffer.begin() + static_cast<long>(bytes_read));
+      }
+      if (latency && handshake_done) {
+        bool starts_command;
+        if (classic && !tls) {
+          CommandStartFinder finder;
+          client_framer.feed(&buffer[0], bytes_read, finder);
+          starts_command = finder.found;
+        } else {
+          starts_command = protocol_->starts_command(buffer, bytes_read);
+        }
+        // the handshake is not a command
+        if (was_handshake_done) {
+          latency->on_client_data(now, starts_command);
+        }
+      }
+    }
+    if (handshake_done && !handshake_timed) {
+      // the handshake might have finished while copying either way
+      time_handshake();
+
+      // hand over to the splitter, unless the client sent a command already
+      // or the primary refused it
+      if (read_write_splitting_ && bytes_read == 0 && !client_handshake.empty() &&
+          last_server_packet != 0xff) {
+        ReadWriteSplitter splitter(socket_operations_, client, server,
+            [this, &rule_hints]() {
+              int connect_error = 0;
+              int secondary = read_destination_->get_server_socket(destination_connect_timeout_, &connect_error,
+                                                                   rule_hints);
+              if (secondary >= 0 && !server_socket_options_.is_default()) {
+                routing::set_socket_options(secondary, server_socket_options_);
+              }
+              return secondary;
+            },
+            [this](int secondary) { read_destination_->release_server_socket(secondary); },
+            split_user_, split_password_, destination_connect_timeout_, name);
+        if (splitter.set_client_handshake(client_handshake.data(), client_handshake.size())) {
+          splitter.set_server_auth_data(last_server_data.data(), last_server_data.size());
+          splitter.set_accounting(connection.get(), &metrics_);
+          extra_msg = splitter.run(last_server_packet == 0x00);
+          bytes_down += splitter.get_bytes_client_to_server();
+          bytes_up += splitter.get_bytes_server_to_client();
+          break;
+        }
+      }
+    }
 
-  } // while (true)
+  } // while (copy_traffic)
 
-  if (!handshake_done) {
+  if (latency) {
+    latency->finish();
+  }
+  metrics_.active_connections.add(-1);
+  metrics_.connection_duration.observe(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - connected_at).count()));
+
+  // before closing the sockets, so that the registry does not shut down reused descriptors
+  connections_.remove(connection);
+  auto close_reason = connection->get_close_reason();
+  if (close_reason == ConnectionRegistry::CloseReason::kDrained) {
+    // closed on purpose; not the client's fault, even during the handshake
+    extra_msg = "closed for destination " + destination_name;
+  } else if (close_reason == ConnectionRegistry::CloseReason::kClientIdle) {
+    extra_msg = "client idle for too long";
+    metrics_.idle_closed_client.inc();
+    if (!tls) {
+      // like ER_CLIENT_INTERACTION_TIMEOUT of the MySQL Server
+      protocol_->on_idle_timeout(client, server, 4031,
+                                 "The client was disconnected by MySQL Router because of inactivity",
+                                 name);
+    }
+  } else if (close_reason == ConnectionRegistry::CloseReason::kServerIdle) {
+    extra_msg = "no answer from " + destination_name + " in time";
+    metrics_.idle_closed_server.inc();
+    if (!tls) {
+      protocol_->on_idle_timeout(client, server, 2013,
+                                 "Lost connection to MySQL server during query",
+                                 name);
+    }
+  } else if (!handshake_done) {
+    // the client might be gone already; its address is known since accept()
     auto ip_array = in_addr_to_array(client_addr);
-    log_debug("[%s] Routing failed for %s: %s", name.c_str(), c_ip.first.c_str(), extra_msg.c_str());
-    block_client_host(ip_array, c_ip.first.c_str(), server);
+    std::string client_host = get_address_host(client_addr);
+    LOGGER_DEBUG("[%s] Routing failed for %s: %s", name.c_str(), client_host.c_str(), extra_msg.c_str());
+    block_client_host(ip_array, client_host, server);
   }
 
   // Either client or server terminated
   socket_operations_->shutdown(client);
   socket_operations_->shutdown(server);
   socket_operations_->close(client);
+  destination->release_server_socket(server);
   socket_operations_->close(server);
 
-  --info_active_routes_;
+  release_rule();
+  release_connection_slot();
 #ifndef _WIN32
-  log_debug("[%s] Routing stopped (up:%zub;down:%zub) %s", name.c_str(), bytes_up, bytes_down, extra_msg.c_str());
+  LOGGER_DEBUG("[%s] Routing stopped (up:%zub;down:%zub) %s", name.c_str(), bytes_up, bytes_down, extra_msg.c_str());
 #else
-  log_debug("[%s] Routing stopped (up:%Iub;down:%Iub) %s", name.c_str(), bytes_up, bytes_down, extra_msg.c_str());
+  LOGGER_DEBUG("[%s] Routing stopped (up:%Iub;down:%Iub) %s", name.c_str(), bytes_up, bytes_down, extra_msg.c_str());
 #endif
+  // last, as waiting for no active routes is how this object is known to be unused
+  --info_active_routes_;
+}
+
+size_t MySQLRouting::close_connections_to(const std::string &destination) noexcept {
+  size_t closed = connections_.close_connections_to(destination);
+  if (closed > 0) {
+    log_info("[%s] closing %llu connection(s) to %s", name.c_str(),
+             static_cast<unsigned long long>(closed), destination.c_str());
+  }
+  return closed;
+}
+
+void MySQLRouting::drain_destinations() noexcept {
+  std::vector<std::string> due;
+  try {
+    auto now = std::chrono::steady_clock::now();
+    due = destination_->take_due_drains(now);
+    for (auto &shard : shard_destinations_) {
+      auto shard_due = shard.second->take_due_drains(now);
+      due.insert(due.end(), shard_due.begin(), shard_due.end());
+    }
+  } catch (const std::exception &exc) {
+    log_error("[%s] Failed draining destinations: %s", name.c_str(), exc.what());
+    return;
+  }
+  for (auto &destination : due) {
+    close_connections_to(destination);
+  }
+}
+
+void MySQLRouting::close_idle_connections() noexcept {
+  size_t closed = connections_.close_idle_connections(std::chrono::steady_clock::now(),
+                                                      client_idle_timeout_, server_idle_timeout_);
+  if (closed > 0) {
+    log_debug("[%s] closing %llu idle connection(s)", name.c_str(),
+              static_cast<unsigned long long>(closed));
+  }
 }
 
 void MySQLRouting::start() {
@@ -387,9 +803,23 @@ void MySQLRouting::start_acceptor() {
   struct sockaddr_storage client_addr;
   socklen_t sin_size = static_cast<socklen_t>(sizeof client_addr);
   int opt_nodelay = 1;
-  int nfds = 0;
 
+  auto &registry = mysql_harness::metrics::MetricsRegistry::instance();
+  registry.set_info("routing_route_info", {{"route", name}},
+                    {{{"bind_address", bind_address_.port > 0 ? bind_address_.str() : ""},
+                      {"socket", bind_named_socket_.is_set() ? bind_named_socket_.str() : ""},
+                      {"mode", routing::get_access_mode_name(mode_)}}},
+                    "Routes which accept clients");
+  metrics_.max_connections.set(max_connections_);
+
+  destination_->set_quarantine_probing(destination_connect_timeout_);
   destination_->start();
+  if (read_destination_) {
+    read_destination_->start();
+  }
+  for (auto &shard : shard_destinations_) {
+    shard.second->start();
+  }
 
   if (service_tcp_ > 0) {
     routing::set_socket_blocking(service_tcp_, false);
@@ -397,23 +827,25 @@ void MySQLRouting::start_acceptor() {
   if (service_named_socket_ > 0) {
     routing::set_socket_blocking(service_named_socket_, false);
   }
-  nfds = std::max(service_tcp_, service_named_socket_) + 1;
-  fd_set readfds;
-  fd_set errfds;
-  struct timeval timeout_val;
+  // poll() ignores entries with a negative descriptor
+  struct pollfd fds[2];
+  fds[0].fd = service_tcp_ > 0 ? service_tcp_ : -1;
+  fds[0].events = POLLIN;
+  fds[1].fd = service_named_socket_ > 0 ? service_named_socket_ : -1;
+  fds[1].events = POLLIN;
+  // keep a descriptor in reserve, so that we can still accept and reject
+  // clients once all others are in use
+  spare_fd_ = open_spare_fd();
   while (!stopping()) {
-    // Reset on each loop
-    FD_ZERO(&readfds);
-    FD_ZERO(&errfds);
-    if (service_tcp_ > 0) {
-      FD_SET(service_tcp_, &readfds);
+    drain_destinations();
+    close_idle_connections();
+    if (accept_pause_.count() > 0) {
+      std::this_thread::sleep_for(accept_pause_);
     }
-    if (service_named_socket_ > 0) {
-      FD_SET(service_named_socket_, &readfds);
-    }
-    timeout_val.tv_sec = kAcceptorStopPollInterval_ms / 1000;
-    timeout_val.tv_usec = (kAcceptorStopPollInterval_ms % 1000) * 1000;
-    int ready_fdnum = select(nfds, &readfds, nullptr, &errfds, &timeout_val);
+    // Reset on each loop
+    fds[0].revents = 0;
+    fds[1].revents = 0;
+    int ready_fdnum = routing::poll_sockets(fds, 2, std::chrono::milliseconds(kAcceptorStopPollInterval_ms));
     if (ready_fdnum <= 0) {
       if (ready_fdnum == 0) {
         // timeout - just check if stopping and continue
@@ -421,70 +853,139 @@ void MySQLRouting::start_acceptor() {
       } else if (errno > 0) {
         if (errno == EINTR || errno == EAGAIN)
           continue;
-        log_error("[%s] Select failed with error: %s", name.c_str(), get_strerror(errno).c_str());
+        log_error("[%s] Poll failed with error: %s", name.c_str(), get_strerror(errno).c_str());
         break;
   #ifdef _WIN32
       } else if (WSAGetLastError() > 0) {
-        log_error("[%s] Select failed with error: %s", name.c_str(), get_message_error(WSAGetLastError()));
+        log_error("[%s] Poll failed with error: %s", name.c_str(), get_message_error(WSAGetLastError()));
   #endif
         break;
       } else {
-        log_error("[%s] Select failed (%i)", name.c_str(), errno);
+        log_error("[%s] Poll failed (%i)", name.c_str(), errno);
         break;
       }
     }
     while (ready_fdnum > 0) {
       bool is_tcp = false;
-      if (FD_ISSET(service_tcp_, &readfds)) {
-        FD_CLR(service_tcp_, &readfds);
+      if (fds[0].revents != 0) {
+        fds[0].revents = 0;
         --ready_fdnum;
         if ((sock_client = accept(service_tcp_, (struct sockaddr *) &client_addr, &sin_size)) < 0) {
-          log_error("[%s] Failed accepting TCP connection: %s", name.c_str(), get_message_error(errno).c_str());
+          handle_accept_error(service_tcp_, "TCP connection");
           continue;
         }
         is_tcp = true;
-        log_debug("[%s] TCP connection from %i accepted at %s", name.c_str(),
+        LOGGER_DEBUG("[%s] TCP connection from %i accepted at %s", name.c_str(),
                   sock_client, bind_address_.str().c_str());
       }
-      if (FD_ISSET(service_named_socket_, &readfds)) {
-        FD_CLR(service_named_socket_, &readfds);
+      if (fds[1].revents != 0) {
+        fds[1].revents = 0;
         --ready_fdnum;
         if ((sock_client = accept(service_named_socket_, (struct sockaddr *) &client_addr, &sin_size)) < 0) {
-          log_error("[%s] Failed accepting socket connection: %s", name.c_str(), get_message_error(errno).c_str());
+          handle_accept_error(service_named_socket_, "socket connection");
           continue;
         }
-        log_debug("[%s] UNIX socket connection from %i accepted at %s", name.c_str(),
+        LOGGER_DEBUG("[%s] UNIX socket connection from %i accepted at %s", name.c_str(),
                   sock_client, bind_address_.str().c_str());
       }
 
+      accept_succeeded();
+      metrics_.accepted.inc();
+
       if (conn_error_counters_[in_addr_to_array(client_addr)] >= max_connect_errors_) {
         std::stringstream os;
         os << "Too many connection errors from " << get_peer_name(sock_client).first;
+        metrics_.reject(RejectReason::kBlockedHost);
         protocol_->send_error(sock_client, 1129, os.str(), "HY000", name);
         log_info("%s", os.str().c_str());
         socket_operations_->close(sock_client); // no shutdown() before close()
         continue;
       }
 
-      if (info_active_routes_.load(std::memory_order_relaxed) >= max_connections_) {
+      // when no client can wait for a slot, reject right here instead of
+      // starting a thread for it
+      if (admitted_routes_.load(std::memory_order_relaxed) >= max_connections_ &&
+          !admission_queue_.has_room()) {
+        metrics_.reject(RejectReason::kMaxConnections);
         protocol_->send_error(sock_client, 1040, "Too many connections", "HY000", name);
         socket_operations_->close(sock_client); // no shutdown() before close()
-        log_warning("[%s] reached max active connections (%d max=%d)", name.c_str(),
-                   info_active_routes_.load(), max_connections_);
+        LOGGER_WARNING_LIMITED("[%s] reached max active connections (%d max=%d)", name.c_str(),
+                   admitted_routes_.load(), max_connections_);
         continue;
       }
 
       if (is_tcp && setsockopt(sock_client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char *>(&opt_nodelay), static_cast<socklen_t>(sizeof(int))) == -1) {
-        log_error("[%s] client setsockopt error: %s", name.c_str(), get_message_error(errno).c_str());
+        LOGGER_ERROR_LIMITED("[%s] client setsockopt error: %s", name.c_str(), get_message_error(errno).c_str());
         continue;
       }
+      if (is_tcp && !client_socket_options_.is_default() &&
+          !routing::set_socket_options(sock_client, client_socket_options_)) {
+        LOGGER_WARNING_LIMITED("[%s] Failed setting client socket options: %s", name.c_str(),
+                               get_message_error(errno).c_str());
+      }
 
       std::thread(&MySQLRouting::routing_select_thread, this, sock_client, client_addr).detach();
     }
   } // while (!stopping())
+  close_spare_fd(spare_fd_);
+  spare_fd_ = -1;
+  registry.set_info("routing_route_info", {{"route", name}}, {});
   log_info("[%s] stopped", name.c_str());
 }
 
+void MySQLRouting::handle_accept_error(int service_socket, const char *kind) noexcept {
+#ifdef _WIN32
+  int err = WSAGetLastError();
+#else
+  int err = errno;
+#endif
+  if (!is_fd_exhaustion(err)) {
+    LOGGER_ERROR_LIMITED("[%s] Failed accepting %s: %s", name.c_str(), kind, get_message_error(err).c_str());
+    return;
+  }
+
+  // The client stays in the listen backlog and keeps the service socket
+  // readable. Give up the spare descriptor to take it off the backlog and
+  // tell it why, instead of letting it hang until it times out.
+  ++refused_accepts_;
+  if (spare_fd_ >= 0) {
+    close_spare_fd(spare_fd_);
+    spare_fd_ = -1;
+    int sock_client = accept(service_socket, nullptr, nullptr);
+    if (sock_client >= 0) {
+      ++rejected_on_exhaustion_;
+      metrics_.reject(RejectReason::kFdExhaustion);
+      protocol_->send_error(sock_client, 1040, "Too many connections", "HY000", name);
+      socket_operations_->close(sock_client); // no shutdown() before close()
+    }
+    spare_fd_ = open_spare_fd();
+  }
+
+  // pause accepting until connections went away and gave back descriptors
+  accept_pause_ = std::min(std::max(accept_pause_ * 2, kAcceptPauseMin), kAcceptPauseMax);
+
+  ++accept_errors_since_log_;
+  auto now = std::chrono::steady_clock::now();
+  if (accept_errors_since_log_ == 1 || now - last_accept_error_log_ >= kAcceptErrorLogInterval) {
+    log_error("[%s] Failed accepting %s: %s; refused %llu connection(s), pausing accepts for %s",
+              name.c_str(), kind, get_message_error(err).c_str(),
+              static_cast<unsigned long long>(accept_errors_since_log_),
+              mysqlrouter::ms_to_string(accept_pause_).c_str());
+    last_accept_error_log_ = now;
+    accept_errors_since_log_ = 0;
+  }
+}
+
+void MySQLRouting::accept_succeeded() noexcept {
+  if (accept_pause_.count() == 0) {
+    return;
+  }
+  accept_pause_ = std::chrono::milliseconds(0);
+  log_info("[%s] Accepting connections again; %llu refused so far", name.c_str(),
+           static_cast<unsigned long long>(refused_accepts_.load()));
+  accept_errors_since_log_ = 0;
+}
+
 void MySQLRouting::stop() {
   stopping_.store(true);
 }
@@ -541,7 +1042,11 @@ void MySQLRouting::setup_tcp_service() {
     throw runtime_error(string_format("[%s] Failed to setup server socket", name.c_str()));
   }
 
-  if (listen(service_tcp_, kListenQueueSize) < 0) {
+  if (!routing::set_listen_options(service_tcp_, listen_options_)) {
+    log_warning("[%s] Failed setting listen options: %s", name.c_str(), get_message_error(errno).c_str());
+  }
+
+  if (listen(service_tcp_, listen_options_.backlog) < 0) {
     throw runtime_error(string_format("[%s] Failed to start listening for connections using TCP", name.c_str()));
   }
 }
@@ -600,7 +1105,7 @@ retry:
     throw std::runtime_error(get_strerror(errno));
   }
 
-  if (listen(service_named_socket_, kListenQueueSize) < 0) {
+  if (listen(service_named_socket_, listen_options_.backlog) < 0) {
     throw runtime_error("Failed to start listening for connections using named socket");
   }
 }
@@ -617,9 +1122,60 @@ void MySQLRouting::set_destinations_from_uri(const URI &uri) {
     if (uri.query.find("role") == uri.query.end())
       throw runtime_error("Missing 'role' in routing destination specification");
 
-    destination_.reset(new DestMetadataCacheGroup(uri.host, replicaset_name,
-                                                  get_access_mode_name(mode_),
-                                                  uri.query, protocol_->get_type()));
+    // primaries of a replicaset, as configured for the route
+    auto make_destination = [&](const std::string &replicaset) {
+      std::unique_ptr<DestMetadataCacheGroup> group(
+          new DestMetadataCacheGroup(uri.host, replicaset, get_access_mode_name(mode_),
+                                     uri.query, protocol_->get_type()));
+      group->set_route_name(name);
+      group->set_slow_start(slow_start_period_, slow_start_ramp_);
+      group->set_connection_limits(max_connections_per_destination_, connection_queue_length_,
+                                   connection_queue_timeout_);
+      group->set_drain_grace_period(drain_grace_period_);
+      group->set_local_sockets(local_sockets_);
+      group->set_spillover(spillover_);
+      if (affinity_.key != routing::AffinityKey::kNone) {
+        group->set_affinity(affinity_.max_load);
+      }
+      return std::unique_ptr<RouteDestination>(std::move(group));
+    };
+    destination_ = make_destination(replicaset_name);
+
+    if (read_write_splitting_) {
+      if (uri.query.at("role") != "PRIMARY") {
+        throw runtime_error("read_write_splitting needs destinations with role=PRIMARY");
+      }
+      URIQuery read_query(uri.query);
+      read_query["role"] = "SECONDARY";
+      std::unique_ptr<DestMetadataCacheGroup> reads(
+          new DestMetadataCacheGroup(uri.host, replicaset_name, "read-only", read_query,
+                                     protocol_->get_type()));
+      reads->set_spillover(spillover_);
+      read_destination_ = std::move(reads);
+      read_destination_->set_route_name(name);
+      read_destination_->set_slow_start(slow_start_period_, slow_start_ramp_);
+      read_destination_->set_connection_limits(max_connections_per_destination_, 0,
+                                               connection_queue_timeout_);
+      read_destination_->set_drain_grace_period(drain_grace_period_);
+      read_destination_->set_local_sockets(local_sockets_);
+    }
+
+    if (!schema_sharding_.empty()) {
+      if (uri.query.at("role") != "PRIMARY") {
+        throw runtime_error("schema_sharding needs destinations with role=PRIMARY");
+      }
+      shard_map_.reset(new SchemaShardMap(schema_sharding_, replicaset_name));
+      shard_destinations_.clear();
+      for (auto &shard : shard_map_->get_replicasets()) {
+        if (shard == replicaset_name) {
+          continue;  // destination_
+        }
+        shard_destinations_[shard] = make_destination(shard);
+      }
+    } else if (affinity_.needs_handshake() || (routing_rules_ && routing_rules_->needs_handshake())) {
+      // all schemas on the replicaset of the destinations
+      shard_map_.reset(new SchemaShardMap("", replicaset_name));
+    }
   } else {
     throw runtime_error(string_format("Invalid URI scheme; expecting: 'metadata-cache' is: '%s'",
                                       uri.scheme.c_str()));
@@ -627,6 +1183,18 @@ void MySQLRouting::set_destinations_from_uri(const URI &uri) {
 }
 
 void MySQLRouting::set_destinations_from_csv(const string &csv) {
+  if (read_write_splitting_) {
+    throw std::runtime_error("read_write_splitting needs Metadata Cache destinations");
+  }
+  if (affinity_.key != routing::AffinityKey::kNone) {
+    throw std::runtime_error("affinity needs Metadata Cache destinations");
+  }
+  if (routing_rules_ && routing_rules_->filters_destinations()) {
+    throw std::runtime_error("routing_rules with servers or location need Metadata Cache destinations");
+  }
+  if (!schema_sharding_.empty()) {
+    throw std::runtime_error("schema_sharding needs Metadata Cache destinations");
+  }
   std::stringstream ss(csv);
   std::string part;
   std::pair<std::string, uint16_t> info;
@@ -639,8 +1207,24 @@ void MySQLRouting::set_destinations_from_csv(const string &csv) {
   } else {
     throw std::runtime_error("Unknown mode");
   }
+  destination_->set_route_name(name);
+  destination_->set_slow_start(slow_start_period_, slow_start_ramp_);
+  destination_->set_connection_limits(max_connections_per_destination_, connection_queue_length_,
+                                      connection_queue_timeout_);
+  destination_->set_local_sockets(local_sockets_);
   // Fall back to comma separated list of MySQL servers
   while (std::getline(ss, part, ',')) {
+    mysqlrouter::trim(part);
+    if (!part.empty() && part[0] == '/') {
+      // Unix socket of a server on this host
+      std::string error;
+      TCPAddress socket_addr(part, 0);
+      if (!routing::is_local_socket(socket_addr) || !is_valid_socket_name(part, error)) {
+        throw std::runtime_error(string_format("Destination socket '%s' is invalid", part.c_str()));
+      }
+      destination_->add(socket_addr);
+      continue;
+    }
     info = mysqlrouter::split_addr_port(part);
     if (info.second == 0) {
       info.second = Protocol::get_default_port(protocol_->get_type());
@@ -665,18 +1249,18 @@ void MySQLRouting::set_destinations_from_csv(const string &csv) {
   }
 }
 
-int MySQLRouting::set_destination_connect_timeout(int seconds) {
-  if (seconds <= 0 || seconds > UINT16_MAX) {
-    auto err = string_format("[%s] tried to set destination_connect_timeout using invalid value, was '%d'",
-                             name.c_str(), seconds);
+std::chrono::milliseconds MySQLRouting::set_destination_connect_timeout(std::chrono::milliseconds timeout) {
+  if (timeout.count() <= 0 || timeout > std::chrono::seconds(UINT16_MAX)) {
+    auto err = string_format("[%s] tried to set destination_connect_timeout using invalid value, was '%s'",
+                             name.c_str(), mysqlrouter::ms_to_string(timeout).c_str());
     throw std::invalid_argument(err);
   }
-  destination_connect_timeout_ = seconds;
+  destination_connect_timeout_ = timeout;
   return destination_connect_timeout_;
 }
 
 int MySQLRouting::set_max_connections(int maximum) {
-  if (maximum <= 0 || maximum > UINT16_MAX) {
+  if (maximum <= 0 || maximum > routing::kMaxConnectionsLimit) {
     auto err = string_format("[%s] tried to set max_connections using invalid value, was '%d'", name.c_str(),
                              maximum);
     throw std::invalid_argument(err);
@@ -684,3 +1268,146 @@ int MySQLRouting::set_max_connections(int maximum) {
   max_connections_ = maximum;
   return max_connections_;
 }
+
+void MySQLRouting::set_connection_limits(size_t max_per_destination, size_t queue_length,
+                                         std::chrono::milliseconds queue_timeout) {
+  max_connections_per_destination_ = max_per_destination;
+  connection_queue_length_ = queue_length;
+  connection_queue_timeout_ = queue_timeout;
+  admission_queue_.configure(queue_length, queue_timeout);
+}
+
+void MySQLRouting::set_read_write_splitting(const std::string &user, const std::string &password) {
+  if (protocol_->get_type() != Protocol::Type::kClassicProtocol) {
+    throw std::invalid_argument("read_write_splitting is only supported with the classic protocol");
+  }
+  if (!schema_sharding_.empty()) {
+    throw std::invalid_argument("schema_sharding can not be used with read_write_splitting");
+  }
+  if (affinity_.needs_handshake()) {
+    throw std::invalid_argument("affinity on the handshake can not be used with read_write_splitting");
+  }
+  if (routing_rules_ && routing_rules_->needs_handshake()) {
+    throw std::invalid_argument("routing_rules on the handshake can not be used with read_write_splitting");
+  }
+  read_write_splitting_ = true;
+  split_user_ = user;
+  split_password_ = password;
+}
+
+void MySQLRouting::set_schema_sharding(const std::string &shard_map) {
+  if (protocol_->get_type() != Protocol::Type::kClassicProtocol) {
+    throw std::invalid_argument("schema_sharding is only supported with the classic protocol");
+  }
+  if (read_write_splitting_) {
+    throw std::invalid_argument("schema_sharding can not be used with read_write_splitting");
+  }
+  // checked now; the default replicaset is known with the destinations
+  SchemaShardMap checked(shard_map, kDefaultReplicaSetName);
+  schema_sharding_ = shard_map;
+}
+
+void MySQLRouting::set_affinity(const routing::AffinityOptions &options) {
+  if (options.needs_handshake()) {
+    if (protocol_->get_type() != Protocol::Type::kClassicProtocol) {
+      throw std::invalid_argument("affinity on the handshake is only supported with the classic protocol");
+    }
+    if (read_write_splitting_) {
+      throw std::invalid_argument("affinity on the handshake can not be used with read_write_splitting");
+    }
+  }
+  affinity_ = options;
+}
+
+void MySQLRouting::set_routing_rules(const std::string &rules) {
+  std::unique_ptr<RoutingRules> parsed(new RoutingRules(rules));
+  if (parsed->needs_handshake()) {
+    if (protocol_->get_type() != Protocol::Type::kClassicProtocol) {
+      throw std::invalid_argument("routing_rules on the handshake are only supported with the classic protocol");
+    }
+    if (read_write_splitting_) {
+      throw std::invalid_argument("routing_rules on the handshake can not be used with read_write_splitting");
+    }
+  }
+  if (parsed->size() > 0) {
+    routing_rules_ = std::move(parsed);
+  } else {
+    routing_rules_.reset();
+  }
+}
+
+void MySQLRouting::set_tls(const routing::TlsOptions &options) {
+  if (protocol_->get_type() != Protocol::Type::kClassicProtocol) {
+    throw std::invalid_argument("tls_termination is only supported with the classic protocol");
+  }
+  if (read_write_splitting_) {
+    throw std::invalid_argument("tls_termination can not be used with read_write_splitting");
+  }
+  if (!schema_sharding_.empty() || affinity_.needs_handshake() ||
+      (routing_rules_ && routing_rules_->needs_handshake())) {
+    throw std::invalid_argument("tls_termination can not be used with schema_sharding, nor with "
+                                "affinity or routing_rules on the handshake");
+  }
+  tls_server_context_.reset(new TlsServerContext(options.cert, options.key,
+                                                 options.session_cache_size,
+                                                 options.session_timeout, name));
+  if (options.server_tls) {
+    tls_client_context_.reset(new TlsClientContext(options.server_ca));
+  } else {
+    tls_client_context_.reset();
+  }
+  log_info("[%s] terminating TLS of clients; up to %u sessions resumable for %llds, %s to destinations",
+           name.c_str(), options.session_cache_size,
+           static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(
+               options.session_timeout).count()),
+           options.server_tls ? "TLS" : "plaintext");
+}
+
+std::string MySQLRouting::get_affinity_key(const sockaddr_storage &client_addr,
+                                           const ShardSession *session) const {
+  switch (affinity_.key) {
+    case routing::AffinityKey::kClientAddress:
+      return get_address_host(client_addr);
+    case routing::AffinityKey::kUser:
+      return session ? session->get_user() : std::string();
+    case routing::AffinityKey::kSchema:
+      return session ? session->get_schema() : std::string();
+    case routing::AffinityKey::kConnectAttribute:
+      if (session) {
+        auto attributes = session->get_connect_attributes();
+        auto it = attributes.find(affinity_.connect_attribute);
+        if (it != attributes.end()) {
+          return it->second;
+        }
+      }
+      return std::string();
+    case routing::AffinityKey::kNone:
+      break;
+  }
+  return std::string();
+}
+
+std::string MySQLRouting::get_shard_server_version() {
+  std::lock_guard<std::mutex> lock(mutex_shard_server_version_);
+  return shard_server_version_;
+}
+
+void MySQLRouting::set_shard_server_version(const std::string &version) {
+  std::lock_guard<std::mutex> lock(mutex_shard_server_version_);
+  shard_server_version_ = version;
+}
+
+bool MySQLRouting::take_connection_slot() noexcept {
+  int current = admitted_routes_.load();
+  while (current < max_connections_) {
+    if (admitted_routes_.compare_exchange_weak(current, current + 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void MySQLRouting::release_connection_slot() noexcept {
+  --admitted_routes_;
+  admission_queue_.notify();
+}
@@ -27,17 +27,25 @@
  */
 
 #include "protocol/base_protocol.h"
+#include "admission_queue.h"
 #include "config.h"
+#include "connection_registry.h"
 #include "destination.h"
 #include "filesystem.h"
 #include "mysqlrouter/datatypes.h"
 #include "mysqlrouter/mysql_protocol.h"
 #include "plugin_config.h"
+#include "routing_metrics.h"
+#include "routing_rules.h"
+#include "schema_shard_map.h"
+#include "slow_start.h"
+#include "tls_context.h"
 #include "utils.h"
 #include "mysqlrouter/routing.h"
 
 #include <array>
 #include <atomic>
+#include <chrono>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -74,6 +82,8 @@
 using std::string;
 using mysqlrouter::URI;
 
+class ShardSession;
+
 /** @class MySQLRoutering
  *  @brief Manage Connections from clients to MySQL servers
  *
@@ -118,7 +128,7 @@ public:
    * @param max_connections Maximum allowed active connections
    * @param destination_connect_timeout Timeout trying to connect destination server
    * @param max_connect_errors Maximum connect or handshake errors per host
-   * @param connect_timeout Timeout waiting for handshake response
+   * @param client_connect_timeout Timeout waiting for handshake response
    * @param net_buffer_length length of the network buffer
    * @param socket_operations object handling the operations on network sockets
    */
@@ -128,9 +138,9 @@ public:
                const mysql_harness::Path& named_socket = mysql_harness::Path(),
                const string &route_name = string{},
                int max_connections = routing::kDefaultMaxConnections,
-               int destination_connect_timeout = routing::kDefaultDestinationConnectionTimeout,
+               std::chrono::milliseconds destination_connect_timeout = routing::kDefaultDestinationConnectionTimeout,
                unsigned long long max_connect_errors = routing::kDefaultMaxConnectErrors,
-               unsigned int connect_timeout = routing::kDefaultClientConnectTimeout,
+               std::chrono::milliseconds client_connect_timeout = routing::kDefaultClientConnectTimeout,
                unsigned int net_buffer_length = routing::kDefaultNetBufferLength,
                routing::SocketOperationsBase *socket_operations = routing::SocketOperations::instance());
 
@@ -179,28 +189,28 @@ public:
 
   /** @brief Returns timeout when connecting to destination
    *
-   * @return Timeout in seconds as int
+   * @return Timeout in milliseconds
    */
-  int get_destination_connect_timeout() const noexcept {
+  std::chrono::milliseconds get_destination_connect_timeout() const noexcept {
     return destination_connect_timeout_;
   }
 
   /** @brief Sets timeout when connecting to destination
    *
-   * Sets timeout connecting with destination servers. Timeout in seconds must be between 1 and
-   * 65535.
+   * Sets timeout connecting with destination servers. Timeout must be between 1 millisecond
+   * and 65535 seconds.
    *
    * Throws std::invalid_argument when an invalid value was provided.
    *
-   * @param seconds Timeout in seconds
-   * @return New value as int
+   * @param timeout Timeout in milliseconds
+   * @return New value
    */
-  int set_destination_connect_timeout(int seconds);
+  std::chrono::milliseconds set_destination_connect_timeout(std::chrono::milliseconds timeout);
 
   /** @brief Sets maximum active connections
    *
    * Sets maximum of active connections. Maximum must be between 1 and
-   * 65535.
+   * routing::kMaxConnectionsLimit.
    *
    * Throws std::invalid_argument when an invalid value was provided.
    *
@@ -242,6 +252,241 @@ public:
     return max_connections_;
   }
 
+  /** @brief Returns number of active routes
+   *
+   * A route is active once the connection to the destination is made
+   * and until either side closes it.
+   *
+   * @return Number of active routes as int
+   */
+  int get_active_routes() const noexcept {
+    return info_active_routes_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Sets slow-start of destinations
+   *
+   * Destinations which become available again get a reduced share of new
+   * connections during the given period. Must be called before the
+   * destinations are set.
+   *
+   * @param period slow-start period; 0 disables slow-start
+   * @param ramp how the share of a destination grows during the period
+   */
+  void set_slow_start(std::chrono::milliseconds period, SlowStart::Ramp ramp) noexcept {
+    slow_start_period_ = period;
+    slow_start_ramp_ = ramp;
+  }
+
+  /** @brief Sets connection limits and admission queue
+   *
+   * Clients exceeding max_connections, or for which all destinations
+   * reached max_per_destination, wait for a free slot instead of getting
+   * error 1040 right away. At most queue_length clients wait, each for
+   * at most queue_timeout. Must be called before the destinations are set.
+   *
+   * @param max_per_destination maximum connections to a single destination; 0 means unlimited
+   * @param queue_length number of clients which can wait; 0 disables waiting
+   * @param queue_timeout how long a client waits at most
+   */
+  void set_connection_limits(size_t max_per_destination, size_t queue_length,
+                             std::chrono::milliseconds queue_timeout);
+
+  /** @brief Sets how long connections to destinations which left the topology are kept
+   *
+   * Only used with Metadata Cache destinations. Connections to a primary
+   * which was demoted are closed right away on read-write routes. Must be
+   * called before the destinations are set.
+   *
+   * @param period time given to the connections; 0 closes them right away
+   */
+  void set_drain_grace_period(std::chrono::milliseconds period) noexcept {
+    drain_grace_period_ = period;
+  }
+
+  /** @brief Sets Unix sockets of servers on this host
+   *
+   * Destinations on this host whose port has a socket are connected
+   * through it instead of loopback TCP; see
+   * RouteDestination::set_local_sockets(). The server then authenticates
+   * these clients as user@localhost over a secure transport. Must be called
+   * before the destinations are set.
+   *
+   * @param sockets paths of sockets by TCP port
+   */
+  void set_local_sockets(const std::map<uint16_t, std::string> &sockets) {
+    local_sockets_ = sockets;
+  }
+
+  /** @brief Sets when read-only connections spill over to the primary
+   *
+   * Used by metadata-cache destinations with allow_primary_reads=spillover;
+   * see DestMetadataCacheGroup::set_spillover(). Must be called before the
+   * destinations are set.
+   *
+   * @param options thresholds of the secondaries and limit of the primary
+   */
+  void set_spillover(const routing::SpilloverOptions &options) noexcept {
+    spillover_ = options;
+  }
+
+  /** @brief Sets options of the sockets of routed connections
+   *
+   * Must be called before start().
+   *
+   * @param client options of client sockets accepted over TCP
+   * @param server options of sockets connected to destinations
+   */
+  void set_socket_options(const routing::SocketOptions &client,
+                          const routing::SocketOptions &server) noexcept {
+    client_socket_options_ = client;
+    server_socket_options_ = server;
+  }
+
+  /** @brief Sets how long routed connections may idle
+   *
+   * Idle connections are looked for by the acceptor, so they are closed up
+   * to a poll interval late. Must be called before start().
+   *
+   * @param client_idle_timeout how long clients may send nothing after the
+   *        server answered; 0 disables
+   * @param server_idle_timeout how long the server may take to answer the
+   *        client; 0 disables
+   */
+  void set_idle_timeouts(std::chrono::milliseconds client_idle_timeout,
+                         std::chrono::milliseconds server_idle_timeout) noexcept {
+    client_idle_timeout_ = client_idle_timeout;
+    server_idle_timeout_ = server_idle_timeout;
+  }
+
+  /** @brief Sends reads of classic protocol clients to secondaries
+   *
+   * Only for Metadata Cache destinations with role PRIMARY; the secondaries
+   * are those of the same replicaset. Secondaries are connected with the
+   * account and password of each client, see ReadWriteSplitter. Must be
+   * called before the destinations are set.
+   *
+   * @warning With a shared account, the reads of all clients run on the
+   * secondaries with the privileges of that account instead of their own.
+   *
+   * @param user shared account used with secondaries for all clients; empty
+   *        to use the account of each client
+   * @param password password of the shared account
+   * @throws std::invalid_argument when the route does not use the classic protocol
+   */
+  void set_read_write_splitting(const std::string &user, const std::string &password);
+
+  /** @brief Routes classic protocol clients to a replicaset by their default schema
+   *
+   * Only for Metadata Cache destinations with role PRIMARY; the replicaset
+   * of the destinations is the default one. See SchemaShardMap for the
+   * syntax of the map and ShardSession for what the router does with the
+   * handshake. Must be called before the destinations are set.
+   *
+   * @param shard_map schemas and their replicasets
+   * @throws std::invalid_argument when the map is invalid, the route does not
+   *         use the classic protocol, or splits reads and writes
+   */
+  void set_schema_sharding(const std::string &shard_map);
+
+  /** @brief Keeps clients with the same key on the same server
+   *
+   * Only for Metadata Cache destinations. In read-write mode it matters
+   * with multiple primaries: writers of the same tenant then meet on the
+   * same primary, which avoids certification conflicts. In read-only mode,
+   * with the schema as key, each secondary serves a stable subset of the
+   * tenants and keeps only their data in its buffer pool. See
+   * DestMetadataCacheGroup::set_affinity(). Keys from the handshake
+   * response make the router greet clients itself, like schema sharding
+   * does. Must be called before the destinations are set.
+   *
+   * @param options what keeps clients together, and the load bound of servers
+   * @throws std::invalid_argument when the key needs the handshake response
+   *         and the route does not use the classic protocol, or splits reads
+   *         and writes
+   */
+  void set_affinity(const routing::AffinityOptions &options);
+
+  /** @brief Routes clients by their user, connection attributes, schema or subnet
+   *
+   * See RoutingRules for the syntax. Rules on the handshake response make
+   * the router greet clients itself, like schema sharding does. Rules
+   * restricting servers or location need Metadata Cache destinations. Must
+   * be called before the destinations are set.
+   *
+   * @param rules routing rules
+   * @throws std::invalid_argument when the rules are invalid, or look at the
+   *         handshake response and the route does not use the classic
+   *         protocol, or splits reads and writes
+   */
+  void set_routing_rules(const std::string &rules);
+
+  /** @brief Terminates TLS of clients at the router
+   *
+   * Only for the classic protocol; see TlsSession. Not with features which
+   * greet clients themselves, like schema sharding, nor with read/write
+   * splitting. Must be called after those are set, and before start().
+   *
+   * @param options certificate, session cache and TLS with destinations
+   * @throws std::invalid_argument when the route can not terminate TLS
+   * @throws std::runtime_error when TLS is not supported, or the certificate
+   *         or key can not be used
+   */
+  void set_tls(const routing::TlsOptions &options);
+
+  /** @brief Sets options of the listening sockets
+   *
+   * The backlog is also used for the named socket. Must be called before start().
+   *
+   * @param options listen options
+   */
+  void set_listen_options(const routing::ListenOptions &options) noexcept {
+    listen_options_ = options;
+  }
+
+  /** @brief Returns the queue of clients waiting for max_connections
+   *
+   * Clients waiting because of per-destination limits are found in
+   * get_destination_admission_queue().
+   */
+  const AdmissionQueue &get_admission_queue() const noexcept {
+    return admission_queue_;
+  }
+
+  /** @brief Returns the queue of clients waiting for a destination */
+  const AdmissionQueue &get_destination_admission_queue() const noexcept {
+    return destination_->get_admission_queue();
+  }
+
+  /** @brief Returns number of accepts which failed for lack of file descriptors */
+  uint64_t get_refused_accepts() const noexcept {
+    return refused_accepts_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Returns number of clients rejected with an error while out of file descriptors
+   *
+   * These clients were accepted using a descriptor kept in reserve, and
+   * got error 1040 instead of hanging in the listen backlog.
+   */
+  uint64_t get_rejected_on_exhaustion() const noexcept {
+    return rejected_on_exhaustion_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Returns the state of the routed connections
+   *
+   * Connections are listed once connected to their destination and until
+   * either side closes them.
+   */
+  std::vector<ConnectionRegistry::ConnectionInfo> get_connections() const {
+    return connections_.get_connections();
+  }
+
+  /** @brief Closes all routed connections to a destination
+   *
+   * @param destination address of the destination, like "192.168.1.10:3306"
+   * @return number of connections closed
+   */
+  size_t close_connections_to(const std::string &destination) noexcept;
+
 private:
   /** @brief Sets up the TCP service
    *
@@ -275,6 +520,56 @@ private:
 
   void start_acceptor();
 
+  /** @brief Handles accept() failing on a service socket
+   *
+   * When we are out of file descriptors, the pending client is rejected
+   * using the spare descriptor, and accepts are paused for an
+   * exponentially growing time. Errors are logged at most every few
+   * seconds while this lasts.
+   *
+   * @param service_socket socket on which accept() failed
+   * @param kind kind of connection, for logging
+   */
+  void handle_accept_error(int service_socket, const char *kind) noexcept;
+
+  /** @brief Returns the affinity key of a client; empty for none
+   *
+   * @param client_addr address of the client
+   * @param session session of the client when the router greeted it; may be nullptr
+   */
+  std::string get_affinity_key(const sockaddr_storage &client_addr,
+                               const ShardSession *session) const;
+
+  /** @brief Returns the server version told to clients of sharded routes */
+  std::string get_shard_server_version();
+
+  /** @brief Sets the server version told to clients of sharded routes */
+  void set_shard_server_version(const std::string &version);
+
+  /** @brief Ends a pause started by handle_accept_error() */
+  void accept_succeeded() noexcept;
+
+  /** @brief Closes connections to destinations whose drain is due
+   *
+   * Called by the acceptor on each loop, so at least once per poll interval.
+   */
+  void drain_destinations() noexcept;
+
+  /** @brief Closes connections which idled for too long
+   *
+   * Called by the acceptor on each loop, like drain_destinations().
+   */
+  void close_idle_connections() noexcept;
+
+  /** @brief Takes one of the max_connections slots
+   *
+   * @return false when all slots are taken
+   */
+  bool take_connection_slot() noexcept;
+
+  /** @brief Gives back a slot taken with take_connection_slot() */
+  void release_connection_slot() noexcept;
+
   /** @brief return a short string suitable to be used as a thread name
    * @param config_name configuration name (e.g: "routing", "routing:test_default_x_ro", etc)
    * @param prefix thread name prefix (e.g. "RtS")
@@ -299,13 +594,63 @@ private:
    * tried. It is good to leave this time out to 1 second or higher
    * if using an unstable network.
    */
-  int destination_connect_timeout_;
+  std::chrono::milliseconds destination_connect_timeout_;
   /** @brief Max connect errors blocking hosts when handshake not completed */
   unsigned long long max_connect_errors_;
   /** @brief Timeout waiting for handshake response from client */
-  unsigned int client_connect_timeout_;
+  std::chrono::milliseconds client_connect_timeout_;
   /** @brief Size of buffer to store receiving packets */
   unsigned int net_buffer_length_;
+  /** @brief Slow-start period of destinations (0 = disabled) */
+  std::chrono::milliseconds slow_start_period_;
+  /** @brief How the share of a destination in slow-start grows */
+  SlowStart::Ramp slow_start_ramp_;
+  /** @brief Maximum connections to a single destination (0 = unlimited) */
+  size_t max_connections_per_destination_;
+  /** @brief Number of clients which can wait for a connection slot */
+  size_t connection_queue_length_;
+  /** @brief How long clients wait for a connection slot */
+  std::chrono::milliseconds connection_queue_timeout_;
+  /** @brief Time given to connections to destinations which left the topology */
+  std::chrono::milliseconds drain_grace_period_;
+  /** @brief Unix sockets of servers on this host, by TCP port */
+  std::map<uint16_t, std::string> local_sockets_;
+  /** @brief When read-only connections spill over to the primary */
+  routing::SpilloverOptions spillover_;
+  /** @brief How long clients may idle; 0 = no timeout */
+  std::chrono::milliseconds client_idle_timeout_;
+  /** @brief How long destinations may take to answer; 0 = no timeout */
+  std::chrono::milliseconds server_idle_timeout_;
+  /** @brief Whether reads are sent to secondaries */
+  bool read_write_splitting_;
+  /** @brief Shared account used with secondaries; empty for the account of each client */
+  std::string split_user_;
+  /** @brief Password of split_user_ */
+  std::string split_password_;
+  /** @brief Map of schemas to replicasets; empty without schema sharding */
+  std::string schema_sharding_;
+  /** @brief Parsed schema_sharding_, once the destinations are set; a map
+   *         without entries when only the affinity needs the handshake */
+  std::unique_ptr<SchemaShardMap> shard_map_;
+  /** @brief Primaries of the replicasets of shard_map_, except the one of destination_ */
+  std::map<std::string, std::unique_ptr<RouteDestination>> shard_destinations_;
+  /** @brief Version of the last server which greeted a client of a sharded route */
+  std::string shard_server_version_;
+  std::mutex mutex_shard_server_version_;
+  /** @brief Affinity of clients to servers */
+  routing::AffinityOptions affinity_;
+  /** @brief Rules deciding per client where it may go; nullptr for none */
+  std::unique_ptr<RoutingRules> routing_rules_;
+  /** @brief TLS with clients; nullptr when the route does not terminate TLS */
+  std::unique_ptr<TlsServerContext> tls_server_context_;
+  /** @brief TLS with destinations; nullptr for plaintext */
+  std::unique_ptr<TlsClientContext> tls_client_context_;
+  /** @brief Options of client sockets accepted over TCP */
+  routing::SocketOptions client_socket_options_;
+  /** @brief Options of sockets connected to destinations */
+  routing::SocketOptions server_socket_options_;
+  /** @brief Options of the TCP service socket */
+  routing::ListenOptions listen_options_;
   /** @brief IP address and TCP port for setting up TCP service */
   const mysqlrouter::TCPAddress bind_address_;
   /** @brief Path to named socket for setting up named socket service */
@@ -316,16 +661,47 @@ private:
   int service_named_socket_;
   /** @brief Destination object to use when getting next connection */
   std::unique_ptr<RouteDestination> destination_;
+  /** @brief Secondaries used by read/write splitting; null without */
+  std::unique_ptr<RouteDestination> read_destination_;
   /** @brief Whether we were asked to stop */
   std::atomic<bool> stopping_;
   /** @brief Number of active routes */
-  std::atomic<uint16_t> info_active_routes_;
+  std::atomic<int> info_active_routes_;
   /** @brief Number of handled routes */
   std::atomic<uint64_t> info_handled_routes_;
+  /** @brief Number of clients holding a max_connections slot
+   *
+   * Unlike info_active_routes_, this includes clients for which we are
+   * still connecting to a destination.
+   */
+  std::atomic<int> admitted_routes_;
+  /** @brief Clients waiting for a max_connections slot */
+  AdmissionQueue admission_queue_;
+
+  /** @brief Descriptor kept in reserve for rejecting clients when out of descriptors */
+  int spare_fd_;
+  /** @brief How long the acceptor pauses before accepting again */
+  std::chrono::milliseconds accept_pause_;
+  /** @brief When an accept error was logged last */
+  std::chrono::steady_clock::time_point last_accept_error_log_;
+  /** @brief Accept errors since the last one logged */
+  uint64_t accept_errors_since_log_;
+  /** @brief Number of accepts which failed for lack of file descriptors */
+  std::atomic<uint64_t> refused_accepts_;
+  /** @brief Number of clients rejected using the spare descriptor */
+  std::atomic<uint64_t> rejected_on_exhaustion_;
+
+  /** @brief Metrics of the route */
+  RouteMetrics metrics_;
 
   /** @brief Connection error counters for IPv4 or IPv6 hosts */
   mutable std::mutex mutex_conn_errors_;
   std::map<std::array<uint8_t, 16>, size_t> conn_error_counters_;
+  /** @brief Blocked client hosts, for metrics */
+  std::vector<std::string> blocked_hosts_;
+
+  /** @brief Connections being routed */
+  ConnectionRegistry connections_;
 
   /** @brief TCP (and UNIX socket) service thread */
   std::thread thread_acceptor_;
@@ -22,6 +22,7 @@
 
 #include <algorithm>
 #include <exception>
+#include <memory>
 #include <vector>
 
 #include "mysqlrouter/utils.h"
@@ -33,6 +34,27 @@ using mysqlrouter::URI;
 using mysqlrouter::URIError;
 using mysqlrouter::to_string;
 
+// whether destinations follow a replicaset
+static bool is_metadata_cache_destinations(const std::string &destinations) {
+  try {
+    return URI(destinations, false).scheme == "metadata-cache";
+  } catch (const URIError &) {
+    return false;
+  }
+}
+
+// whether destinations are the primaries of a replicaset
+static bool is_primary_destinations(const std::string &destinations) {
+  try {
+    URI uri(destinations, false);
+    auto role = uri.query.find("role");
+    return uri.scheme == "metadata-cache" && role != uri.query.end() && role->second == "PRIMARY";
+  } catch (const URIError &) {
+    // a list of addresses; nothing tells which are primaries
+    return false;
+  }
+}
+
 //master:
 /** @brief Constructor
  *
@@ -45,17 +67,154 @@ RoutingPluginConfig::RoutingPluginConfig(const mysql_harness::ConfigSection *sec
       bind_port(get_option_tcp_port(section, "bind_port")),
       bind_address(get_option_tcp_address(section, "bind_address", false, bind_port)),
       named_socket(get_option_named_socket(section, "socket")),
-      connect_timeout(get_uint_option<uint16_t>(section, "connect_timeout", 1)),
+      connect_timeout(get_option_milliseconds(section, "connect_timeout",
+                                              std::chrono::milliseconds(1), std::chrono::seconds(UINT16_MAX))),
       mode(get_option_mode(section, "mode")),
-      max_connections(get_uint_option<uint16_t>(section, "max_connections", 1)),
+      max_connections(get_uint_option<int>(section, "max_connections", 1, routing::kMaxConnectionsLimit)),
       max_connect_errors(get_uint_option<uint32_t>(section, "max_connect_errors", 1, UINT32_MAX)),
-      client_connect_timeout(get_uint_option<uint32_t>(section, "client_connect_timeout", 2, 31536000)),
-      net_buffer_length(get_uint_option<uint32_t>(section, "net_buffer_length", 1024, 1048576)) {
+      client_connect_timeout(get_option_milliseconds(section, "client_connect_timeout",
+                                                     std::chrono::seconds(2), std::chrono::seconds(31536000))),
+      net_buffer_length(get_uint_option<uint32_t>(section, "net_buffer_length", 1024, 1048576)),
+      slow_start_period(get_option_milliseconds(section, "slow_start_period",
+                                                std::chrono::seconds(0), std::chrono::seconds(3600))),
+      slow_start_ramp(get_option_slow_start_ramp(section, "slow_start_ramp")),
+      max_connections_per_destination(get_uint_option<uint32_t>(section, "max_connections_per_destination", 0,
+                                                                static_cast<uint32_t>(routing::kMaxConnectionsLimit))),
+      connection_queue_length(get_uint_option<uint32_t>(section, "connection_queue_length", 0,
+                                                        static_cast<uint32_t>(routing::kMaxConnectionsLimit))),
+      connection_queue_timeout(get_option_milliseconds(section, "connection_queue_timeout",
+                                                       std::chrono::milliseconds(1), std::chrono::seconds(3600))),
+      drain_grace_period(get_option_milliseconds(section, "drain_grace_period",
+                                                 std::chrono::seconds(0), std::chrono::seconds(3600))),
+      client_idle_timeout(get_option_milliseconds(section, "client_idle_timeout",
+                                                  std::chrono::seconds(0), std::chrono::seconds(31536000))),
+      server_idle_timeout(get_option_milliseconds(section, "server_idle_timeout",
+                                                  std::chrono::seconds(0), std::chrono::seconds(31536000))),
+      client_socket_options(get_option_socket_options(section, "client_")),
+      server_socket_options(get_option_socket_options(section, "server_")),
+      listen_options(get_option_listen_options(section, protocol)),
+      read_write_splitting(get_uint_option<uint32_t>(section, "read_write_splitting", 0, 1) == 1),
+      read_write_splitting_shared_account(
+          get_uint_option<uint32_t>(section, "read_write_splitting_shared_account", 0, 1) == 1),
+      read_write_splitting_user(get_option_string(section, "read_write_splitting_user")),
+      schema_sharding(get_option_string(section, "schema_sharding")),
+      affinity(get_option_affinity(section)),
+      routing_rules(get_option_string(section, "routing_rules")),
+      tls(get_option_tls(section)),
+      local_sockets(get_option_local_sockets(section, "local_sockets")),
+      spillover(get_option_spillover(section)) {
 
   // either bind_address or socket needs to be set, or both
   if (!bind_address.port && !named_socket.is_set()) {
     throw invalid_argument("either bind_address or socket option needs to be supplied, or both");
   }
+
+  if (read_write_splitting) {
+    if (protocol != Protocol::Type::kClassicProtocol) {
+      throw invalid_argument(get_log_prefix("read_write_splitting") +
+                             " is only supported with protocol=classic");
+    }
+    if (!is_primary_destinations(destinations)) {
+      throw invalid_argument(get_log_prefix("read_write_splitting") +
+                             " needs metadata-cache destinations with role=PRIMARY");
+    }
+    // the privileges of the clients are not checked on secondaries with a
+    // shared account, so it has to be asked for explicitly
+    if (read_write_splitting_shared_account && read_write_splitting_user.empty()) {
+      throw invalid_argument(get_log_prefix("read_write_splitting_user") +
+                             " is required with read_write_splitting_shared_account");
+    }
+    if (!read_write_splitting_shared_account && !read_write_splitting_user.empty()) {
+      throw invalid_argument(get_log_prefix("read_write_splitting_user") +
+                             " needs read_write_splitting_shared_account=1");
+    }
+  }
+
+  if (!schema_sharding.empty()) {
+    if (protocol != Protocol::Type::kClassicProtocol) {
+      throw invalid_argument(get_log_prefix("schema_sharding") +
+                             " is only supported with protocol=classic");
+    }
+    if (read_write_splitting) {
+      throw invalid_argument(get_log_prefix("schema_sharding") +
+                             " can not be used with read_write_splitting");
+    }
+    if (!is_primary_destinations(destinations)) {
+      throw invalid_argument(get_log_prefix("schema_sharding") +
+                             " needs metadata-cache destinations with role=PRIMARY");
+    }
+    try {
+      SchemaShardMap checked(schema_sharding, "default");
+    } catch (const invalid_argument &exc) {
+      throw invalid_argument(get_log_prefix("schema_sharding") + " is invalid: " + exc.what());
+    }
+  }
+
+  if (affinity.key != routing::AffinityKey::kNone) {
+    if (!is_metadata_cache_destinations(destinations)) {
+      throw invalid_argument(get_log_prefix("affinity") + " needs metadata-cache destinations");
+    }
+    if (affinity.needs_handshake()) {
+      if (protocol != Protocol::Type::kClassicProtocol) {
+        throw invalid_argument(get_log_prefix("affinity") + " on the handshake is only supported "
+                               "with protocol=classic");
+      }
+      if (read_write_splitting) {
+        throw invalid_argument(get_log_prefix("affinity") + " on the handshake can not be used "
+                               "with read_write_splitting");
+      }
+    }
+  }
+
+  if (spillover.is_set() && !is_metadata_cache_destinations(destinations)) {
+    const char *option = spillover.connections > 0 ? "spillover_connections" :
+                         spillover.latency.count() > 0 ? "spillover_latency" : "spillover_max_connections";
+    throw invalid_argument(get_log_prefix(option) + " needs metadata-cache destinations");
+  }
+
+  if (!routing_rules.empty()) {
+    std::unique_ptr<RoutingRules> checked;
+    try {
+      checked.reset(new RoutingRules(routing_rules));
+    } catch (const invalid_argument &exc) {
+      throw invalid_argument(get_log_prefix("routing_rules") + " is invalid: " + exc.what());
+    }
+    if (checked->needs_handshake()) {
+      if (protocol != Protocol::Type::kClassicProtocol) {
+        throw invalid_argument(get_log_prefix("routing_rules") + " on the handshake are only supported "
+                               "with protocol=classic");
+      }
+      if (read_write_splitting) {
+        throw invalid_argument(get_log_prefix("routing_rules") + " on the handshake can not be used "
+                               "with read_write_splitting");
+      }
+    }
+    if (checked->filters_destinations() && !is_metadata_cache_destinations(destinations)) {
+      throw invalid_argument(get_log_prefix("routing_rules") + " with servers or location need "
+                             "metadata-cache destinations");
+    }
+    if (tls.enabled && checked->needs_handshake()) {
+      throw invalid_argument(get_log_prefix("tls_termination") + " can not be used with "
+                             "routing_rules on the handshake");
+    }
+  }
+
+  if (tls.enabled) {
+    if (!TlsServerContext::is_supported()) {
+      throw invalid_argument(get_log_prefix("tls_termination") + " needs a router built with OpenSSL 1.x "
+                             "(-DWITH_SSL=system or a path to it)");
+    }
+    if (protocol != Protocol::Type::kClassicProtocol) {
+      throw invalid_argument(get_log_prefix("tls_termination") + " is only supported with protocol=classic");
+    }
+    if (read_write_splitting || !schema_sharding.empty() || affinity.needs_handshake()) {
+      throw invalid_argument(get_log_prefix("tls_termination") + " can not be used with "
+                             "read_write_splitting, schema_sharding or affinity on the handshake");
+    }
+    if (tls.cert.empty() || tls.key.empty()) {
+      throw invalid_argument(get_log_prefix("tls_termination") + " needs tls_cert and tls_key");
+    }
+  }
 }
 
 
@@ -63,11 +222,52 @@ string RoutingPluginConfig::get_default(const string &option) {
 
   const std::map<string, string> defaults{
       {"bind_address", to_string(routing::kDefaultBindAddress)},
-      {"connect_timeout", to_string(routing::kDefaultDestinationConnectionTimeout)},
+      {"connect_timeout", mysqlrouter::ms_to_string(routing::kDefaultDestinationConnectionTimeout)},
       {"max_connections", to_string(routing::kDefaultMaxConnections)},
       {"max_connect_errors", to_string(routing::kDefaultMaxConnectErrors)},
-      {"client_connect_timeout", to_string(routing::kDefaultClientConnectTimeout)},
+      {"client_connect_timeout", mysqlrouter::ms_to_string(routing::kDefaultClientConnectTimeout)},
       {"net_buffer_length", to_string(routing::kDefaultNetBufferLength)},
+      {"slow_start_period", mysqlrouter::ms_to_string(routing::kDefaultSlowStartPeriod)},
+      {"slow_start_ramp", "linear"},
+      {"max_connections_per_destination", to_string(routing::kDefaultMaxConnectionsPerDestination)},
+      {"connection_queue_length", to_string(routing::kDefaultConnectionQueueLength)},
+      {"connection_queue_timeout", mysqlrouter::ms_to_string(routing::kDefaultConnectionQueueTimeout)},
+      {"drain_grace_period", mysqlrouter::ms_to_string(routing::kDefaultDrainGracePeriod)},
+      {"client_idle_timeout", mysqlrouter::ms_to_string(routing::kDefaultClientIdleTimeout)},
+      {"server_idle_timeout", mysqlrouter::ms_to_string(routing::kDefaultServerIdleTimeout)},
+      {"client_keepalive_idle", "0"},
+      {"client_keepalive_interval", "0"},
+      {"client_keepalive_count", "0"},
+      {"client_user_timeout", "0"},
+      {"client_send_buffer", "0"},
+      {"client_receive_buffer", "0"},
+      {"server_keepalive_idle", mysqlrouter::ms_to_string(routing::kDefaultServerKeepaliveIdle)},
+      {"server_keepalive_interval", mysqlrouter::ms_to_string(routing::kDefaultServerKeepaliveInterval)},
+      {"server_keepalive_count", to_string(routing::kDefaultServerKeepaliveCount)},
+      {"server_user_timeout", mysqlrouter::ms_to_string(routing::kDefaultServerUserTimeout)},
+      {"server_send_buffer", "0"},
+      {"server_receive_buffer", "0"},
+      {"backlog", to_string(routing::kDefaultListenBacklog)},
+      {"defer_accept", "0"},
+      {"fastopen", "0"},
+      {"read_write_splitting", "0"},
+      {"read_write_splitting_shared_account", "0"},
+      {"read_write_splitting_user", ""},
+      {"schema_sharding", ""},
+      {"affinity", ""},
+      {"affinity_max_load", to_string(routing::kDefaultAffinityMaxLoad)},
+      {"routing_rules", ""},
+      {"tls_termination", "0"},
+      {"tls_cert", ""},
+      {"tls_key", ""},
+      {"tls_session_cache_size", to_string(routing::kDefaultTlsSessionCacheSize)},
+      {"tls_session_timeout", mysqlrouter::ms_to_string(routing::kDefaultTlsSessionTimeout)},
+      {"server_tls", "0"},
+      {"server_tls_ca", ""},
+      {"local_sockets", ""},
+      {"spillover_connections", "0"},
+      {"spillover_latency", "0"},
+      {"spillover_max_connections", "0"},
   };
 
   auto it = defaults.find(option);
@@ -108,6 +308,103 @@ routing::AccessMode RoutingPluginConfig::get_option_mode(
   return result;
 }
 
+SlowStart::Ramp RoutingPluginConfig::get_option_slow_start_ramp(
+    const mysql_harness::ConfigSection *section, const string &option) {
+  string value = get_option_string(section, option);
+  std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+  try {
+    return SlowStart::get_ramp(value);
+  } catch (const invalid_argument &exc) {
+    throw invalid_argument(get_log_prefix(option) + " is invalid; " + exc.what());
+  }
+}
+
+routing::SocketOptions RoutingPluginConfig::get_option_socket_options(
+    const mysql_harness::ConfigSection *section, const string &prefix) {
+  // limits of Linux
+  routing::SocketOptions options;
+  options.keepalive_idle = get_option_milliseconds(section, prefix + "keepalive_idle",
+                                                   std::chrono::seconds(0), std::chrono::seconds(32767));
+  options.keepalive_interval = get_option_milliseconds(section, prefix + "keepalive_interval",
+                                                       std::chrono::seconds(0), std::chrono::seconds(32767));
+  options.keepalive_count = get_uint_option<int>(section, prefix + "keepalive_count", 0, 127);
+  options.user_timeout = get_option_milliseconds(section, prefix + "user_timeout",
+                                                 std::chrono::seconds(0), std::chrono::seconds(86400));
+  options.send_buffer = get_uint_option<int>(section, prefix + "send_buffer", 0, INT32_MAX);
+  options.receive_buffer = get_uint_option<int>(section, prefix + "receive_buffer", 0, INT32_MAX);
+  return options;
+}
+
+routing::ListenOptions RoutingPluginConfig::get_option_listen_options(
+    const mysql_harness::ConfigSection *section, Protocol::Type protocol_type) {
+  routing::ListenOptions options;
+  options.backlog = get_uint_option<int>(section, "backlog", 1, 65535);
+  options.defer_accept = get_option_milliseconds(section, "defer_accept",
+                                                 std::chrono::seconds(0), std::chrono::seconds(3600));
+  options.fastopen = get_uint_option<int>(section, "fastopen", 0, 65535);
+  // with the classic protocol the server talks first; accept would wait for the timeout
+  if (options.defer_accept.count() > 0 && protocol_type == Protocol::Type::kClassicProtocol) {
+    throw invalid_argument(get_log_prefix("defer_accept") + " only works with protocol=x");
+  }
+  return options;
+}
+
+routing::AffinityOptions RoutingPluginConfig::get_option_affinity(
+    const mysql_harness::ConfigSection *section) {
+  routing::AffinityOptions options;
+  string value = get_option_string(section, "affinity");
+  try {
+    routing::parse_affinity_key(value, &options);
+  } catch (const invalid_argument &exc) {
+    throw invalid_argument(get_log_prefix("affinity") + " is invalid; " + exc.what());
+  }
+  options.max_load = get_uint_option<unsigned int>(section, "affinity_max_load", 100, 1000);
+  return options;
+}
+
+routing::TlsOptions RoutingPluginConfig::get_option_tls(const mysql_harness::ConfigSection *section) {
+  routing::TlsOptions options;
+  options.enabled = get_uint_option<uint32_t>(section, "tls_termination", 0, 1) == 1;
+  options.cert = get_option_string(section, "tls_cert");
+  options.key = get_option_string(section, "tls_key");
+  options.session_cache_size = get_uint_option<unsigned int>(section, "tls_session_cache_size", 1, 1048576);
+  options.session_timeout = get_option_milliseconds(section, "tls_session_timeout",
+                                                    std::chrono::seconds(1), std::chrono::seconds(86400));
+  options.server_tls = get_uint_option<uint32_t>(section, "server_tls", 0, 1) == 1;
+  options.server_ca = get_option_string(section, "server_tls_ca");
+  return options;
+}
+
+std::map<uint16_t, std::string> RoutingPluginConfig::get_option_local_sockets(
+    const mysql_harness::ConfigSection *section, const std::string &option) {
+  auto value = get_option_string(section, option);
+  if (value.empty()) {
+    return {};
+  }
+#ifdef _WIN32
+  throw invalid_argument(get_log_prefix(option) + " is not supported on Windows");
+#else
+  try {
+    return routing::parse_local_sockets(value);
+  } catch (const invalid_argument &exc) {
+    throw invalid_argument(get_log_prefix(option) + " is invalid: " + exc.what());
+  }
+#endif
+}
+
+routing::SpilloverOptions RoutingPluginConfig::get_option_spillover(
+    const mysql_harness::ConfigSection *section) {
+  routing::SpilloverOptions options;
+  options.connections = get_uint_option<unsigned int>(section, "spillover_connections", 0,
+                                                      routing::kMaxConnectionsLimit);
+  options.latency = get_option_milliseconds(section, "spillover_latency",
+                                            std::chrono::milliseconds(0), std::chrono::seconds(3600));
+  options.max_connections = get_uint_option<unsigned int>(section, "spillover_max_connections", 0,
+                                                          routing::kMaxConnectionsLimit);
+  return options;
+}
+
 Protocol::Type RoutingPluginConfig::get_protocol(const mysql_harness::ConfigSection *section,
                                                  const std::string &option) {
   std::string name;
@@ -180,6 +477,20 @@ string RoutingPluginConfig::get_option_destinations(const mysql_harness::ConfigS
         throw invalid_argument(get_log_prefix(option) +
                                    ": empty address found in destination list (was '" + value + "')");
       }
+      if (part[0] == '/') {
+#ifndef _WIN32
+        // Unix socket of a server on this host
+        std::string error;
+        if (!mysqlrouter::is_valid_socket_name(part, error)) {
+          throw invalid_argument(get_log_prefix(option) + " has an invalid destination socket '" + part +
+                                 "': " + error);
+        }
+        continue;
+#else
+        throw invalid_argument(get_log_prefix(option) + ": Unix sockets are not supported on Windows (was '" +
+                               part + "')");
+#endif
+      }
       try {
         info = mysqlrouter::split_addr_port(part);
       } catch (const std::runtime_error &e) {
@@ -27,9 +27,11 @@
 #include "mysqlrouter/uri.h"
 #include "mysqlrouter/utils.h"
 #include "protocol/protocol.h"
+#include "slow_start.h"
 
 #include "utils.h"
 
+#include <chrono>
 #include <map>
 #include <string>
 
@@ -67,7 +69,7 @@ public:
   /** @brief `socket` option read from configuration section is stored as named_socket */
   const mysql_harness::Path named_socket;
   /** @brief `connect_timeout` option read from configuration section */
-  const int connect_timeout;
+  const std::chrono::milliseconds connect_timeout;
   /** @brief `mode` option read from configuration section */
   const routing::AccessMode mode;
   /** @brief `max_connections` option read from configuration section */
@@ -75,9 +77,54 @@ public:
   /** @brief `max_connect_errors` option read from configuration section */
   const unsigned long long max_connect_errors;
   /** @brief `client_connect_timeout` option read from configuration section */
-  const unsigned int client_connect_timeout;
+  const std::chrono::milliseconds client_connect_timeout;
   /** @brief Size of buffer to receive packets */
   const unsigned int net_buffer_length;
+  /** @brief `slow_start_period` option read from configuration section */
+  const std::chrono::milliseconds slow_start_period;
+  /** @brief `slow_start_ramp` option read from configuration section */
+  const SlowStart::Ramp slow_start_ramp;
+  /** @brief `max_connections_per_destination` option read from configuration section */
+  const unsigned int max_connections_per_destination;
+  /** @brief `connection_queue_length` option read from configuration section */
+  const unsigned int connection_queue_length;
+  /** @brief `connection_queue_timeout` option read from configuration section */
+  const std::chrono::milliseconds connection_queue_timeout;
+  /** @brief `drain_grace_period` option read from configuration section */
+  const std::chrono::milliseconds drain_grace_period;
+  /** @brief `client_idle_timeout` option read from configuration section */
+  const std::chrono::milliseconds client_idle_timeout;
+  /** @brief `server_idle_timeout` option read from configuration section */
+  const std::chrono::milliseconds server_idle_timeout;
+  /** @brief `client_keepalive_idle`, `client_user_timeout`, etc. options read from configuration section */
+  const routing::SocketOptions client_socket_options;
+  /** @brief `server_keepalive_idle`, `server_user_timeout`, etc. options read from configuration section */
+  const routing::SocketOptions server_socket_options;
+  /** @brief `backlog`, `defer_accept` and `fastopen` options read from configuration section */
+  const routing::ListenOptions listen_options;
+  /** @brief `read_write_splitting` option read from configuration section */
+  const bool read_write_splitting;
+  /** @brief `read_write_splitting_shared_account` option read from configuration section
+   *
+   * Reads of all clients run on secondaries as read_write_splitting_user,
+   * with the privileges of that account instead of their own. Without it,
+   * secondaries are connected with the account and password of each client.
+   */
+  const bool read_write_splitting_shared_account;
+  /** @brief `read_write_splitting_user` option read from configuration section */
+  const std::string read_write_splitting_user;
+  /** @brief `schema_sharding` option read from configuration section */
+  const std::string schema_sharding;
+  /** @brief `affinity` and `affinity_max_load` options read from configuration section */
+  const routing::AffinityOptions affinity;
+  /** @brief `routing_rules` option read from configuration section */
+  const std::string routing_rules;
+  /** @brief `tls_termination`, `tls_cert`, `server_tls`, etc. options read from configuration section */
+  const routing::TlsOptions tls;
+  /** @brief `local_sockets` option read from configuration section */
+  const std::map<uint16_t, std::string> local_sockets;
+  /** @brief `spillover_connections`, `spillover_latency` and `spillover_max_connections` options read from configuration section */
+  const routing::SpilloverOptions spillover;
 
 protected:
 
@@ -86,6 +133,16 @@ private:
   std::string get_option_destinations(const mysql_harness::ConfigSection *section, const std::string &option,
                                       const Protocol::Type &protocol_type);
   Protocol::Type get_protocol(const mysql_harness::ConfigSection *section, const std::string &option);
+  SlowStart::Ramp get_option_slow_start_ramp(const mysql_harness::ConfigSection *section, const std::string &option);
+  routing::SocketOptions get_option_socket_options(const mysql_harness::ConfigSection *section,
+                                                   const std::string &prefix);
+  routing::ListenOptions get_option_listen_options(const mysql_harness::ConfigSection *section,
+                                                   Protocol::Type protocol_type);
+  routing::AffinityOptions get_option_affinity(const mysql_harness::ConfigSection *section);
+  routing::TlsOptions get_option_tls(const mysql_harness::ConfigSection *section);
+  std::map<uint16_t, std::string> get_option_local_sockets(const mysql_harness::ConfigSection *section,
+                                                           const std::string &option);
+  routing::SpilloverOptions get_option_spillover(const mysql_harness::ConfigSection *section);
 };
 
 #endif // PLUGIN_CONFIG_ROUTING_INCLUDED
@@ -62,14 +62,28 @@ public:
    */
   virtual bool on_block_client_host(int server, const std::string &log_prefix) = 0;
 
-  /** @brief Reads from sender and writes it back to receiver using select
+  /** @brief Function that gets called when a connection idled for too long
+   *
+   * Tells the client why the connection ends, and the server that the
+   * session ends, so that neither sees an aborted connection.
+   *
+   * @param client Descriptor of the client
+   * @param server Descriptor of the server
+   * @param code error code given to the client
+   * @param message human readable error message given to the client
+   * @param log_prefix prefix to be used by the function as a tag for logging
+   */
+  virtual void on_idle_timeout(int client, int server, unsigned short code,
+                               const std::string &message, const std::string &log_prefix) = 0;
+
+  /** @brief Reads from sender and writes it back to receiver
    *
    * This function reads data from the sender socket and writes it back
-   * to the receiver socket. It use `select`.
+   * to the receiver socket, when the sender is readable.
    *
    * @param sender Descriptor of the sender
    * @param receiver Descriptor of the receiver
-   * @param readfds Read descriptors used with FD_ISSET
+   * @param sender_is_readable Whether poll() reported data to read from sender
    * @param buffer Buffer to use for storage
    * @param curr_pktnr Pointer to storage for sequence id of packet
    * @param handshake_done Whether handshake phase is finished or not
@@ -79,11 +93,29 @@ public:
    *
    * @return 0 on success; -1 on error
    */
-  virtual int copy_packets(int sender, int receiver, fd_set *readfds,
+  virtual int copy_packets(int sender, int receiver, bool sender_is_readable,
                            RoutingProtocolBuffer &buffer, int *curr_pktnr,
                            bool &handshake_done, size_t *report_bytes_read,
                            bool from_server) = 0;
 
+  /** @brief Returns whether data read from a client starts a command
+   *
+   * Only used to measure latency, so a wrong answer skews a measurement
+   * but does no harm. The data is whatever one read returned, so it is
+   * assumed to start at a message boundary. By default, every read
+   * starting after the server answered starts a command.
+   *
+   * @param buffer data read from the client
+   * @param size number of bytes read
+   *
+   * @return true when the data starts a command
+   */
+  virtual bool starts_command(const RoutingProtocolBuffer &buffer, size_t size) const noexcept {
+    (void)buffer;
+    (void)size;
+    return true;
+  }
+
   /** @brief Sends error message to the provided receiver.
    *
    * This function sends protocol message containing MySQL error
@@ -102,6 +134,15 @@ public:
                           const std::string &sql_state,
                           const std::string &log_prefix) = 0;
 
+  /** @brief Returns whether data looks like the start of a TLS record
+   *
+   * Content type 20 to 24, then major version 3. Once a connection carries
+   * TLS, the router cannot add messages of its own to it.
+   */
+  static bool is_tls_record(const RoutingProtocolBuffer &buffer, size_t size) noexcept {
+    return size >= 2 && buffer[0] >= 0x14 && buffer[0] <= 0x18 && buffer[1] == 0x03;
+  }
+
   /** @brief Gets protocol type. */
   virtual Type get_type() = 0;
 protected:
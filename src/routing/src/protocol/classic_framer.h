@@ -0,0 +1,151 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_CLASSIC_FRAMER_INCLUDED
+#define ROUTING_CLASSIC_FRAMER_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/** @class ClassicFramer
+ * @brief Finds packet boundaries in a stream of the classic protocol
+ *
+ * Data is fed as read from the socket, in chunks of any size: headers split
+ * over reads and packets of 16M-1 bytes continued by the next packet are
+ * handled. The framer only looks at the 4 byte headers; payloads are
+ * skipped, or handed to the handler as they are, without copying or
+ * allocating. The data itself is never changed, so it can be forwarded as
+ * it was read.
+ *
+ * Handlers given to feed() provide:
+ *
+ * - `void on_header(uint8_t sequence_id, uint32_t payload_size, bool continuation)`,
+ *   called once the header of a packet is complete; continuation is true
+ *   when the packet continues the previous one
+ * - `void on_payload(const uint8_t *data, size_t size)`, called with the
+ *   payload, possibly in several pieces
+ * - `bool on_packet_end()`, called at the end of each packet; returning
+ *   false stops feeding right after the packet
+ *
+ * A framer belongs to one direction of one connection and is not
+ * thread-safe.
+ */
+class ClassicFramer {
+ public:
+  /** @brief Size of packet headers */
+  static const size_t kHeaderSize = 4;
+  /** @brief Payload size of packets which are continued by the next packet */
+  static const uint32_t kMaxPayloadSize = 0xffffff;
+
+  ClassicFramer() noexcept { reset(); }
+
+  /** @brief Expects a packet to start with the next byte */
+  void reset() noexcept {
+    header_size_ = 0;
+    sequence_id_ = 0;
+    payload_size_ = 0;
+    payload_left_ = 0;
+    continuation_ = false;
+  }
+
+  /** @brief Feeds data read from the stream
+   *
+   * @param data data read
+   * @param size number of bytes read
+   * @param handler told about headers, payloads and packet ends
+   * @return number of bytes consumed; less than size only when the handler stopped
+   */
+  template <class Handler>
+  size_t feed(const uint8_t *data, size_t size, Handler &handler) {
+    size_t used = 0;
+    while (used < size) {
+      if (header_size_ == 0) {
+        // fast path: packets which are whole in this read, headers not copied
+        while (size - used >= kHeaderSize) {
+          const uint8_t *header = data + used;
+          uint32_t payload_size = static_cast<uint32_t>(header[0] | (header[1] << 8) | (header[2] << 16));
+          if (size - used - kHeaderSize < payload_size) {
+            break;
+          }
+          sequence_id_ = header[3];
+          handler.on_header(sequence_id_, payload_size, continuation_);
+          if (payload_size > 0) {
+            handler.on_payload(header + kHeaderSize, payload_size);
+          }
+          used += kHeaderSize + payload_size;
+          continuation_ = (payload_size == kMaxPayloadSize);
+          if (!handler.on_packet_end()) {
+            return used;
+          }
+        }
+        if (used == size) {
+          break;
+        }
+      }
+
+      if (header_size_ < kHeaderSize) {
+        size_t n = std::min(kHeaderSize - header_size_, size - used);
+        std::memcpy(header_ + header_size_, data + used, n);
+        header_size_ += n;
+        used += n;
+        if (header_size_ < kHeaderSize) {
+          break;
+        }
+        payload_size_ = static_cast<uint32_t>(header_[0] | (header_[1] << 8) | (header_[2] << 16));
+        payload_left_ = payload_size_;
+        sequence_id_ = header_[3];
+        handler.on_header(header_[3], payload_size_, continuation_);
+      }
+
+      size_t n = std::min<size_t>(payload_left_, size - used);
+      if (n > 0) {
+        handler.on_payload(data + used, n);
+        payload_left_ -= static_cast<uint32_t>(n);
+        used += n;
+      }
+      if (payload_left_ == 0) {
+        continuation_ = (payload_size_ == kMaxPayloadSize);
+        header_size_ = 0;
+        if (!handler.on_packet_end()) {
+          break;
+        }
+      }
+    }
+    return used;
+  }
+
+  /** @brief Returns whether the next byte starts a packet */
+  bool at_boundary() const noexcept { return header_size_ == 0; }
+
+  /** @brief Returns whether the next packet continues a packet of 16M-1 bytes */
+  bool is_continued() const noexcept { return continuation_; }
+
+  /** @brief Returns the sequence id of the last packet whose header was complete */
+  uint8_t get_sequence_id() const noexcept { return sequence_id_; }
+
+ private:
+  uint8_t header_[kHeaderSize];
+  size_t header_size_;
+  uint8_t sequence_id_;
+  uint32_t payload_size_;
+  uint32_t payload_left_;
+  bool continuation_;
+};
+
+#endif // ROUTING_CLASSIC_FRAMER_INCLUDED
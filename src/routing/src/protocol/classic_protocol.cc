@@ -30,13 +30,34 @@ using mysql_harness::get_strerror;
 bool ClassicProtocol::on_block_client_host(int server, const std::string &log_prefix) {
   auto fake_response = mysql_protocol::HandshakeResponsePacket(1, {}, "ROUTER", "", "fake_router_login");
   if (socket_operations_->write_all(server, fake_response.data(), fake_response.size()) < 0) {
-    log_debug("[%s] write error: %s", log_prefix.c_str(), get_message_error(errno).c_str());
+    LOGGER_DEBUG("[%s] write error: %s", log_prefix.c_str(), get_message_error(errno).c_str());
     return false;
   }
   return true;
 }
 
-int ClassicProtocol::copy_packets(int sender, int receiver, fd_set *readfds,
+void ClassicProtocol::on_idle_timeout(int client, int server, unsigned short code,
+                                      const std::string &message, const std::string &log_prefix) {
+  send_error(client, code, message, "HY000", log_prefix);
+
+  // COM_QUIT, so that the server does not count an aborted connection
+  uint8_t quit[] = {0x01, 0x00, 0x00, 0x00, 0x01};
+  if (socket_operations_->write_all(server, quit, sizeof(quit)) < 0) {
+    LOGGER_DEBUG("[%s] write error: %s", log_prefix.c_str(), get_message_error(errno).c_str());
+  }
+}
+
+bool ClassicProtocol::starts_command(const RoutingProtocolBuffer &buffer, size_t size) const noexcept {
+  if (size < mysql_protocol::Packet::kHeaderSize) {
+    return true;
+  }
+  if (is_tls_record(buffer, size)) {
+    return true;
+  }
+  return buffer[3] == 0;
+}
+
+int ClassicProtocol::copy_packets(int sender, int receiver, bool sender_is_readable,
                                   RoutingProtocolBuffer &buffer, int *curr_pktnr,
                                   bool &handshake_done, size_t *report_bytes_read,
                                   bool /*from_server*/) {
@@ -56,10 +77,10 @@ int ClassicProtocol::copy_packets(int sender, int receiver, fd_set *readfds,
 #ifdef _WIN32
   WSASetLastError(0);
 #endif
-  if (FD_ISSET(sender, readfds)) {
+  if (sender_is_readable) {
     if ((res = socket_operations_->read(sender, &buffer.front(), buffer_length)) <= 0) {
       if (res == -1) {
-        log_debug("sender read failed: (%d %s)", errno, get_message_error(errno).c_str());
+        LOGGER_DEBUG("sender read failed: (%d %s)", errno, get_message_error(errno).c_str());
       }
       return -1;
     }
@@ -79,7 +100,7 @@ int ClassicProtocol::copy_packets(int sender, int receiver, fd_set *readfds,
       }
       pktnr = buffer[3];
       if (*curr_pktnr > 0 && pktnr != *curr_pktnr + 1) {
-        log_debug("Received incorrect packet number; aborting (was %d)", pktnr);
+        LOGGER_DEBUG("Received incorrect packet number; aborting (was %d)", pktnr);
         return -1;
       }
 
@@ -87,13 +108,18 @@ int ClassicProtocol::copy_packets(int sender, int receiver, fd_set *readfds,
         // We got error from MySQL Server while handshaking
         // We do not consider this a failed handshake
 
-        // copy part of the buffer containing serialized error
-        RoutingProtocolBuffer buffer_err(buffer.begin(), buffer.begin() +
-                                         static_cast<RoutingProtocolBuffer::iterator::difference_type>(bytes_read));
-
-        auto server_error = mysql_protocol::ErrorPacket(buffer_err);
-        if (socket_operations_->write_all(receiver, server_error.data(), server_error.size()) < 0) {
-          log_debug("Write error: %s", get_message_error(errno).c_str());
+        // forward the error as it was received, once we know it is one
+        mysql_protocol::PacketView packet(&buffer[0], bytes_read);
+        try {
+          mysql_protocol::ErrorPacketView server_error(
+              packet.sub(0, mysql_protocol::Packet::kHeaderSize + packet.get_payload_size()));
+          LOGGER_DEBUG("Server sent error %d while handshaking", server_error.get_code());
+        } catch (const mysql_protocol::packet_error &exc) {
+          LOGGER_DEBUG("%s", exc.what());
+          return -1;
+        }
+        if (socket_operations_->write_all(receiver, &buffer[0], bytes_read) < 0) {
+          LOGGER_DEBUG("Write error: %s", get_message_error(errno).c_str());
         }
         // receiver socket closed by caller
         *curr_pktnr = 2; // we assume handshaking is done though there was an error
@@ -106,10 +132,9 @@ int ClassicProtocol::copy_packets(int sender, int receiver, fd_set *readfds,
         // if client is switching to SSL, we are not continuing any checks
         uint32_t capabilities = 0;
         try {
-          auto pkt = mysql_protocol::Packet(buffer);
-          capabilities = pkt.get_int<uint32_t>(4);
+          capabilities = mysql_protocol::PacketView(&buffer[0], bytes_read).get_int<uint32_t>(4);
         } catch (const mysql_protocol::packet_error &exc) {
-          log_debug(exc.what());
+          LOGGER_DEBUG("%s", exc.what());
           return -1;
         }
         if (capabilities & mysql_protocol::kClientSSL) {
@@ -119,7 +144,7 @@ int ClassicProtocol::copy_packets(int sender, int receiver, fd_set *readfds,
     }
 
     if (socket_operations_->write_all(receiver, &buffer[0], bytes_read) < 0) {
-      log_debug("Write error: %s", get_message_error(errno).c_str());
+      LOGGER_DEBUG("Write error: %s", get_message_error(errno).c_str());
       return -1;
     }
   }
@@ -141,7 +166,7 @@ bool ClassicProtocol::send_error(int destination,
   WSASetLastError(0);
 #endif
   if (socket_operations_->write_all(destination, server_error.data(), server_error.size()) < 0) {
-    log_debug("[%s] write error: %s", log_prefix.c_str(), get_message_error(errno).c_str());
+    LOGGER_DEBUG("[%s] write error: %s", log_prefix.c_str(), get_message_error(errno).c_str());
   }
   return errno == 0;
 }
@@ -38,10 +38,24 @@ public:
    */
   virtual bool on_block_client_host(int server, const std::string &log_prefix) override;
 
-  /** @brief Reads from sender and writes it back to receiver using select
+  /** @brief Function that gets called when a connection idled for too long
+   *
+   * Tells the client why the connection ends, and the server that the
+   * session ends, so that neither sees an aborted connection.
+   *
+   * @param client Descriptor of the client
+   * @param server Descriptor of the server
+   * @param code error code given to the client
+   * @param message human readable error message given to the client
+   * @param log_prefix prefix to be used by the function as a tag for logging
+   */
+  virtual void on_idle_timeout(int client, int server, unsigned short code,
+                               const std::string &message, const std::string &log_prefix) override;
+
+  /** @brief Reads from sender and writes it back to receiver
    *
    * This function reads data from the sender socket and writes it back
-   * to the receiver socket. It use `select`.
+   * to the receiver socket, when the sender is readable.
    *
    * Checking the handshaking is done when the client first connects and
    * the server sends its handshake. The client replies and the server
@@ -53,7 +67,7 @@ public:
    *
    * @param sender Descriptor of the sender
    * @param receiver Descriptor of the receiver
-   * @param readfds Read descriptors used with FD_ISSET
+   * @param sender_is_readable Whether poll() reported data to read from sender
    * @param buffer Buffer to use for storage
    * @param curr_pktnr Pointer to storage for sequence id of packet
    * @param handshake_done Whether handshake phase is finished or not
@@ -63,7 +77,7 @@ public:
    *
    * @return 0 on success; -1 on error
    */
-  virtual int copy_packets(int sender, int receiver, fd_set *readfds,
+  virtual int copy_packets(int sender, int receiver, bool sender_is_readable,
                            RoutingProtocolBuffer &buffer, int *curr_pktnr,
                            bool &handshake_done, size_t *report_bytes_read,
                            bool from_server) override;
@@ -86,6 +100,21 @@ public:
                           const std::string &sql_state,
                           const std::string &log_prefix) override;
 
+  /** @brief Returns whether data read from a client starts a command
+   *
+   * Commands start with sequence id 0. Packets with another sequence id,
+   * like the contents of a file sent for LOAD DATA LOCAL or the rest of
+   * an authentication exchange, continue what the server asked for.
+   * Encrypted connections can not be inspected; TLS records are taken to
+   * start commands.
+   *
+   * @param buffer data read from the client
+   * @param size number of bytes read
+   *
+   * @return true when the data starts a command
+   */
+  virtual bool starts_command(const RoutingProtocolBuffer &buffer, size_t size) const noexcept override;
+
   /** @brief Gets protocol type. */
   virtual Type get_type() override {
     return Type::kClassicProtocol;
@@ -52,7 +52,7 @@ static bool send_message(const std::string &log_prefix,
   }
 
   if (socket_operations->write_all(destination, &buffer[0], buffer.size()) < 0) {
-    log_error("[%s] write error: %s", log_prefix.c_str(), get_message_error(errno).c_str());
+    LOGGER_ERROR_LIMITED("[%s] write error: %s", log_prefix.c_str(), get_message_error(errno).c_str());
     return false;
   }
 
@@ -119,7 +119,7 @@ static bool get_next_message(int sender,
 #endif
     read_res = socket_operations->read(sender, &buffer[message_offset + bytes_left], 4 - bytes_left);
     if (read_res <= 0) {
-      log_error("failed reading size of the message: (%d %s %d)", errno, get_message_error(errno).c_str(), read_res);
+      LOGGER_ERROR_LIMITED("failed reading size of the message: (%d %s %d)", errno, get_message_error(errno).c_str(), read_res);
       error = true;
       return false;
     }
@@ -139,7 +139,7 @@ static bool get_next_message(int sender,
   // of the client sending huge messages while authenticating.
   size_t size_needed = message_offset + 4 + message_size;
   if (buffer.size() < size_needed) {
-    log_error("X protocol message too big to fit the buffer: (%u, %u, %u)", message_size, buffer.size(), message_offset);
+    LOGGER_ERROR_LIMITED("X protocol message too big to fit the buffer: (%u, %u, %u)", message_size, buffer.size(), message_offset);
     error = true;
     return false;
   }
@@ -151,7 +151,7 @@ static bool get_next_message(int sender,
 #endif
     read_res = socket_operations->read(sender, &buffer[message_offset+bytes_left], message_size + 4 - bytes_left);
     if (read_res <= 0) {
-      log_error("failed reading part of X protocol message: (%d %s %d)", errno, get_message_error(errno).c_str(), read_res);
+      LOGGER_ERROR_LIMITED("failed reading part of X protocol message: (%d %s %d)", errno, get_message_error(errno).c_str(), read_res);
       error = true;
       return false;
     }
@@ -165,11 +165,10 @@ static bool get_next_message(int sender,
   return true;
 }
 
-int XProtocol::copy_packets(int sender, int receiver, fd_set *readfds,
+int XProtocol::copy_packets(int sender, int receiver, bool sender_is_readable,
                             RoutingProtocolBuffer &buffer, int * /*curr_pktnr*/,
                             bool &handshake_done, size_t *report_bytes_read,
                             bool from_server) {
-  assert(readfds != nullptr);
   assert(report_bytes_read != nullptr);
 
   ssize_t res = 0;
@@ -180,10 +179,10 @@ int XProtocol::copy_packets(int sender, int receiver, fd_set *readfds,
 #ifdef _WIN32
   WSASetLastError(0);
 #endif
-  if (FD_ISSET(sender, readfds)) {
+  if (sender_is_readable) {
     if ((res = socket_operations_->read(sender, &buffer.front(), buffer_length)) <= 0) {
       if (res == -1) {
-        log_error("sender read failed: (%d %s)", errno, get_message_error(errno).c_str());
+        LOGGER_ERROR_LIMITED("sender read failed: (%d %s)", errno, get_message_error(errno).c_str());
       }
       return -1;
     }
@@ -218,7 +217,7 @@ int XProtocol::copy_packets(int sender, int receiver, fd_set *readfds,
                   || message_type == Mysqlx::ClientMessages::CON_CLOSE) {
             // validate the message
             if (!message_valid(&buffer[message_offset+kMessageHeaderSize], message_type, message_size-1)) {
-              log_warning("Invalid message content: type(%hhu), size(%u)", message_type, message_size-1);
+              LOGGER_WARNING_LIMITED("Invalid message content: type(%hhu), size(%u)", message_type, message_size-1);
               return -1;
             }
             handshake_done = true;
@@ -227,7 +226,7 @@ int XProtocol::copy_packets(int sender, int receiver, fd_set *readfds,
           else {
             // any other message at this point is not allowed by the x protocol and would make
             // MySQL Server consider this connection an error which we need to prevent
-            log_warning("Received incorrect message type from the client while handshaking (was %hhu)",
+            LOGGER_WARNING_LIMITED("Received incorrect message type from the client while handshaking (was %hhu)",
                         message_type);
             return -1;
           }
@@ -251,7 +250,7 @@ int XProtocol::copy_packets(int sender, int receiver, fd_set *readfds,
     }
 
     if (socket_operations_->write_all(receiver, &buffer[0], bytes_read) < 0) {
-      log_error("Write error: %s", get_message_error(errno).c_str());
+      LOGGER_ERROR_LIMITED("Write error: %s", get_message_error(errno).c_str());
       return -1;
     }
   }
@@ -274,6 +273,25 @@ bool XProtocol::send_error(int destination,
 }
 
 
+void XProtocol::on_idle_timeout(int client, int server, unsigned short code,
+                                const std::string &message, const std::string &log_prefix) {
+  // the X Plugin tells clients it disconnects with a global warning notice
+  Mysqlx::Notice::Warning warning;
+  warning.set_level(Mysqlx::Notice::Warning::ERROR);
+  warning.set_code(code);
+  warning.set_msg(message);
+
+  Mysqlx::Notice::Frame notice;
+  notice.set_type(1);  // Warning
+  notice.set_scope(Mysqlx::Notice::Frame::GLOBAL);
+  notice.set_payload(warning.SerializeAsString());
+
+  send_message(log_prefix, client, Mysqlx::ServerMessages::NOTICE, notice, socket_operations_);
+
+  Mysqlx::Connection::Close close;
+  send_message(log_prefix, server, Mysqlx::ClientMessages::CON_CLOSE, close, socket_operations_);
+}
+
 bool XProtocol::on_block_client_host(int server, const std::string &log_prefix) {
   // currently the MySQL Server (X-Plugin) does not have the feature of blocking
   // the client after reaching certain threshold of unsuccesfull connection attemps (max_connect_errors)
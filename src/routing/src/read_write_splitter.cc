@@ -0,0 +1,747 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "read_write_splitter.h"
+#include "common.h"
+#include "logger.h"
+#include "mysqlrouter/mysql_protocol.h"
+#include "mysqlrouter/routing.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#  include <poll.h>
+#else
+#  include <winsock2.h>
+#endif
+
+using namespace mysql_protocol;
+
+// size of reads; as net_buffer_length
+static const size_t kBufferSize = 16384;
+// statements changing the session kept for replay; more pin the client to the primary
+static const size_t kMaxSessionStatements = 256;
+// how long to use the primary only after connecting to a secondary failed
+static const std::chrono::seconds kSecondaryRetryInterval(5);
+// capabilities changing what is sent in a way the splitter can not follow
+static const uint32_t kClientCompress = 0x00000020;
+static const uint32_t kClientConnectAttrs = 0x00100000;
+static const uint32_t kClientOptionalResultsetMetadata = 0x02000000;
+
+static uint32_t get_payload_size(const uint8_t *header) noexcept {
+  return static_cast<uint32_t>(header[0] | (header[1] << 8) | (header[2] << 16));
+}
+
+static std::vector<uint8_t> make_command(uint8_t command, const std::string &argument) {
+  std::vector<uint8_t> packet(4);
+  packet.push_back(command);
+  packet.insert(packet.end(), argument.begin(), argument.end());
+  uint32_t size = static_cast<uint32_t>(packet.size() - 4);
+  packet[0] = static_cast<uint8_t>(size);
+  packet[1] = static_cast<uint8_t>(size >> 8);
+  packet[2] = static_cast<uint8_t>(size >> 16);
+  return packet;
+}
+
+// whether a packet of the server during authentication asks the client for
+// its password in clear text: a switch to mysql_clear_password, or the full
+// authentication of caching_sha2_password
+static bool asks_for_clear_password(const uint8_t *packet, size_t size) noexcept {
+  static const char kClearPassword[] = "mysql_clear_password";
+  if (size < 6) {
+    return false;
+  }
+  const uint8_t *payload = packet + 4;
+  size_t payload_size = size - 4;
+  if (payload[0] == 0x01) {
+    return payload_size == 2 && payload[1] == 0x04;
+  }
+  return payload[0] == 0xfe && payload_size > sizeof(kClearPassword) &&
+         memcmp(payload + 1, kClearPassword, sizeof(kClearPassword)) == 0;
+}
+
+// a packet with the given payload
+static std::vector<uint8_t> make_packet(uint8_t sequence_id, const std::vector<uint8_t> &payload) {
+  uint32_t size = static_cast<uint32_t>(payload.size());
+  std::vector<uint8_t> packet{static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8),
+                              static_cast<uint8_t>(size >> 16), sequence_id};
+  packet.insert(packet.end(), payload.begin(), payload.end());
+  return packet;
+}
+
+ReadWriteSplitter::ReadWriteSplitter(routing::SocketOperationsBase *socket_operations, int client,
+                                     int primary, SecondaryConnector connect_secondary,
+                                     SecondaryRelease release_secondary, const std::string &user,
+                                     const std::string &password, std::chrono::milliseconds timeout,
+                                     const std::string &log_prefix)
+    : socket_operations_(socket_operations), client_(client), primary_(primary), secondary_(-1),
+      connect_secondary_(connect_secondary), release_secondary_(release_secondary),
+      timeout_(timeout), log_prefix_(log_prefix), shared_account_(!user.empty()),
+      user_(user), password_(password), expect_password_(false), client_capabilities_(0),
+      char_set_(8), secondary_replayed_(0),
+      primary_status_(kServerStatusAutocommit), secondary_in_transaction_(false),
+      last_backend_(primary), tracker_(new ClassicResponseTracker(false)), buffer_(kBufferSize),
+      connection_(nullptr), metrics_(nullptr), bytes_client_to_server_(0),
+      bytes_server_to_client_(0) {}
+
+ReadWriteSplitter::~ReadWriteSplitter() {
+  detach_secondary();
+}
+
+bool ReadWriteSplitter::set_client_handshake(const uint8_t *packet, size_t size) noexcept {
+  // capabilities, max packet size, character set, filler
+  const size_t kFixedSize = 4 + 4 + 1 + 23;
+  if (size < 4 + kFixedSize) {
+    return false;
+  }
+  const uint8_t *payload = packet + 4;
+  const uint8_t *end = packet + std::min<size_t>(size, 4 + get_payload_size(packet));
+  uint32_t capabilities = static_cast<uint32_t>(payload[0] | (payload[1] << 8) |
+                                                (payload[2] << 16) | (payload[3] << 24));
+  if (!(capabilities & kClientProtocol41) ||
+      (capabilities & (kClientSSL | kClientCompress | kClientOptionalResultsetMetadata))) {
+    return false;
+  }
+  client_capabilities_ = capabilities;
+  char_set_ = payload[8];
+  tracker_.reset(new ClassicResponseTracker((capabilities & kClientDeprecateEOF) != 0));
+
+  const uint8_t *pos = payload + kFixedSize;
+  // user name
+  const uint8_t *user_end = std::find(pos, end, 0);
+  if (!shared_account_) {
+    user_.assign(pos, user_end);
+  }
+  pos = user_end;
+  if (pos == end) {
+    return true;
+  }
+  ++pos;
+  // authentication response
+  size_t auth_size = 0;
+  if (pos < end && (capabilities & (kClientPluginAuthLenencClientData | kClientSecureConnection))) {
+    if (*pos >= 0xfb) {
+      return true;  // longer than any known authentication response
+    }
+    auth_size = *pos++;
+  } else {
+    auth_size = static_cast<size_t>(std::find(pos, end, 0) - pos) + 1;
+  }
+  if (static_cast<size_t>(end - pos) < auth_size) {
+    return true;
+  }
+  pos += auth_size;
+  if (capabilities & kClientConnectWithDb) {
+    schema_.assign(reinterpret_cast<const char *>(pos),
+                   reinterpret_cast<const char *>(std::find(pos, end, 0)));
+  }
+  return true;
+}
+
+void ReadWriteSplitter::set_server_auth_data(const uint8_t *data, size_t size) noexcept {
+  while (size >= 4 && size >= 4 + get_payload_size(data)) {
+    size_t packet_size = 4 + get_payload_size(data);
+    expect_password_ = asks_for_clear_password(data, packet_size);
+    data += packet_size;
+    size -= packet_size;
+  }
+}
+
+void ReadWriteSplitter::take_password(const uint8_t *packet, size_t size) {
+  // the password, terminated by a 0 byte
+  const uint8_t *payload = packet + 4;
+  size_t payload_size = size - 4;
+  if (!shared_account_ && payload_size > 1 && payload[payload_size - 1] == 0 &&
+      memchr(payload, 0, payload_size - 1) == nullptr) {
+    password_.assign(payload, payload + payload_size - 1);
+  }
+}
+
+void ReadWriteSplitter::count_client_to_server(size_t bytes) noexcept {
+  bytes_client_to_server_ += bytes;
+  if (connection_) {
+    connection_->add_bytes_client_to_server(bytes, clock::now());
+  }
+  if (metrics_) {
+    metrics_->bytes_client_to_server.inc(bytes);
+  }
+}
+
+void ReadWriteSplitter::count_server_to_client(size_t bytes) noexcept {
+  bytes_server_to_client_ += bytes;
+  if (connection_) {
+    connection_->add_bytes_server_to_client(bytes, clock::now());
+  }
+  if (metrics_) {
+    metrics_->bytes_server_to_client.inc(bytes);
+  }
+}
+
+bool ReadWriteSplitter::write_all(int fd, const uint8_t *data, size_t size) noexcept {
+  if (size == 0) {
+    return true;
+  }
+  return socket_operations_->write_all(fd, const_cast<uint8_t *>(data), size) >= 0;
+}
+
+std::string ReadWriteSplitter::run(bool authenticated) {
+  std::string error = route(authenticated);
+  detach_secondary();
+  return error;
+}
+
+std::string ReadWriteSplitter::route(bool authenticated) {
+  std::string error;
+  if (!authenticated) {
+    Next next = finish_authentication(&error);
+    if (next == Next::kEnd) {
+      return error;
+    } else if (next == Next::kPin) {
+      return copy_to_primary(&error);
+    }
+  }
+  if (!shared_account_ && password_.empty()) {
+    log_debug("[%s] password of '%s' not sent in clear text; using the primary only",
+              log_prefix_.c_str(), user_.c_str());
+    return copy_to_primary(&error);
+  }
+
+  while (true) {
+    // handle complete commands sent by the client
+    while (pending_.size() >= 4) {
+      uint32_t payload_size = get_payload_size(pending_.data());
+      if (payload_size == ClassicFramer::kMaxPayloadSize) {
+        // too large to look at
+        return copy_to_primary(&error);
+      }
+      if (pending_.size() < 4 + payload_size) {
+        break;
+      }
+      std::vector<uint8_t> packet(pending_.begin(), pending_.begin() + 4 + payload_size);
+      pending_.erase(pending_.begin(), pending_.begin() + 4 + payload_size);
+      Next next = handle_command(packet, &error);
+      if (next == Next::kEnd) {
+        return error;
+      } else if (next == Next::kPin) {
+        return copy_to_primary(&error);
+      }
+    }
+
+    struct pollfd fds[3];
+    fds[0].fd = client_;
+    fds[1].fd = primary_;
+    fds[2].fd = secondary_;  // ignored when negative
+    for (auto &it : fds) {
+      it.events = POLLIN;
+      it.revents = 0;
+    }
+    int res = routing::poll_sockets(fds, 3, std::chrono::milliseconds(-1));
+    if (res < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      return "Poll failed with error: " + get_message_error(errno);
+    }
+
+    if (fds[1].revents != 0) {
+      // nothing was asked; the server is about to close, maybe with an error
+      ssize_t size = socket_operations_->read(primary_, buffer_.data(), buffer_.size());
+      if (size <= 0) {
+        return "primary closed the connection";
+      }
+      write_all(client_, buffer_.data(), static_cast<size_t>(size));
+      count_server_to_client(static_cast<size_t>(size));
+    }
+    if (secondary_ >= 0 && fds[2].revents != 0) {
+      log_debug("[%s] secondary closed the connection", log_prefix_.c_str());
+      detach_secondary();
+    }
+    if (fds[0].revents != 0) {
+      ssize_t size = socket_operations_->read(client_, buffer_.data(), buffer_.size());
+      if (size <= 0) {
+        return size == 0 ? "" : "Client read failed: " + get_message_error(errno);
+      }
+      pending_.insert(pending_.end(), buffer_.begin(), buffer_.begin() + size);
+    }
+  }
+}
+
+ReadWriteSplitter::Next ReadWriteSplitter::finish_authentication(std::string *error) {
+  // copy until the primary accepted or refused the client; an auth switch
+  // or more authentication data may come first
+  std::vector<uint8_t> from_server;
+  std::vector<uint8_t> from_client;
+  while (true) {
+    struct pollfd fds[2];
+    fds[0].fd = client_;
+    fds[1].fd = primary_;
+    for (auto &it : fds) {
+      it.events = POLLIN;
+      it.revents = 0;
+    }
+    int res = routing::poll_sockets(fds, 2, std::chrono::milliseconds(-1));
+    if (res < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      *error = "Poll failed with error: " + get_message_error(errno);
+      return Next::kEnd;
+    }
+    if (fds[0].revents != 0) {
+      ssize_t size = socket_operations_->read(client_, buffer_.data(), buffer_.size());
+      if (size <= 0 || !write_all(primary_, buffer_.data(), static_cast<size_t>(size))) {
+        return Next::kEnd;
+      }
+      count_client_to_server(static_cast<size_t>(size));
+      from_client.insert(from_client.end(), buffer_.begin(), buffer_.begin() + size);
+      while (from_client.size() >= 4 && from_client.size() >= 4 + get_payload_size(from_client.data())) {
+        size_t packet_size = 4 + get_payload_size(from_client.data());
+        if (expect_password_) {
+          take_password(from_client.data(), packet_size);
+          expect_password_ = false;
+        }
+        from_client.erase(from_client.begin(), from_client.begin() + packet_size);
+      }
+    }
+    if (fds[1].revents != 0) {
+      ssize_t size = socket_operations_->read(primary_, buffer_.data(), buffer_.size());
+      if (size <= 0 || !write_all(client_, buffer_.data(), static_cast<size_t>(size))) {
+        *error = "primary closed the connection";
+        return Next::kEnd;
+      }
+      count_server_to_client(static_cast<size_t>(size));
+      from_server.insert(from_server.end(), buffer_.begin(), buffer_.begin() + size);
+      while (from_server.size() >= 4 && from_server.size() >= 4 + get_payload_size(from_server.data())) {
+        uint32_t payload_size = get_payload_size(from_server.data());
+        uint8_t type = payload_size > 0 ? from_server[4] : 0;
+        if (type == 0x00) {
+          if (from_server.size() > 4 + payload_size) {
+            return Next::kPin;  // data we do not understand
+          }
+          return Next::kContinue;
+        } else if (type == 0xff) {
+          // the primary closes the connection
+          return Next::kPin;
+        }
+        expect_password_ = asks_for_clear_password(from_server.data(), 4 + payload_size);
+        from_server.erase(from_server.begin(), from_server.begin() + 4 + payload_size);
+      }
+    }
+  }
+}
+
+int ReadWriteSplitter::choose_backend(StatementClass statement_class) {
+  // the transaction, or the session without autocommit, stays on the primary
+  if ((primary_status_ & kServerStatusInTrans) || !(primary_status_ & kServerStatusAutocommit)) {
+    return primary_;
+  }
+  if (secondary_in_transaction_ && secondary_ >= 0) {
+    return secondary_;
+  }
+  switch (statement_class) {
+    case StatementClass::kRead:
+    case StatementClass::kStartReadOnly:
+      if (attach_secondary()) {
+        if (replay_session()) {
+          return secondary_;
+        }
+        // a statement the secondary refused fails again on any secondary,
+        // so the reads of this client stay on the primary
+        secondary_retry_after_ = (tracker_->is_done() && tracker_->is_error()) ?
+            clock::time_point::max() : clock::now() + kSecondaryRetryInterval;
+      }
+      detach_secondary();
+      return primary_;
+    case StatementClass::kPrevious:
+      return (last_backend_ == secondary_ && secondary_ >= 0) ? secondary_ : primary_;
+    case StatementClass::kWrite:
+    case StatementClass::kSessionState:
+    case StatementClass::kPin:
+      break;
+  }
+  return primary_;
+}
+
+ReadWriteSplitter::Next ReadWriteSplitter::handle_command(const std::vector<uint8_t> &packet,
+                                                          std::string *error) {
+  uint8_t command = packet.size() > 4 ? packet[4] : 0;
+  std::string argument(packet.begin() + std::min<size_t>(5, packet.size()), packet.end());
+  StatementClass statement_class = StatementClass::kWrite;
+
+  if (command == kComQuit) {
+    write_all(primary_, packet.data(), packet.size());
+    count_client_to_server(packet.size());
+    return Next::kEnd;
+  } else if (command == kComQuery) {
+    statement_class = classify_statement(argument);
+    // a read-only transaction on the secondary runs it there, as any statement
+    if (statement_class == StatementClass::kPin && !(secondary_in_transaction_ && secondary_ >= 0)) {
+      pending_.insert(pending_.begin(), packet.begin(), packet.end());
+      return Next::kPin;
+    }
+  } else if (command != kComInitDb && command != kComPing) {
+    // responses which can not be followed
+    pending_.insert(pending_.begin(), packet.begin(), packet.end());
+    return Next::kPin;
+  }
+
+  int backend = choose_backend(statement_class);
+  if (!write_all(backend, packet.data(), packet.size())) {
+    if (backend == primary_) {
+      *error = "Write to primary failed: " + get_message_error(errno);
+      return Next::kEnd;
+    }
+    // not sent; the primary answers instead
+    detach_secondary();
+    backend = primary_;
+    if (!write_all(backend, packet.data(), packet.size())) {
+      *error = "Write to primary failed: " + get_message_error(errno);
+      return Next::kEnd;
+    }
+  }
+  count_client_to_server(packet.size());
+  if (metrics_) {
+    (backend == primary_ ? metrics_->statements_to_primary : metrics_->statements_to_secondary).inc();
+  }
+  last_backend_ = backend;
+
+  Next next = relay_response(backend, error);
+  if (next != Next::kContinue) {
+    return next;
+  }
+
+  if (tracker_->is_error()) {
+    return Next::kContinue;
+  }
+  if (backend == primary_) {
+    primary_status_ = tracker_->get_status_flags();
+  } else {
+    secondary_in_transaction_ = (tracker_->get_status_flags() & kServerStatusInTrans) != 0;
+  }
+  if (command == kComInitDb || statement_class == StatementClass::kSessionState) {
+    if (session_statements_.size() >= kMaxSessionStatements) {
+      log_debug("[%s] too many session statements; using the primary only", log_prefix_.c_str());
+      return Next::kPin;
+    }
+    if (command == kComInitDb) {
+      // replayed in order with USE and SET
+      schema_ = argument;
+      std::string quoted;
+      for (char c : argument) {
+        quoted += (c == '`') ? "``" : std::string(1, c);
+      }
+      session_statements_.push_back("USE `" + quoted + "`");
+    } else {
+      session_statements_.push_back(argument);
+    }
+  }
+  return Next::kContinue;
+}
+
+ReadWriteSplitter::Next ReadWriteSplitter::relay_response(int backend, std::string *error) {
+  tracker_->start();
+  while (!tracker_->is_done()) {
+    struct pollfd fds[2];
+    fds[0].fd = backend;
+    fds[1].fd = client_;
+    for (auto &it : fds) {
+      it.events = POLLIN;
+      it.revents = 0;
+    }
+    int res = routing::poll_sockets(fds, 2, std::chrono::milliseconds(-1));
+    if (res < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      *error = "Poll failed with error: " + get_message_error(errno);
+      return Next::kEnd;
+    }
+    if (fds[0].revents != 0) {
+      ssize_t size = socket_operations_->read(backend, buffer_.data(), buffer_.size());
+      if (size <= 0) {
+        if (backend == primary_) {
+          *error = "primary closed the connection";
+        } else {
+          *error = "secondary closed the connection during a statement";
+        }
+        return Next::kEnd;
+      }
+      tracker_->feed(buffer_.data(), static_cast<size_t>(size));
+      if (!write_all(client_, buffer_.data(), static_cast<size_t>(size))) {
+        *error = "Write to client failed: " + get_message_error(errno);
+        return Next::kEnd;
+      }
+      count_server_to_client(static_cast<size_t>(size));
+      if (tracker_->is_local_infile()) {
+        if (backend != primary_) {
+          *error = "LOAD DATA LOCAL on a secondary";
+          return Next::kEnd;
+        }
+        return Next::kPin;
+      }
+    }
+    if (fds[1].revents != 0) {
+      // sent before the answer; kept for later
+      ssize_t size = socket_operations_->read(client_, buffer_.data(), buffer_.size());
+      if (size <= 0) {
+        return Next::kEnd;
+      }
+      pending_.insert(pending_.end(), buffer_.begin(), buffer_.begin() + size);
+    }
+  }
+  return Next::kContinue;
+}
+
+std::string ReadWriteSplitter::copy_to_primary(std::string *error) {
+  detach_secondary();
+  if (!write_all(primary_, pending_.data(), pending_.size())) {
+    return "Write to primary failed: " + get_message_error(errno);
+  }
+  count_client_to_server(pending_.size());
+  pending_.clear();
+
+  while (true) {
+    struct pollfd fds[2];
+    fds[0].fd = client_;
+    fds[1].fd = primary_;
+    for (auto &it : fds) {
+      it.events = POLLIN;
+      it.revents = 0;
+    }
+    int res = routing::poll_sockets(fds, 2, std::chrono::milliseconds(-1));
+    if (res < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      return "Poll failed with error: " + get_message_error(errno);
+    }
+    if (fds[1].revents != 0) {
+      ssize_t size = socket_operations_->read(primary_, buffer_.data(), buffer_.size());
+      if (size <= 0 || !write_all(client_, buffer_.data(), static_cast<size_t>(size))) {
+        return *error;
+      }
+      count_server_to_client(static_cast<size_t>(size));
+    }
+    if (fds[0].revents != 0) {
+      ssize_t size = socket_operations_->read(client_, buffer_.data(), buffer_.size());
+      if (size <= 0 || !write_all(primary_, buffer_.data(), static_cast<size_t>(size))) {
+        return *error;
+      }
+      count_client_to_server(static_cast<size_t>(size));
+    }
+  }
+}
+
+bool ReadWriteSplitter::attach_secondary() {
+  if (secondary_ >= 0) {
+    return true;
+  }
+  if (clock::now() < secondary_retry_after_) {
+    return false;
+  }
+  int secondary = connect_secondary_();
+  if (secondary < 0) {
+    secondary_retry_after_ = clock::now() + kSecondaryRetryInterval;
+    return false;
+  }
+  if (!authenticate_secondary(secondary)) {
+    socket_operations_->shutdown(secondary);
+    release_secondary_(secondary);
+    socket_operations_->close(secondary);
+    secondary_retry_after_ = clock::now() + kSecondaryRetryInterval;
+    return false;
+  }
+  secondary_ = secondary;
+  secondary_replayed_ = 0;
+  secondary_in_transaction_ = false;
+  return true;
+}
+
+bool ReadWriteSplitter::authenticate_secondary(int secondary) {
+  std::vector<uint8_t> packet;
+  if (!read_packet(secondary, &packet)) {
+    return false;
+  }
+  std::vector<unsigned char> auth_data;
+  uint32_t capabilities = 0;
+  try {
+    HandshakePacket handshake(packet);
+    auth_data = handshake.get_auth_data();
+    // the secondary has to answer like the primary
+    capabilities = (client_capabilities_ & handshake.get_server_capabilities() &
+                    ~(kClientSSL | kClientCompress | kClientConnectAttrs | kClientConnectWithDb)) |
+                   kClientProtocol41 | kClientSecureConnection | kClientPluginAuth;
+  } catch (const packet_error &exc) {
+    log_warning("[%s] Invalid handshake from secondary: %s", log_prefix_.c_str(), exc.what());
+    return false;
+  }
+  if (!schema_.empty()) {
+    capabilities |= kClientConnectWithDb;
+  }
+
+  HandshakeResponsePacket response(1, auth_data, user_, password_, schema_, char_set_,
+                                   "mysql_native_password", capabilities);
+  if (!write_all(secondary, response.data(), response.size())) {
+    return false;
+  }
+
+  // servers take Unix sockets for secure; the password may be sent in clear text
+  bool secure = is_unix_socket(secondary);
+  std::vector<uint8_t> clear_password(password_.begin(), password_.end());
+  clear_password.push_back(0);
+  while (read_packet(secondary, &packet)) {
+    uint8_t type = packet.size() > 4 ? packet[4] : 0;
+    std::vector<uint8_t> reply;
+    if (type == 0x00) {
+      return true;
+    } else if (type == 0xfe && packet.size() > 5) {
+      // auth switch: plugin name, then the new salt
+      auto name_end = std::find(packet.begin() + 5, packet.end(), 0);
+      std::string plugin(packet.begin() + 5, name_end);
+      std::vector<unsigned char> salt;
+      if (name_end != packet.end()) {
+        salt.assign(name_end + 1, packet.end());
+      }
+      if (!salt.empty() && salt.back() == 0) {
+        salt.pop_back();
+      }
+      if (plugin == "mysql_native_password") {
+        reply = HandshakeResponsePacket::scramble_native_password(salt, password_);
+      } else if (plugin == "caching_sha2_password") {
+        reply = HandshakeResponsePacket::scramble_caching_sha2_password(salt, password_);
+      } else if (plugin == "mysql_clear_password" && secure) {
+        reply = clear_password;
+      } else {
+        log_warning("[%s] Secondary asked for authentication plugin '%s' for '%s'; supported are "
+                    "mysql_native_password, caching_sha2_password, and mysql_clear_password "
+                    "through Unix sockets", log_prefix_.c_str(), plugin.c_str(), user_.c_str());
+        return false;
+      }
+    } else if (type == 0x01 && packet.size() == 6 && packet[5] == 0x03) {
+      // fast authentication of caching_sha2_password; the OK follows
+      continue;
+    } else if (type == 0x01 && packet.size() == 6 && packet[5] == 0x04) {
+      // full authentication of caching_sha2_password
+      if (!secure) {
+        log_warning("[%s] Secondary needs the full authentication of caching_sha2_password for "
+                    "'%s', which the router only does through Unix sockets",
+                    log_prefix_.c_str(), user_.c_str());
+        return false;
+      }
+      reply = clear_password;
+    } else if (type == 0xff) {
+      try {
+        ErrorPacketView error_packet(PacketView(packet), kClientProtocol41);
+        log_warning("[%s] Secondary refused '%s': %s", log_prefix_.c_str(), user_.c_str(),
+                    error_packet.get_message().str().c_str());
+      } catch (const packet_error &) {
+        log_warning("[%s] Secondary refused '%s'", log_prefix_.c_str(), user_.c_str());
+      }
+      return false;
+    } else {
+      log_warning("[%s] Unexpected packet authenticating with secondary (type %u)",
+                  log_prefix_.c_str(), type);
+      return false;
+    }
+    reply = make_packet(static_cast<uint8_t>(packet[3] + 1), reply);
+    if (!write_all(secondary, reply.data(), reply.size())) {
+      return false;
+    }
+  }
+  return false;
+}
+
+bool ReadWriteSplitter::replay_session() {
+  for (; secondary_replayed_ < session_statements_.size(); ++secondary_replayed_) {
+    if (!exchange(secondary_, make_command(kComQuery, session_statements_[secondary_replayed_]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ReadWriteSplitter::exchange(int backend, const std::vector<uint8_t> &command) {
+  if (!write_all(backend, command.data(), command.size())) {
+    return false;
+  }
+  tracker_->start();
+  while (!tracker_->is_done()) {
+    struct pollfd fds[1];
+    fds[0].fd = backend;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    if (routing::poll_sockets(fds, 1, timeout_) <= 0) {
+      return false;
+    }
+    ssize_t size = socket_operations_->read(backend, buffer_.data(), buffer_.size());
+    if (size <= 0) {
+      return false;
+    }
+    tracker_->feed(buffer_.data(), static_cast<size_t>(size));
+    if (tracker_->is_local_infile()) {
+      return false;
+    }
+  }
+  if (tracker_->is_error()) {
+    log_debug("[%s] Replaying the session on the secondary failed", log_prefix_.c_str());
+    return false;
+  }
+  return true;
+}
+
+void ReadWriteSplitter::detach_secondary() noexcept {
+  if (secondary_ < 0) {
+    return;
+  }
+  std::vector<uint8_t> quit{0x01, 0x00, 0x00, 0x00, kComQuit};
+  write_all(secondary_, quit.data(), quit.size());
+  socket_operations_->shutdown(secondary_);
+  release_secondary_(secondary_);
+  socket_operations_->close(secondary_);
+  if (last_backend_ == secondary_) {
+    last_backend_ = primary_;
+  }
+  secondary_ = -1;
+  secondary_in_transaction_ = false;
+}
+
+bool ReadWriteSplitter::read_packet(int fd, std::vector<uint8_t> *packet) {
+  packet->clear();
+  size_t wanted = 4;
+  while (packet->size() < wanted) {
+    struct pollfd fds[1];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    if (routing::poll_sockets(fds, 1, timeout_) <= 0) {
+      return false;
+    }
+    size_t offset = packet->size();
+    packet->resize(wanted);
+    ssize_t size = socket_operations_->read(fd, packet->data() + offset, wanted - offset);
+    if (size <= 0) {
+      return false;
+    }
+    packet->resize(offset + static_cast<size_t>(size));
+    if (packet->size() == 4 && wanted == 4) {
+      wanted = 4 + get_payload_size(packet->data());
+    }
+  }
+  return true;
+}
@@ -0,0 +1,218 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_READ_WRITE_SPLITTER_INCLUDED
+#define ROUTING_READ_WRITE_SPLITTER_INCLUDED
+
+#include "connection_registry.h"
+#include "response_tracker.h"
+#include "routing_metrics.h"
+#include "statement_classifier.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace routing {
+class SocketOperationsBase;
+}
+
+/** @class ReadWriteSplitter
+ * @brief Sends the statements of one classic protocol client to a primary or a secondary
+ *
+ * The client is connected and authenticated with the primary as on any
+ * route. After authentication, each COM_QUERY is classified (see
+ * classify_statement()): reads in autocommit mode and read-only
+ * transactions go to a secondary, everything else, and everything while
+ * the primary has a transaction open or autocommit disabled, goes to the
+ * primary.
+ *
+ * The secondary connection is opened on the first read. It is
+ * authenticated with the account and password of the client, so that the
+ * secondary checks the privileges of the client like the primary does,
+ * and starts in the schema the client is in. The router only learns the
+ * password when the client sends it in clear text: with
+ * mysql_clear_password, or with the full authentication of
+ * caching_sha2_password, which clients only do over a connection they
+ * take for secure, like the Unix socket of the route. Without the
+ * password, the client stays on the primary. Secondaries may ask for
+ * mysql_native_password or caching_sha2_password; the password is only
+ * sent to them in clear text through a Unix socket.
+ *
+ * @warning With a shared account, all clients are authenticated with the
+ * secondaries as that account instead. Their reads then run with the
+ * privileges of the shared account, not their own, and CURRENT_USER(),
+ * roles and definer checks differ between the primary and the
+ * secondaries.
+ *
+ * Statements changing the session (SET, USE, COM_INIT_DB) run on the
+ * primary and are replayed, in order, on the secondary before it runs the
+ * next read.
+ *
+ * Commands whose responses can not be followed, like prepared statements
+ * or LOAD DATA LOCAL, and statements leaving state which can not be
+ * replayed, like temporary tables, pin the client to the primary: from
+ * then on, data is copied as on any other route and the secondary is
+ * closed.
+ *
+ * A splitter runs in the routing thread of its client and is not
+ * thread-safe.
+ */
+class ReadWriteSplitter {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  /** @brief Connects to a secondary; returns the socket, or -1 */
+  using SecondaryConnector = std::function<int()>;
+
+  /** @brief Gives back a socket returned by the SecondaryConnector, before it is closed */
+  using SecondaryRelease = std::function<void(int)>;
+
+  /** @brief Constructor
+   *
+   * @param socket_operations socket operations
+   * @param client socket of the client
+   * @param primary socket of the primary, authenticated or authenticating
+   * @param connect_secondary opens connections to secondaries
+   * @param release_secondary gives back connections to secondaries
+   * @param user shared account used with secondaries for all clients; empty
+   *        to use the account and password of each client
+   * @param password password of the shared account
+   * @param timeout how long secondaries may take to answer during authentication and replay
+   * @param log_prefix prefix of log messages, like the route name
+   */
+  ReadWriteSplitter(routing::SocketOperationsBase *socket_operations, int client, int primary,
+                    SecondaryConnector connect_secondary, SecondaryRelease release_secondary,
+                    const std::string &user,
+                    const std::string &password, std::chrono::milliseconds timeout,
+                    const std::string &log_prefix);
+
+  /** @brief Destructor; closes the secondary connection */
+  ~ReadWriteSplitter();
+
+  ReadWriteSplitter(const ReadWriteSplitter &) = delete;
+  ReadWriteSplitter &operator=(const ReadWriteSplitter &) = delete;
+
+  /** @brief Takes what the client asked for from its handshake response
+   *
+   * @param packet the handshake response packet, including the header
+   * @param size size of the packet
+   * @return false when the connection can not be split, like with SSL or compression
+   */
+  bool set_client_handshake(const uint8_t *packet, size_t size) noexcept;
+
+  /** @brief Takes what the primary sent last before the splitter took over
+   *
+   * The authentication may continue from there; the splitter needs to know
+   * whether the client was asked for its password in clear text.
+   *
+   * @param data one or more packets, including their headers
+   * @param size size of the data
+   */
+  void set_server_auth_data(const uint8_t *data, size_t size) noexcept;
+
+  /** @brief Sets where traffic is counted; both may be null */
+  void set_accounting(ConnectionRegistry::Connection *connection, RouteMetrics *metrics) noexcept {
+    connection_ = connection;
+    metrics_ = metrics;
+  }
+
+  /** @brief Routes the traffic of the client until it or the primary closes
+   *
+   * The secondary connection is closed before returning.
+   *
+   * @param authenticated whether the primary sent the OK packet of the authentication already
+   * @return why the connection ended; empty when the client quit or closed
+   */
+  std::string run(bool authenticated);
+
+  /** @brief Returns the number of bytes sent by the client */
+  size_t get_bytes_client_to_server() const noexcept { return bytes_client_to_server_; }
+
+  /** @brief Returns the number of bytes sent to the client */
+  size_t get_bytes_server_to_client() const noexcept { return bytes_server_to_client_; }
+
+ private:
+  enum class Next {
+    kContinue,
+    kPin,
+    kEnd,
+  };
+
+  std::string route(bool authenticated);
+  Next finish_authentication(std::string *error);
+  Next handle_command(const std::vector<uint8_t> &packet, std::string *error);
+  Next relay_response(int backend, std::string *error);
+  int choose_backend(StatementClass statement_class);
+  std::string copy_to_primary(std::string *error);
+
+  bool attach_secondary();
+  bool authenticate_secondary(int secondary);
+  void take_password(const uint8_t *packet, size_t size);
+  bool replay_session();
+  bool exchange(int backend, const std::vector<uint8_t> &command);
+  void detach_secondary() noexcept;
+
+  bool read_packet(int fd, std::vector<uint8_t> *packet);
+  bool write_all(int fd, const uint8_t *data, size_t size) noexcept;
+  void count_client_to_server(size_t bytes) noexcept;
+  void count_server_to_client(size_t bytes) noexcept;
+
+  routing::SocketOperationsBase *socket_operations_;
+  const int client_;
+  const int primary_;
+  int secondary_;
+  SecondaryConnector connect_secondary_;
+  SecondaryRelease release_secondary_;
+  const std::chrono::milliseconds timeout_;
+  const std::string log_prefix_;
+  // the shared account, or the client
+  const bool shared_account_;
+  std::string user_;
+  std::string password_;
+  // whether the primary asked the client for its password in clear text
+  bool expect_password_;
+
+  // from the handshake response of the client
+  uint32_t client_capabilities_;
+  uint8_t char_set_;
+  std::string schema_;
+
+  // statements changing the session, replayed on secondaries
+  std::vector<std::string> session_statements_;
+  size_t secondary_replayed_;
+  clock::time_point secondary_retry_after_;
+
+  uint16_t primary_status_;
+  bool secondary_in_transaction_;
+  int last_backend_;
+
+  std::unique_ptr<ClassicResponseTracker> tracker_;
+  std::vector<uint8_t> buffer_;
+  // client data not handled yet
+  std::vector<uint8_t> pending_;
+
+  ConnectionRegistry::Connection *connection_;
+  RouteMetrics *metrics_;
+  size_t bytes_client_to_server_;
+  size_t bytes_server_to_client_;
+};
+
+#endif // ROUTING_READ_WRITE_SPLITTER_INCLUDED
@@ -0,0 +1,164 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "response_tracker.h"
+#include "mysqlrouter/mysql_protocol.h"
+
+#include <algorithm>
+#include <cstring>
+
+const size_t ClassicResponseTracker::kPrefixSize;
+
+ClassicResponseTracker::ClassicResponseTracker(bool deprecate_eof) noexcept
+    : deprecate_eof_(deprecate_eof), state_(State::kDone), error_(false), status_flags_(0),
+      columns_left_(0), payload_size_(0), payload_read_(0), continuation_(false) {}
+
+void ClassicResponseTracker::start() noexcept {
+  state_ = State::kFirst;
+  error_ = false;
+  framer_.reset();
+}
+
+size_t ClassicResponseTracker::feed(const uint8_t *data, size_t size) noexcept {
+  if (state_ == State::kDone || state_ == State::kLocalInfile) {
+    return 0;
+  }
+  return framer_.feed(data, size, *this);
+}
+
+void ClassicResponseTracker::on_header(uint8_t /*sequence_id*/, uint32_t payload_size,
+                                       bool continuation) noexcept {
+  payload_size_ = payload_size;
+  payload_read_ = 0;
+  continuation_ = continuation;
+}
+
+void ClassicResponseTracker::on_payload(const uint8_t *data, size_t size) noexcept {
+  if (payload_read_ < kPrefixSize) {
+    size_t keep = std::min(size, kPrefixSize - payload_read_);
+    std::memcpy(prefix_ + payload_read_, data, keep);
+  }
+  payload_read_ += static_cast<uint32_t>(size);
+}
+
+bool ClassicResponseTracker::on_packet_end() noexcept {
+  if (!continuation_) {
+    on_packet();
+  }
+  return state_ != State::kDone && state_ != State::kLocalInfile;
+}
+
+bool ClassicResponseTracker::read_lenenc(size_t *pos, uint64_t *value) const noexcept {
+  size_t available = std::min<size_t>(payload_size_, kPrefixSize);
+  if (*pos >= available) {
+    return false;
+  }
+  uint8_t first = prefix_[*pos];
+  size_t length = 0;
+  if (first < 0xfb) {
+    *value = first;
+    *pos += 1;
+    return true;
+  } else if (first == 0xfc) {
+    length = 2;
+  } else if (first == 0xfd) {
+    length = 3;
+  } else if (first == 0xfe) {
+    length = 8;
+  } else {
+    return false;
+  }
+  if (*pos + 1 + length > available) {
+    return false;
+  }
+  *value = 0;
+  for (size_t i = length; i > 0; --i) {
+    *value = (*value << 8) | prefix_[*pos + i];
+  }
+  *pos += 1 + length;
+  return true;
+}
+
+void ClassicResponseTracker::on_end_of_result(size_t status_pos) noexcept {
+  if (status_pos + 2 <= std::min<size_t>(payload_size_, kPrefixSize)) {
+    status_flags_ = static_cast<uint16_t>(prefix_[status_pos] | (prefix_[status_pos + 1] << 8));
+  }
+  state_ = (status_flags_ & mysql_protocol::kServerMoreResultsExists) ? State::kFirst : State::kDone;
+}
+
+void ClassicResponseTracker::on_packet() noexcept {
+  uint8_t type = payload_size_ > 0 ? prefix_[0] : 0;
+  size_t pos = 1;
+  uint64_t value = 0;
+
+  if (payload_size_ > 0 && type == 0xff) {
+    error_ = true;
+    state_ = State::kDone;
+    return;
+  }
+
+  switch (state_) {
+    case State::kFirst:
+      if (type == 0x00) {
+        // OK: affected rows, last insert id, status flags
+        uint64_t ignored;
+        if (read_lenenc(&pos, &ignored) && read_lenenc(&pos, &ignored)) {
+          on_end_of_result(pos);
+        } else {
+          state_ = State::kDone;
+        }
+      } else if (type == 0xfb) {
+        state_ = State::kLocalInfile;
+      } else {
+        pos = 0;
+        if (read_lenenc(&pos, &value) && value > 0) {
+          columns_left_ = value;
+          state_ = State::kColumns;
+        } else {
+          state_ = State::kDone;  // garbage; nothing more to expect
+        }
+      }
+      break;
+    case State::kColumns:
+      if (--columns_left_ == 0) {
+        state_ = deprecate_eof_ ? State::kRows : State::kColumnsEof;
+      }
+      break;
+    case State::kColumnsEof:
+      state_ = State::kRows;
+      break;
+    case State::kRows:
+      // a row starting with 0xfe is at least 16M long
+      if (type == 0xfe && payload_size_ < ClassicFramer::kMaxPayloadSize) {
+        if (deprecate_eof_) {
+          uint64_t ignored;
+          if (read_lenenc(&pos, &ignored) && read_lenenc(&pos, &ignored)) {
+            on_end_of_result(pos);
+          } else {
+            state_ = State::kDone;
+          }
+        } else {
+          // EOF: warnings, status flags
+          on_end_of_result(3);
+        }
+      }
+      break;
+    case State::kLocalInfile:
+    case State::kDone:
+      break;
+  }
+}
@@ -0,0 +1,113 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_RESPONSE_TRACKER_INCLUDED
+#define ROUTING_RESPONSE_TRACKER_INCLUDED
+
+#include "protocol/classic_framer.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/** @class ClassicResponseTracker
+ * @brief Finds the end of responses of the classic protocol in a stream
+ *
+ * Follows the responses to COM_QUERY, COM_INIT_DB and COM_PING: OK and
+ * error packets, and result sets, including multiple result sets. Data is
+ * fed as read from the server, in chunks of any size; only the start of
+ * each packet is kept, so memory use does not depend on the size of rows.
+ *
+ * Responses to other commands, like prepared statements, have a different
+ * layout and can not be followed.
+ *
+ * A tracker belongs to one connection and is not thread-safe.
+ */
+class ClassicResponseTracker {
+ public:
+  /** @brief Constructor
+   *
+   * @param deprecate_eof whether CLIENT_DEPRECATE_EOF was agreed on
+   */
+  explicit ClassicResponseTracker(bool deprecate_eof) noexcept;
+
+  /** @brief Expects the response to a new command */
+  void start() noexcept;
+
+  /** @brief Feeds data read from the server
+   *
+   * @param data data read
+   * @param size number of bytes read
+   * @return number of bytes which belong to the response; less than size
+   *         only when the response is complete
+   */
+  size_t feed(const uint8_t *data, size_t size) noexcept;
+
+  /** @brief Returns whether the response is complete */
+  bool is_done() const noexcept { return state_ == State::kDone; }
+
+  /** @brief Returns whether the server asked for a local file (LOAD DATA LOCAL)
+   *
+   * The response can not be followed any further.
+   */
+  bool is_local_infile() const noexcept { return state_ == State::kLocalInfile; }
+
+  /** @brief Returns whether the response ended with an error packet */
+  bool is_error() const noexcept { return error_; }
+
+  /** @brief Returns the status flags of the last OK or EOF packet */
+  uint16_t get_status_flags() const noexcept { return status_flags_; }
+
+ private:
+  enum class State {
+    kFirst,
+    kColumns,
+    kColumnsEof,
+    kRows,
+    kLocalInfile,
+    kDone,
+  };
+
+  // start of the payload kept for inspection; enough for an OK packet up to the status flags
+  static const size_t kPrefixSize = 24;
+
+  friend class ClassicFramer;
+
+  // called by the framer
+  void on_header(uint8_t sequence_id, uint32_t payload_size, bool continuation) noexcept;
+  void on_payload(const uint8_t *data, size_t size) noexcept;
+  bool on_packet_end() noexcept;
+
+  void on_packet() noexcept;
+  void on_end_of_result(size_t status_pos) noexcept;
+  bool read_lenenc(size_t *pos, uint64_t *value) const noexcept;
+
+  const bool deprecate_eof_;
+  State state_;
+  bool error_;
+  uint16_t status_flags_;
+  uint64_t columns_left_;
+
+  ClassicFramer framer_;
+  // packet being read
+  uint32_t payload_size_;
+  uint32_t payload_read_;
+  uint8_t prefix_[kPrefixSize];
+  // the packet continues a packet of 16M-1 bytes
+  bool continuation_;
+};
+
+#endif // ROUTING_RESPONSE_TRACKER_INCLUDED
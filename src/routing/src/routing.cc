@@ -21,7 +21,12 @@
 #include "logger.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <climits>
 #include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
 
 #ifndef _WIN32
 # ifdef __sun
@@ -29,9 +34,15 @@
 # else
 #  include <sys/fcntl.h>
 # endif
+# include <ifaddrs.h>
 # include <netdb.h>
+# include <netinet/in.h>
 # include <netinet/tcp.h>
+# include <poll.h>
+# include <sys/resource.h>
 # include <sys/socket.h>
+# include <sys/time.h>
+# include <sys/un.h>
 #else
 # define WIN32_LEAN_AND_MEAN
 # include <windows.h>
@@ -47,11 +58,28 @@ namespace routing {
 
 const int kDefaultWaitTimeout = 0; // 0 = no timeout used
 const int kDefaultMaxConnections = 512;
-const int kDefaultDestinationConnectionTimeout = 1;
+const int kMaxConnectionsLimit = INT32_MAX;
+const std::chrono::milliseconds kDefaultDestinationConnectionTimeout = std::chrono::seconds(1);
 const std::string kDefaultBindAddress = "127.0.0.1";
 const unsigned int kDefaultNetBufferLength = 16384;  // Default defined in latest MySQL Server
 const unsigned long long kDefaultMaxConnectErrors = 100;  // Similar to MySQL Server
-const unsigned int kDefaultClientConnectTimeout = 9; // Default connect_timeout MySQL Server minus 1
+const std::chrono::milliseconds kDefaultClientConnectTimeout = std::chrono::seconds(9); // Default connect_timeout MySQL Server minus 1
+const std::chrono::milliseconds kDefaultSlowStartPeriod = std::chrono::seconds(0); // 0 = no slow-start
+const unsigned int kDefaultMaxConnectionsPerDestination = 0; // 0 = no limit
+const unsigned int kDefaultConnectionQueueLength = 0; // 0 = clients do not wait
+const std::chrono::milliseconds kDefaultConnectionQueueTimeout = std::chrono::seconds(1);
+const std::chrono::milliseconds kDefaultDrainGracePeriod = std::chrono::seconds(0); // 0 = close right away
+const int kDefaultListenBacklog = 1024;
+const std::chrono::milliseconds kDefaultClientIdleTimeout = std::chrono::seconds(0); // 0 = no timeout
+const std::chrono::milliseconds kDefaultServerIdleTimeout = std::chrono::seconds(0); // 0 = no timeout
+const std::chrono::milliseconds kDefaultServerKeepaliveIdle = std::chrono::seconds(10);
+const std::chrono::milliseconds kDefaultServerKeepaliveInterval = std::chrono::seconds(5);
+const int kDefaultServerKeepaliveCount = 3;
+const std::chrono::milliseconds kDefaultServerUserTimeout = std::chrono::seconds(30);
+const unsigned int kDefaultAffinityMaxLoad = 125;
+const unsigned int kSpilloverRecoveryPercent = 80;
+const unsigned int kDefaultTlsSessionCacheSize = 20480;
+const std::chrono::milliseconds kDefaultTlsSessionTimeout = std::chrono::seconds(300);
 
 const char* const kAccessModeNames[] = {
   nullptr, "read-write", "read-only"
@@ -80,6 +108,125 @@ std::string get_access_mode_name(AccessMode access_mode) noexcept {
   return kAccessModeNames[static_cast<int>(access_mode)];
 }
 
+void parse_affinity_key(const std::string &value, AffinityOptions *options) {
+  static const std::string kConnectAttribute = "connect_attribute:";
+  options->connect_attribute.clear();
+  if (value.empty()) {
+    options->key = AffinityKey::kNone;
+  } else if (value == "client_address") {
+    options->key = AffinityKey::kClientAddress;
+  } else if (value == "user") {
+    options->key = AffinityKey::kUser;
+  } else if (value == "schema") {
+    options->key = AffinityKey::kSchema;
+  } else if (value.compare(0, kConnectAttribute.size(), kConnectAttribute) == 0 &&
+             value.size() > kConnectAttribute.size()) {
+    options->key = AffinityKey::kConnectAttribute;
+    options->connect_attribute = value.substr(kConnectAttribute.size());
+  } else {
+    throw std::invalid_argument("valid are client_address, user, schema and "
+                                "connect_attribute:<name> (was '" + value + "')");
+  }
+}
+
+bool is_local_socket(const TCPAddress &addr) noexcept {
+#ifndef _WIN32
+  return addr.port == 0 && !addr.addr.empty() && addr.addr[0] == '/';
+#else
+  (void)addr;
+  return false;
+#endif
+}
+
+#ifndef _WIN32
+// whether two socket addresses have the same IP, ignoring the port
+static bool same_ip(const struct sockaddr *a, const struct sockaddr *b) {
+  if (a->sa_family != b->sa_family) {
+    return false;
+  }
+  if (a->sa_family == AF_INET) {
+    return reinterpret_cast<const sockaddr_in *>(a)->sin_addr.s_addr ==
+           reinterpret_cast<const sockaddr_in *>(b)->sin_addr.s_addr;
+  }
+  return a->sa_family == AF_INET6 &&
+         memcmp(&reinterpret_cast<const sockaddr_in6 *>(a)->sin6_addr,
+                &reinterpret_cast<const sockaddr_in6 *>(b)->sin6_addr, sizeof(in6_addr)) == 0;
+}
+
+static bool is_loopback(const struct sockaddr *addr) {
+  if (addr->sa_family == AF_INET) {
+    return (ntohl(reinterpret_cast<const sockaddr_in *>(addr)->sin_addr.s_addr) >> 24) == 127;
+  }
+  return addr->sa_family == AF_INET6 &&
+         IN6_IS_ADDR_LOOPBACK(&reinterpret_cast<const sockaddr_in6 *>(addr)->sin6_addr);
+}
+#endif
+
+bool is_local_host(const std::string &host) {
+#ifndef _WIN32
+  struct addrinfo hints, *servinfo = nullptr;
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (host.empty() || getaddrinfo(host.c_str(), nullptr, &hints, &servinfo) != 0) {
+    return false;
+  }
+  std::shared_ptr<addrinfo> servinfo_deleter(servinfo, freeaddrinfo);
+
+  struct ifaddrs *interfaces = nullptr;
+  if (getifaddrs(&interfaces) != 0) {
+    interfaces = nullptr;
+  }
+  std::shared_ptr<ifaddrs> interfaces_deleter(interfaces, [](ifaddrs *ifa) {
+    if (ifa) freeifaddrs(ifa);
+  });
+
+  for (auto info = servinfo; info != nullptr; info = info->ai_next) {
+    if (is_loopback(info->ai_addr)) {
+      return true;
+    }
+    for (auto ifa = interfaces; ifa != nullptr; ifa = ifa->ifa_next) {
+      if (ifa->ifa_addr != nullptr && same_ip(info->ai_addr, ifa->ifa_addr)) {
+        return true;
+      }
+    }
+  }
+#else
+  (void)host;
+#endif
+  return false;
+}
+
+std::map<uint16_t, std::string> parse_local_sockets(const std::string &value) {
+  std::map<uint16_t, std::string> result;
+  std::stringstream ss(value);
+  std::string part;
+  while (std::getline(ss, part, ',')) {
+    mysqlrouter::trim(part);
+    auto colon = part.find(':');
+    if (colon == std::string::npos || colon == 0) {
+      throw std::invalid_argument("expected port:path (was '" + part + "')");
+    }
+    int port = mysqlrouter::strtoi_checked(part.substr(0, colon).c_str(), 0);
+    std::string path = part.substr(colon + 1);
+    mysqlrouter::trim(path);
+    if (port < 1 || port > UINT16_MAX) {
+      throw std::invalid_argument("port needs a value between 1 and 65535 (was '" + part + "')");
+    }
+    if (path.empty() || path[0] != '/') {
+      throw std::invalid_argument("path needs to be absolute (was '" + part + "')");
+    }
+    std::string error;
+    if (!mysqlrouter::is_valid_socket_name(path, error)) {
+      throw std::invalid_argument(error);
+    }
+    if (!result.emplace(static_cast<uint16_t>(port), path).second) {
+      throw std::invalid_argument("port " + to_string(port) + " is given twice");
+    }
+  }
+  return result;
+}
+
 void set_socket_blocking(int sock, bool blocking) {
 
   assert(!(sock < 0));
@@ -98,16 +245,195 @@ void set_socket_blocking(int sock, bool blocking) {
 #endif
 }
 
+int poll_sockets(struct pollfd *fds, size_t nfds, std::chrono::milliseconds timeout) {
+  int timeout_ms = -1;
+  if (timeout.count() >= 0) {
+    timeout_ms = static_cast<int>(std::min<std::chrono::milliseconds::rep>(timeout.count(), INT_MAX));
+  }
+#ifndef _WIN32
+  return poll(fds, static_cast<nfds_t>(nfds), timeout_ms);
+#else
+  return WSAPoll(fds, static_cast<ULONG>(nfds), timeout_ms);
+#endif
+}
+
+uint64_t raise_open_files_limit(uint64_t wanted) {
+#ifndef _WIN32
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+    log_warning("Failed getting the open files limit: %s", get_message_error(errno).c_str());
+    return 0;
+  }
+  if (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur >= wanted) {
+    LOGGER_DEBUG("Open files limit is %llu, %llu needed",
+              static_cast<unsigned long long>(limit.rlim_cur), static_cast<unsigned long long>(wanted));
+    return limit.rlim_cur == RLIM_INFINITY ? UINT64_MAX : limit.rlim_cur;
+  }
+
+  rlim_t previous = limit.rlim_cur;
+  if (limit.rlim_max == RLIM_INFINITY || limit.rlim_max >= wanted) {
+    limit.rlim_cur = static_cast<rlim_t>(wanted);
+  } else {
+    limit.rlim_cur = limit.rlim_max;
+  }
+  if (setrlimit(RLIMIT_NOFILE, &limit) == -1) {
+    log_warning("Failed raising the open files limit from %llu to %llu: %s",
+                static_cast<unsigned long long>(previous), static_cast<unsigned long long>(limit.rlim_cur),
+                get_message_error(errno).c_str());
+    limit.rlim_cur = previous;
+  } else if (limit.rlim_cur != previous) {
+    log_info("Raised open files limit from %llu to %llu",
+             static_cast<unsigned long long>(previous), static_cast<unsigned long long>(limit.rlim_cur));
+  }
+
+  if (limit.rlim_cur < wanted) {
+    log_warning("Open files limit is %llu, but max_connections of all routes need up to %llu; "
+                "raise the hard limit (for example with 'ulimit -Hn') or lower max_connections",
+                static_cast<unsigned long long>(limit.rlim_cur), static_cast<unsigned long long>(wanted));
+  }
+  return limit.rlim_cur;
+#else
+  return wanted;
+#endif
+}
+
+// setsockopt() with an int value; the cast keeps Windows happy (const char* instead of const void*)
+static bool set_int_option(int sock, int level, int option, int value) noexcept {
+  return setsockopt(sock, level, option, reinterpret_cast<const char*>(&value),
+                    static_cast<socklen_t>(sizeof(value))) == 0;
+}
+
+// whole seconds, rounded up, for options the kernel takes in seconds
+static int to_seconds(std::chrono::milliseconds value) noexcept {
+  auto seconds = (value.count() + 999) / 1000;
+  return static_cast<int>(std::min<std::chrono::milliseconds::rep>(seconds, INT_MAX));
+}
+
+bool set_socket_options(int sock, const SocketOptions &options) noexcept {
+#ifndef _WIN32
+  // destinations on this host might be connected through Unix sockets
+  struct sockaddr_storage addr;
+  socklen_t addr_len = static_cast<socklen_t>(sizeof(addr));
+  if (getsockname(sock, reinterpret_cast<struct sockaddr *>(&addr), &addr_len) == 0 &&
+      addr.ss_family == AF_UNIX) {
+    return true;
+  }
+#endif
+  if (options.keepalive_idle.count() > 0) {
+    if (!set_int_option(sock, SOL_SOCKET, SO_KEEPALIVE, 1)) {
+      return false;
+    }
+#if defined(TCP_KEEPIDLE)
+    if (!set_int_option(sock, IPPROTO_TCP, TCP_KEEPIDLE, to_seconds(options.keepalive_idle))) {
+      return false;
+    }
+#elif defined(TCP_KEEPALIVE)
+    // macOS
+    if (!set_int_option(sock, IPPROTO_TCP, TCP_KEEPALIVE, to_seconds(options.keepalive_idle))) {
+      return false;
+    }
+#endif
+#ifdef TCP_KEEPINTVL
+    if (options.keepalive_interval.count() > 0 &&
+        !set_int_option(sock, IPPROTO_TCP, TCP_KEEPINTVL, to_seconds(options.keepalive_interval))) {
+      return false;
+    }
+#endif
+#ifdef TCP_KEEPCNT
+    if (options.keepalive_count > 0 &&
+        !set_int_option(sock, IPPROTO_TCP, TCP_KEEPCNT, options.keepalive_count)) {
+      return false;
+    }
+#endif
+  }
+#ifdef TCP_USER_TIMEOUT
+  if (options.user_timeout.count() > 0 &&
+      !set_int_option(sock, IPPROTO_TCP, TCP_USER_TIMEOUT,
+                      static_cast<int>(std::min<std::chrono::milliseconds::rep>(
+                          options.user_timeout.count(), INT_MAX)))) {
+    return false;
+  }
+#endif
+  if (options.send_buffer > 0 && !set_int_option(sock, SOL_SOCKET, SO_SNDBUF, options.send_buffer)) {
+    return false;
+  }
+  if (options.receive_buffer > 0 &&
+      !set_int_option(sock, SOL_SOCKET, SO_RCVBUF, options.receive_buffer)) {
+    return false;
+  }
+  return true;
+}
+
+bool set_listen_options(int sock, const ListenOptions &options) noexcept {
+#ifdef TCP_DEFER_ACCEPT
+  if (options.defer_accept.count() > 0 &&
+      !set_int_option(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, to_seconds(options.defer_accept))) {
+    return false;
+  }
+#endif
+#ifdef TCP_FASTOPEN
+  if (options.fastopen > 0 && !set_int_option(sock, IPPROTO_TCP, TCP_FASTOPEN, options.fastopen)) {
+    return false;
+  }
+#endif
+  (void)sock;
+  (void)options;
+  return true;
+}
+
 SocketOperations* SocketOperations::instance() {
   static SocketOperations instance_;
   return &instance_;
 }
 
-int SocketOperations::get_mysql_socket(TCPAddress addr, int connect_timeout, bool log) noexcept {
-  fd_set readfds;
-  fd_set writefds;
-  fd_set errfds;
-  struct timeval timeout_val;
+#ifndef _WIN32
+// connects to a server on this host through its Unix socket
+static int get_local_mysql_socket(const std::string &path, std::chrono::milliseconds connect_timeout,
+                                  bool log) noexcept {
+  struct sockaddr_un sock_unix;
+  memset(&sock_unix, 0, sizeof(sock_unix));
+  sock_unix.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(sock_unix.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strncpy(sock_unix.sun_path, path.c_str(), sizeof(sock_unix.sun_path) - 1);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock == -1) {
+    LOGGER_ERROR_LIMITED("Failed opening socket: %s", get_message_error(errno).c_str());
+    return -1;
+  }
+  // connect() waits while the backlog of the server is full; the send
+  // timeout limits the wait (non-blocking, Linux fails with EAGAIN instead)
+  struct timeval timeout;
+  timeout.tv_sec = static_cast<time_t>(connect_timeout.count() / 1000);
+  timeout.tv_usec = static_cast<suseconds_t>((connect_timeout.count() % 1000) * 1000);
+  setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  if (connect(sock, reinterpret_cast<struct sockaddr *>(&sock_unix), sizeof(sock_unix)) < 0) {
+    int err = (errno == EAGAIN || errno == EWOULDBLOCK) ? ETIMEDOUT : errno;
+    ::close(sock);
+    if (log) {
+      LOGGER_DEBUG("MySQL Server %s: %s (%d)", path.c_str(), get_message_error(err).c_str(), err);
+    }
+    errno = err;
+    return -1;
+  }
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 0;
+  setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  errno = 0;
+  return sock;
+}
+#endif
+
+int SocketOperations::get_mysql_socket(TCPAddress addr, std::chrono::milliseconds connect_timeout, bool log) noexcept {
+#ifndef _WIN32
+  if (is_local_socket(addr)) {
+    return get_local_mysql_socket(addr.addr, connect_timeout, log);
+  }
+#endif
+  struct pollfd fds[1];
 
   struct addrinfo *servinfo, *info, hints;
 
@@ -129,7 +455,7 @@ int SocketOperations::get_mysql_socket(TCPAddress addr, int connect_timeout, boo
 #else
       std::string errstr = get_message_error(err);
 #endif
-      log_debug("Failed getting address information for '%s' (%s)", addr.addr.c_str(), errstr.c_str());
+      LOGGER_DEBUG("Failed getting address information for '%s' (%s)", addr.addr.c_str(), errstr.c_str());
     }
     return -1;
   }
@@ -144,63 +470,61 @@ int SocketOperations::get_mysql_socket(TCPAddress addr, int connect_timeout, boo
 #endif
   for (info = servinfo; info != nullptr; info = info->ai_next) {
     if ((sock = socket(info->ai_family, info->ai_socktype, info->ai_protocol)) == -1) {
-      log_error("Failed opening socket: %s", get_message_error(errno).c_str());
+      LOGGER_ERROR_LIMITED("Failed opening socket: %s", get_message_error(errno).c_str());
       continue;
     }
-    FD_ZERO(&readfds);
-    FD_SET(sock, &readfds);
-    errfds = writefds = readfds;
-    timeout_val.tv_sec = connect_timeout;
-    timeout_val.tv_usec = 0;
+    fds[0].fd = sock;
+    fds[0].events = POLLOUT;
+    fds[0].revents = 0;
 
-    // Set non-blocking so we can timeout using select()
+    // Set non-blocking so we can timeout using poll()
     set_socket_blocking(sock, false);
     if (connect(sock, info->ai_addr, info->ai_addrlen) < 0) {
 #ifdef _WIN32
       if (WSAGetLastError() != WSAEINPROGRESS && WSAGetLastError() != WSAEWOULDBLOCK) {
-        log_error("Error connecting socket to %s:%i (%s)", addr.addr.c_str(), addr.port, get_message_error(SOCKET_ERROR).c_str());
+        LOGGER_ERROR_LIMITED("Error connecting socket to %s:%i (%s)", addr.addr.c_str(), addr.port, get_message_error(SOCKET_ERROR).c_str());
         this->close(sock);
         continue;
       }
 #else
       if (errno != EINPROGRESS) {
-        log_error("Error connecting socket to %s:%i (%s)", addr.addr.c_str(), addr.port, strerror(errno));
+        LOGGER_ERROR_LIMITED("Error connecting socket to %s:%i (%s)", addr.addr.c_str(), addr.port, strerror(errno));
         this->close(sock);
         continue;
       }
 #endif
     }
 
-    res = select(sock + 1, &readfds, &writefds, &errfds, &timeout_val);
+    res = poll_sockets(fds, 1, connect_timeout);
     if (res <= 0) {
       this->shutdown(sock);
       this->close(sock);
       if (res == 0) {
         if (log) {
-          log_warning("Timeout reached trying to connect to MySQL Server %s", addr.str().c_str());
+          LOGGER_WARNING_LIMITED("Timeout reached trying to connect to MySQL Server %s", addr.str().c_str());
         }
         continue;
       }
-      log_debug("select failed");
+      LOGGER_DEBUG("poll failed");
       continue;
     }
 
-    if (FD_ISSET(sock, &readfds) || FD_ISSET(sock, &writefds) || FD_ISSET(sock, &errfds)) {
+    if (fds[0].revents != 0) {
       if (getsockopt(sock, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&so_error), &error_len) == -1) {
-        log_debug("Failed executing getsockopt on client socket: %s",
+        LOGGER_DEBUG("Failed executing getsockopt on client socket: %s",
           get_message_error(errno).c_str());
         this->shutdown(sock);
         this->close(sock);
         continue;
       }
       if (so_error) {
-        log_debug("Socket error: %s: %s (%d)", addr.str().c_str(), get_message_error(so_error).c_str(), so_error);
+        LOGGER_DEBUG("Socket error: %s: %s (%d)", addr.str().c_str(), get_message_error(so_error).c_str(), so_error);
         this->shutdown(sock);
         this->close(sock);
         continue;
       }
     } else {
-      log_debug("Failed connecting with MySQL server %s", addr.str().c_str());
+      LOGGER_DEBUG("Failed connecting with MySQL server %s", addr.str().c_str());
       this->shutdown(sock);
       this->close(sock);
       continue;
@@ -219,7 +543,7 @@ int SocketOperations::get_mysql_socket(TCPAddress addr, int connect_timeout, boo
     this->close(sock);
     err = so_error ? so_error : SOCKET_ERROR;
     if (log) {
-      log_debug("MySQL Server %s: %s (%d)", addr.str().c_str(), get_message_error(err).c_str(), err);
+      LOGGER_DEBUG("MySQL Server %s: %s (%d)", addr.str().c_str(), get_message_error(err).c_str(), err);
     }
     return -1;
   }
@@ -229,7 +553,7 @@ int SocketOperations::get_mysql_socket(TCPAddress addr, int connect_timeout, boo
     this->close(sock);
     err = so_error ? so_error : errno;
     if (log) {
-      log_debug("MySQL Server %s: %s (%d)", addr.str().c_str(), get_message_error(err).c_str(), err);
+      LOGGER_DEBUG("MySQL Server %s: %s (%d)", addr.str().c_str(), get_message_error(err).c_str(), err);
     }
     return -1;
   }
@@ -242,7 +566,7 @@ int SocketOperations::get_mysql_socket(TCPAddress addr, int connect_timeout, boo
   if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
                  reinterpret_cast<const char*>(&opt_nodelay), // cast keeps Windows happy (const void* on Unix)
                  static_cast<socklen_t>(sizeof(int))) == -1) {
-    log_debug("Failed setting TCP_NODELAY on client socket");
+    LOGGER_DEBUG("Failed setting TCP_NODELAY on client socket");
     return -1;
   }
 
@@ -286,4 +610,12 @@ void SocketOperations::shutdown(int fd) {
 #endif
 }
 
+void SocketOperations::shutdown_read(int fd) {
+#ifndef _WIN32
+  ::shutdown(fd, SHUT_RD);
+#else
+  ::shutdown(fd, SD_RECEIVE);
+#endif
+}
+
 } // routing
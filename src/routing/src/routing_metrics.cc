@@ -0,0 +1,178 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "routing_metrics.h"
+
+using mysql_harness::metrics::MetricsRegistry;
+
+// connection durations, from 1ms up to a day
+static const std::vector<uint64_t> kDurationBounds{
+    1, 10, 100, 1000, 10000, 60000, 600000, 3600000, 86400000};
+
+// latencies, from 100us up to a minute
+static const std::vector<uint64_t> kLatencyBounds{
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000,
+    250000, 500000, 1000000, 2500000, 5000000, 10000000, 60000000};
+
+static mysql_harness::metrics::Labels route_labels(const std::string &route) {
+  return {{"route", route}};
+}
+
+static mysql_harness::metrics::Counter &rejected(const std::string &route, const char *reason) {
+  return MetricsRegistry::instance().counter(
+      "routing_rejected_total", {{"route", route}, {"reason", reason}},
+      "Clients turned away, by reason");
+}
+
+static mysql_harness::metrics::Counter &tls_handshakes(const std::string &route, const char *side,
+                                                      const char *resumed) {
+  return MetricsRegistry::instance().counter(
+      "routing_tls_handshakes_total", {{"route", route}, {"side", side}, {"resumed", resumed}},
+      "TLS handshakes of the router, by peer side and whether a session was resumed");
+}
+
+static mysql_harness::metrics::Counter &tls_handshake_failures(const std::string &route,
+                                                              const char *side) {
+  return MetricsRegistry::instance().counter(
+      "routing_tls_handshake_failures_total", {{"route", route}, {"side", side}},
+      "TLS handshakes of the router which failed, by peer side");
+}
+
+static mysql_harness::metrics::Counter &spilled(const std::string &route, const std::string &destination,
+                                               const char *reason) {
+  return MetricsRegistry::instance().counter(
+      "routing_spilled_connections_total",
+      {{"route", route}, {"destination", destination}, {"reason", reason}},
+      "Read-only connections sent to the primary, by reason");
+}
+
+RouteMetrics::RouteMetrics(const std::string &route)
+    : accepted(MetricsRegistry::instance().counter(
+          "routing_accepted_total", route_labels(route), "Clients accepted")),
+      bytes_client_to_server(MetricsRegistry::instance().counter(
+          "routing_bytes_total", {{"route", route}, {"direction", "client_to_server"}},
+          "Bytes copied between clients and destinations")),
+      bytes_server_to_client(MetricsRegistry::instance().counter(
+          "routing_bytes_total", {{"route", route}, {"direction", "server_to_client"}},
+          "Bytes copied between clients and destinations")),
+      active_connections(MetricsRegistry::instance().gauge(
+          "routing_active_connections", route_labels(route),
+          "Clients connected to a destination")),
+      connection_duration(MetricsRegistry::instance().histogram(
+          "routing_connection_duration_ms", kDurationBounds, route_labels(route),
+          "How long connections to destinations lasted, in milliseconds")),
+      max_connections(MetricsRegistry::instance().gauge(
+          "routing_max_connections", route_labels(route),
+          "Maximum of clients connected at the same time")),
+      idle_closed_client(MetricsRegistry::instance().counter(
+          "routing_idle_closed_total", {{"route", route}, {"side", "client"}},
+          "Connections closed for idling too long, by idle side")),
+      idle_closed_server(MetricsRegistry::instance().counter(
+          "routing_idle_closed_total", {{"route", route}, {"side", "server"}},
+          "Connections closed for idling too long, by idle side")),
+      statements_to_primary(MetricsRegistry::instance().counter(
+          "routing_split_statements_total", {{"route", route}, {"backend", "primary"}},
+          "Statements routed by read/write splitting, by backend")),
+      statements_to_secondary(MetricsRegistry::instance().counter(
+          "routing_split_statements_total", {{"route", route}, {"backend", "secondary"}},
+          "Statements routed by read/write splitting, by backend")),
+      tls_client_handshakes(tls_handshakes(route, "client", "no")),
+      tls_client_resumed(tls_handshakes(route, "client", "yes")),
+      tls_client_failures(tls_handshake_failures(route, "client")),
+      tls_server_handshakes(tls_handshakes(route, "server", "no")),
+      tls_server_resumed(tls_handshakes(route, "server", "yes")),
+      tls_server_failures(tls_handshake_failures(route, "server")),
+      tls_cached_sessions(MetricsRegistry::instance().gauge(
+          "routing_tls_cached_sessions", route_labels(route),
+          "TLS sessions of clients kept for resumption")),
+      rejected_max_connections_(rejected(route, "max_connections")),
+      rejected_blocked_host_(rejected(route, "blocked_host")),
+      rejected_destination_busy_(rejected(route, "destination_busy")),
+      rejected_no_destination_(rejected(route, "no_destination")),
+      rejected_fd_exhaustion_(rejected(route, "fd_exhaustion")),
+      rejected_rule_quota_(rejected(route, "rule_quota")) {}
+
+void RouteMetrics::reject(RejectReason reason) noexcept {
+  switch (reason) {
+    case RejectReason::kMaxConnections:
+      rejected_max_connections_.inc();
+      break;
+    case RejectReason::kBlockedHost:
+      rejected_blocked_host_.inc();
+      break;
+    case RejectReason::kDestinationBusy:
+      rejected_destination_busy_.inc();
+      break;
+    case RejectReason::kNoDestination:
+      rejected_no_destination_.inc();
+      break;
+    case RejectReason::kFdExhaustion:
+      rejected_fd_exhaustion_.inc();
+      break;
+    case RejectReason::kRuleQuota:
+      rejected_rule_quota_.inc();
+      break;
+  }
+}
+
+DestinationMetrics::DestinationMetrics(const std::string &route, const std::string &destination)
+    : connect_attempts(MetricsRegistry::instance().counter(
+          "routing_backend_connect_attempts_total",
+          {{"route", route}, {"destination", destination}},
+          "Connections to destinations tried for clients")),
+      connect_failures(MetricsRegistry::instance().counter(
+          "routing_backend_connect_failures_total",
+          {{"route", route}, {"destination", destination}},
+          "Connections to destinations which failed")),
+      quarantined(MetricsRegistry::instance().counter(
+          "routing_quarantine_total",
+          {{"route", route}, {"destination", destination}},
+          "Times destinations were put in quarantine")),
+      active_connections(MetricsRegistry::instance().gauge(
+          "routing_destination_active_connections",
+          {{"route", route}, {"destination", destination}},
+          "Connections open to destinations")),
+      in_quarantine(MetricsRegistry::instance().gauge(
+          "routing_destination_quarantined",
+          {{"route", route}, {"destination", destination}},
+          "Whether destinations are in quarantine (1) or not (0)")),
+      affinity_keys(MetricsRegistry::instance().gauge(
+          "routing_destination_affinity_keys",
+          {{"route", route}, {"destination", destination}},
+          "Distinct affinity keys with connections open to destinations")),
+      affinity_fallbacks(MetricsRegistry::instance().counter(
+          "routing_affinity_fallbacks_total",
+          {{"route", route}, {"destination", destination}},
+          "Connections sent to destinations other than the one of their affinity key")),
+      spilled_unavailable(spilled(route, destination, "unavailable")),
+      spilled_saturated(spilled(route, destination, "saturated")),
+      connect_duration(MetricsRegistry::instance().histogram(
+          "routing_backend_connect_duration_us", kLatencyBounds,
+          {{"route", route}, {"destination", destination}},
+          "How long connecting to destinations took, in microseconds")),
+      handshake_duration(MetricsRegistry::instance().histogram(
+          "routing_handshake_duration_us", kLatencyBounds,
+          {{"route", route}, {"destination", destination}},
+          "How long protocol handshakes took, in microseconds")),
+      time_to_first_byte(MetricsRegistry::instance().histogram(
+          "routing_time_to_first_byte_us", kLatencyBounds,
+          {{"route", route}, {"destination", destination}},
+          "From the start of a command to the first byte of its answer, in microseconds")),
+      command_turnaround(MetricsRegistry::instance().histogram(
+          "routing_command_turnaround_us", kLatencyBounds,
+          {{"route", route}, {"destination", destination}},
+          "From the start of a command to the end of its answer, in microseconds")) {}
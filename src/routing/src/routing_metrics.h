@@ -0,0 +1,142 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_METRICS_INCLUDED
+#define ROUTING_METRICS_INCLUDED
+
+#include "metrics.h"
+
+#include <string>
+
+/** @brief Why a client was turned away */
+enum class RejectReason {
+  /** max_connections reached and no room to wait */
+  kMaxConnections,
+  /** too many connection errors from the client host */
+  kBlockedHost,
+  /** all destinations reached max_connections_per_destination */
+  kDestinationBusy,
+  /** no destination could be connected */
+  kNoDestination,
+  /** out of file descriptors */
+  kFdExhaustion,
+  /** the routing rule of the client reached its quota */
+  kRuleQuota,
+};
+
+/** @class RouteMetrics
+ * @brief Metrics of a route, registered in the process-wide registry
+ *
+ * All metrics carry the label `route`.
+ */
+class RouteMetrics {
+ public:
+  using Counter = mysql_harness::metrics::Counter;
+  using Gauge = mysql_harness::metrics::Gauge;
+  using Histogram = mysql_harness::metrics::Histogram;
+
+  explicit RouteMetrics(const std::string &route);
+
+  /** @brief Counts a client turned away */
+  void reject(RejectReason reason) noexcept;
+
+  /** @brief Clients accepted */
+  Counter &accepted;
+  /** @brief Bytes copied from clients to destinations */
+  Counter &bytes_client_to_server;
+  /** @brief Bytes copied from destinations to clients */
+  Counter &bytes_server_to_client;
+  /** @brief Clients connected to a destination */
+  Gauge &active_connections;
+  /** @brief How long connections lasted, in milliseconds */
+  Histogram &connection_duration;
+  /** @brief Configured maximum of connections */
+  Gauge &max_connections;
+  /** @brief Connections closed for exceeding client_idle_timeout */
+  Counter &idle_closed_client;
+  /** @brief Connections closed for exceeding server_idle_timeout */
+  Counter &idle_closed_server;
+  /** @brief Statements sent to the primary by read/write splitting */
+  Counter &statements_to_primary;
+  /** @brief Statements sent to a secondary by read/write splitting */
+  Counter &statements_to_secondary;
+  /** @brief Full TLS handshakes with clients */
+  Counter &tls_client_handshakes;
+  /** @brief TLS handshakes with clients resuming a session */
+  Counter &tls_client_resumed;
+  /** @brief TLS handshakes with clients which failed */
+  Counter &tls_client_failures;
+  /** @brief Full TLS handshakes with destinations */
+  Counter &tls_server_handshakes;
+  /** @brief TLS handshakes with destinations resuming a session */
+  Counter &tls_server_resumed;
+  /** @brief TLS handshakes with destinations which failed */
+  Counter &tls_server_failures;
+  /** @brief Sessions of clients kept for resumption */
+  Gauge &tls_cached_sessions;
+
+ private:
+  Counter &rejected_max_connections_;
+  Counter &rejected_blocked_host_;
+  Counter &rejected_destination_busy_;
+  Counter &rejected_no_destination_;
+  Counter &rejected_fd_exhaustion_;
+  Counter &rejected_rule_quota_;
+};
+
+/** @class DestinationMetrics
+ * @brief Metrics of a destination of a route
+ *
+ * All metrics carry the labels `route` and `destination`.
+ */
+class DestinationMetrics {
+ public:
+  using Counter = mysql_harness::metrics::Counter;
+  using Gauge = mysql_harness::metrics::Gauge;
+  using Histogram = mysql_harness::metrics::Histogram;
+
+  DestinationMetrics(const std::string &route, const std::string &destination);
+
+  /** @brief Connections tried on behalf of clients */
+  Counter &connect_attempts;
+  /** @brief Connections which failed */
+  Counter &connect_failures;
+  /** @brief Times the destination was put in quarantine */
+  Counter &quarantined;
+  /** @brief Open connections to the destination */
+  Gauge &active_connections;
+  /** @brief 1 while the destination is in quarantine, 0 otherwise */
+  Gauge &in_quarantine;
+  /** @brief Distinct affinity keys, like tenant schemas, with connections open to the destination */
+  Gauge &affinity_keys;
+  /** @brief Connections which came to the destination although their affinity key belongs to another */
+  Counter &affinity_fallbacks;
+  /** @brief Read-only connections which spilled over to the primary because no secondary could take them */
+  Counter &spilled_unavailable;
+  /** @brief Read-only connections which spilled over to the primary because all secondaries were saturated */
+  Counter &spilled_saturated;
+  /** @brief How long connecting took, in microseconds */
+  Histogram &connect_duration;
+  /** @brief How long the protocol handshake took, in microseconds */
+  Histogram &handshake_duration;
+  /** @brief From the start of a command to the first byte of its answer, in microseconds */
+  Histogram &time_to_first_byte;
+  /** @brief From the start of a command to the end of its answer, in microseconds */
+  Histogram &command_turnaround;
+};
+
+#endif // ROUTING_METRICS_INCLUDED
@@ -21,6 +21,7 @@
 
 #include "logger.h"
 #include "config_parser.h"
+#include "keyring/keyring_manager.h"
 
 #include <atomic>
 #include <iostream>
@@ -37,6 +38,13 @@ using std::string;
 const mysql_harness::AppInfo *g_app_info;
 static const string kSectionName = "routing";
 
+// file descriptors we keep aside for everything but routed connections:
+// log files, metadata server connections, listening sockets, ..
+static const uint64_t kReservedOpenFiles = 256;
+
+// keyring attribute holding the password of read_write_splitting_user
+static const char *kKeyringAttributePassword = "password";
+
 const char *kRoutingRequires[1] = {
     "logger",
 };
@@ -103,6 +111,7 @@ static int init(const mysql_harness::AppInfo *info) {
   if (info->config != nullptr) {
     bool have_metadata_cache = false;
     bool need_metadata_cache = false;
+    uint64_t open_files_needed = kReservedOpenFiles;
     std::vector<TCPAddress> bind_addresses;
     for (const mysql_harness::ConfigSection* &section: info->config->sections()) {
       if (section->name == kSectionName) {
@@ -113,6 +122,9 @@ static int init(const mysql_harness::AppInfo *info) {
         RoutingPluginConfig config(section);                // throws std::invalid_argument
         validate_socket_info(err_prefix, section, config);  // throws std::invalid_argument
 
+        // each routed connection uses a client and a server socket
+        open_files_needed += 2 * static_cast<uint64_t>(config.max_connections);
+
         // ensure that TCP port is unique
         if (config.bind_address.port) {
 
@@ -155,6 +167,10 @@ static int init(const mysql_harness::AppInfo *info) {
       throw std::invalid_argument("Routing needs Metadata Cache, but no none "
                                   "was found in configuration.");
     }
+
+    if (open_files_needed > kReservedOpenFiles) {
+      routing::raise_open_files_limit(open_files_needed);
+    }
   }
   g_app_info = info;
   return 0;
@@ -177,6 +193,39 @@ static void start(const ConfigSection *section) {
                    name,                       config.max_connections,
                    config.connect_timeout,     config.max_connect_errors,
                    config.client_connect_timeout);
+    r.set_slow_start(config.slow_start_period, config.slow_start_ramp);
+    r.set_connection_limits(config.max_connections_per_destination, config.connection_queue_length,
+                            config.connection_queue_timeout);
+    r.set_drain_grace_period(config.drain_grace_period);
+    r.set_local_sockets(config.local_sockets);
+    r.set_spillover(config.spillover);
+    r.set_idle_timeouts(config.client_idle_timeout, config.server_idle_timeout);
+    r.set_socket_options(config.client_socket_options, config.server_socket_options);
+    r.set_listen_options(config.listen_options);
+    if (config.read_write_splitting) {
+      std::string password;
+      if (config.read_write_splitting_shared_account) {
+        password = mysql_harness::get_keyring() ?
+          mysql_harness::get_keyring()->fetch(config.read_write_splitting_user,
+                                              kKeyringAttributePassword) : "";
+        log_warning("[%s] read_write_splitting_shared_account: reads of all clients run on secondaries "
+                    "as '%s'; the privileges of the clients themselves are not checked there",
+                    name.c_str(), config.read_write_splitting_user.c_str());
+      }
+      r.set_read_write_splitting(config.read_write_splitting_user, password);
+    }
+    if (!config.schema_sharding.empty()) {
+      r.set_schema_sharding(config.schema_sharding);
+    }
+    if (config.affinity.key != routing::AffinityKey::kNone) {
+      r.set_affinity(config.affinity);
+    }
+    if (!config.routing_rules.empty()) {
+      r.set_routing_rules(config.routing_rules);
+    }
+    if (config.tls.enabled) {
+      r.set_tls(config.tls);
+    }
     try {
       // don't allow rootless URIs as we did already in the get_option_destinations()
       r.set_destinations_from_uri(URI(config.destinations, false));
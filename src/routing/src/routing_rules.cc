@@ -0,0 +1,301 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "routing_rules.h"
+#include "mysqlrouter/datatypes.h"
+#include "mysqlrouter/utils.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#  include <arpa/inet.h>
+#  include <netinet/in.h>
+#else
+#  include <ws2tcpip.h>
+#endif
+
+using mysqlrouter::string_format;
+
+const size_t RoutingRules::kNoRule = static_cast<size_t>(-1);
+
+// non-empty, trimmed parts of a list
+static std::vector<std::string> split_list(const std::string &list, char delimiter) {
+  std::vector<std::string> parts;
+  for (auto &part : mysqlrouter::split_string(list, delimiter, false)) {
+    mysqlrouter::trim(part);
+    if (!part.empty()) {
+      parts.push_back(part);
+    }
+  }
+  return parts;
+}
+
+RoutingRules::RoutingRules(const std::string &spec) {
+  for (auto &rule : split_list(spec, ';')) {
+    parse_rule(rule);
+  }
+  connections_.reset(new std::atomic<size_t>[rules_.size()]);
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    connections_[i] = 0;
+  }
+}
+
+void RoutingRules::parse_rule(const std::string &text) {
+  auto arrow = text.find("->");
+  if (arrow == std::string::npos) {
+    throw std::invalid_argument(string_format("expecting conditions -> actions, got '%s'", text.c_str()));
+  }
+  Rule rule;
+  for (auto &condition_text : split_list(text.substr(0, arrow), ',')) {
+    auto equal = condition_text.find('=');
+    if (equal == std::string::npos) {
+      throw std::invalid_argument(string_format("expecting name=value, got '%s'", condition_text.c_str()));
+    }
+    std::string name = condition_text.substr(0, equal);
+    std::string value = condition_text.substr(equal + 1);
+    mysqlrouter::trim(name);
+    mysqlrouter::trim(value);
+    Condition condition;
+    if (name == "user") {
+      condition.kind = Condition::Kind::kUser;
+      condition.pattern = parse_pattern(value);
+      needs_handshake_ = true;
+    } else if (name == "schema") {
+      condition.kind = Condition::Kind::kSchema;
+      condition.pattern = parse_pattern(value);
+      needs_handshake_ = true;
+    } else if (name.compare(0, 5, "attr:") == 0 && name.size() > 5) {
+      condition.kind = Condition::Kind::kAttribute;
+      condition.attribute = name.substr(5);
+      condition.pattern = parse_pattern(value);
+      needs_handshake_ = true;
+      needs_attributes_ = true;
+    } else if (name == "subnet") {
+      condition.kind = Condition::Kind::kSubnet;
+      condition.subnet = parse_subnet(value);
+    } else {
+      throw std::invalid_argument(string_format("unknown condition '%s'; valid are user, schema, "
+                                                "attr:<name> and subnet", name.c_str()));
+    }
+    rule.conditions.push_back(condition);
+  }
+  if (rule.conditions.empty()) {
+    throw std::invalid_argument(string_format("rule without conditions: '%s'", text.c_str()));
+  }
+
+  bool has_action = false;
+  for (auto &action_text : split_list(text.substr(arrow + 2), ',')) {
+    auto equal = action_text.find('=');
+    if (equal == std::string::npos) {
+      throw std::invalid_argument(string_format("expecting name=value, got '%s'", action_text.c_str()));
+    }
+    std::string name = action_text.substr(0, equal);
+    std::string value = action_text.substr(equal + 1);
+    mysqlrouter::trim(name);
+    mysqlrouter::trim(value);
+    if (name == "servers") {
+      for (auto &server : split_list(value, '|')) {
+        std::pair<std::string, uint16_t> addr;
+        try {
+          addr = mysqlrouter::split_addr_port(server);
+        } catch (const std::runtime_error &exc) {
+          throw std::invalid_argument(string_format("server '%s' is invalid: %s", server.c_str(), exc.what()));
+        }
+        if (addr.second == 0) {
+          throw std::invalid_argument(string_format("server '%s' needs a port", server.c_str()));
+        }
+        rule.action.servers.push_back(mysqlrouter::TCPAddress(addr.first, addr.second).str());
+      }
+      if (rule.action.servers.empty()) {
+        throw std::invalid_argument(string_format("no servers in '%s'", action_text.c_str()));
+      }
+    } else if (name == "location") {
+      if (value.empty()) {
+        throw std::invalid_argument(string_format("empty location in '%s'", action_text.c_str()));
+      }
+      rule.action.location = value;
+    } else if (name == "quota") {
+      char *end = nullptr;
+      unsigned long quota = std::strtoul(value.c_str(), &end, 10);
+      if (value.empty() || *end != '\0' || value[0] == '-' || quota == 0 || quota > 65535) {
+        throw std::invalid_argument(string_format("quota needs a value between 1 and 65535, was '%s'",
+                                                  value.c_str()));
+      }
+      rule.action.quota = quota;
+    } else {
+      throw std::invalid_argument(string_format("unknown action '%s'; valid are servers, location "
+                                                "and quota", name.c_str()));
+    }
+    has_action = true;
+  }
+  if (!has_action) {
+    throw std::invalid_argument(string_format("rule without actions: '%s'", text.c_str()));
+  }
+  rules_.push_back(std::move(rule));
+}
+
+RoutingRules::Pattern RoutingRules::parse_pattern(const std::string &text) {
+  Pattern pattern;
+  if (text == "*") {
+    pattern.kind = Pattern::Kind::kAny;
+  } else if (!text.empty() && text.back() == '*') {
+    pattern.kind = Pattern::Kind::kPrefix;
+    pattern.text = text.substr(0, text.size() - 1);
+  } else {
+    pattern.kind = Pattern::Kind::kExact;
+    pattern.text = text;
+  }
+  if (pattern.text.find('*') != std::string::npos) {
+    throw std::invalid_argument(string_format("'*' only allowed at the end of '%s'", text.c_str()));
+  }
+  return pattern;
+}
+
+RoutingRules::Subnet RoutingRules::parse_subnet(const std::string &text) {
+  Subnet subnet;
+  auto slash = text.find('/');
+  std::string address = text.substr(0, slash);
+  unsigned int max_bits;
+  if (inet_pton(AF_INET, address.c_str(), subnet.address) == 1) {
+    subnet.family = AF_INET;
+    max_bits = 32;
+  } else if (inet_pton(AF_INET6, address.c_str(), subnet.address) == 1) {
+    subnet.family = AF_INET6;
+    max_bits = 128;
+  } else {
+    throw std::invalid_argument(string_format("subnet '%s' is not an IP address", text.c_str()));
+  }
+  subnet.bits = max_bits;
+  if (slash != std::string::npos) {
+    std::string bits = text.substr(slash + 1);
+    char *end = nullptr;
+    unsigned long value = std::strtoul(bits.c_str(), &end, 10);
+    if (bits.empty() || *end != '\0' || bits[0] == '-' || value > max_bits) {
+      throw std::invalid_argument(string_format("subnet '%s' needs between 0 and %u bits",
+                                                text.c_str(), max_bits));
+    }
+    subnet.bits = static_cast<unsigned int>(value);
+  }
+  return subnet;
+}
+
+bool RoutingRules::Pattern::matches(const std::string &value) const noexcept {
+  switch (kind) {
+    case Kind::kAny:
+      return true;
+    case Kind::kExact:
+      return value == text;
+    case Kind::kPrefix:
+      return value.compare(0, text.size(), text) == 0;
+  }
+  return false;
+}
+
+bool RoutingRules::Subnet::matches(const sockaddr_storage *client) const noexcept {
+  if (client == nullptr) {
+    return false;
+  }
+  const uint8_t *bytes;
+  if (client->ss_family == AF_INET && family == AF_INET) {
+    bytes = reinterpret_cast<const uint8_t *>(
+        &reinterpret_cast<const sockaddr_in *>(client)->sin_addr);
+  } else if (client->ss_family == AF_INET6) {
+    bytes = reinterpret_cast<const uint8_t *>(
+        &reinterpret_cast<const sockaddr_in6 *>(client)->sin6_addr);
+    if (family == AF_INET) {
+      // IPv4 clients of a dual-stack socket come as ::ffff:a.b.c.d
+      static const uint8_t kMapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+      if (memcmp(bytes, kMapped, sizeof(kMapped)) != 0) {
+        return false;
+      }
+      bytes += sizeof(kMapped);
+    }
+  } else {
+    return false;
+  }
+  unsigned int full = bits / 8;
+  if (memcmp(bytes, address, full) != 0) {
+    return false;
+  }
+  unsigned int rest = bits % 8;
+  if (rest == 0) {
+    return true;
+  }
+  uint8_t mask = static_cast<uint8_t>(0xff << (8 - rest));
+  return (bytes[full] & mask) == (address[full] & mask);
+}
+
+bool RoutingRules::filters_destinations() const noexcept {
+  for (auto &rule : rules_) {
+    if (!rule.action.location.empty() || !rule.action.servers.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t RoutingRules::match(const Client &client) const noexcept {
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    bool matched = true;
+    for (auto &condition : rules_[i].conditions) {
+      switch (condition.kind) {
+        case Condition::Kind::kUser:
+          matched = condition.pattern.matches(client.user);
+          break;
+        case Condition::Kind::kSchema:
+          matched = condition.pattern.matches(client.schema);
+          break;
+        case Condition::Kind::kAttribute: {
+          auto it = client.attributes.find(condition.attribute);
+          matched = it != client.attributes.end() && condition.pattern.matches(it->second);
+          break;
+        }
+        case Condition::Kind::kSubnet:
+          matched = condition.subnet.matches(client.address);
+          break;
+      }
+      if (!matched) {
+        break;
+      }
+    }
+    if (matched) {
+      return i;
+    }
+  }
+  return kNoRule;
+}
+
+bool RoutingRules::acquire(size_t rule) noexcept {
+  size_t quota = rules_[rule].action.quota;
+  if (quota == 0) {
+    connections_[rule].fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  size_t current = connections_[rule].load(std::memory_order_relaxed);
+  while (current < quota) {
+    if (connections_[rule].compare_exchange_weak(current, current + 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RoutingRules::release(size_t rule) noexcept {
+  connections_[rule].fetch_sub(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,192 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_ROUTING_RULES_INCLUDED
+#define ROUTING_ROUTING_RULES_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#  include <sys/socket.h>
+#else
+#  include <winsock2.h>
+#endif
+
+/** @class RoutingRules
+ * @brief Decides per connection where a client may go, by who it is
+ *
+ * Rules are given as a list separated by `;`. Each rule has conditions and
+ * actions separated by `->`; both are lists separated by `,`:
+ *
+ *     user=etl_*, attr:program_name=spark -> location=analytics, quota=20;
+ *     subnet=10.20.0.0/16 -> servers=db3:3306|db4:3306
+ *
+ * Conditions, which all have to match:
+ *
+ * - `user=PATTERN`: user name from the handshake response
+ * - `schema=PATTERN`: default schema from the handshake response
+ * - `attr:NAME=PATTERN`: connection attribute, like program_name or
+ *   _client_name; a missing attribute does not match
+ * - `subnet=ADDRESS/BITS`: IPv4 or IPv6 network of the client
+ *
+ * A PATTERN is a name, or a prefix followed by `*`; `*` alone matches any
+ * value, also an empty one.
+ *
+ * Actions:
+ *
+ * - `servers=ADDR|ADDR|...`: only these destinations, as host:port
+ * - `location=NAME`: only Metadata Cache members in this location
+ * - `quota=N`: at most N connections of the rule at the same time
+ *
+ * The first matching rule applies. Clients matched by no rule are routed
+ * as usual.
+ *
+ * Rules are compiled once: patterns into exact and prefix comparisons,
+ * subnets into address bytes and masks. Matching a client walks the rules
+ * without allocating.
+ */
+class RoutingRules {
+ public:
+  /** @brief Returned by match() when no rule matched */
+  static const size_t kNoRule;
+
+  /** @brief What is known about a client */
+  struct Client {
+    /** @brief Address of the client; nullptr or AF_UNIX when unknown */
+    const sockaddr_storage *address = nullptr;
+    /** @brief User name; empty before the handshake response */
+    std::string user;
+    /** @brief Default schema; empty when none */
+    std::string schema;
+    /** @brief Connection attributes */
+    std::map<std::string, std::string> attributes;
+  };
+
+  /** @brief What a rule does with the clients it matches */
+  struct Action {
+    /** @brief Destinations allowed, as host:port; empty allows all */
+    std::vector<std::string> servers;
+    /** @brief Location of Metadata Cache members allowed; empty allows all */
+    std::string location;
+    /** @brief Maximum connections of the rule; 0 for no limit */
+    size_t quota = 0;
+  };
+
+  /** @brief Constructor
+   *
+   * @param spec rules, as described above; empty for none
+   * @throws std::invalid_argument when spec is invalid
+   */
+  explicit RoutingRules(const std::string &spec);
+
+  RoutingRules(const RoutingRules &) = delete;
+  RoutingRules &operator=(const RoutingRules &) = delete;
+
+  /** @brief Returns the number of rules */
+  size_t size() const noexcept {
+    return rules_.size();
+  }
+
+  /** @brief Returns whether rules look at the handshake response */
+  bool needs_handshake() const noexcept {
+    return needs_handshake_;
+  }
+
+  /** @brief Returns whether rules look at connection attributes */
+  bool needs_attributes() const noexcept {
+    return needs_attributes_;
+  }
+
+  /** @brief Returns whether a rule uses servers= or location= */
+  bool filters_destinations() const noexcept;
+
+  /** @brief Returns the first rule matching the client
+   *
+   * @param client what is known about the client
+   * @return index of the rule, or kNoRule
+   */
+  size_t match(const Client &client) const noexcept;
+
+  /** @brief Returns the action of a rule */
+  const Action &get_action(size_t rule) const {
+    return rules_.at(rule).action;
+  }
+
+  /** @brief Takes a connection of the quota of a rule
+   *
+   * Each successful call has to be followed by release().
+   *
+   * @param rule index of the rule
+   * @return false when the rule reached its quota
+   */
+  bool acquire(size_t rule) noexcept;
+
+  /** @brief Gives back a connection taken with acquire() */
+  void release(size_t rule) noexcept;
+
+  /** @brief Returns the open connections of a rule, counted by acquire() */
+  size_t get_connections(size_t rule) const noexcept {
+    return connections_[rule].load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Pattern {
+    enum class Kind { kAny, kExact, kPrefix };
+    Kind kind = Kind::kAny;
+    std::string text;
+
+    bool matches(const std::string &value) const noexcept;
+  };
+
+  struct Subnet {
+    int family = AF_UNSPEC;
+    uint8_t address[16] = {0};
+    unsigned int bits = 0;
+
+    bool matches(const sockaddr_storage *address) const noexcept;
+  };
+
+  struct Condition {
+    enum class Kind { kUser, kSchema, kAttribute, kSubnet };
+    Kind kind;
+    std::string attribute;
+    Pattern pattern;
+    Subnet subnet;
+  };
+
+  struct Rule {
+    std::vector<Condition> conditions;
+    Action action;
+  };
+
+  static Pattern parse_pattern(const std::string &text);
+  static Subnet parse_subnet(const std::string &text);
+  void parse_rule(const std::string &text);
+
+  std::vector<Rule> rules_;
+  std::unique_ptr<std::atomic<size_t>[]> connections_;
+  bool needs_handshake_ = false;
+  bool needs_attributes_ = false;
+};
+
+#endif // ROUTING_ROUTING_RULES_INCLUDED
@@ -0,0 +1,137 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "schema_shard_map.h"
+#include "mysqlrouter/utils.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using mysqlrouter::string_format;
+
+SchemaShardMap::SchemaShardMap(const std::string &spec, const std::string &default_replicaset)
+    : default_replicaset_(default_replicaset) {
+  for (auto &entry : mysqlrouter::split_string(spec, ',', false)) {
+    mysqlrouter::trim(entry);
+    if (entry.empty()) {
+      continue;
+    }
+    auto equal = entry.find('=');
+    if (equal == std::string::npos) {
+      throw std::invalid_argument(string_format("expecting schema=replicaset, got '%s'", entry.c_str()));
+    }
+    std::string pattern = entry.substr(0, equal);
+    std::string target = entry.substr(equal + 1);
+    mysqlrouter::trim(pattern);
+    mysqlrouter::trim(target);
+    if (pattern.empty() || target.empty()) {
+      throw std::invalid_argument(string_format("expecting schema=replicaset, got '%s'", entry.c_str()));
+    }
+
+    if (pattern == "*") {
+      if (!hashed_.empty()) {
+        throw std::invalid_argument("'*' given more than once");
+      }
+      for (auto &replicaset : mysqlrouter::split_string(target, '|')) {
+        mysqlrouter::trim(replicaset);
+        if (replicaset.empty()) {
+          throw std::invalid_argument(string_format("empty replicaset in '%s'", entry.c_str()));
+        }
+        hashed_.push_back(replicaset);
+      }
+      continue;
+    }
+
+    if (target.find('|') != std::string::npos) {
+      throw std::invalid_argument(string_format("only '*' can be spread over replicasets, got '%s'",
+                                                entry.c_str()));
+    }
+    if (pattern.back() == '*') {
+      pattern.pop_back();
+      if (pattern.empty() || pattern.find('*') != std::string::npos) {
+        throw std::invalid_argument(string_format("invalid schema prefix in '%s'", entry.c_str()));
+      }
+      for (auto &prefix : prefixes_) {
+        if (prefix.first == pattern) {
+          throw std::invalid_argument(string_format("schema prefix '%s*' given more than once",
+                                                    pattern.c_str()));
+        }
+      }
+      prefixes_.emplace_back(pattern, target);
+    } else {
+      if (pattern.find('*') != std::string::npos) {
+        throw std::invalid_argument(string_format("'*' only allowed at the end of '%s'", pattern.c_str()));
+      }
+      if (!schemas_.emplace(pattern, target).second) {
+        throw std::invalid_argument(string_format("schema '%s' given more than once", pattern.c_str()));
+      }
+    }
+  }
+
+  std::stable_sort(prefixes_.begin(), prefixes_.end(),
+                   [](const std::pair<std::string, std::string> &a,
+                      const std::pair<std::string, std::string> &b) {
+                     return a.first.size() > b.first.size();
+                   });
+}
+
+const std::string &SchemaShardMap::get_replicaset(const std::string &schema) const noexcept {
+  if (schema.empty()) {
+    return default_replicaset_;
+  }
+  auto found = schemas_.find(schema);
+  if (found != schemas_.end()) {
+    return found->second;
+  }
+  for (auto &prefix : prefixes_) {
+    if (schema.compare(0, prefix.first.size(), prefix.first) == 0) {
+      return prefix.second;
+    }
+  }
+  if (!hashed_.empty()) {
+    return hashed_[hash(schema) % hashed_.size()];
+  }
+  return default_replicaset_;
+}
+
+std::vector<std::string> SchemaShardMap::get_replicasets() const {
+  std::vector<std::string> result{default_replicaset_};
+  auto add = [&result](const std::string &replicaset) {
+    if (std::find(result.begin(), result.end(), replicaset) == result.end()) {
+      result.push_back(replicaset);
+    }
+  };
+  for (auto &it : schemas_) {
+    add(it.second);
+  }
+  for (auto &it : prefixes_) {
+    add(it.second);
+  }
+  for (auto &it : hashed_) {
+    add(it);
+  }
+  return result;
+}
+
+uint32_t SchemaShardMap::hash(const std::string &schema) noexcept {
+  uint32_t result = 2166136261u;
+  for (unsigned char c : schema) {
+    result ^= c;
+    result *= 16777619u;
+  }
+  return result;
+}
@@ -0,0 +1,78 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_SCHEMA_SHARD_MAP_INCLUDED
+#define ROUTING_SCHEMA_SHARD_MAP_INCLUDED
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/** @class SchemaShardMap
+ * @brief Tells which replicaset holds a schema, for schema-based sharding
+ *
+ * The map is given as a comma separated list of entries:
+ *
+ *     shop_eu=shard_eu, shop_us_*=shard_us, *=shard_a|shard_b
+ *
+ * - `name=replicaset` sends the schema `name` to the replicaset;
+ * - `prefix*=replicaset` sends schemas starting with `prefix` to the
+ *   replicaset; the longest matching prefix wins;
+ * - `*=rs1|rs2|...` spreads all other schemas over the given replicasets
+ *   by a hash of the schema name (FNV-1a), which is the same on every
+ *   router.
+ *
+ * Schemas matched by nothing, and clients without a default schema, go to
+ * the default replicaset. Names are case sensitive.
+ */
+class SchemaShardMap {
+ public:
+  /** @brief Constructor
+   *
+   * @param spec entries of the map, as described above
+   * @param default_replicaset replicaset of schemas matched by nothing
+   * @throws std::invalid_argument when spec is invalid
+   */
+  SchemaShardMap(const std::string &spec, const std::string &default_replicaset);
+
+  /** @brief Returns the replicaset holding the schema
+   *
+   * @param schema name of the schema; may be empty
+   */
+  const std::string &get_replicaset(const std::string &schema) const noexcept;
+
+  /** @brief Returns all replicasets of the map, including the default, without duplicates */
+  std::vector<std::string> get_replicasets() const;
+
+  /** @brief Returns the default replicaset */
+  const std::string &get_default_replicaset() const noexcept {
+    return default_replicaset_;
+  }
+
+  /** @brief Hash used to spread schemas; 32-bit FNV-1a */
+  static uint32_t hash(const std::string &schema) noexcept;
+
+ private:
+  std::string default_replicaset_;
+  std::map<std::string, std::string> schemas_;
+  // longest first
+  std::vector<std::pair<std::string, std::string>> prefixes_;
+  std::vector<std::string> hashed_;
+};
+
+#endif // ROUTING_SCHEMA_SHARD_MAP_INCLUDED
@@ -0,0 +1,448 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "shard_session.h"
+#include "common.h"
+#include "logger.h"
+#include "mysqlrouter/mysql_protocol.h"
+#include "mysqlrouter/routing.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <random>
+
+#ifndef _WIN32
+#  include <poll.h>
+#else
+#  include <winsock2.h>
+#endif
+
+using namespace mysql_protocol;
+
+// capabilities the greeting offers: those of a MySQL 5.7 server, without
+// CLIENT_SSL and CLIENT_COMPRESS
+static const uint32_t kGreetingCapabilities = 0x01fff7df;
+// capabilities changing the protocol; a server lacking one the client uses
+// would send what the client does not expect
+static const uint32_t kClientMultiResults = 0x00020000;
+static const uint32_t kClientPsMultiResults = 0x00040000;
+static const uint32_t kClientSessionTrack = 0x00800000;
+static const uint32_t kProtocolCapabilities =
+    kClientProtocol41 | kClientSecureConnection | kClientPluginAuth |
+    kClientPluginAuthLenencClientData | kClientDeprecateEOF | kClientSessionTrack |
+    kClientMultiResults | kClientPsMultiResults;
+static const uint32_t kClientCompress = 0x00000020;
+static const uint32_t kClientConnectAttrs = 0x00100000;
+static const size_t kSaltSize = 20;
+static const char *kDefaultAuthPlugin = "mysql_native_password";
+
+namespace {
+
+void set_payload_size(std::vector<uint8_t> &packet) {
+  Packet::vector_t::size_type size = packet.size() - Packet::kHeaderSize;
+  packet[0] = static_cast<uint8_t>(size);
+  packet[1] = static_cast<uint8_t>(size >> 8);
+  packet[2] = static_cast<uint8_t>(size >> 16);
+}
+
+}
+
+ShardSession::ShardSession(routing::SocketOperationsBase *socket_operations, int client,
+                           const SchemaShardMap &shard_map, std::chrono::milliseconds timeout,
+                           const std::string &log_prefix)
+    : socket_operations_(socket_operations), client_(client), shard_map_(shard_map),
+      timeout_(timeout), log_prefix_(log_prefix), client_capabilities_(0), max_packet_size_(0),
+      char_set_(8), bytes_from_client_(0), bytes_to_client_(0) {}
+
+bool ShardSession::accept_client(const std::string &server_version, std::string *error) {
+  auto greeting = make_greeting(server_version);
+  if (!write_packet(client_, greeting, 0)) {
+    *error = "writing greeting failed: " + get_message_error(errno);
+    return false;
+  }
+  std::vector<uint8_t> packet;
+  if (!read_packet(client_, &packet)) {
+    *error = "no handshake response from client";
+    return false;
+  }
+  bytes_from_client_ += packet.size();
+  if (!parse_handshake_response(packet, error)) {
+    return false;
+  }
+  replicaset_ = shard_map_.get_replicaset(schema_);
+  return true;
+}
+
+bool ShardSession::parse_handshake_response(const std::vector<uint8_t> &packet, std::string *error) {
+  try {
+    PacketView view(packet);
+    PacketReader reader(view, Packet::kHeaderSize);
+    client_capabilities_ = reader.read_int<uint32_t>();
+    if (!(client_capabilities_ & kClientProtocol41) ||
+        (client_capabilities_ & (kClientSSL | kClientCompress))) {
+      // none of them was offered
+      *error = "client does not use the 4.1 protocol, or asks for SSL or compression";
+      send_handshake_error(1043, "Bad handshake");
+      return false;
+    }
+    if (!(client_capabilities_ & kClientPluginAuth)) {
+      *error = "client does not support authentication plugins";
+      send_handshake_error(1251, "Client does not support authentication protocol requested by "
+                                 "server; consider upgrading MySQL client");
+      return false;
+    }
+    max_packet_size_ = reader.read_int<uint32_t>();
+    char_set_ = reader.read_int<uint8_t>();
+    reader.skip(23);
+    user_ = reader.read_nul_string().str();
+    // the response to the greeting; the client answers again for the server
+    if (client_capabilities_ & kClientPluginAuthLenencClientData) {
+      reader.read_lenenc_bytes();
+    } else {
+      reader.read_bytes(reader.read_int<uint8_t>());
+    }
+    if (client_capabilities_ & kClientConnectWithDb) {
+      schema_ = reader.read_nul_string().str();
+    }
+    reader.read_nul_string();  // authentication plugin
+    if ((client_capabilities_ & kClientConnectAttrs) && reader.get_remaining() > 0) {
+      PacketView attributes = reader.read_rest();
+      connect_attributes_.assign(attributes.begin(), attributes.end());
+    }
+  } catch (const packet_error &exc) {
+    *error = std::string("invalid handshake response: ") + exc.what();
+    send_handshake_error(1043, "Bad handshake");
+    return false;
+  }
+  return true;
+}
+
+std::map<std::string, std::string> ShardSession::get_connect_attributes() const {
+  std::map<std::string, std::string> attributes;
+  try {
+    PacketView view(connect_attributes_.data(), connect_attributes_.size());
+    PacketReader reader(view);
+    PacketView pairs = reader.read_bytes(static_cast<size_t>(reader.read_lenenc_uint()));
+    PacketReader pair_reader(pairs);
+    while (pair_reader.get_remaining() > 0) {
+      std::string key = pair_reader.read_lenenc_bytes().str();
+      attributes[key] = pair_reader.read_lenenc_bytes().str();
+    }
+  } catch (const packet_error &) {
+    // what was decoded so far
+  }
+  return attributes;
+}
+
+ShardSession::AuthResult ShardSession::authenticate(int server, std::string *error) {
+  std::vector<uint8_t> packet;
+  if (!read_packet(server, &packet)) {
+    *error = "no greeting from server";
+    return AuthResult::kFailed;
+  }
+  if (packet.size() > Packet::kHeaderSize && packet[4] == 0xff) {
+    // like too many connections; the client waits for the end of the handshake
+    *error = "server refused the connection";
+    write_packet(client_, packet, 2);
+    return AuthResult::kRefused;
+  }
+
+  uint32_t server_capabilities = 0;
+  std::vector<uint8_t> salt;
+  std::string plugin;
+  try {
+    HandshakePacket greeting(packet);
+    server_capabilities = greeting.get_server_capabilities();
+    salt = greeting.get_auth_data();
+    plugin = greeting.get_auth_plugin();
+    server_version_ = greeting.get_server_version();
+  } catch (const packet_error &exc) {
+    *error = std::string("invalid greeting from server: ") + exc.what();
+    send_handshake_error(2027, "Malformed packet");
+    return AuthResult::kFailed;
+  }
+  if (plugin.empty()) {
+    plugin = kDefaultAuthPlugin;
+  }
+  uint32_t missing = client_capabilities_ & kProtocolCapabilities & ~server_capabilities;
+  if (missing) {
+    *error = "server lacks capabilities " + std::to_string(missing) + " used by the client";
+    send_handshake_error(1105, "Server of replicaset '" + replicaset_ +
+                               "' does not support the capabilities of the client");
+    return AuthResult::kFailed;
+  }
+
+  // the client answers the salt of the server
+  std::vector<uint8_t> auth_switch(Packet::kHeaderSize);
+  auth_switch.push_back(0xfe);
+  auth_switch.insert(auth_switch.end(), plugin.begin(), plugin.end());
+  auth_switch.push_back(0);
+  auth_switch.insert(auth_switch.end(), salt.begin(), salt.end());
+  auth_switch.push_back(0);
+  set_payload_size(auth_switch);
+  if (!write_packet(client_, auth_switch, 2) || !read_packet(client_, &packet)) {
+    *error = "client did not answer the authentication switch";
+    return AuthResult::kFailed;
+  }
+  bytes_from_client_ += packet.size();
+
+  auto response = make_handshake_response(
+      client_capabilities_ & server_capabilities & ~(kClientSSL | kClientCompress), plugin,
+      std::vector<uint8_t>(packet.begin() + Packet::kHeaderSize, packet.end()));
+  if (!write_packet(server, response, 1)) {
+    *error = "writing handshake response failed: " + get_message_error(errno);
+    return AuthResult::kFailed;
+  }
+
+  // the client is two packets ahead of the server
+  while (true) {
+    if (!read_packet(server, &packet) || packet.size() <= Packet::kHeaderSize) {
+      *error = "no answer from server during authentication";
+      return AuthResult::kFailed;
+    }
+    uint8_t type = packet[4];
+    if (!write_packet(client_, packet, static_cast<uint8_t>(packet[3] + 2))) {
+      *error = "writing to client failed: " + get_message_error(errno);
+      return AuthResult::kFailed;
+    }
+    if (type == 0x00) {
+      return AuthResult::kAuthenticated;
+    } else if (type == 0xff) {
+      *error = "server refused the client";
+      return AuthResult::kRefused;
+    } else if (type == 0x01 && packet.size() == Packet::kHeaderSize + 2 && packet[5] == 0x03) {
+      // fast authentication succeeded; the OK follows
+      continue;
+    }
+    if (!read_packet(client_, &packet)) {
+      *error = "no answer from client during authentication";
+      return AuthResult::kFailed;
+    }
+    bytes_from_client_ += packet.size();
+    if (!write_packet(server, packet, static_cast<uint8_t>(packet[3] - 2))) {
+      *error = "writing to server failed: " + get_message_error(errno);
+      return AuthResult::kFailed;
+    }
+  }
+}
+
+void ShardSession::send_handshake_error(uint16_t code, const std::string &message) noexcept {
+  try {
+    ErrorPacket error(2, code, message, "HY000", kClientProtocol41);
+    if (socket_operations_->write_all(client_, error.data(), error.size()) >= 0) {
+      bytes_to_client_ += error.size();
+    }
+  } catch (const std::exception &exc) {
+    log_debug("[%s] Failed sending error: %s", log_prefix_.c_str(), exc.what());
+  }
+}
+
+int ShardSession::copy_client_data(int server, bool client_is_readable,
+                                   RoutingProtocolBuffer &buffer, size_t *bytes_read) {
+  *bytes_read = 0;
+  if (!client_is_readable) {
+    return 0;
+  }
+  ssize_t res = socket_operations_->read(client_, &buffer.front(), buffer.size());
+  if (res <= 0) {
+    if (res == -1) {
+      LOGGER_DEBUG("sender read failed: (%d %s)", errno, get_message_error(errno).c_str());
+    }
+    return -1;
+  }
+  size_t size = static_cast<size_t>(res);
+  const uint8_t *data = &buffer[0];
+
+  // the feed stops after each packet; data[unsent, pos) goes to the server as it is
+  size_t unsent = 0;
+  size_t pos = 0;
+  while (pos < size) {
+    size_t start = pos;
+    init_db_finder_.clear_ended();
+    pos += client_framer_.feed(data + start, size - start, init_db_finder_);
+
+    if (init_db_finder_.init_db_ended()) {
+      held_.insert(held_.end(), data + start, data + pos);
+      if (!send_to_server(server, data + unsent, start - unsent, bytes_read)) {
+        return -1;
+      }
+      unsent = pos;
+      const std::string &schema = init_db_finder_.get_schema();
+      auto &replicaset = shard_map_.get_replicaset(schema);
+      if (replicaset != replicaset_) {
+        log_debug("[%s] Refusing COM_INIT_DB to '%s': in replicaset '%s', connected to '%s'",
+                  log_prefix_.c_str(), schema.c_str(), replicaset.c_str(), replicaset_.c_str());
+        ErrorPacket error(1, 1105, "Schema '" + schema + "' is on another shard; reconnect using "
+                                   "it as default schema", "HY000", kClientProtocol41);
+        if (socket_operations_->write_all(client_, error.data(), error.size()) < 0) {
+          return -1;
+        }
+      } else if (!send_to_server(server, held_.data(), held_.size(), bytes_read)) {
+        return -1;
+      }
+      held_.clear();
+    } else if (pos == size && init_db_finder_.may_be_init_db(client_framer_)) {
+      // the rest comes with the next read
+      if (!send_to_server(server, data + unsent, start - unsent, bytes_read)) {
+        return -1;
+      }
+      held_.insert(held_.end(), data + start, data + pos);
+      unsent = pos;
+    } else if (!held_.empty()) {
+      // the held command turned out to be another one; its bytes come first
+      if (!send_to_server(server, held_.data(), held_.size(), bytes_read)) {
+        return -1;
+      }
+      held_.clear();
+    }
+  }
+  if (!send_to_server(server, data + unsent, size - unsent, bytes_read)) {
+    return -1;
+  }
+  return 0;
+}
+
+bool ShardSession::send_to_server(int server, const uint8_t *data, size_t size,
+                                  size_t *bytes_sent) {
+  if (size == 0) {
+    return true;
+  }
+  if (socket_operations_->write_all(server, const_cast<uint8_t *>(data), size) < 0) {
+    LOGGER_DEBUG("Write error: %s", get_message_error(errno).c_str());
+    return false;
+  }
+  *bytes_sent += size;
+  return true;
+}
+
+void ShardSession::InitDbFinder::on_payload(const uint8_t *data, size_t size) {
+  if (!command_) {
+    return;
+  }
+  if (!command_seen_) {
+    command_seen_ = true;
+    init_db_ = data[0] == kComInitDb;
+    ++data;
+    --size;
+  }
+  if (init_db_) {
+    schema_.append(reinterpret_cast<const char *>(data), size);
+  }
+}
+
+std::vector<uint8_t> ShardSession::make_greeting(const std::string &server_version) const {
+  // the salt is only answered for the greeting; the client is asked to answer the
+  // one of the server later
+  std::random_device random;
+  std::uniform_int_distribution<int> salt_byte(1, 127);
+  std::vector<uint8_t> salt(kSaltSize);
+  for (auto &byte : salt) {
+    byte = static_cast<uint8_t>(salt_byte(random));
+  }
+
+  Packet packet{0x00, 0x00, 0x00, 0x00};
+  packet.add_int<uint8_t>(10);  // protocol version
+  packet.add(server_version);
+  packet.add_int<uint8_t>(0);
+  packet.add_int<uint32_t>(0);  // connection id; the one of the server is not known yet
+  packet.add(std::vector<uint8_t>(salt.begin(), salt.begin() + 8));
+  packet.add_int<uint8_t>(0);
+  packet.add_int<uint16_t>(static_cast<uint16_t>(kGreetingCapabilities));
+  packet.add_int<uint8_t>(33);  // utf8_general_ci
+  packet.add_int<uint16_t>(kServerStatusAutocommit);
+  packet.add_int<uint16_t>(static_cast<uint16_t>(kGreetingCapabilities >> 16));
+  packet.add_int<uint8_t>(kSaltSize + 1);
+  packet.add(std::vector<uint8_t>(10, 0));
+  packet.add(std::vector<uint8_t>(salt.begin() + 8, salt.end()));
+  packet.add_int<uint8_t>(0);
+  packet.add(std::string(kDefaultAuthPlugin));
+  packet.add_int<uint8_t>(0);
+  std::vector<uint8_t> result(packet.begin(), packet.end());
+  set_payload_size(result);
+  return result;
+}
+
+std::vector<uint8_t> ShardSession::make_handshake_response(
+    uint32_t capabilities, const std::string &plugin,
+    const std::vector<uint8_t> &auth_response) const {
+  Packet packet{0x00, 0x00, 0x00, 0x01};
+  packet.add_int<uint32_t>(capabilities);
+  packet.add_int<uint32_t>(max_packet_size_);
+  packet.add_int<uint8_t>(char_set_);
+  packet.add(std::vector<uint8_t>(23, 0));
+  packet.add(user_);
+  packet.add_int<uint8_t>(0);
+  if (capabilities & kClientPluginAuthLenencClientData) {
+    if (auth_response.size() < 251) {
+      packet.add_int<uint8_t>(static_cast<uint8_t>(auth_response.size()));
+    } else {
+      packet.add_int<uint8_t>(0xfc);
+      packet.add_int<uint16_t>(static_cast<uint16_t>(auth_response.size()));
+    }
+  } else {
+    packet.add_int<uint8_t>(static_cast<uint8_t>(auth_response.size()));
+  }
+  packet.add(auth_response);
+  if (capabilities & kClientConnectWithDb) {
+    packet.add(schema_);
+    packet.add_int<uint8_t>(0);
+  }
+  packet.add(plugin);
+  packet.add_int<uint8_t>(0);
+  if (capabilities & kClientConnectAttrs) {
+    packet.add(connect_attributes_);
+  }
+  std::vector<uint8_t> result(packet.begin(), packet.end());
+  set_payload_size(result);
+  return result;
+}
+
+bool ShardSession::write_packet(int fd, std::vector<uint8_t> &packet, uint8_t sequence_id) noexcept {
+  packet[3] = sequence_id;
+  if (socket_operations_->write_all(fd, packet.data(), packet.size()) < 0) {
+    return false;
+  }
+  if (fd == client_) {
+    bytes_to_client_ += packet.size();
+  }
+  return true;
+}
+
+bool ShardSession::read_packet(int fd, std::vector<uint8_t> *packet) {
+  packet->clear();
+  size_t wanted = Packet::kHeaderSize;
+  while (packet->size() < wanted) {
+    struct pollfd fds[1];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    if (routing::poll_sockets(fds, 1, timeout_) <= 0) {
+      return false;
+    }
+    size_t offset = packet->size();
+    packet->resize(wanted);
+    ssize_t size = socket_operations_->read(fd, packet->data() + offset, wanted - offset);
+    if (size <= 0) {
+      return false;
+    }
+    packet->resize(offset + static_cast<size_t>(size));
+    if (packet->size() == Packet::kHeaderSize && wanted == Packet::kHeaderSize) {
+      wanted = Packet::kHeaderSize + PacketView(*packet).get_payload_size();
+    }
+  }
+  return true;
+}
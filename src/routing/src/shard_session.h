@@ -0,0 +1,223 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_SHARD_SESSION_INCLUDED
+#define ROUTING_SHARD_SESSION_INCLUDED
+
+#include "protocol/base_protocol.h"
+#include "protocol/classic_framer.h"
+#include "schema_shard_map.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace routing {
+class SocketOperationsBase;
+}
+
+/** @class ShardSession
+ * @brief Takes part in a classic protocol connection routed by schema
+ *
+ * The replicaset of a client is known only once its handshake response,
+ * holding the default schema, was read. So the router greets the client
+ * itself, picks the replicaset using the SchemaShardMap, and connects to
+ * it. The client is then asked to switch to the authentication plugin of
+ * the server, with the salt of the server (AuthSwitchRequest), so that
+ * its answer can be sent to the server as part of a handshake response
+ * built from the one of the client. The password is never seen. The
+ * rest of the authentication is relayed.
+ *
+ * After authentication data is copied as on any route, except COM_INIT_DB
+ * to a schema on another replicaset, which is answered with an error: the
+ * connection can not be moved without the password.
+ *
+ * Routes with an affinity on the user, schema or connection attributes
+ * use a session too, with a map without entries: they need the handshake
+ * response before picking a server as well.
+ *
+ * The greeting does not offer SSL nor compression. Clients must support
+ * CLIENT_PROTOCOL_41 and CLIENT_PLUGIN_AUTH.
+ *
+ * A session runs in the routing thread of its client and is not
+ * thread-safe.
+ */
+class ShardSession {
+ public:
+  /** @brief Outcome of authenticate() */
+  enum class AuthResult {
+    /** @brief the server accepted the client; both were sent its OK */
+    kAuthenticated,
+    /** @brief the server refused the client; the client was sent its error */
+    kRefused,
+    /** @brief the client or the server broke the handshake */
+    kFailed,
+  };
+
+  /** @brief Constructor
+   *
+   * @param socket_operations socket operations
+   * @param client socket of the client
+   * @param shard_map replicaset of each schema
+   * @param timeout how long the client and the server may take to answer
+   * @param log_prefix prefix of log messages, like the route name
+   */
+  ShardSession(routing::SocketOperationsBase *socket_operations, int client,
+               const SchemaShardMap &shard_map, std::chrono::milliseconds timeout,
+               const std::string &log_prefix);
+
+  ShardSession(const ShardSession &) = delete;
+  ShardSession &operator=(const ShardSession &) = delete;
+
+  /** @brief Greets the client and reads its handshake response
+   *
+   * @param server_version version told to the client
+   * @param error set to why the handshake failed
+   * @return false when the handshake failed; the client was told when possible
+   */
+  bool accept_client(const std::string &server_version, std::string *error);
+
+  /** @brief Returns the user name the client logs in with */
+  const std::string &get_user() const noexcept { return user_; }
+
+  /** @brief Returns the default schema of the client; empty when none */
+  const std::string &get_schema() const noexcept { return schema_; }
+
+  /** @brief Returns the connection attributes sent by the client, like program_name
+   *
+   * Attributes which can not be decoded are left out.
+   */
+  std::map<std::string, std::string> get_connect_attributes() const;
+
+  /** @brief Returns the replicaset holding the default schema, once the client was accepted */
+  const std::string &get_replicaset() const noexcept { return replicaset_; }
+
+  /** @brief Authenticates the client with the server
+   *
+   * @param server socket connected to a server of get_replicaset(), which did not greet yet
+   * @param error set to why the handshake failed
+   */
+  AuthResult authenticate(int server, std::string *error);
+
+  /** @brief Returns the version of the server, once it greeted */
+  const std::string &get_server_version() const noexcept { return server_version_; }
+
+  /** @brief Sends an error to the client while it waits for the end of the handshake */
+  void send_handshake_error(uint16_t code, const std::string &message) noexcept;
+
+  /** @brief Copies data of the authenticated client to the server
+   *
+   * Like BaseProtocol::copy_packets(), but COM_INIT_DB to a schema of
+   * another replicaset is answered with an error instead of being sent.
+   * Packets are followed with a ClassicFramer, so a COM_INIT_DB is found
+   * wherever it is in the data read; the bytes of a command which may be
+   * one are held until it is complete.
+   *
+   * @param server socket of the server
+   * @param client_is_readable whether the client has data
+   * @param buffer buffer to use
+   * @param bytes_read set to the number of bytes sent to the server
+   * @return -1 when the connection ended, 0 otherwise
+   */
+  int copy_client_data(int server, bool client_is_readable, RoutingProtocolBuffer &buffer,
+                       size_t *bytes_read);
+
+  /** @brief Returns the number of bytes exchanged with the client during the handshake */
+  size_t get_handshake_bytes_from_client() const noexcept { return bytes_from_client_; }
+  size_t get_handshake_bytes_to_client() const noexcept { return bytes_to_client_; }
+
+ private:
+  /** @brief Follows the commands of the client for the ClassicFramer, to find COM_INIT_DB */
+  class InitDbFinder {
+   public:
+    InitDbFinder() noexcept
+        : in_packet_(false), command_(false), command_seen_(false), init_db_(false),
+          ended_(false) {}
+
+    void on_header(uint8_t sequence_id, uint32_t payload_size, bool continuation) noexcept {
+      in_packet_ = true;
+      // commands start with sequence id 0; a schema name is never 16M long
+      command_ = sequence_id == 0 && !continuation && payload_size < ClassicFramer::kMaxPayloadSize;
+      command_seen_ = false;
+      init_db_ = false;
+      schema_.clear();
+    }
+
+    void on_payload(const uint8_t *data, size_t size);
+
+    bool on_packet_end() noexcept {
+      in_packet_ = false;
+      ended_ = true;
+      return false;  // the caller decides about each packet
+    }
+
+    /** @brief Whether the bytes of the packet fed so far may belong to a COM_INIT_DB */
+    bool may_be_init_db(const ClassicFramer &framer) const noexcept {
+      return in_packet_ ? command_ && (!command_seen_ || init_db_) : !framer.at_boundary();
+    }
+
+    /** @brief Whether the last feed ended with a COM_INIT_DB */
+    bool init_db_ended() const noexcept { return ended_ && init_db_; }
+
+    void clear_ended() noexcept { ended_ = false; }
+
+    const std::string &get_schema() const noexcept { return schema_; }
+
+   private:
+    bool in_packet_;
+    bool command_;
+    bool command_seen_;
+    bool init_db_;
+    bool ended_;
+    std::string schema_;
+  };
+
+  bool send_to_server(int server, const uint8_t *data, size_t size, size_t *bytes_sent);
+  bool read_packet(int fd, std::vector<uint8_t> *packet);
+  bool write_packet(int fd, std::vector<uint8_t> &packet, uint8_t sequence_id) noexcept;
+  bool parse_handshake_response(const std::vector<uint8_t> &packet, std::string *error);
+  std::vector<uint8_t> make_greeting(const std::string &server_version) const;
+  std::vector<uint8_t> make_handshake_response(uint32_t capabilities, const std::string &plugin,
+                                               const std::vector<uint8_t> &auth_response) const;
+
+  routing::SocketOperationsBase *socket_operations_;
+  const int client_;
+  const SchemaShardMap &shard_map_;
+  const std::chrono::milliseconds timeout_;
+  const std::string log_prefix_;
+
+  // from the handshake response of the client
+  uint32_t client_capabilities_;
+  uint32_t max_packet_size_;
+  uint8_t char_set_;
+  std::string user_;
+  std::string schema_;
+  std::vector<uint8_t> connect_attributes_;
+  std::string replicaset_;
+
+  std::string server_version_;
+  ClassicFramer client_framer_;
+  InitDbFinder init_db_finder_;
+  // bytes of a command of the client which may be COM_INIT_DB, from earlier reads
+  std::vector<uint8_t> held_;
+  size_t bytes_from_client_;
+  size_t bytes_to_client_;
+};
+
+#endif // ROUTING_SHARD_SESSION_INCLUDED
@@ -0,0 +1,108 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "slow_start.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+constexpr double SlowStart::kMinWeight;
+
+void SlowStart::configure(milliseconds period, Ramp ramp) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  period_ = period;
+  ramp_ = ramp;
+  if (period_.count() == 0) {
+    ramping_.clear();
+    ramping_count_ = 0;
+  }
+}
+
+void SlowStart::begin(const std::string &key, clock::time_point now) {
+  if (!enabled()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ramping_[key] = Entry{now, 0.0};
+  ramping_count_ = ramping_.size();
+}
+
+double SlowStart::weight_at(const Entry &entry, clock::time_point now) const {
+  auto elapsed = duration_cast<milliseconds>(now - entry.started);
+  if (period_.count() == 0 || elapsed >= period_) {
+    return 1.0;
+  }
+  double fraction = std::max(0.0, static_cast<double>(elapsed.count()) /
+                                  static_cast<double>(period_.count()));
+  if (ramp_ == Ramp::kExponential) {
+    // grows geometrically: kMinWeight at the start, 1.0 at the end
+    return std::pow(kMinWeight, 1.0 - fraction);
+  }
+  return kMinWeight + (1.0 - kMinWeight) * fraction;
+}
+
+double SlowStart::weight(const std::string &key, clock::time_point now) {
+  if (ramping_count_.load(std::memory_order_relaxed) == 0) {
+    return 1.0;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = ramping_.find(key);
+  if (it == ramping_.end()) {
+    return 1.0;
+  }
+  return weight_at(it->second, now);
+}
+
+bool SlowStart::admit(const std::string &key, clock::time_point now) {
+  if (ramping_count_.load(std::memory_order_relaxed) == 0) {
+    return true;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = ramping_.find(key);
+  if (it == ramping_.end()) {
+    return true;
+  }
+
+  double weight = weight_at(it->second, now);
+  if (weight >= 1.0) {
+    // slow-start period is over
+    ramping_.erase(it);
+    ramping_count_ = ramping_.size();
+    return true;
+  }
+
+  // the epsilon compensates rounding when adding up fractional weights
+  it->second.credit += weight;
+  if (it->second.credit >= 1.0 - 1e-9) {
+    it->second.credit -= 1.0;
+    return true;
+  }
+  return false;
+}
+
+SlowStart::Ramp SlowStart::get_ramp(const std::string &name) {
+  if (name == "linear") {
+    return Ramp::kLinear;
+  } else if (name == "exponential") {
+    return Ramp::kExponential;
+  }
+  throw std::invalid_argument("valid are linear, exponential (was '" + name + "')");
+}
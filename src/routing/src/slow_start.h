@@ -0,0 +1,145 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_SLOW_START_INCLUDED
+#define ROUTING_SLOW_START_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+
+/** @class SlowStart
+ * @brief Ramps up the share of new connections a destination receives
+ *
+ * A server which comes back from quarantine, or which rejoins the
+ * replicaset, has cold caches. Giving it a full round-robin share of new
+ * connections right away hurts the latency of the clients landing on it.
+ *
+ * SlowStart keeps, per destination key, the moment the destination became
+ * available again. During the configured period the effective weight of
+ * the destination grows from kMinWeight to 1.0, either linearly or
+ * exponentially. The destination classes ask admit() whether the
+ * destination picked by round-robin should be used; a destination with
+ * weight 0.25 is admitted once every fourth time it is picked.
+ *
+ * Keys are opaque strings: RouteDestination uses the address of the
+ * server, DestMetadataCacheGroup the server UUID.
+ */
+class SlowStart {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  /** @brief How the weight grows during the slow-start period */
+  enum class Ramp {
+    kLinear,
+    kExponential,
+  };
+
+  /** @brief Weight of a destination right after it became available */
+  static constexpr double kMinWeight = 0.1;
+
+  /** @brief Constructor
+   *
+   * @param period length of the slow-start period; zero disables slow-start
+   * @param ramp how the weight grows during the period
+   */
+  explicit SlowStart(std::chrono::milliseconds period = std::chrono::milliseconds(0),
+                     Ramp ramp = Ramp::kLinear)
+      : period_(period), ramp_(ramp), ramping_count_(0) {}
+
+  SlowStart(const SlowStart &) = delete;
+  SlowStart &operator=(const SlowStart &) = delete;
+
+  /** @brief Changes period and ramp
+   *
+   * Destinations currently ramping up keep their start time.
+   *
+   * @param period length of the slow-start period; zero disables slow-start
+   * @param ramp how the weight grows during the period
+   */
+  void configure(std::chrono::milliseconds period, Ramp ramp);
+
+  /** @brief Returns whether slow-start is enabled */
+  bool enabled() const noexcept {
+    return period_.count() > 0;
+  }
+
+  /** @brief Starts the slow-start period for a destination
+   *
+   * Calling begin() for a destination already ramping up restarts its
+   * period.
+   *
+   * @param key destination key
+   * @param now current time
+   */
+  void begin(const std::string &key, clock::time_point now = clock::now());
+
+  /** @brief Returns the effective weight of a destination
+   *
+   * @param key destination key
+   * @param now current time
+   * @return weight between kMinWeight and 1.0
+   */
+  double weight(const std::string &key, clock::time_point now = clock::now());
+
+  /** @brief Returns whether a new connection should go to a destination
+   *
+   * Each call adds the current weight of the destination to its credit;
+   * the destination is admitted when the credit reaches 1. Destinations
+   * which are not ramping up are always admitted.
+   *
+   * @param key destination key
+   * @param now current time
+   * @return true if the destination should be used
+   */
+  bool admit(const std::string &key, clock::time_point now = clock::now());
+
+  /** @brief Returns number of destinations currently ramping up */
+  size_t size() const noexcept {
+    return ramping_count_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Parses the literal name of a ramp
+   *
+   * Throws std::invalid_argument when the name is unknown.
+   *
+   * @param name either "linear" or "exponential"
+   * @return Ramp
+   */
+  static Ramp get_ramp(const std::string &name);
+
+ private:
+  struct Entry {
+    clock::time_point started;
+    double credit;
+  };
+
+  /** @brief Weight at a given point of the period; caller holds mutex_ */
+  double weight_at(const Entry &entry, clock::time_point now) const;
+
+  std::chrono::milliseconds period_;
+  Ramp ramp_;
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Entry> ramping_;
+  /** @brief Size of ramping_, read without taking mutex_ */
+  std::atomic<size_t> ramping_count_;
+};
+
+#endif // ROUTING_SLOW_START_INCLUDED
@@ -0,0 +1,172 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "statement_classifier.h"
+
+#include <algorithm>
+#include <cctype>
+#include <set>
+#include <vector>
+
+// words which make a SELECT write, lock, or depend on the session
+static const std::set<std::string> kSessionBoundWords{
+    "INTO", "UPDATE", "SHARE", "LOCK", "LAST_INSERT_ID", "FOUND_ROWS", "ROW_COUNT",
+    "GET_LOCK", "RELEASE_LOCK", "RELEASE_ALL_LOCKS", "IS_FREE_LOCK", "IS_USED_LOCK",
+    "CONNECTION_ID", "NEXTVAL"};
+
+static bool is_word_char(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static std::string to_upper(std::string value) {
+  std::transform(value.begin(), value.end(), value.begin(), ::toupper);
+  return value;
+}
+
+// splits into upper-cased words, ignoring everything else
+static std::vector<std::string> get_words(const std::string &statement, size_t pos) {
+  std::vector<std::string> words;
+  while (pos < statement.size()) {
+    if (!is_word_char(statement[pos])) {
+      ++pos;
+      continue;
+    }
+    size_t end = pos;
+    while (end < statement.size() && is_word_char(statement[end])) {
+      ++end;
+    }
+    words.push_back(to_upper(statement.substr(pos, end - pos)));
+    pos = end;
+  }
+  return words;
+}
+
+StatementClass classify_statement(const std::string &statement) {
+  size_t pos = 0;
+
+  // leading white space and comments
+  while (pos < statement.size()) {
+    char c = statement[pos];
+    if (std::isspace(static_cast<unsigned char>(c)) || c == '(') {
+      ++pos;
+    } else if (statement.compare(pos, 2, "/*") == 0) {
+      if (statement.compare(pos, 3, "/*!") == 0) {
+        return StatementClass::kPin;  // executed by the server
+      }
+      auto end = statement.find("*/", pos + 2);
+      if (end == std::string::npos) {
+        return StatementClass::kWrite;
+      }
+      std::string hint = to_upper(statement.substr(pos + 2, end - pos - 2));
+      hint.erase(std::remove_if(hint.begin(), hint.end(), ::isspace), hint.end());
+      if (hint == "ROUTE=SECONDARY") {
+        return StatementClass::kRead;
+      } else if (hint == "ROUTE=PRIMARY") {
+        return StatementClass::kWrite;
+      }
+      pos = end + 2;
+    } else if (c == '#' || statement.compare(pos, 3, "-- ") == 0) {
+      auto end = statement.find('\n', pos);
+      pos = (end == std::string::npos) ? statement.size() : end + 1;
+    } else {
+      break;
+    }
+  }
+
+  // more than one statement
+  auto semicolon = statement.find(';', pos);
+  if (semicolon != std::string::npos &&
+      statement.find_first_not_of(" \t\r\n", semicolon + 1) != std::string::npos) {
+    return StatementClass::kPin;
+  }
+
+  auto words = get_words(statement, pos);
+  if (words.empty()) {
+    return StatementClass::kWrite;
+  }
+  const std::string &keyword = words[0];
+
+  if (keyword == "SELECT") {
+    if (statement.find(":=", pos) != std::string::npos) {
+      return StatementClass::kPin;  // assigns user variables
+    }
+    for (size_t i = 1; i < words.size(); ++i) {
+      if (words[i] == "INTO") {
+        // INTO OUTFILE and INTO DUMPFILE leave nothing in the session
+        bool to_file = i + 1 < words.size() &&
+            (words[i + 1] == "OUTFILE" || words[i + 1] == "DUMPFILE");
+        return to_file ? StatementClass::kWrite : StatementClass::kPin;
+      }
+    }
+    for (auto &word : words) {
+      if (kSessionBoundWords.count(word) > 0) {
+        return StatementClass::kWrite;
+      }
+    }
+    return StatementClass::kRead;
+  } else if (keyword == "START") {
+    bool read_only = false;
+    for (size_t i = 1; i + 1 < words.size(); ++i) {
+      if (words[i] == "READ" && words[i + 1] == "WRITE") {
+        return StatementClass::kWrite;
+      } else if (words[i] == "READ" && words[i + 1] == "ONLY") {
+        read_only = true;
+      }
+    }
+    return (words.size() > 1 && words[1] == "TRANSACTION" && read_only) ?
+        StatementClass::kStartReadOnly : StatementClass::kWrite;
+  } else if (keyword == "SET") {
+    // only the next transaction, which runs on the primary
+    if (words.size() > 1 && words[1] == "TRANSACTION") {
+      return StatementClass::kWrite;
+    }
+    // not the session; must not be repeated on secondaries
+    if (words.size() > 1 && (words[1] == "GLOBAL" || words[1] == "PERSIST" ||
+                             words[1] == "PERSIST_ONLY")) {
+      return StatementClass::kWrite;
+    }
+    // accounts and resource groups; not state of the session
+    if (words.size() > 1 && (words[1] == "PASSWORD" || words[1] == "RESOURCE" ||
+                             (words[1] == "DEFAULT" && words.size() > 2 && words[2] == "ROLE"))) {
+      return StatementClass::kWrite;
+    }
+    // the privileges of the session, which the secondary does not share
+    if (words.size() > 1 && words[1] == "ROLE") {
+      return StatementClass::kPin;
+    }
+    // the value of a function or a subquery may differ on secondaries
+    if (statement.find('(', pos) != std::string::npos) {
+      return StatementClass::kPin;
+    }
+    return StatementClass::kSessionState;
+  } else if (keyword == "USE") {
+    return StatementClass::kSessionState;
+  } else if (keyword == "SHOW" && words.size() > 1 &&
+             (words[1] == "WARNINGS" || words[1] == "ERRORS" ||
+              (words[1] == "COUNT" && words.size() > 2 &&
+               (words[2] == "WARNINGS" || words[2] == "ERRORS")))) {
+    return StatementClass::kPrevious;
+  } else if ((keyword == "CREATE" || keyword == "DROP") && words.size() > 1 &&
+             words[1] == "TEMPORARY") {
+    return StatementClass::kPin;
+  } else if (keyword == "LOCK" || keyword == "PREPARE" || keyword == "HANDLER") {
+    // table locks, prepared statements and handlers exist on the primary only
+    return StatementClass::kPin;
+  }
+
+  return StatementClass::kWrite;
+}
@@ -0,0 +1,58 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_STATEMENT_CLASSIFIER_INCLUDED
+#define ROUTING_STATEMENT_CLASSIFIER_INCLUDED
+
+#include <string>
+
+/** @brief Where a statement may be executed, for read/write splitting */
+enum class StatementClass {
+  /** @brief only reads; may go to a secondary */
+  kRead,
+  /** @brief may write, or depends on the session; goes to the primary */
+  kWrite,
+  /** @brief starts a read-only transaction; may go to a secondary */
+  kStartReadOnly,
+  /** @brief changes the session, like SET or USE; goes to the primary and is replayed on secondaries */
+  kSessionState,
+  /** @brief is about the previous statement, like SHOW WARNINGS; goes where that one went */
+  kPrevious,
+  /** @brief leaves state in the session which can not be replayed on secondaries, like a
+   * temporary table; pins the client to the primary */
+  kPin,
+};
+
+/** @brief Classifies a statement sent with COM_QUERY
+ *
+ * The statement is not parsed: leading comments are skipped and keywords
+ * looked at. Whatever is not known to be safe on a secondary is classified
+ * kWrite, so a wrong guess only costs the primary some load. Statements
+ * whose effect on the session can not be repeated on a secondary, or which
+ * can not be looked at, like several statements at once, are classified
+ * kPin.
+ *
+ * A leading C-style comment holding only `route=secondary` or
+ * `route=primary` (case insensitive) overrides the classification with
+ * kRead or kWrite.
+ *
+ * @param statement text of the statement
+ * @return class of the statement
+ */
+StatementClass classify_statement(const std::string &statement);
+
+#endif // ROUTING_STATEMENT_CLASSIFIER_INCLUDED
@@ -0,0 +1,478 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "tls_context.h"
+
+#include "mysqlrouter/utils.h"
+#include "utils.h"
+
+#include <stdexcept>
+
+#ifdef WITH_ROUTING_TLS
+#  include <algorithm>
+#  include <climits>
+#  include <cstring>
+#  include <vector>
+
+#  include <openssl/err.h>
+#  include <openssl/ssl.h>
+#  include <openssl/x509v3.h>
+
+#  ifndef _WIN32
+#    include <poll.h>
+#  else
+#    include <winsock2.h>
+#  endif
+#endif
+
+using mysqlrouter::string_format;
+
+const ssize_t TlsConnection::kWouldBlock = -2;
+
+#ifdef WITH_ROUTING_TLS
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+// OpenSSL before 1.1.0 leaves locking to the application
+static std::vector<std::mutex> *g_openssl_locks = nullptr;
+
+static void openssl_locking(int mode, int n, const char * /*file*/, int /*line*/) {
+  if (mode & CRYPTO_LOCK) {
+    (*g_openssl_locks)[static_cast<size_t>(n)].lock();
+  } else {
+    (*g_openssl_locks)[static_cast<size_t>(n)].unlock();
+  }
+}
+#endif
+
+static void init_openssl() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    SSL_library_init();
+    SSL_load_error_strings();
+    // the MySQL client library might have set them already
+    if (CRYPTO_get_locking_callback() == nullptr) {
+      g_openssl_locks = new std::vector<std::mutex>(static_cast<size_t>(CRYPTO_num_locks()));
+      CRYPTO_set_locking_callback(openssl_locking);
+    }
+#else
+    OPENSSL_init_ssl(0, nullptr);
+#endif
+  });
+}
+
+// takes the errors of the calling thread
+static std::string get_tls_error() {
+  std::string result;
+  for (unsigned long code = ERR_get_error(); code != 0; code = ERR_get_error()) {
+    char message[256];
+    ERR_error_string_n(code, message, sizeof(message));
+    if (!result.empty()) {
+      result += "; ";
+    }
+    result += message;
+  }
+  return result.empty() ? "connection closed" : result;
+}
+
+static void set_common_options(SSL_CTX *ctx) {
+  long options = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION;
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+  // clients often close without close_notify; that is no error
+  options |= SSL_OP_IGNORE_UNEXPECTED_EOF;
+#endif
+  SSL_CTX_set_options(ctx, options);
+  // write() is called again with the same data, but maybe another buffer
+  SSL_CTX_set_mode(ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+}
+
+static bool is_ip_address(const std::string &host) {
+  ASN1_OCTET_STRING *ip = a2i_IPADDRESS(host.c_str());
+  if (ip == nullptr) {
+    ERR_clear_error();
+    return false;
+  }
+  ASN1_OCTET_STRING_free(ip);
+  return true;
+}
+
+// sends the host name of the destination with SNI and, when servers are
+// verified, makes the certificate match its host name or IP address
+static bool set_server_name(SSL *ssl, const std::string &destination, std::string *error) {
+  std::string host;
+  try {
+    host = mysqlrouter::split_addr_port(destination).first;
+  } catch (const std::runtime_error &exc) {
+    *error = string_format("invalid destination '%s': %s", destination.c_str(), exc.what());
+    return false;
+  }
+  bool ip = is_ip_address(host);
+  // SNI is for host names only (RFC 6066)
+  if (!ip && SSL_set_tlsext_host_name(ssl, host.c_str()) != 1) {
+    *error = get_tls_error();
+    return false;
+  }
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+  if (SSL_get_verify_mode(ssl) & SSL_VERIFY_PEER) {
+    X509_VERIFY_PARAM *param = SSL_get0_param(ssl);
+    int res = ip ? X509_VERIFY_PARAM_set1_ip_asc(param, host.c_str())
+                 : X509_VERIFY_PARAM_set1_host(param, host.c_str(), host.size());
+    if (res != 1) {
+      *error = get_tls_error();
+      return false;
+    }
+  }
+#endif
+  return true;
+}
+
+TlsConnection::~TlsConnection() {
+  // without close_notify, OpenSSL takes the session for broken and it can
+  // not be resumed; one try, the socket is not waited for
+  if (!failed_ && SSL_is_init_finished(ssl_)) {
+    ERR_clear_error();
+    SSL_shutdown(ssl_);
+  }
+  SSL_free(ssl_);
+}
+
+bool TlsConnection::is_resumed() const noexcept {
+  return SSL_session_reused(ssl_) == 1;
+}
+
+std::string TlsConnection::get_version() const {
+  return SSL_get_version(ssl_);
+}
+
+std::string TlsConnection::get_cipher() const {
+  return SSL_get_cipher_name(ssl_);
+}
+
+ssize_t TlsConnection::check_result(int result) noexcept {
+  switch (SSL_get_error(ssl_, result)) {
+    case SSL_ERROR_WANT_READ:
+      wants_write_ = false;
+      return kWouldBlock;
+    case SSL_ERROR_WANT_WRITE:
+      wants_write_ = true;
+      return kWouldBlock;
+    case SSL_ERROR_ZERO_RETURN:
+      return 0;
+    case SSL_ERROR_SYSCALL:
+      // end of file without close_notify
+      if (ERR_peek_error() == 0 && result == 0) {
+        return 0;
+      }
+      failed_ = true;
+      return -1;
+    default:
+      failed_ = true;
+      return -1;
+  }
+}
+
+ssize_t TlsConnection::read(void *buffer, size_t size) noexcept {
+  ERR_clear_error();
+  int result = SSL_read(ssl_, buffer, static_cast<int>(std::min<size_t>(size, INT_MAX)));
+  if (result > 0) {
+    wants_write_ = false;
+    return result;
+  }
+  return check_result(result);
+}
+
+ssize_t TlsConnection::write(const void *buffer, size_t size) noexcept {
+  ERR_clear_error();
+  int result = SSL_write(ssl_, buffer, static_cast<int>(std::min<size_t>(size, INT_MAX)));
+  if (result > 0) {
+    wants_write_ = false;
+    return result;
+  }
+  ssize_t checked = check_result(result);
+  return checked == 0 ? -1 : checked;
+}
+
+bool TlsConnection::has_pending() const noexcept {
+  return SSL_pending(ssl_) > 0;
+}
+
+bool TlsConnection::handshake(bool accept, std::chrono::milliseconds timeout, std::string *error) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    ERR_clear_error();
+    int result = accept ? SSL_accept(ssl_) : SSL_connect(ssl_);
+    if (result == 1) {
+      wants_write_ = false;
+      return true;
+    }
+    if (check_result(result) != kWouldBlock) {
+      *error = get_tls_error();
+      return false;
+    }
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0) {
+      *error = "TLS handshake timed out";
+      return false;
+    }
+    struct pollfd fds[1];
+    fds[0].fd = fd_;
+    fds[0].events = wants_write_ ? POLLOUT : POLLIN;
+    fds[0].revents = 0;
+    int res = routing::poll_sockets(fds, 1, remaining);
+    if (res == 0) {
+      *error = "TLS handshake timed out";
+      return false;
+    } else if (res < 0 && errno != EINTR) {
+      *error = "poll failed: " + get_message_error(errno);
+      return false;
+    }
+  }
+}
+
+bool TlsServerContext::is_supported() noexcept {
+  return true;
+}
+
+TlsServerContext::TlsServerContext(const std::string &cert_file, const std::string &key_file,
+                                   size_t session_cache_size,
+                                   std::chrono::milliseconds session_timeout,
+                                   const std::string &session_id_context)
+    : ctx_(nullptr) {
+  init_openssl();
+  std::unique_ptr<SSL_CTX, void (*)(SSL_CTX *)> ctx(SSL_CTX_new(SSLv23_server_method()),
+                                                   &SSL_CTX_free);
+  if (!ctx) {
+    throw std::runtime_error("creating TLS context failed: " + get_tls_error());
+  }
+  set_common_options(ctx.get());
+  if (SSL_CTX_use_certificate_chain_file(ctx.get(), cert_file.c_str()) != 1) {
+    throw std::runtime_error(string_format("loading certificate from '%s' failed: %s",
+                                           cert_file.c_str(), get_tls_error().c_str()));
+  }
+  if (SSL_CTX_use_PrivateKey_file(ctx.get(), key_file.c_str(), SSL_FILETYPE_PEM) != 1) {
+    throw std::runtime_error(string_format("loading private key from '%s' failed: %s",
+                                           key_file.c_str(), get_tls_error().c_str()));
+  }
+  if (SSL_CTX_check_private_key(ctx.get()) != 1) {
+    throw std::runtime_error(string_format("private key '%s' does not match certificate '%s'",
+                                           key_file.c_str(), cert_file.c_str()));
+  }
+
+  // sessions by ID in the cache of this context, and as tickets
+  SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_SERVER);
+  SSL_CTX_sess_set_cache_size(ctx.get(), static_cast<long>(session_cache_size));
+  auto seconds = std::chrono::duration_cast<std::chrono::seconds>(session_timeout).count();
+  SSL_CTX_set_timeout(ctx.get(), static_cast<long>(std::max<decltype(seconds)>(seconds, 1)));
+  std::string id_context = session_id_context.substr(0, SSL_MAX_SID_CTX_LENGTH);
+  SSL_CTX_set_session_id_context(ctx.get(), reinterpret_cast<const unsigned char *>(id_context.data()),
+                                 static_cast<unsigned int>(id_context.size()));
+  ctx_ = ctx.release();
+}
+
+TlsServerContext::~TlsServerContext() {
+  SSL_CTX_free(ctx_);
+}
+
+std::unique_ptr<TlsConnection> TlsServerContext::accept(int fd, std::chrono::milliseconds timeout,
+                                                        std::string *error) {
+  ERR_clear_error();
+  SSL *ssl = SSL_new(ctx_);
+  if (ssl == nullptr) {
+    *error = get_tls_error();
+    return nullptr;
+  }
+  std::unique_ptr<TlsConnection> connection(new TlsConnection(ssl, fd));
+  routing::set_socket_blocking(fd, false);
+  if (SSL_set_fd(ssl, fd) != 1 || !connection->handshake(true, timeout, error)) {
+    if (error->empty()) {
+      *error = get_tls_error();
+    }
+    return nullptr;
+  }
+  return connection;
+}
+
+size_t TlsServerContext::get_cached_sessions() const noexcept {
+  return static_cast<size_t>(SSL_CTX_sess_number(ctx_));
+}
+
+TlsClientContext::TlsClientContext(const std::string &ca_file) : ctx_(nullptr) {
+  init_openssl();
+  std::unique_ptr<SSL_CTX, void (*)(SSL_CTX *)> ctx(SSL_CTX_new(SSLv23_client_method()),
+                                                   &SSL_CTX_free);
+  if (!ctx) {
+    throw std::runtime_error("creating TLS context failed: " + get_tls_error());
+  }
+  set_common_options(ctx.get());
+  if (!ca_file.empty()) {
+#if OPENSSL_VERSION_NUMBER < 0x10002000L
+    throw std::runtime_error("verifying the host names of servers needs OpenSSL 1.0.2 or later");
+#endif
+    if (SSL_CTX_load_verify_locations(ctx.get(), ca_file.c_str(), nullptr) != 1) {
+      throw std::runtime_error(string_format("loading CAs from '%s' failed: %s",
+                                             ca_file.c_str(), get_tls_error().c_str()));
+    }
+    SSL_CTX_set_verify(ctx.get(), SSL_VERIFY_PEER, nullptr);
+  } else {
+    SSL_CTX_set_verify(ctx.get(), SSL_VERIFY_NONE, nullptr);
+  }
+  // sessions are kept by destination in sessions_; with TLSv1.3 they only
+  // arrive after the handshake
+  SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(ctx.get(), &TlsClientContext::on_new_session);
+  SSL_CTX_set_app_data(ctx.get(), this);
+  ctx_ = ctx.release();
+}
+
+TlsClientContext::~TlsClientContext() {
+  for (auto &it : sessions_) {
+    SSL_SESSION_free(it.second);
+  }
+  SSL_CTX_free(ctx_);
+}
+
+int TlsClientContext::on_new_session(ssl_st *ssl, ssl_session_st *session) {
+  auto context = static_cast<TlsClientContext *>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+  auto connection = static_cast<TlsConnection *>(SSL_get_app_data(ssl));
+  if (context == nullptr || connection == nullptr) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(context->mutex_sessions_);
+  auto &stored = context->sessions_[connection->destination_];
+  if (stored != nullptr) {
+    SSL_SESSION_free(stored);
+  }
+  stored = session;
+  return 1;  // the reference is kept
+}
+
+std::unique_ptr<TlsConnection> TlsClientContext::connect(int fd, const std::string &destination,
+                                                         std::chrono::milliseconds timeout,
+                                                         std::string *error) {
+  ERR_clear_error();
+  SSL *ssl = SSL_new(ctx_);
+  if (ssl == nullptr) {
+    *error = get_tls_error();
+    return nullptr;
+  }
+  std::unique_ptr<TlsConnection> connection(new TlsConnection(ssl, fd));
+  connection->destination_ = destination;
+  SSL_set_app_data(ssl, connection.get());
+  if (!set_server_name(ssl, destination, error)) {
+    return nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_sessions_);
+    auto it = sessions_.find(destination);
+    if (it != sessions_.end()) {
+      SSL_set_session(ssl, it->second);
+    }
+  }
+  routing::set_socket_blocking(fd, false);
+  if (SSL_set_fd(ssl, fd) != 1 || !connection->handshake(false, timeout, error)) {
+    if (error->empty()) {
+      *error = get_tls_error();
+    }
+    return nullptr;
+  }
+  return connection;
+}
+
+#else  // WITH_ROUTING_TLS
+
+static const char kNotSupported[] = "the router was built without OpenSSL 1.x (-DWITH_SSL=system or a path to it); "
+                                     "TLS termination is not supported";
+
+TlsConnection::~TlsConnection() {}
+
+bool TlsConnection::is_resumed() const noexcept {
+  return false;
+}
+
+std::string TlsConnection::get_version() const {
+  return std::string();
+}
+
+std::string TlsConnection::get_cipher() const {
+  return std::string();
+}
+
+ssize_t TlsConnection::check_result(int /*result*/) noexcept {
+  return -1;
+}
+
+ssize_t TlsConnection::read(void * /*buffer*/, size_t /*size*/) noexcept {
+  return -1;
+}
+
+ssize_t TlsConnection::write(const void * /*buffer*/, size_t /*size*/) noexcept {
+  return -1;
+}
+
+bool TlsConnection::has_pending() const noexcept {
+  return false;
+}
+
+bool TlsConnection::handshake(bool /*accept*/, std::chrono::milliseconds /*timeout*/,
+                              std::string *error) {
+  *error = kNotSupported;
+  return false;
+}
+
+bool TlsServerContext::is_supported() noexcept {
+  return false;
+}
+
+TlsServerContext::TlsServerContext(const std::string & /*cert_file*/, const std::string & /*key_file*/,
+                                   size_t /*session_cache_size*/,
+                                   std::chrono::milliseconds /*session_timeout*/,
+                                   const std::string & /*session_id_context*/)
+    : ctx_(nullptr) {
+  throw std::runtime_error(kNotSupported);
+}
+
+TlsServerContext::~TlsServerContext() {}
+
+std::unique_ptr<TlsConnection> TlsServerContext::accept(int /*fd*/, std::chrono::milliseconds /*timeout*/,
+                                                        std::string *error) {
+  *error = kNotSupported;
+  return nullptr;
+}
+
+size_t TlsServerContext::get_cached_sessions() const noexcept {
+  return 0;
+}
+
+TlsClientContext::TlsClientContext(const std::string & /*ca_file*/) : ctx_(nullptr) {
+  throw std::runtime_error(kNotSupported);
+}
+
+TlsClientContext::~TlsClientContext() {}
+
+int TlsClientContext::on_new_session(ssl_st * /*ssl*/, ssl_session_st * /*session*/) {
+  return 0;
+}
+
+std::unique_ptr<TlsConnection> TlsClientContext::connect(int /*fd*/, const std::string & /*destination*/,
+                                                         std::chrono::milliseconds /*timeout*/,
+                                                         std::string *error) {
+  *error = kNotSupported;
+  return nullptr;
+}
+
+#endif  // WITH_ROUTING_TLS
@@ -0,0 +1,204 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_TLS_CONTEXT_INCLUDED
+#define ROUTING_TLS_CONTEXT_INCLUDED
+
+#include "mysqlrouter/routing.h"
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// OpenSSL types; only tls_context.cc includes OpenSSL
+struct ssl_ctx_st;
+struct ssl_st;
+struct ssl_session_st;
+
+/** @class TlsConnection
+ * @brief TLS on a connected socket
+ *
+ * Made by TlsServerContext::accept() or TlsClientContext::connect(). The
+ * socket is non-blocking: read() and write() return kWouldBlock when they
+ * have to wait for the socket, which is then polled for reading or
+ * writing as told by wants_write(). The socket itself is not closed.
+ */
+class TlsConnection {
+ public:
+  /** @brief Returned by read() and write() when the socket has to be polled */
+  static const ssize_t kWouldBlock;
+
+  ~TlsConnection();
+
+  TlsConnection(const TlsConnection &) = delete;
+  TlsConnection &operator=(const TlsConnection &) = delete;
+
+  /** @brief Returns the socket */
+  int get_fd() const noexcept { return fd_; }
+
+  /** @brief Returns whether the handshake resumed an earlier session */
+  bool is_resumed() const noexcept;
+
+  /** @brief Returns the protocol version, like TLSv1.2 */
+  std::string get_version() const;
+
+  /** @brief Returns the cipher of the connection */
+  std::string get_cipher() const;
+
+  /** @brief Reads decrypted data
+   *
+   * @return bytes read, 0 when the peer closed, -1 on errors, or kWouldBlock
+   */
+  ssize_t read(void *buffer, size_t size) noexcept;
+
+  /** @brief Writes data to encrypt
+   *
+   * After kWouldBlock, the same data has to be written again.
+   *
+   * @return bytes written, -1 on errors, or kWouldBlock
+   */
+  ssize_t write(const void *buffer, size_t size) noexcept;
+
+  /** @brief Returns whether decrypted data can be read without polling the socket */
+  bool has_pending() const noexcept;
+
+  /** @brief Returns whether the last kWouldBlock waits for the socket to be writable */
+  bool wants_write() const noexcept { return wants_write_; }
+
+ private:
+  friend class TlsServerContext;
+  friend class TlsClientContext;
+
+  TlsConnection(ssl_st *ssl, int fd) noexcept : ssl_(ssl), fd_(fd), wants_write_(false), failed_(false) {}
+
+  // runs SSL_accept() or SSL_connect() until done, failed or timed out
+  bool handshake(bool accept, std::chrono::milliseconds timeout, std::string *error);
+  // tells kWouldBlock from errors after a failed call
+  ssize_t check_result(int result) noexcept;
+
+  ssl_st *ssl_;
+  const int fd_;
+  bool wants_write_;
+  bool failed_;
+  // of connections to servers, to keep their sessions
+  std::string destination_;
+};
+
+/** @class TlsServerContext
+ * @brief TLS with clients of a route: the certificate and the session cache
+ *
+ * One context is shared by all clients of a route. Sessions are kept in
+ * the cache of the context, by session ID, and given out as session
+ * tickets; reconnecting clients resume them with an abbreviated handshake
+ * that needs no public-key operation. Ticket keys are made when the
+ * context is, so tickets do not outlive the route.
+ *
+ * Thread-safe.
+ */
+class TlsServerContext {
+ public:
+  /** @brief Returns whether the router was built with TLS support (OpenSSL) */
+  static bool is_supported() noexcept;
+
+  /** @brief Constructor
+   *
+   * @param cert_file PEM file with the certificate, and its chain
+   * @param key_file PEM file with the private key
+   * @param session_cache_size sessions kept for resumption
+   * @param session_timeout how long sessions can be resumed
+   * @param session_id_context name of what the sessions are valid for, like the route
+   * @throws std::runtime_error when TLS is not supported, or the files can not be used
+   */
+  TlsServerContext(const std::string &cert_file, const std::string &key_file,
+                   size_t session_cache_size, std::chrono::milliseconds session_timeout,
+                   const std::string &session_id_context);
+
+  ~TlsServerContext();
+
+  TlsServerContext(const TlsServerContext &) = delete;
+  TlsServerContext &operator=(const TlsServerContext &) = delete;
+
+  /** @brief Runs the server side of the TLS handshake
+   *
+   * @param fd connected socket; made non-blocking
+   * @param timeout how long the handshake may take
+   * @param error set to why the handshake failed
+   * @return the connection, or nullptr when the handshake failed
+   */
+  std::unique_ptr<TlsConnection> accept(int fd, std::chrono::milliseconds timeout,
+                                        std::string *error);
+
+  /** @brief Returns the number of sessions in the cache */
+  size_t get_cached_sessions() const noexcept;
+
+ private:
+  ssl_ctx_st *ctx_;
+};
+
+/** @class TlsClientContext
+ * @brief TLS with destinations of a route
+ *
+ * The last session of each destination is kept and offered when
+ * connecting to it again, so that servers supporting resumption skip the
+ * full handshake.
+ *
+ * Host names of destinations are sent with SNI. When servers are
+ * verified, the certificate has to be for the host name, or the IP
+ * address, of the destination as well.
+ *
+ * Thread-safe.
+ */
+class TlsClientContext {
+ public:
+  /** @brief Constructor
+   *
+   * @param ca_file PEM file with the CAs servers are verified with; empty to not verify
+   * @throws std::runtime_error when TLS is not supported, or the file can not be used, or
+   *         OpenSSL is older than 1.0.2 and can not verify host names
+   */
+  explicit TlsClientContext(const std::string &ca_file);
+
+  ~TlsClientContext();
+
+  TlsClientContext(const TlsClientContext &) = delete;
+  TlsClientContext &operator=(const TlsClientContext &) = delete;
+
+  /** @brief Runs the client side of the TLS handshake
+   *
+   * @param fd connected socket; made non-blocking
+   * @param destination destination as host:port; its session is offered and its host
+   *        verified
+   * @param timeout how long the handshake may take
+   * @param error set to why the handshake failed
+   * @return the connection, or nullptr when the handshake failed
+   */
+  std::unique_ptr<TlsConnection> connect(int fd, const std::string &destination,
+                                         std::chrono::milliseconds timeout, std::string *error);
+
+ private:
+  // keeps the sessions servers hand out, by destination
+  static int on_new_session(ssl_st *ssl, ssl_session_st *session);
+
+  ssl_ctx_st *ctx_;
+  std::mutex mutex_sessions_;
+  std::map<std::string, ssl_session_st *> sessions_;
+};
+
+#endif // ROUTING_TLS_CONTEXT_INCLUDED
@@ -0,0 +1,410 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "tls_session.h"
+#include "common.h"
+#include "logger.h"
+#include "mysqlrouter/mysql_protocol.h"
+#include "mysqlrouter/routing.h"
+#include "utils.h"
+
+#include <cerrno>
+
+#ifndef _WIN32
+#  include <poll.h>
+#else
+#  include <winsock2.h>
+#endif
+
+using namespace mysql_protocol;
+
+// size of the SSL request a client sends instead of its handshake response
+static const size_t kSslRequestPayloadSize = 32;
+
+TlsSession::TlsSession(routing::SocketOperationsBase *socket_operations, int client, int server,
+                       TlsServerContext &client_context, TlsClientContext *server_context,
+                       const std::string &destination, std::chrono::milliseconds timeout,
+                       size_t buffer_size, const std::string &log_prefix)
+    : socket_operations_(socket_operations), client_(client), server_(server),
+      client_context_(client_context), server_context_(server_context),
+      destination_(destination), timeout_(timeout), log_prefix_(log_prefix),
+      buffer_(buffer_size), connection_(nullptr), metrics_(nullptr),
+      bytes_client_to_server_(0), bytes_server_to_client_(0) {}
+
+TlsSession::Result TlsSession::start(std::string *error) {
+  auto deadline = clock::now() + timeout_;
+  std::vector<uint8_t> packet;
+  if (!read_packet(server_, nullptr, &packet, deadline)) {
+    *error = "no greeting from server";
+    return Result::kFailed;
+  }
+  if (packet.size() > Packet::kHeaderSize && packet[4] == 0xff) {
+    // like too many connections
+    *error = "server refused the connection";
+    send_all(client_, nullptr, packet.data(), packet.size());
+    account(false, packet.size());
+    return Result::kRefused;
+  }
+  size_t capabilities_offset = 0;
+  uint32_t server_capabilities = 0;
+  try {
+    HandshakePacket greeting(packet);
+    server_capabilities = greeting.get_server_capabilities();
+    // protocol version, server version, connection ID, salt and filler
+    capabilities_offset = Packet::kHeaderSize + 1 + greeting.get_server_version().size() + 1 + 4 + 8 + 1;
+  } catch (const packet_error &exc) {
+    *error = std::string("invalid greeting from server: ") + exc.what();
+    return Result::kFailed;
+  }
+  if (server_context_ && !(server_capabilities & kClientSSL)) {
+    *error = "server " + destination_ + " does not support SSL";
+    ErrorPacket server_error(0, 2026, "SSL connection error: server " + destination_ +
+                             " does not support SSL", "HY000");
+    send_all(client_, nullptr, server_error.data(), server_error.size());
+    return Result::kFailed;
+  }
+  // the router offers SSL, whether or not the server does
+  packet[capabilities_offset + 1] = static_cast<uint8_t>(packet[capabilities_offset + 1] |
+                                                         (kClientSSL >> 8));
+  if (!send_all(client_, nullptr, packet.data(), packet.size())) {
+    *error = "writing greeting failed: " + get_message_error(errno);
+    return Result::kFailed;
+  }
+  account(false, packet.size());
+
+  if (!read_packet(client_, nullptr, &packet, deadline)) {
+    *error = "no handshake response from client";
+    return Result::kFailed;
+  }
+  uint32_t client_capabilities = 0;
+  try {
+    client_capabilities = PacketView(packet).get_int<uint32_t>(Packet::kHeaderSize);
+  } catch (const packet_error &exc) {
+    *error = std::string("invalid handshake response: ") + exc.what();
+    return Result::kFailed;
+  }
+  if (!(client_capabilities & kClientSSL)) {
+    if (!send_all(server_, nullptr, packet.data(), packet.size())) {
+      *error = "writing handshake response failed: " + get_message_error(errno);
+      return Result::kFailed;
+    }
+    account(true, packet.size());
+    return Result::kPlain;
+  }
+  if (packet.size() != Packet::kHeaderSize + kSslRequestPayloadSize) {
+    *error = "invalid SSL request";
+    return Result::kFailed;
+  }
+  if (!server_context_ && !is_unix_socket(server_)) {
+    // the full authentication of caching_sha2_password and sha256_password
+    // would fail, or send the password in plaintext
+    *error = "server " + destination_ + " is not connected through a Unix socket; TLS clients "
+             "need server_tls=1";
+    ErrorPacket client_error(2, 2026, "SSL connection error: the route has no secure "
+                             "connection to " + destination_, "HY000");
+    send_all(client_, nullptr, client_error.data(), client_error.size());
+    account(false, client_error.size());
+    return Result::kFailed;
+  }
+
+  client_tls_ = client_context_.accept(client_, timeout_, error);
+  if (!client_tls_) {
+    *error = "TLS handshake with client failed: " + *error;
+    if (metrics_) {
+      metrics_->tls_client_failures.inc();
+    }
+    return Result::kFailed;
+  }
+  if (metrics_) {
+    (client_tls_->is_resumed() ? metrics_->tls_client_resumed : metrics_->tls_client_handshakes).inc();
+    metrics_->tls_cached_sessions.set(static_cast<int64_t>(client_context_.get_cached_sessions()));
+  }
+  LOGGER_DEBUG("[%s] %s with client, %s%s", log_prefix_.c_str(), client_tls_->get_version().c_str(),
+               client_tls_->get_cipher().c_str(), client_tls_->is_resumed() ? ", resumed" : "");
+
+  if (server_context_) {
+    if (!send_all(server_, nullptr, packet.data(), packet.size())) {
+      *error = "writing SSL request failed: " + get_message_error(errno);
+      return Result::kFailed;
+    }
+    server_tls_ = server_context_->connect(server_, destination_, timeout_, error);
+    if (!server_tls_) {
+      *error = "TLS handshake with " + destination_ + " failed: " + *error;
+      if (metrics_) {
+        metrics_->tls_server_failures.inc();
+      }
+      return Result::kFailed;
+    }
+    if (metrics_) {
+      (server_tls_->is_resumed() ? metrics_->tls_server_resumed : metrics_->tls_server_handshakes).inc();
+    }
+  } else {
+    routing::set_socket_blocking(server_, false);
+    if (!relay_authentication(error)) {
+      return Result::kFailed;
+    }
+  }
+  return Result::kTls;
+}
+
+bool TlsSession::relay_authentication(std::string *error) {
+  auto deadline = clock::now() + timeout_;
+  std::vector<uint8_t> packet;
+  if (!read_packet(client_, client_tls_.get(), &packet, deadline)) {
+    *error = "no handshake response from client";
+    return false;
+  }
+  if (packet.size() < Packet::kHeaderSize + 4) {
+    *error = "invalid handshake response";
+    return false;
+  }
+  // the server did not see the SSL request
+  packet[Packet::kHeaderSize + 1] = static_cast<uint8_t>(packet[Packet::kHeaderSize + 1] &
+                                                         ~(kClientSSL >> 8));
+  packet[3] = static_cast<uint8_t>(packet[3] - 1);
+  if (!send_all(server_, nullptr, packet.data(), packet.size())) {
+    *error = "writing handshake response failed: " + get_message_error(errno);
+    return false;
+  }
+  account(true, packet.size());
+
+  // until the server sends OK or an error, either side may send next, like
+  // after the fast authentication of caching_sha2_password
+  while (true) {
+    bool from_client = client_tls_->has_pending();
+    if (!from_client) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now());
+      struct pollfd fds[2];
+      fds[0].fd = client_;
+      fds[0].events = POLLIN;
+      fds[0].revents = 0;
+      fds[1].fd = server_;
+      fds[1].events = POLLIN;
+      fds[1].revents = 0;
+      int res = remaining.count() > 0 ? routing::poll_sockets(fds, 2, remaining) : 0;
+      if (res == 0) {
+        *error = "authentication timed out";
+        return false;
+      } else if (res < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        *error = "poll failed: " + get_message_error(errno);
+        return false;
+      }
+      from_client = fds[1].revents == 0;
+    }
+    if (from_client) {
+      if (!read_packet(client_, client_tls_.get(), &packet, deadline)) {
+        *error = "client left during authentication";
+        return false;
+      }
+      packet[3] = static_cast<uint8_t>(packet[3] - 1);
+      if (!send_all(server_, nullptr, packet.data(), packet.size())) {
+        *error = "writing to server failed: " + get_message_error(errno);
+        return false;
+      }
+      account(true, packet.size());
+    } else {
+      if (!read_packet(server_, nullptr, &packet, deadline)) {
+        *error = "server left during authentication";
+        return false;
+      }
+      packet[3] = static_cast<uint8_t>(packet[3] + 1);
+      if (!send_all(client_, client_tls_.get(), packet.data(), packet.size())) {
+        *error = "writing to client failed";
+        return false;
+      }
+      account(false, packet.size());
+      if (packet.size() > Packet::kHeaderSize && (packet[4] == 0x00 || packet[4] == 0xff)) {
+        // OK or error: the commands start with sequence ID 0 again
+        return true;
+      }
+    }
+  }
+}
+
+std::string TlsSession::run() {
+  struct pollfd fds[2];
+  fds[0].fd = client_;
+  fds[1].fd = server_;
+  const short kReadable = POLLIN | POLLOUT | POLLHUP | POLLERR;
+  while (true) {
+    bool client_ready = client_tls_->has_pending();
+    bool server_ready = server_tls_ && server_tls_->has_pending();
+    if (!client_ready && !server_ready) {
+      fds[0].events = static_cast<short>(client_tls_->wants_write() ? POLLOUT : POLLIN);
+      fds[0].revents = 0;
+      fds[1].events = static_cast<short>(server_tls_ && server_tls_->wants_write() ? POLLOUT : POLLIN);
+      fds[1].revents = 0;
+      int res = routing::poll_sockets(fds, 2, std::chrono::milliseconds(-1));
+      if (res < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+          continue;
+        }
+        return "Poll failed with error: " + get_message_error(errno);
+      }
+      client_ready = (fds[0].revents & kReadable) != 0;
+      server_ready = (fds[1].revents & kReadable) != 0;
+    }
+
+    if (server_ready) {
+      ssize_t size = receive(server_, server_tls_.get(), buffer_.data(), buffer_.size());
+      if (size == 0) {
+        return std::string();
+      } else if (size > 0) {
+        if (!send_all(client_, client_tls_.get(), buffer_.data(), static_cast<size_t>(size))) {
+          return "writing to client failed";
+        }
+        account(false, static_cast<size_t>(size));
+      } else if (size != TlsConnection::kWouldBlock) {
+        return "reading from server failed";
+      }
+    }
+    if (client_ready) {
+      ssize_t size = receive(client_, client_tls_.get(), buffer_.data(), buffer_.size());
+      if (size == 0) {
+        return std::string();
+      } else if (size > 0) {
+        if (!send_all(server_, server_tls_.get(), buffer_.data(), static_cast<size_t>(size))) {
+          return "writing to server failed";
+        }
+        account(true, static_cast<size_t>(size));
+      } else if (size != TlsConnection::kWouldBlock) {
+        return "reading from client failed";
+      }
+    }
+  }
+}
+
+ssize_t TlsSession::receive(int fd, TlsConnection *tls, void *buffer, size_t size) noexcept {
+  if (tls) {
+    return tls->read(buffer, size);
+  }
+  ssize_t result = socket_operations_->read(fd, buffer, size);
+#ifndef _WIN32
+  if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+#else
+  if (result < 0 && WSAGetLastError() == WSAEWOULDBLOCK) {
+#endif
+    return TlsConnection::kWouldBlock;
+  }
+  return result;
+}
+
+bool TlsSession::send_all(int fd, TlsConnection *tls, const uint8_t *data, size_t size) noexcept {
+  while (size > 0) {
+    ssize_t written;
+    if (tls) {
+      written = tls->write(data, size);
+    } else {
+      written = socket_operations_->write(fd, const_cast<uint8_t *>(data), size);
+#ifndef _WIN32
+      if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+#else
+      if (written < 0 && WSAGetLastError() == WSAEWOULDBLOCK) {
+#endif
+        written = TlsConnection::kWouldBlock;
+      }
+    }
+    if (written == TlsConnection::kWouldBlock) {
+      // like write_all(), as long as it takes
+      struct pollfd fds[1];
+      fds[0].fd = fd;
+      fds[0].events = static_cast<short>(tls && !tls->wants_write() ? POLLIN : POLLOUT);
+      fds[0].revents = 0;
+      if (routing::poll_sockets(fds, 1, std::chrono::milliseconds(-1)) < 0 && errno != EINTR) {
+        return false;
+      }
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+bool TlsSession::wait(int fd, TlsConnection *tls, clock::time_point deadline) noexcept {
+  if (tls && tls->has_pending()) {
+    return true;
+  }
+  while (true) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now());
+    if (remaining.count() <= 0) {
+      return false;
+    }
+    struct pollfd fds[1];
+    fds[0].fd = fd;
+    fds[0].events = static_cast<short>(tls && tls->wants_write() ? POLLOUT : POLLIN);
+    fds[0].revents = 0;
+    int res = routing::poll_sockets(fds, 1, remaining);
+    if (res > 0) {
+      return true;
+    } else if (res == 0 || errno != EINTR) {
+      return false;
+    }
+  }
+}
+
+bool TlsSession::read_packet(int fd, TlsConnection *tls, std::vector<uint8_t> *packet,
+                             clock::time_point deadline) {
+  packet->clear();
+  size_t wanted = Packet::kHeaderSize;
+  while (packet->size() < wanted) {
+    if (!wait(fd, tls, deadline)) {
+      return false;
+    }
+    size_t offset = packet->size();
+    packet->resize(wanted);
+    ssize_t size = receive(fd, tls, packet->data() + offset, wanted - offset);
+    if (size == TlsConnection::kWouldBlock) {
+      packet->resize(offset);
+      continue;
+    } else if (size <= 0) {
+      return false;
+    }
+    packet->resize(offset + static_cast<size_t>(size));
+    if (packet->size() == Packet::kHeaderSize && wanted == Packet::kHeaderSize) {
+      wanted = Packet::kHeaderSize + PacketView(*packet).get_payload_size();
+    }
+  }
+  return true;
+}
+
+void TlsSession::account(bool to_server, size_t bytes) noexcept {
+  auto now = clock::now();
+  if (to_server) {
+    bytes_client_to_server_ += bytes;
+    if (connection_) {
+      connection_->add_bytes_client_to_server(bytes, now);
+    }
+    if (metrics_) {
+      metrics_->bytes_client_to_server.inc(bytes);
+    }
+  } else {
+    bytes_server_to_client_ += bytes;
+    if (connection_) {
+      connection_->add_bytes_server_to_client(bytes, now);
+    }
+    if (metrics_) {
+      metrics_->bytes_server_to_client.inc(bytes);
+    }
+  }
+}
@@ -0,0 +1,157 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_TLS_SESSION_INCLUDED
+#define ROUTING_TLS_SESSION_INCLUDED
+
+#include "connection_registry.h"
+#include "routing_metrics.h"
+#include "tls_context.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace routing {
+class SocketOperationsBase;
+}
+
+/** @class TlsSession
+ * @brief Terminates the TLS of a classic protocol client at the router
+ *
+ * The greeting of the server is passed to the client offering SSL. When
+ * the client asks for it, the router runs the TLS handshake with the
+ * client, using the certificate and the shared session cache of the
+ * route (TlsServerContext), so that reconnecting clients resume their
+ * session instead of costing the server a full handshake.
+ *
+ * The router then talks to the server over its own connection:
+ *
+ * - with TLS (TlsClientContext): the SSL request of the client is passed
+ *   on and the router runs a TLS handshake with the server, resuming the
+ *   last session with it when possible; data is decrypted and encrypted
+ *   again.
+ * - in plaintext: the server never sees the SSL request, so packets of
+ *   the authentication get a sequence ID one lower towards the server and
+ *   one higher towards the client. Authentication methods which need a
+ *   secure connection, like the full authentication of
+ *   caching_sha2_password, only work when the server considers the
+ *   connection secure, so plaintext is only used with servers connected
+ *   through a Unix socket; clients asking for TLS get an error otherwise.
+ *
+ * Clients which do not ask for TLS are handed back to the caller after
+ * their handshake response was passed on.
+ *
+ * A session runs in the routing thread of its client and is not
+ * thread-safe.
+ */
+class TlsSession {
+ public:
+  /** @brief Outcome of start() */
+  enum class Result {
+    /** @brief TLS is set up; run() relays the connection */
+    kTls,
+    /** @brief the client did not ask for TLS; its handshake response was passed to the server */
+    kPlain,
+    /** @brief the server refused the connection; the client was sent its error */
+    kRefused,
+    /** @brief the client or the server broke the handshake */
+    kFailed,
+  };
+
+  /** @brief Constructor
+   *
+   * @param socket_operations socket operations
+   * @param client socket of the client
+   * @param server socket of the server, which did not greet yet
+   * @param client_context TLS with clients
+   * @param server_context TLS with servers; nullptr for plaintext
+   * @param destination name of the server, for resuming its session
+   * @param timeout how long the client and the server may take during the handshake
+   * @param buffer_size size of the buffer relaying data
+   * @param log_prefix prefix of log messages, like the route name
+   */
+  TlsSession(routing::SocketOperationsBase *socket_operations, int client, int server,
+             TlsServerContext &client_context, TlsClientContext *server_context,
+             const std::string &destination, std::chrono::milliseconds timeout,
+             size_t buffer_size, const std::string &log_prefix);
+
+  TlsSession(const TlsSession &) = delete;
+  TlsSession &operator=(const TlsSession &) = delete;
+
+  /** @brief Sets where traffic and handshakes are counted; both may be null */
+  void set_accounting(ConnectionRegistry::Connection *connection, RouteMetrics *metrics) noexcept {
+    connection_ = connection;
+    metrics_ = metrics;
+  }
+
+  /** @brief Passes the greeting and sets up TLS when the client asks for it
+   *
+   * @param error set to why the handshake failed
+   */
+  Result start(std::string *error);
+
+  /** @brief Relays the connection after start() returned Result::kTls
+   *
+   * Returns when the client or the server closed, or failed.
+   *
+   * @return why the connection ended; empty when it was closed
+   */
+  std::string run();
+
+  /** @brief Returns whether the client resumed a session */
+  bool is_client_resumed() const noexcept {
+    return client_tls_ && client_tls_->is_resumed();
+  }
+
+  /** @brief Returns the number of bytes passed on */
+  size_t get_bytes_client_to_server() const noexcept { return bytes_client_to_server_; }
+  size_t get_bytes_server_to_client() const noexcept { return bytes_server_to_client_; }
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  ssize_t receive(int fd, TlsConnection *tls, void *buffer, size_t size) noexcept;
+  bool send_all(int fd, TlsConnection *tls, const uint8_t *data, size_t size) noexcept;
+  bool wait(int fd, TlsConnection *tls, clock::time_point deadline) noexcept;
+  bool read_packet(int fd, TlsConnection *tls, std::vector<uint8_t> *packet,
+                   clock::time_point deadline);
+  bool relay_authentication(std::string *error);
+  void account(bool to_server, size_t bytes) noexcept;
+
+  routing::SocketOperationsBase *socket_operations_;
+  const int client_;
+  const int server_;
+  TlsServerContext &client_context_;
+  TlsClientContext *server_context_;
+  const std::string destination_;
+  const std::chrono::milliseconds timeout_;
+  const std::string log_prefix_;
+
+  std::unique_ptr<TlsConnection> client_tls_;
+  std::unique_ptr<TlsConnection> server_tls_;
+  std::vector<uint8_t> buffer_;
+
+  ConnectionRegistry::Connection *connection_;
+  RouteMetrics *metrics_;
+  size_t bytes_client_to_server_;
+  size_t bytes_server_to_client_;
+};
+
+#endif // ROUTING_TLS_SESSION_INCLUDED
@@ -74,6 +74,48 @@ std::pair<std::string, int > get_peer_name(int sock) {
   return std::make_pair(std::string(result_addr), port);
 }
 
+std::string get_address_name(const sockaddr_storage& addr) {
+  char result_addr[105];  // For IPv4 and IPv6
+
+  if (addr.ss_family == AF_INET6) {
+    auto *sin6 = (const struct sockaddr_in6 *)&addr;
+    inet_ntop(AF_INET6, &sin6->sin6_addr, result_addr, static_cast<socklen_t>(sizeof result_addr));
+    return "[" + std::string(result_addr) + "]:" + std::to_string(ntohs(sin6->sin6_port));
+  } else if (addr.ss_family == AF_INET) {
+    auto *sin4 = (const struct sockaddr_in *)&addr;
+    inet_ntop(AF_INET, &sin4->sin_addr, result_addr, static_cast<socklen_t>(sizeof result_addr));
+    return std::string(result_addr) + ":" + std::to_string(ntohs(sin4->sin_port));
+  }
+  return "unix socket";
+}
+
+std::string get_address_host(const sockaddr_storage& addr) {
+  char result_addr[105];  // For IPv4 and IPv6
+
+  if (addr.ss_family == AF_INET6) {
+    auto *sin6 = (const struct sockaddr_in6 *)&addr;
+    inet_ntop(AF_INET6, &sin6->sin6_addr, result_addr, static_cast<socklen_t>(sizeof result_addr));
+    return std::string(result_addr);
+  } else if (addr.ss_family == AF_INET) {
+    auto *sin4 = (const struct sockaddr_in *)&addr;
+    inet_ntop(AF_INET, &sin4->sin_addr, result_addr, static_cast<socklen_t>(sizeof result_addr));
+    return std::string(result_addr);
+  }
+  return std::string();
+}
+
+bool is_unix_socket(int sock) noexcept {
+#ifndef _WIN32
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+  return getsockname(sock, reinterpret_cast<struct sockaddr *>(&addr), &addr_len) == 0 &&
+         addr.ss_family == AF_UNIX;
+#else
+  (void)sock;
+  return false;
+#endif
+}
+
 std::vector<std::string> split_string(const std::string& data, const char delimiter, bool allow_empty) {
   std::stringstream ss(data);
   std::string token;
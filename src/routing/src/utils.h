@@ -54,6 +54,36 @@ void * get_in_addr(struct sockaddr *addr);
  */
 std::pair<std::string, int > get_peer_name(int sock);
 
+/**
+ * Get address of a peer for display
+ *
+ * Formats the address returned by accept() without asking the socket
+ * again. IPv6 addresses are put between brackets, e.g. "[::1]:3306";
+ * Unix sockets/Windows named pipes give "unix socket".
+ *
+ * @param addr a sockaddr_storage struct
+ * @return std::string
+ */
+std::string get_address_name(const sockaddr_storage& addr);
+
+/**
+ * Get IP address of a peer, without port
+ *
+ * @param addr a sockaddr_storage struct
+ * @return std::string; empty for Unix sockets/Windows named pipes
+ */
+std::string get_address_host(const sockaddr_storage& addr);
+
+/**
+ * Whether a socket is a Unix socket
+ *
+ * Servers take connections through Unix sockets for secure.
+ *
+ * @param sock a socket
+ * @return bool; always false on Windows
+ */
+bool is_unix_socket(int sock) noexcept;
+
 /**
  * Splits a string using a delimiter
  *
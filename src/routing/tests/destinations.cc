@@ -24,6 +24,7 @@
 
 #include "logger.h"
 #include "destination.h"
+#include "routing_mocks.h"
 
 #include "mysqlrouter/datatypes.h"
 
@@ -122,3 +123,79 @@ TEST_F(RouteDestinationTest, RemoveAll)
   exp = 0;
   ASSERT_EQ(exp, d.size());
 }
+
+// each connection gets its own socket descriptor, like it would for real
+class AffinitySocketOperations : public MockSocketOperations {
+ public:
+  int get_mysql_socket(TCPAddress addr, std::chrono::milliseconds timeout,
+                       bool log_errors = true) noexcept override {
+    return MockSocketOperations::get_mysql_socket(addr, timeout, log_errors) * 1000 + next_++;
+  }
+
+ private:
+  int next_ = 0;
+};
+
+TEST_F(RouteDestinationTest, AffinityKeys)
+{
+  AffinitySocketOperations sock_ops;
+  RouteDestination d(Protocol::Type::kClassicProtocol, &sock_ops);
+  d.add("41", 1);
+  TCPAddress addr("41", 1);
+  int error = 0;
+  ConnectionHints tenant_a;
+  tenant_a.affinity_key = "tenant_a";
+  ConnectionHints tenant_b;
+  tenant_b.affinity_key = "tenant_b";
+
+  int fd1 = d.get_server_socket(std::chrono::milliseconds(10), &error, tenant_a);
+  int fd2 = d.get_server_socket(std::chrono::milliseconds(10), &error, tenant_a);
+  int fd3 = d.get_server_socket(std::chrono::milliseconds(10), &error, tenant_b);
+  int fd4 = d.get_server_socket(std::chrono::milliseconds(10), &error);
+  ASSERT_EQ(2u, d.get_affinity_keys(addr));
+
+  // a key counts as long as one of its connections is open
+  d.release_server_socket(fd1);
+  d.release_server_socket(fd4);
+  ASSERT_EQ(2u, d.get_affinity_keys(addr));
+  d.release_server_socket(fd2);
+  ASSERT_EQ(1u, d.get_affinity_keys(addr));
+  d.release_server_socket(fd3);
+  ASSERT_EQ(0u, d.get_affinity_keys(addr));
+}
+
+#ifndef _WIN32
+// remembers what was connected to
+class LocalSocketOperations : public MockSocketOperations {
+ public:
+  int get_mysql_socket(TCPAddress addr, std::chrono::milliseconds timeout,
+                       bool log_errors = true) noexcept override {
+    connected.push_back(addr.str());
+    return MockSocketOperations::get_mysql_socket(TCPAddress("42", 1), timeout, log_errors);
+  }
+
+  std::vector<std::string> connected;
+};
+
+TEST_F(RouteDestinationTest, LocalSockets)
+{
+  LocalSocketOperations sock_ops;
+  RouteDestination d(Protocol::Type::kClassicProtocol, &sock_ops);
+  d.set_local_sockets({{3306, "/var/run/mysqld/mysqld.sock"}});
+
+  // only servers on this host, and only ports with a socket
+  ASSERT_EQ(TCPAddress("/var/run/mysqld/mysqld.sock", 0), d.get_connect_address(TCPAddress("127.0.0.1", 3306)));
+  ASSERT_EQ(TCPAddress("/var/run/mysqld/mysqld.sock", 0), d.get_connect_address(TCPAddress("localhost", 3306)));
+  ASSERT_EQ(TCPAddress("127.0.0.1", 3307), d.get_connect_address(TCPAddress("127.0.0.1", 3307)));
+  ASSERT_EQ(TCPAddress("192.0.2.1", 3306), d.get_connect_address(TCPAddress("192.0.2.1", 3306)));
+
+  // the destination keeps its address
+  d.add("127.0.0.1", 3306);
+  int error = 0;
+  int fd = d.get_server_socket(std::chrono::milliseconds(10), &error);
+  ASSERT_EQ(42, fd);
+  ASSERT_EQ(std::vector<std::string>{"/var/run/mysqld/mysqld.sock"}, sock_ops.connected);
+  ASSERT_EQ("127.0.0.1:3306", d.get_socket_destination(fd));
+  d.release_server_socket(fd);
+}
+#endif
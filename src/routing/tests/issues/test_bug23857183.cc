@@ -43,7 +43,7 @@ class Bug23857183 : public ::testing::Test {
 };
 
 void Bug23857183::connect_to(const mysqlrouter::TCPAddress& address) {
-  const int TIMEOUT = 4; // seconds
+  const std::chrono::seconds TIMEOUT(4);
 
   auto start = std::chrono::system_clock::now();
 
@@ -56,7 +56,7 @@ void Bug23857183::connect_to(const mysqlrouter::TCPAddress& address) {
 
   // we are trying to connect to the server on wrong port
   // it should not take the whole TIMEOUT to fail
-  ASSERT_LT(duration_seconds, TIMEOUT / 2);
+  ASSERT_LT(duration_seconds, TIMEOUT.count() / 2);
 }
 
 TEST_F(Bug23857183, ConnectToServerWrongPort) {
@@ -495,7 +495,7 @@ TEST_F(RoutingPluginTests, StartConnectTimeoutSetNegative) {
   reset_config();
   auto cmd_result = cmd_exec(cmd, true);
   ASSERT_THAT(cmd_result.output,
-              HasSubstr("connect_timeout in [routing:tests] needs value between 1 and 65535 inclusive, was '-1'"));
+              HasSubstr("connect_timeout in [routing:tests] needs value between 1ms and 65535s inclusive, was '-1'"));
 }
 
 TEST_F(RoutingPluginTests, StartClientConnectTimeoutSetIncorrectly) {
@@ -534,7 +534,7 @@ TEST_F(RoutingPluginTests, StartTimeoutsSetToZero) {
   auto cmd_result = cmd_exec(cmd, true);
   ASSERT_THAT(cmd_result.output,
               HasSubstr(
-                  "option connect_timeout in [routing:tests] needs value between 1 and 65535 inclusive, was '0'"));
+                  "option connect_timeout in [routing:tests] needs value between 1ms and 65535s inclusive, was '0'"));
 }
 
 TEST_F(RoutingPluginTests, EmptyProtocolName) {
@@ -40,7 +40,7 @@
 
 class MockSocketOperations : public routing::SocketOperationsBase {
  public:
-  int get_mysql_socket(mysqlrouter::TCPAddress addr, int, bool = true) noexcept override {
+  int get_mysql_socket(mysqlrouter::TCPAddress addr, std::chrono::milliseconds, bool = true) noexcept override {
     get_mysql_socket_call_cnt_++;
     if (get_mysql_socket_fails_todo_) {
       set_errno(ECONNREFUSED);
@@ -59,6 +59,7 @@ class MockSocketOperations : public routing::SocketOperationsBase {
   MOCK_METHOD3(write, ssize_t(int, void*, size_t));
   MOCK_METHOD1(close, void(int));
   MOCK_METHOD1(shutdown, void(int));
+  MOCK_METHOD1(shutdown_read, void(int));
 
   void set_errno(int err) {
     // set errno/Windows equivalent. At the time of writing, unit tests
@@ -0,0 +1,208 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "admission_queue.h"
+#include "dest_first_available.h"
+#include "destination.h"
+
+#include "routing_mocks.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+TEST(AdmissionQueueTest, AdmittedWithoutWaiting) {
+  AdmissionQueue queue;
+  ASSERT_EQ(AdmissionQueue::Result::kAdmitted, queue.acquire([]() { return true; }));
+  EXPECT_EQ(0u, queue.waiting());
+  EXPECT_EQ(0u, queue.admitted_after_wait());
+
+  // nothing waited, so nothing is in the histogram
+  for (auto count : queue.wait_histogram().get_counts()) {
+    EXPECT_EQ(0u, count);
+  }
+}
+
+TEST(AdmissionQueueTest, DisabledQueueRejects) {
+  AdmissionQueue queue;
+  ASSERT_FALSE(queue.has_room());
+  ASSERT_EQ(AdmissionQueue::Result::kQueueFull, queue.acquire([]() { return false; }));
+  EXPECT_EQ(1u, queue.rejected());
+}
+
+TEST(AdmissionQueueTest, TimesOut) {
+  AdmissionQueue queue(1, milliseconds(20));
+  ASSERT_TRUE(queue.has_room());
+
+  auto started = std::chrono::steady_clock::now();
+  ASSERT_EQ(AdmissionQueue::Result::kTimedOut, queue.acquire([]() { return false; }));
+  EXPECT_GE(std::chrono::steady_clock::now() - started, milliseconds(20));
+  EXPECT_EQ(1u, queue.timed_out());
+  EXPECT_EQ(0u, queue.waiting());
+  EXPECT_EQ(1u, queue.max_waiting());
+
+  // 20ms falls in the (10ms, 50ms] bucket
+  EXPECT_EQ(1u, queue.wait_histogram().get_counts()[3]);
+}
+
+TEST(AdmissionQueueTest, AdmittedWhenSlotIsGivenBack) {
+  AdmissionQueue queue(1, seconds(10));
+  std::atomic<int> slots(0);
+  auto try_take = [&slots]() {
+    int free_slots = slots.load();
+    return free_slots > 0 && slots.compare_exchange_strong(free_slots, free_slots - 1);
+  };
+
+  std::thread waiter([&]() {
+    EXPECT_EQ(AdmissionQueue::Result::kAdmitted, queue.acquire(try_take));
+  });
+
+  // wait for the client to queue up
+  while (queue.waiting() == 0) {
+    std::this_thread::sleep_for(milliseconds(1));
+  }
+  // a second client does not fit in the queue
+  EXPECT_FALSE(queue.has_room());
+  EXPECT_EQ(AdmissionQueue::Result::kQueueFull, queue.acquire(try_take));
+
+  ++slots;
+  queue.notify();
+  waiter.join();
+
+  EXPECT_EQ(0, slots.load());
+  EXPECT_EQ(1u, queue.admitted_after_wait());
+  EXPECT_EQ(1u, queue.rejected());
+}
+
+TEST(WaitHistogramTest, Buckets) {
+  WaitHistogram histogram;
+  histogram.add(milliseconds(0));
+  histogram.add(milliseconds(1));
+  histogram.add(milliseconds(2));
+  histogram.add(milliseconds(5000));
+  histogram.add(seconds(60));
+
+  auto counts = histogram.get_counts();
+  EXPECT_EQ(2u, counts[0]);  // <= 1ms
+  EXPECT_EQ(1u, counts[1]);  // <= 5ms
+  EXPECT_EQ(1u, counts[WaitHistogram::kBuckets - 2]);  // <= 5s
+  EXPECT_EQ(1u, counts[WaitHistogram::kBuckets - 1]);  // everything above
+}
+
+// each connection gets its own socket descriptor, like it would for real
+class UniqueSocketOperations : public MockSocketOperations {
+ public:
+  int get_mysql_socket(mysqlrouter::TCPAddress addr, std::chrono::milliseconds timeout,
+                       bool log_errors = true) noexcept override {
+    int fd = MockSocketOperations::get_mysql_socket(addr, timeout, log_errors);
+    return fd < 0 ? fd : fd * 1000 + next_++;
+  }
+
+ private:
+  int next_ = 0;
+};
+
+TEST(DestinationLimitsTest, RoundRobinSkipsFullDestination) {
+  UniqueSocketOperations sock_ops;
+  RouteDestination dest(Protocol::Type::kClassicProtocol, &sock_ops);
+  dest.add("41", 1);
+  dest.add("42", 2);
+  dest.set_connection_limits(2, 0, milliseconds(10));
+
+  int error = 0;
+  int fd1 = dest.get_server_socket(milliseconds(10), &error);
+  int fd2 = dest.get_server_socket(milliseconds(10), &error);
+  int fd3 = dest.get_server_socket(milliseconds(10), &error);
+  int fd4 = dest.get_server_socket(milliseconds(10), &error);
+  ASSERT_EQ(41, fd1 / 1000);
+  ASSERT_EQ(42, fd2 / 1000);
+  ASSERT_EQ(41, fd3 / 1000);
+  ASSERT_EQ(42, fd4 / 1000);
+  EXPECT_EQ(2u, dest.get_active_connections(mysqlrouter::TCPAddress("41", 1)));
+  EXPECT_EQ(2u, dest.get_active_connections(mysqlrouter::TCPAddress("42", 2)));
+
+  // both destinations are full and nobody can wait
+  ASSERT_EQ(-1, dest.get_server_socket(milliseconds(10), &error));
+  EXPECT_EQ(EBUSY, error);
+  EXPECT_EQ(1u, dest.get_admission_queue().rejected());
+
+  // giving back a connection to 42 makes room on 42 only
+  dest.release_server_socket(fd2);
+  EXPECT_EQ(1u, dest.get_active_connections(mysqlrouter::TCPAddress("42", 2)));
+  int fd5 = dest.get_server_socket(milliseconds(10), &error);
+  EXPECT_EQ(42, fd5 / 1000);
+}
+
+TEST(DestinationLimitsTest, FailedConnectGivesSlotBack) {
+  UniqueSocketOperations sock_ops;
+  RouteDestination dest(Protocol::Type::kClassicProtocol, &sock_ops);
+  dest.add("41", 1);
+  dest.add("42", 2);
+  dest.set_connection_limits(1, 0, milliseconds(10));
+
+  sock_ops.get_mysql_socket_fail(1);
+  int error = 0;
+  int fd = dest.get_server_socket(milliseconds(10), &error);
+  ASSERT_EQ(42, fd / 1000);
+  EXPECT_EQ(0u, dest.get_active_connections(mysqlrouter::TCPAddress("41", 1)));
+  EXPECT_EQ(1u, dest.get_active_connections(mysqlrouter::TCPAddress("42", 2)));
+}
+
+TEST(DestinationLimitsTest, WaitsForFreeDestination) {
+  UniqueSocketOperations sock_ops;
+  DestFirstAvailable dest(Protocol::Type::kClassicProtocol, &sock_ops);
+  dest.add("41", 1);
+  dest.add("42", 2);
+  dest.set_connection_limits(1, 1, seconds(10));
+
+  int error = 0;
+  int fd1 = dest.get_server_socket(milliseconds(10), &error);
+  ASSERT_EQ(41, fd1 / 1000);
+
+  // the active server is full; first-available waits for it instead of
+  // failing over to 42
+  int fd2 = -1;
+  std::thread waiter([&]() {
+    int thread_error = 0;
+    fd2 = dest.get_server_socket(milliseconds(10), &thread_error);
+  });
+  while (dest.get_admission_queue().waiting() == 0) {
+    std::this_thread::sleep_for(milliseconds(1));
+  }
+  dest.release_server_socket(fd1);
+  waiter.join();
+
+  EXPECT_EQ(41, fd2 / 1000);
+  EXPECT_EQ(1u, dest.get_admission_queue().admitted_after_wait());
+}
+
+TEST(DestinationLimitsTest, NoLimitByDefault) {
+  UniqueSocketOperations sock_ops;
+  RouteDestination dest(Protocol::Type::kClassicProtocol, &sock_ops);
+  dest.add("41", 1);
+
+  int error = 0;
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_EQ(41, dest.get_server_socket(milliseconds(10), &error) / 1000);
+  }
+  // nothing is counted when there is no limit
+  EXPECT_EQ(0u, dest.get_active_connections(mysqlrouter::TCPAddress("41", 1)));
+}
@@ -0,0 +1,143 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "protocol/classic_framer.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using Bytes = std::vector<uint8_t>;
+
+static void add_packet(Bytes *stream, uint8_t seq, size_t payload_size, uint8_t fill = 'x') {
+  stream->push_back(static_cast<uint8_t>(payload_size));
+  stream->push_back(static_cast<uint8_t>(payload_size >> 8));
+  stream->push_back(static_cast<uint8_t>(payload_size >> 16));
+  stream->push_back(seq);
+  stream->insert(stream->end(), payload_size, fill);
+}
+
+// records what the framer reports
+struct Recorder {
+  struct Packet {
+    uint8_t sequence_id;
+    uint32_t payload_size;
+    bool continuation;
+    size_t payload_seen;
+    bool ended;
+  };
+
+  std::vector<Packet> packets;
+  size_t stop_after = SIZE_MAX;
+
+  void on_header(uint8_t sequence_id, uint32_t payload_size, bool continuation) {
+    packets.push_back({sequence_id, payload_size, continuation, 0, false});
+  }
+  void on_payload(const uint8_t * /*data*/, size_t size) {
+    packets.back().payload_seen += size;
+  }
+  bool on_packet_end() {
+    packets.back().ended = true;
+    return packets.size() < stop_after;
+  }
+};
+
+class ClassicFramerTest : public ::testing::Test {
+};
+
+TEST_F(ClassicFramerTest, PacketsInOneRead) {
+  Bytes stream;
+  add_packet(&stream, 0, 10);
+  add_packet(&stream, 1, 0);
+  add_packet(&stream, 2, 300);
+
+  ClassicFramer framer;
+  Recorder recorder;
+  EXPECT_EQ(stream.size(), framer.feed(stream.data(), stream.size(), recorder));
+  ASSERT_EQ(3u, recorder.packets.size());
+  EXPECT_EQ(0, recorder.packets[0].sequence_id);
+  EXPECT_EQ(10u, recorder.packets[0].payload_seen);
+  EXPECT_EQ(0u, recorder.packets[1].payload_size);
+  EXPECT_TRUE(recorder.packets[1].ended);
+  EXPECT_EQ(2, recorder.packets[2].sequence_id);
+  EXPECT_EQ(300u, recorder.packets[2].payload_size);
+  EXPECT_TRUE(recorder.packets[2].ended);
+  EXPECT_TRUE(framer.at_boundary());
+}
+
+TEST_F(ClassicFramerTest, ByteByByte) {
+  Bytes stream;
+  add_packet(&stream, 0, 5);
+  add_packet(&stream, 1, 3);
+
+  ClassicFramer framer;
+  Recorder recorder;
+  for (size_t i = 0; i < stream.size(); ++i) {
+    EXPECT_EQ(1u, framer.feed(&stream[i], 1, recorder));
+    if (i == 1) {
+      // half a header
+      EXPECT_TRUE(recorder.packets.empty());
+      EXPECT_FALSE(framer.at_boundary());
+    }
+  }
+  ASSERT_EQ(2u, recorder.packets.size());
+  EXPECT_EQ(5u, recorder.packets[0].payload_seen);
+  EXPECT_EQ(1, recorder.packets[1].sequence_id);
+  EXPECT_EQ(3u, recorder.packets[1].payload_seen);
+  EXPECT_TRUE(recorder.packets[1].ended);
+  EXPECT_EQ(1, framer.get_sequence_id());
+}
+
+TEST_F(ClassicFramerTest, ContinuationPackets) {
+  Bytes stream;
+  add_packet(&stream, 0, ClassicFramer::kMaxPayloadSize);
+  add_packet(&stream, 1, ClassicFramer::kMaxPayloadSize);
+  add_packet(&stream, 2, 0);
+  add_packet(&stream, 0, 1);
+
+  ClassicFramer framer;
+  Recorder recorder;
+  // in reads which do not end on packets
+  size_t pos = 0;
+  while (pos < stream.size()) {
+    size_t n = std::min<size_t>(stream.size() - pos, 65537);
+    EXPECT_EQ(n, framer.feed(&stream[pos], n, recorder));
+    pos += n;
+  }
+  ASSERT_EQ(4u, recorder.packets.size());
+  EXPECT_FALSE(recorder.packets[0].continuation);
+  EXPECT_TRUE(recorder.packets[1].continuation);
+  EXPECT_TRUE(recorder.packets[2].continuation);
+  EXPECT_FALSE(recorder.packets[3].continuation);
+  EXPECT_EQ(ClassicFramer::kMaxPayloadSize, recorder.packets[1].payload_seen);
+  EXPECT_FALSE(framer.is_continued());
+}
+
+TEST_F(ClassicFramerTest, HandlerStops) {
+  Bytes stream;
+  add_packet(&stream, 0, 10);
+  size_t first = stream.size();
+  add_packet(&stream, 1, 10);
+
+  ClassicFramer framer;
+  Recorder recorder;
+  recorder.stop_after = 1;
+  EXPECT_EQ(first, framer.feed(stream.data(), stream.size(), recorder));
+  EXPECT_TRUE(framer.at_boundary());
+}
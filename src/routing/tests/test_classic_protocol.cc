@@ -105,7 +105,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsFdNotSet)
 
   FD_CLR(sender_socket_, &readfds_);
 
-  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   ASSERT_TRUE(result==0);
@@ -121,7 +121,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsReadError)
 
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_,_,_)).WillOnce(Return(-1));
 
-  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   ASSERT_FALSE(handshake_done_);
@@ -139,7 +139,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsHandshakeDoneOK)
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, &network_buffer_[0], network_buffer_.size())).WillOnce(Return(PACKET_SIZE));
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], PACKET_SIZE)).WillOnce(Return(PACKET_SIZE));
 
-  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   ASSERT_TRUE(handshake_done_);
@@ -159,7 +159,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsHandshakeDoneWriteError)
                                                                   WillOnce(Return(PACKET_SIZE));
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], 20)).WillOnce(Return(-1));
 
-  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                        handshake_done_, &report_bytes_read, true);
 
   ASSERT_TRUE(handshake_done_);
@@ -174,7 +174,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsHandshakePacketTooSmall)
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, &network_buffer_[0], network_buffer_.size())).
                                                                   WillOnce(Return((ssize_t)report_bytes_read));
 
-  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                        handshake_done_, &report_bytes_read, true);
 
   ASSERT_FALSE(handshake_done_);
@@ -194,7 +194,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsHandshakeInvalidPacketNumber)
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, &network_buffer_[0], network_buffer_.size())).
                                                                   WillOnce(Return((ssize_t)report_bytes_read));
 
-  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                        handshake_done_, &report_bytes_read, true);
 
   ASSERT_FALSE(handshake_done_);
@@ -218,7 +218,7 @@ TEST_F(ClassicProtocolTest, CopyPacketsHandshakeServerSendsError)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, _, network_buffer_offset_)).
                                                        WillOnce(Return((ssize_t)network_buffer_offset_));
 
-  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = sut_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                        handshake_done_, &report_bytes_read, true);
 
   // if the server sent error handshake is considered done
@@ -238,6 +238,31 @@ TEST_F(ClassicProtocolTest, SendErrorOKMultipleWrites)
   ASSERT_TRUE(res);
 }
 
+TEST_F(ClassicProtocolTest, StartsCommand)
+{
+  // COM_QUERY, sequence id 0
+  RoutingProtocolBuffer buffer{0x09, 0x00, 0x00, 0x00, 0x03, 's', 'e', 'l', 'e', 'c', 't', ' ', '1'};
+  ASSERT_TRUE(sut_protocol_->starts_command(buffer, buffer.size()));
+
+  // continued packet of a large command, or the reply to an auth switch
+  buffer[3] = 0x01;
+  ASSERT_FALSE(sut_protocol_->starts_command(buffer, buffer.size()));
+
+  // TLS application data can't be looked into
+  RoutingProtocolBuffer tls{0x17, 0x03, 0x03, 0x00, 0x20};
+  ASSERT_TRUE(sut_protocol_->starts_command(tls, tls.size()));
+}
+
+TEST_F(ClassicProtocolTest, OnIdleTimeout)
+{
+  // error packet to the client, COM_QUIT to the server
+  auto error = mysql_protocol::ErrorPacket(0, 4031, "idle", "HY000");
+  EXPECT_CALL(*mock_socket_operations_, write(sender_socket_, _, error.size())).WillOnce(Return((ssize_t)error.size()));
+  EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, _, 5)).WillOnce(Return(5));
+
+  sut_protocol_->on_idle_timeout(sender_socket_, receiver_socket_, 4031, "idle", "routing");
+}
+
 TEST_F(ClassicProtocolTest, SendErrorWriteFail)
 {
   auto set_errno = [&]() -> void {errno=15;};
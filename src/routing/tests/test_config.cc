@@ -128,6 +128,176 @@ TEST_F(TestConfig, InvalidDefaultPort) {
       "option bind_port in [routing] needs value between 1 and 65535 inclusive, was '23123124123123'");
 }
 
+TEST_F(TestConfig, InvalidSlowStartRamp) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\nslow_start_ramp=quadratic\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option slow_start_ramp in [routing] is invalid; valid are linear, exponential (was 'quadratic')");
+}
+
+TEST_F(TestConfig, InvalidConnectTimeoutUnit) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\nconnect_timeout=5m\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option connect_timeout in [routing] needs value between 1ms and 65535s inclusive, was '5m'");
+}
+
+TEST_F(TestConfig, InvalidConnectionQueueTimeout) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\nconnection_queue_length=10\nconnection_queue_timeout=0\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option connection_queue_timeout in [routing] needs value between 1ms and 3600s inclusive, was '0'");
+}
+
+TEST_F(TestConfig, DeferAcceptNeedsXProtocol) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\ndefer_accept=5\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option defer_accept in [routing] only works with protocol=x");
+}
+
+TEST_F(TestConfig, InvalidKeepaliveCount) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\nserver_keepalive_count=1000\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option server_keepalive_count in [routing] needs value between 0 and 127 inclusive, was '1000'");
+}
+
+TEST_F(TestConfig, ReadWriteSplittingNeedsMetadataCache) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\nread_write_splitting=1\nread_write_splitting_user=router\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option read_write_splitting in [routing] needs metadata-cache destinations with role=PRIMARY");
+}
+
+TEST_F(TestConfig, ReadWriteSplittingUserNeedsSharedAccount) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\nread_write_splitting=1\nread_write_splitting_user=router\n";
+  c << "destinations=metadata-cache://test/default?role=PRIMARY\nmode=read-write\n";
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option read_write_splitting_user in [routing] needs read_write_splitting_shared_account=1");
+}
+
+TEST_F(TestConfig, SchemaShardingNeedsMetadataCache) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\nschema_sharding=shop_eu=eu\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option schema_sharding in [routing] needs metadata-cache destinations with role=PRIMARY");
+}
+
+TEST_F(TestConfig, AffinityNeedsMetadataCache) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\naffinity=schema\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option affinity in [routing] needs metadata-cache destinations");
+}
+
+TEST_F(TestConfig, RoutingRulesInvalid) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\nrouting_rules=user=etl -> quota=0\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option routing_rules in [routing] is invalid: quota needs a value between 1 and 65535");
+}
+
+TEST_F(TestConfig, RoutingRulesServersNeedMetadataCache) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\nrouting_rules=subnet=10.0.0.0/8 -> servers=db1:3306\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option routing_rules in [routing] with servers or location need metadata-cache destinations");
+}
+
+TEST_F(TestConfig, SpilloverNeedsMetadataCache) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\nspillover_latency=50\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option spillover_latency in [routing] needs metadata-cache destinations");
+}
+
+TEST_F(TestConfig, TlsSessionCacheSizeInvalid) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\ntls_termination=1\ntls_session_cache_size=0\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option tls_session_cache_size in [routing] needs value between 1 and 1048576 inclusive, was '0'");
+}
+
+#ifndef _WIN32
+TEST_F(TestConfig, LocalSocketsInvalid) {
+  reset_config();
+  std::ofstream c(config_path->str(), std::fstream::app | std::fstream::out);
+  c << "[routing]\nbind_address=127.0.0.1:7001\nlocal_sockets=3306:mysqld.sock\n";
+  c << kDefaultRoutingConfig;
+  c.close();
+
+  MySQLRouter r(g_origin, {"-c", config_path->str()});
+  ASSERT_THROW_LIKE(r.start(), std::invalid_argument,
+      "option local_sockets in [routing] is invalid: path needs to be absolute (was '3306:mysqld.sock')");
+}
+#endif
+
 int main(int argc, char *argv[]) {
   init_windows_sockets();
   g_origin = Path(argv[0]).dirname();
@@ -0,0 +1,284 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "connection_registry.h"
+#include "mysql_routing.h"
+#include "mysqlrouter/routing.h"
+
+#include "routing_mocks.h"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+# include <arpa/inet.h>
+# include <netinet/in.h>
+# include <sys/socket.h>
+# include <unistd.h>
+#endif
+
+using ::testing::_;
+
+TEST(ConnectionRegistryTest, TracksConnections) {
+  MockSocketOperations socket_operations;
+  ConnectionRegistry registry(&socket_operations);
+
+  auto first = registry.add(10, 11, "192.168.1.2:50000", "10.0.0.1:3306");
+  auto second = registry.add(12, 13, "192.168.1.3:50000", "10.0.0.2:3306");
+  EXPECT_EQ(2u, registry.size());
+
+  auto now = ConnectionRegistry::clock::now();
+  first->handshake_done();
+  first->add_bytes_server_to_client(100, now);
+  first->add_bytes_client_to_server(20, now);
+  first->add_bytes_client_to_server(5, now);
+
+  for (const auto &info : registry.get_connections()) {
+    if (info.destination == "10.0.0.1:3306") {
+      EXPECT_EQ("192.168.1.2:50000", info.client_address);
+      EXPECT_TRUE(info.handshake_done);
+      EXPECT_EQ(100u, info.bytes_server_to_client);
+      EXPECT_EQ(25u, info.bytes_client_to_server);
+      EXPECT_EQ(now, info.last_activity);
+    } else {
+      EXPECT_EQ("10.0.0.2:3306", info.destination);
+      EXPECT_FALSE(info.handshake_done);
+      EXPECT_EQ(0u, info.bytes_server_to_client);
+      EXPECT_EQ(info.started, info.last_activity);
+    }
+  }
+
+  registry.remove(first);
+  ASSERT_EQ(1u, registry.size());
+  EXPECT_EQ("10.0.0.2:3306", registry.get_connections()[0].destination);
+  registry.remove(second);
+  EXPECT_EQ(0u, registry.size());
+}
+
+TEST(ConnectionRegistryTest, CloseConnectionsTo) {
+  MockSocketOperations socket_operations;
+  ConnectionRegistry registry(&socket_operations);
+
+  auto first = registry.add(10, 11, "192.168.1.2:50000", "10.0.0.1:3306");
+  auto second = registry.add(12, 13, "192.168.1.3:50000", "10.0.0.2:3306");
+  auto third = registry.add(14, 15, "192.168.1.4:50000", "10.0.0.1:3306");
+
+  EXPECT_CALL(socket_operations, shutdown(_)).Times(0);
+  EXPECT_CALL(socket_operations, shutdown(10));
+  EXPECT_CALL(socket_operations, shutdown(11));
+  EXPECT_CALL(socket_operations, shutdown(14));
+  EXPECT_CALL(socket_operations, shutdown(15));
+  EXPECT_EQ(2u, registry.close_connections_to("10.0.0.1:3306"));
+  EXPECT_EQ(ConnectionRegistry::CloseReason::kDrained, first->get_close_reason());
+  EXPECT_EQ(ConnectionRegistry::CloseReason::kNone, second->get_close_reason());
+  EXPECT_EQ(ConnectionRegistry::CloseReason::kDrained, third->get_close_reason());
+
+  // already closed; the routing threads did not remove them yet
+  EXPECT_EQ(3u, registry.size());
+  EXPECT_EQ(0u, registry.close_connections_to("10.0.0.1:3306"));
+  EXPECT_EQ(0u, registry.close_connections_to("10.0.0.3:3306"));
+}
+
+TEST(ConnectionRegistryTest, CloseIdleConnections) {
+  using std::chrono::seconds;
+  MockSocketOperations socket_operations;
+  ConnectionRegistry registry(&socket_operations);
+
+  auto handshaking = registry.add(10, 11, "192.168.1.2:50000", "10.0.0.1:3306");
+  auto answered = registry.add(12, 13, "192.168.1.3:50000", "10.0.0.1:3306");
+  auto waiting = registry.add(14, 15, "192.168.1.4:50000", "10.0.0.1:3306");
+  answered->handshake_done();
+  waiting->handshake_done();
+
+  auto start = ConnectionRegistry::clock::now();
+  answered->add_bytes_client_to_server(10, start);
+  answered->add_bytes_server_to_client(10, start + seconds(1));
+  waiting->add_bytes_server_to_client(10, start);
+  waiting->add_bytes_client_to_server(10, start + seconds(1));
+
+  EXPECT_CALL(socket_operations, shutdown(_)).Times(0);
+  EXPECT_CALL(socket_operations, shutdown_read(_)).Times(0);
+
+  // disabled
+  EXPECT_EQ(0u, registry.close_idle_connections(start + seconds(100), seconds(0), seconds(0)));
+  // not yet
+  EXPECT_EQ(0u, registry.close_idle_connections(start + seconds(5), seconds(10), seconds(10)));
+  // the server still has to answer; the client is not idle
+  EXPECT_CALL(socket_operations, shutdown_read(12));
+  EXPECT_EQ(1u, registry.close_idle_connections(start + seconds(20), seconds(10), seconds(0)));
+  EXPECT_EQ(ConnectionRegistry::CloseReason::kClientIdle, answered->get_close_reason());
+  EXPECT_EQ(ConnectionRegistry::CloseReason::kNone, waiting->get_close_reason());
+
+  EXPECT_CALL(socket_operations, shutdown_read(14));
+  EXPECT_EQ(1u, registry.close_idle_connections(start + seconds(20), seconds(10), seconds(10)));
+  EXPECT_EQ(ConnectionRegistry::CloseReason::kServerIdle, waiting->get_close_reason());
+  // client_connect_timeout applies before the handshake
+  EXPECT_EQ(ConnectionRegistry::CloseReason::kNone, handshaking->get_close_reason());
+}
+
+#ifndef _WIN32
+
+static const uint16_t kRouterPort = 4659;
+static const uint16_t kServerPort = 4660;
+
+static int listen_on(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int option_value = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &option_value, static_cast<socklen_t>(sizeof(option_value)));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), static_cast<socklen_t>(sizeof(addr))) == -1 ||
+      listen(fd, 5) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int connect_to(uint16_t port) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  for (int i = 0; i < 100; ++i) {
+    // the router might not be listening yet
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), static_cast<socklen_t>(sizeof(addr))) == 0) {
+      return fd;
+    }
+    close(fd);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  return -1;
+}
+
+TEST(ConnectionRegistryTest, CloseRoutedConnections) {
+  int server_socket = listen_on(kServerPort);
+  ASSERT_GE(server_socket, 0);
+
+  MySQLRouting routing(routing::AccessMode::kReadWrite, kRouterPort,
+                       Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+                       "routing:registry", 10, std::chrono::seconds(1), 100,
+                       std::chrono::seconds(10));
+  std::string destination = "127.0.0.1:" + std::to_string(kServerPort);
+  routing.set_destinations_from_csv(destination);
+  std::thread router_thread(&MySQLRouting::start, &routing);
+
+  int client = connect_to(kRouterPort);
+  ASSERT_GE(client, 0);
+  int server = accept(server_socket, nullptr, nullptr);
+  ASSERT_GE(server, 0);
+
+  // the greeting; classic protocol servers talk first
+  const char greeting[] = {0x01, 0x00, 0x00, 0x00, 0x0a};
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(greeting)), write(server, greeting, sizeof(greeting)));
+  char buf[256];
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(greeting)), read(client, buf, sizeof(buf)));
+
+  // counted after being forwarded
+  auto connections = routing.get_connections();
+  for (int i = 0; i < 100 && connections.size() == 1 &&
+                  connections[0].bytes_server_to_client == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    connections = routing.get_connections();
+  }
+  ASSERT_EQ(1u, connections.size());
+  EXPECT_EQ(destination, connections[0].destination);
+  EXPECT_EQ(0u, connections[0].client_address.find("127.0.0.1:"));
+  EXPECT_EQ(sizeof(greeting), connections[0].bytes_server_to_client);
+  EXPECT_FALSE(connections[0].handshake_done);
+
+  EXPECT_EQ(0u, routing.close_connections_to("127.0.0.1:1"));
+  EXPECT_EQ(1u, routing.close_connections_to(destination));
+  // both sides see the connection closed
+  EXPECT_EQ(0, read(client, buf, sizeof(buf)));
+  EXPECT_EQ(0, read(server, buf, sizeof(buf)));
+  close(client);
+  close(server);
+
+  for (int i = 0; i < 100 && routing.get_active_routes() > 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(0u, routing.get_connections().size());
+  // closed on purpose, so not counted against the client host
+  EXPECT_TRUE(routing.get_blocked_client_hosts().empty());
+
+  routing.stop();
+  router_thread.join();
+  close(server_socket);
+}
+
+TEST(ConnectionRegistryTest, CloseIdleRoutedConnections) {
+  const uint16_t router_port = kRouterPort + 2;
+  const uint16_t server_port = kServerPort + 2;
+  int server_socket = listen_on(server_port);
+  ASSERT_GE(server_socket, 0);
+
+  MySQLRouting routing(routing::AccessMode::kReadWrite, router_port,
+                       Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+                       "routing:idle", 10, std::chrono::seconds(1), 100,
+                       std::chrono::seconds(10));
+  routing.set_destinations_from_csv("127.0.0.1:" + std::to_string(server_port));
+  routing.set_idle_timeouts(std::chrono::milliseconds(200), std::chrono::milliseconds(0));
+  std::thread router_thread(&MySQLRouting::start, &routing);
+
+  int client = connect_to(router_port);
+  ASSERT_GE(client, 0);
+  int server = accept(server_socket, nullptr, nullptr);
+  ASSERT_GE(server, 0);
+
+  // greeting, handshake response, OK
+  char buf[256];
+  const char greeting[] = {0x01, 0x00, 0x00, 0x00, 0x0a};
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(greeting)), write(server, greeting, sizeof(greeting)));
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(greeting)), read(client, buf, sizeof(buf)));
+  const char response[] = {0x04, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00};
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(response)), write(client, response, sizeof(response)));
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(response)), read(server, buf, sizeof(buf)));
+  const char ok[] = {0x07, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00};
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(ok)), write(server, ok, sizeof(ok)));
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(ok)), read(client, buf, sizeof(buf)));
+
+  // the client gets an error packet, the server COM_QUIT, then both are closed
+  ssize_t size = read(client, buf, sizeof(buf));
+  ASSERT_GT(size, 6);
+  EXPECT_EQ(static_cast<char>(0xff), buf[4]);
+  EXPECT_EQ(4031, (buf[5] & 0xff) | ((buf[6] & 0xff) << 8));
+  const char quit[] = {0x01, 0x00, 0x00, 0x00, 0x01};
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(quit)), read(server, buf, sizeof(buf)));
+  EXPECT_EQ(0, memcmp(quit, buf, sizeof(quit)));
+  EXPECT_EQ(0, read(client, buf, sizeof(buf)));
+  EXPECT_EQ(0, read(server, buf, sizeof(buf)));
+  close(client);
+  close(server);
+
+  for (int i = 0; i < 100 && routing.get_active_routes() > 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(0u, routing.get_connections().size());
+
+  routing.stop();
+  router_thread.join();
+  close(server_socket);
+}
+
+#endif // _WIN32
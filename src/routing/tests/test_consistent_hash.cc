@@ -0,0 +1,152 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "consistent_hash.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> make_members(size_t count) {
+  std::vector<std::string> members;
+  for (size_t i = 0; i < count; ++i) {
+    members.push_back("10.0.0." + std::to_string(i + 1) + ":3306");
+  }
+  return members;
+}
+
+static std::vector<std::string> make_keys(size_t count) {
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < count; ++i) {
+    keys.push_back("tenant_" + std::to_string(i));
+  }
+  return keys;
+}
+
+// owner of each key, by name
+static std::map<std::string, std::string> owners(const ConsistentHashRing &ring,
+                                                 const std::vector<std::string> &keys) {
+  std::map<std::string, std::string> result;
+  for (auto &key : keys) {
+    result[key] = ring.get_members()[ring.get_owner(key)];
+  }
+  return result;
+}
+
+TEST(ConsistentHashRingTest, Empty) {
+  ConsistentHashRing ring;
+  EXPECT_TRUE(ring.empty());
+  std::vector<size_t> order{1, 2};
+  ring.get_preference("key", &order);
+  EXPECT_TRUE(order.empty());
+  EXPECT_EQ(0U, ring.get_owner("key"));
+}
+
+TEST(ConsistentHashRingTest, SetMembers) {
+  ConsistentHashRing ring;
+  EXPECT_TRUE(ring.set_members(make_members(3)));
+  EXPECT_FALSE(ring.set_members(make_members(3)));
+  EXPECT_TRUE(ring.set_members(make_members(4)));
+  EXPECT_EQ(make_members(4), ring.get_members());
+}
+
+TEST(ConsistentHashRingTest, PreferenceHasEveryMemberOnce) {
+  ConsistentHashRing ring;
+  ring.set_members(make_members(5));
+  std::vector<size_t> order;
+  for (auto &key : make_keys(100)) {
+    ring.get_preference(key, &order);
+    ASSERT_EQ(5U, order.size());
+    EXPECT_EQ(ring.get_owner(key), order[0]);
+    std::vector<size_t> sorted(order);
+    std::sort(sorted.begin(), sorted.end());
+    EXPECT_EQ((std::vector<size_t>{0, 1, 2, 3, 4}), sorted);
+  }
+}
+
+TEST(ConsistentHashRingTest, OrderOfMembersDoesNotMatter) {
+  auto members = make_members(4);
+  ConsistentHashRing ring;
+  ring.set_members(members);
+  auto keys = make_keys(1000);
+  auto before = owners(ring, keys);
+
+  std::reverse(members.begin(), members.end());
+  ConsistentHashRing reversed;
+  reversed.set_members(members);
+  EXPECT_EQ(before, owners(reversed, keys));
+}
+
+TEST(ConsistentHashRingTest, Spread) {
+  ConsistentHashRing ring;
+  ring.set_members(make_members(4));
+  std::map<std::string, size_t> counts;
+  for (auto &it : owners(ring, make_keys(10000))) {
+    ++counts[it.second];
+  }
+  ASSERT_EQ(4U, counts.size());
+  for (auto &it : counts) {
+    // 2500 each when perfectly even
+    EXPECT_GT(it.second, 2000U) << it.first;
+    EXPECT_LT(it.second, 3000U) << it.first;
+  }
+}
+
+TEST(ConsistentHashRingTest, FewKeysMoveWhenMembersChange) {
+  auto keys = make_keys(10000);
+  ConsistentHashRing ring;
+  ring.set_members(make_members(4));
+  auto before = owners(ring, keys);
+
+  // a fifth member takes about a fifth of the keys, from all others
+  ring.set_members(make_members(5));
+  auto after = owners(ring, keys);
+  size_t moved = 0;
+  for (auto &key : keys) {
+    if (before[key] != after[key]) {
+      EXPECT_EQ(make_members(5).back(), after[key]);
+      ++moved;
+    }
+  }
+  EXPECT_GT(moved, 1500U);
+  EXPECT_LT(moved, 2500U);
+
+  // when it leaves again, its keys go back where they were
+  ring.set_members(make_members(4));
+  EXPECT_EQ(before, owners(ring, keys));
+}
+
+TEST(ConsistentHashRingTest, LoadBound) {
+  // ceil(1.25 * 1 / 4)
+  EXPECT_EQ(1U, ConsistentHashRing::get_load_bound(0, 4, 125));
+  // ceil(1.25 * 101 / 4) = ceil(31.5625)
+  EXPECT_EQ(32U, ConsistentHashRing::get_load_bound(100, 4, 125));
+  // at least the even share
+  EXPECT_EQ(26U, ConsistentHashRing::get_load_bound(100, 4, 50));
+  EXPECT_EQ(0U, ConsistentHashRing::get_load_bound(100, 0, 125));
+}
+
+TEST(ConsistentHashRingTest, HashSpreadsSimilarKeys) {
+  // FNV-1a alone keeps the upper bits of keys differing in the last character close
+  uint32_t first = ConsistentHashRing::hash("10.0.0.1:3306#0");
+  uint32_t second = ConsistentHashRing::hash("10.0.0.1:3306#1");
+  EXPECT_NE(first >> 24, second >> 24);
+  EXPECT_EQ(first, ConsistentHashRing::hash("10.0.0.1:3306#0"));
+}
@@ -0,0 +1,229 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest_prod.h> // must be the first header
+#include "dest_metadata_cache.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <chrono>
+
+using metadata_cache::ManagedInstance;
+using metadata_cache::ServerMode;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+static ManagedInstance member(const std::string &uuid, ServerMode mode, unsigned int port) {
+  ManagedInstance instance;
+  instance.replicaset_name = "default";
+  instance.mysql_server_uuid = uuid;
+  instance.role = "HA";
+  instance.mode = mode;
+  instance.weight = 0;
+  instance.version_token = 0;
+  instance.host = "127.0.0.1";
+  instance.port = port;
+  instance.xport = port * 10;
+  return instance;
+}
+
+class DestMetadataCacheDrainTest : public ::testing::Test {
+ protected:
+  std::vector<ManagedInstance> topology(ServerMode first, ServerMode second, ServerMode third) {
+    std::vector<ManagedInstance> members;
+    members.push_back(member("uuid-server1", first, 3000));
+    members.push_back(member("uuid-server2", second, 3001));
+    members.push_back(member("uuid-server3", third, 3002));
+    return members;
+  }
+
+  static std::vector<std::string> due(DestMetadataCacheGroup &dest, milliseconds later = milliseconds(0)) {
+    auto drains = dest.take_due_drains(std::chrono::steady_clock::now() + later);
+    std::sort(drains.begin(), drains.end());
+    return drains;
+  }
+};
+
+TEST_F(DestMetadataCacheDrainTest, DemotedPrimaryOnReadWriteRoute) {
+  DestMetadataCacheGroup dest("cache", "default", "read-write", {}, Protocol::Type::kClassicProtocol);
+  dest.on_replicaset_changed(topology(ServerMode::ReadWrite, ServerMode::ReadOnly, ServerMode::ReadOnly));
+  EXPECT_TRUE(due(dest).empty());
+
+  // switchover: the primary is still there, but read-only
+  dest.on_replicaset_changed(topology(ServerMode::ReadOnly, ServerMode::ReadWrite, ServerMode::ReadOnly));
+  EXPECT_EQ(std::vector<std::string>{"127.0.0.1:3000"}, due(dest));
+  EXPECT_TRUE(due(dest).empty());
+}
+
+TEST_F(DestMetadataCacheDrainTest, PromotedSecondaryOnReadOnlyRoute) {
+  DestMetadataCacheGroup dest("cache", "default", "read-only", {}, Protocol::Type::kClassicProtocol);
+  dest.on_replicaset_changed(topology(ServerMode::ReadWrite, ServerMode::ReadOnly, ServerMode::ReadOnly));
+  // reads still work on the new primary
+  dest.on_replicaset_changed(topology(ServerMode::ReadOnly, ServerMode::ReadWrite, ServerMode::ReadOnly));
+  EXPECT_TRUE(due(dest).empty());
+}
+
+TEST_F(DestMetadataCacheDrainTest, DepartedMembers) {
+  DestMetadataCacheGroup dest("cache", "default", "read-only", {}, Protocol::Type::kXProtocol);
+  dest.on_replicaset_changed(topology(ServerMode::ReadWrite, ServerMode::ReadOnly, ServerMode::ReadOnly));
+
+  // one member goes offline, another one leaves the group
+  std::vector<ManagedInstance> members = topology(ServerMode::ReadWrite, ServerMode::Unavailable,
+                                                  ServerMode::ReadOnly);
+  members.pop_back();
+  dest.on_replicaset_changed(members);
+  // X protocol ports
+  EXPECT_EQ((std::vector<std::string>{"127.0.0.1:30010", "127.0.0.1:30020"}), due(dest));
+}
+
+TEST_F(DestMetadataCacheDrainTest, GracePeriod) {
+  DestMetadataCacheGroup dest("cache", "default", "read-only", {}, Protocol::Type::kClassicProtocol);
+  dest.set_drain_grace_period(seconds(30));
+  dest.on_replicaset_changed(topology(ServerMode::ReadWrite, ServerMode::ReadOnly, ServerMode::ReadOnly));
+
+  dest.on_replicaset_changed(topology(ServerMode::ReadWrite, ServerMode::Unavailable, ServerMode::Unavailable));
+  EXPECT_TRUE(due(dest).empty());
+
+  // one of them comes back before the grace period ends
+  dest.on_replicaset_changed(topology(ServerMode::ReadWrite, ServerMode::ReadOnly, ServerMode::Unavailable));
+  EXPECT_EQ(std::vector<std::string>{"127.0.0.1:3002"}, due(dest, seconds(31)));
+}
+
+TEST_F(DestMetadataCacheDrainTest, FirstTopologyDrainsNothing) {
+  DestMetadataCacheGroup dest("cache", "default", "read-write", {}, Protocol::Type::kClassicProtocol);
+  dest.on_replicaset_changed(topology(ServerMode::Unavailable, ServerMode::ReadOnly, ServerMode::ReadOnly));
+  EXPECT_TRUE(due(dest).empty());
+}
+
+using DestMetadataCacheSlowStartTest = DestMetadataCacheDrainTest;
+
+TEST_F(DestMetadataCacheSlowStartTest, MemberBackOnTopologyChange) {
+  DestMetadataCacheGroup dest("cache", "default", "read-only", {}, Protocol::Type::kClassicProtocol);
+  dest.set_slow_start(seconds(30), SlowStart::Ramp::kLinear);
+  dest.on_replicaset_changed(topology(ServerMode::ReadWrite, ServerMode::ReadOnly, ServerMode::ReadOnly));
+  EXPECT_EQ(0u, dest.size_slow_start());
+
+  // a flap between two connections of clients
+  dest.on_replicaset_changed(topology(ServerMode::ReadWrite, ServerMode::Unavailable, ServerMode::ReadOnly));
+  EXPECT_EQ(0u, dest.size_slow_start());
+  dest.on_replicaset_changed(topology(ServerMode::ReadWrite, ServerMode::ReadOnly, ServerMode::ReadOnly));
+  EXPECT_EQ(1u, dest.size_slow_start());
+}
+
+TEST_F(DestMetadataCacheSlowStartTest, MemberJoinsOnTopologyChange) {
+  DestMetadataCacheGroup dest("cache", "default", "read-only", {}, Protocol::Type::kClassicProtocol);
+  dest.set_slow_start(seconds(30), SlowStart::Ramp::kLinear);
+  std::vector<ManagedInstance> members = topology(ServerMode::ReadWrite, ServerMode::ReadOnly,
+                                                  ServerMode::ReadOnly);
+  members.pop_back();
+  dest.on_replicaset_changed(members);
+  dest.on_replicaset_changed(topology(ServerMode::ReadWrite, ServerMode::ReadOnly, ServerMode::ReadOnly));
+  EXPECT_EQ(1u, dest.size_slow_start());
+}
+
+class DestMetadataCacheSpilloverTest : public ::testing::Test {
+ protected:
+  static mysqlrouter::URIQuery spillover_query() {
+    mysqlrouter::URIQuery query;
+    query["role"] = "SECONDARY";
+    query["allow_primary_reads"] = "spillover";
+    return query;
+  }
+
+  const std::vector<mysqlrouter::TCPAddress> secondaries{
+      mysqlrouter::TCPAddress("127.0.0.1", 3001), mysqlrouter::TCPAddress("127.0.0.1", 3002)};
+};
+
+TEST_F(DestMetadataCacheSpilloverTest, SaturatedByConnections) {
+  DestMetadataCacheGroup dest("cache", "default", "read-only", spillover_query(),
+                              Protocol::Type::kClassicProtocol);
+  dest.set_route_name("spillover_connections");
+  routing::SpilloverOptions options;
+  options.connections = 5;
+  dest.set_spillover(options);
+
+  int fd = 1000;
+  for (int i = 0; i < 4; ++i) {
+    dest.commit_connection(secondaries[0], fd++);
+    dest.commit_connection(secondaries[1], fd++);
+  }
+  EXPECT_FALSE(dest.update_spilling(secondaries));
+
+  // both secondaries at the threshold
+  dest.commit_connection(secondaries[0], fd++);
+  dest.commit_connection(secondaries[1], fd++);
+  EXPECT_TRUE(dest.update_spilling(secondaries));
+
+  // one below the threshold, but not below 80% of it yet
+  dest.release_server_socket(1000);
+  EXPECT_TRUE(dest.update_spilling(secondaries));
+
+  dest.release_server_socket(1002);
+  EXPECT_FALSE(dest.update_spilling(secondaries));
+
+  // back at 4 of 5: not enough to spill again
+  dest.commit_connection(secondaries[0], fd++);
+  EXPECT_FALSE(dest.update_spilling(secondaries));
+}
+
+TEST_F(DestMetadataCacheSpilloverTest, SaturatedByLatency) {
+  DestMetadataCacheGroup dest("cache", "default", "read-only", spillover_query(),
+                              Protocol::Type::kClassicProtocol);
+  dest.set_route_name("spillover_latency");
+  routing::SpilloverOptions options;
+  options.latency = milliseconds(10);
+  dest.set_spillover(options);
+
+  auto answer = [&dest](const mysqlrouter::TCPAddress &addr, uint64_t microseconds) {
+    dest.get_metrics(addr.str()).time_to_first_byte.observe(microseconds);
+  };
+  // the next update_spilling() takes a new sample
+  auto next_sample = [&dest]() {
+    for (auto &it : dest.latency_samples_) {
+      it.second.taken -= seconds(2);
+    }
+  };
+
+  answer(secondaries[0], 20000);
+  answer(secondaries[1], 5000);
+  EXPECT_FALSE(dest.update_spilling(secondaries));
+
+  next_sample();
+  answer(secondaries[1], 15000);
+  answer(secondaries[1], 25000);
+  EXPECT_TRUE(dest.update_spilling(secondaries));
+
+  // without answers since the last sample, the previous average stays
+  next_sample();
+  answer(secondaries[1], 9000);
+  EXPECT_TRUE(dest.update_spilling(secondaries));
+
+  next_sample();
+  answer(secondaries[1], 7000);
+  EXPECT_FALSE(dest.update_spilling(secondaries));
+}
+
+TEST_F(DestMetadataCacheSpilloverTest, WithoutThresholds) {
+  DestMetadataCacheGroup dest("cache", "default", "read-only", spillover_query(),
+                              Protocol::Type::kClassicProtocol);
+  dest.set_route_name("spillover_without_thresholds");
+  dest.commit_connection(secondaries[0], 1000);
+  dest.commit_connection(secondaries[1], 1001);
+  // only spilling when no secondary can take the connection
+  EXPECT_FALSE(dest.update_spilling(secondaries));
+}
@@ -0,0 +1,149 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "mysql_routing.h"
+#include "mysqlrouter/routing.h"
+
+#include "gmock/gmock.h"
+
+#ifndef _WIN32
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+static const uint16_t kRouterPort = 4655;
+// nothing listens here, so routed clients get error 2003
+static const uint16_t kClosedPort = 4656;
+static const rlim_t kOpenFilesLimit = 256;
+
+static int connect_to_router() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kRouterPort);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), static_cast<socklen_t>(sizeof(addr))) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// returns the error code of the error packet sent by the router, or -1
+static int read_error_code(int fd) {
+  struct pollfd fds[1];
+  fds[0].fd = fd;
+  fds[0].events = POLLIN;
+  if (poll(fds, 1, 5000) <= 0) {
+    return -1;
+  }
+  uint8_t buffer[64];
+  ssize_t size = read(fd, buffer, sizeof(buffer));
+  // header (4 bytes), 0xff, error code (2 bytes)
+  if (size < 7 || buffer[4] != 0xff) {
+    return -1;
+  }
+  return buffer[5] | (buffer[6] << 8);
+}
+
+static int connect_and_read_error() {
+  int fd = -1;
+  for (int i = 0; i < 100 && fd < 0; ++i) {
+    // the router might not be listening yet
+    if ((fd = connect_to_router()) < 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+  }
+  if (fd < 0) {
+    return -1;
+  }
+  int code = read_error_code(fd);
+  close(fd);
+  return code;
+}
+
+TEST(FdExhaustionTest, RejectsClientsWhenOutOfDescriptors) {
+  struct rlimit saved_limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &saved_limit));
+  if (saved_limit.rlim_cur != RLIM_INFINITY && saved_limit.rlim_cur < kOpenFilesLimit) {
+    std::cout << "[ SKIPPED  ] open files limit already below " << kOpenFilesLimit << std::endl;
+    return;
+  }
+
+  MySQLRouting routing(routing::AccessMode::kReadWrite, kRouterPort,
+                       Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+                       "routing:fd_exhaustion", 10,
+                       std::chrono::seconds(1), 100, std::chrono::seconds(1));
+  routing.set_destinations_from_csv("127.0.0.1:" + std::to_string(kClosedPort));
+  std::thread router_thread(&MySQLRouting::start, &routing);
+
+  // a route works as usual
+  EXPECT_EQ(2003, connect_and_read_error());
+  EXPECT_EQ(0u, routing.get_refused_accepts());
+
+  // use up all descriptors but one, which the client takes
+  struct rlimit limit = saved_limit;
+  limit.rlim_cur = kOpenFilesLimit;
+  ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+  std::vector<int> fillers;
+  int fd;
+  while ((fd = open("/dev/null", O_RDONLY)) >= 0) {
+    fillers.push_back(fd);
+  }
+  ASSERT_FALSE(fillers.empty());
+  close(fillers.back());
+  fillers.pop_back();
+
+  int client = connect_to_router();
+  EXPECT_GE(client, 0);
+  if (client >= 0) {
+    // the router can not accept() the client, but gets it out of the
+    // backlog with its spare descriptor
+    EXPECT_EQ(1040, read_error_code(client));
+    close(client);
+  }
+  EXPECT_GE(routing.get_refused_accepts(), 1u);
+  EXPECT_EQ(1u, routing.get_rejected_on_exhaustion());
+
+  for (int filler : fillers) {
+    close(filler);
+  }
+  EXPECT_EQ(0, setrlimit(RLIMIT_NOFILE, &saved_limit));
+
+  // once descriptors are back, clients are routed again
+  EXPECT_EQ(2003, connect_and_read_error());
+  EXPECT_EQ(1u, routing.get_rejected_on_exhaustion());
+
+  routing.stop();
+  router_thread.join();
+}
+
+#endif // _WIN32
@@ -58,41 +58,41 @@ TEST_F(FirstAvailableTest, TypicalFailoverSequence) {
   int dummy;
 
   // talk to 1st server
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 41);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 41);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 41);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 41);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 41);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 41);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 41);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 41);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 41);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 41);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 5); // 5 good connections
 
   // fail 1st server -> failover to 2nd
   sock_ops_->get_mysql_socket_fail(1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 42);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 42);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 2); // 1 failed + 1 good conn
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 42);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 42);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 42);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 42);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 42);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 42);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 42);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 42);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 4); // 4 more good conns
 
   // fail 2nd server -> failover to 3rd
   sock_ops_->get_mysql_socket_fail(1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 2); // 1 failed + 1 good conn
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 4); // 4 more good conns
 
   // fail 3rd server -> no more servers
   sock_ops_->get_mysql_socket_fail(1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 1); // 1 failed, no more servers
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 0); // no more servers
 }
 
@@ -101,32 +101,32 @@ TEST_F(FirstAvailableTest, StartWith1stDown) {
 
   // fail 1st server -> failover to 2nd
   sock_ops_->get_mysql_socket_fail(1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 42);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 42);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 2); // 1 failed + 1 good conn
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 42);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 42);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 42);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 42);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 42);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 42);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 42);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 42);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 4); // 4 more good conns
 
   // fail 2nd server -> failover to 3rd
   sock_ops_->get_mysql_socket_fail(1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 2); // 1 failed + 1 good conn
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 4); // 4 more good conns
 
   // fail 3rd server -> no more servers
   sock_ops_->get_mysql_socket_fail(1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 1); // 1 failed, no more servers
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 0); // no more servers
 }
 
@@ -135,22 +135,22 @@ TEST_F(FirstAvailableTest, StartWith2ndDown) {
 
   // fail 1st and 2nd server -> failover to 3rd
   sock_ops_->get_mysql_socket_fail(2);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 3); // 2 failed + 1 good conn
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), 43);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 4); // 4 more good conns
 
   // fail 3rd server -> no more servers
   sock_ops_->get_mysql_socket_fail(1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 1); // 1 failed, no more servers
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 0); // no more servers
 }
 
@@ -159,11 +159,11 @@ TEST_F(FirstAvailableTest, StartWithAllDown) {
 
   // fail 1st, 2nd and 3rd server -> no more servers
   sock_ops_->get_mysql_socket_fail(3);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 3); // 3 failed, no more servers
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
-  ASSERT_EQ(dest().get_server_socket(0, &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
+  ASSERT_EQ(dest().get_server_socket(std::chrono::milliseconds::zero(), &dummy), -1);
   ASSERT_EQ(sock_ops_->get_mysql_socket_call_cnt(), 0); // no more servers
 }
@@ -0,0 +1,95 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "latency_tracker.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+
+using mysql_harness::metrics::Histogram;
+using std::chrono::microseconds;
+
+class LatencyTrackerTest : public ::testing::Test {
+ protected:
+  LatencyTrackerTest()
+      : time_to_first_byte({100, 1000, 10000}), turnaround({100, 1000, 10000}),
+        tracker(time_to_first_byte, turnaround),
+        start(LatencyTracker::clock::now()) {}
+
+  Histogram time_to_first_byte;
+  Histogram turnaround;
+  LatencyTracker tracker;
+  LatencyTracker::clock::time_point start;
+};
+
+TEST_F(LatencyTrackerTest, CommandWithAnswerInPieces) {
+  tracker.on_client_data(start, true);
+  tracker.on_server_data(start + microseconds(50));
+  tracker.on_server_data(start + microseconds(300));
+  tracker.on_server_data(start + microseconds(700));
+  // not recorded until the next command starts
+  EXPECT_EQ(0u, turnaround.snapshot().count);
+
+  tracker.on_client_data(start + microseconds(5000), true);
+  Histogram::Snapshot ttfb = time_to_first_byte.snapshot();
+  EXPECT_EQ(1u, ttfb.count);
+  EXPECT_EQ(50u, ttfb.sum);
+  Histogram::Snapshot total = turnaround.snapshot();
+  EXPECT_EQ(1u, total.count);
+  EXPECT_EQ(700u, total.sum);
+
+  tracker.on_server_data(start + microseconds(5200));
+  tracker.finish();
+  EXPECT_EQ(250u, time_to_first_byte.snapshot().sum);
+  EXPECT_EQ(2u, turnaround.snapshot().count);
+  EXPECT_EQ(900u, turnaround.snapshot().sum);
+}
+
+TEST_F(LatencyTrackerTest, LargeCommandBelongsToOpenCommand) {
+  tracker.on_client_data(start, true);
+  // rest of the command, even if it looks like the start of one
+  tracker.on_client_data(start + microseconds(400), true);
+  tracker.on_server_data(start + microseconds(500));
+  tracker.finish();
+
+  EXPECT_EQ(500u, time_to_first_byte.snapshot().sum);
+  EXPECT_EQ(1u, turnaround.snapshot().count);
+  EXPECT_EQ(500u, turnaround.snapshot().sum);
+}
+
+TEST_F(LatencyTrackerTest, IgnoresDataNotStartingCommand) {
+  tracker.on_client_data(start, true);
+  tracker.on_server_data(start + microseconds(100));
+  // like a file sent for LOAD DATA LOCAL INFILE
+  tracker.on_client_data(start + microseconds(200), false);
+  tracker.on_server_data(start + microseconds(1000));
+  tracker.finish();
+
+  EXPECT_EQ(1u, turnaround.snapshot().count);
+  EXPECT_EQ(1000u, turnaround.snapshot().sum);
+}
+
+TEST_F(LatencyTrackerTest, UnansweredCommandNotRecorded) {
+  // server data without a command, like the greeting
+  tracker.on_server_data(start);
+  tracker.on_client_data(start + microseconds(100), true);
+  tracker.finish();
+
+  EXPECT_EQ(0u, time_to_first_byte.snapshot().count);
+  EXPECT_EQ(0u, turnaround.snapshot().count);
+}
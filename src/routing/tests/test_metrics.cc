@@ -0,0 +1,114 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "metrics.h"
+#include "mysql_routing.h"
+#include "mysqlrouter/routing.h"
+
+#include "gmock/gmock.h"
+
+#ifndef _WIN32
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+using mysql_harness::metrics::Labels;
+using mysql_harness::metrics::MetricsRegistry;
+
+static const uint16_t kRouterPort = 4657;
+// nothing listens here, so routed clients get error 2003
+static const uint16_t kClosedPort = 4658;
+static const char *kRouteName = "routing:metrics";
+
+static int connect_to_router() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kRouterPort);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), static_cast<socklen_t>(sizeof(addr))) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// connects to the router and reads until it closes the connection
+static bool connect_and_wait_close() {
+  int fd = -1;
+  for (int i = 0; i < 100 && fd < 0; ++i) {
+    // the router might not be listening yet
+    if ((fd = connect_to_router()) < 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+  }
+  if (fd < 0) {
+    return false;
+  }
+  char buf[256];
+  while (read(fd, buf, sizeof(buf)) > 0) {}
+  close(fd);
+  return true;
+}
+
+static int64_t metric_value(const std::string &name, const Labels &labels) {
+  for (const auto &sample : MetricsRegistry::instance().collect()) {
+    if (sample.name == name && sample.labels == labels) {
+      return sample.value;
+    }
+  }
+  return -1;
+}
+
+TEST(RoutingMetricsTest, NoDestination) {
+  MySQLRouting routing(routing::AccessMode::kReadOnly, kRouterPort,
+                       Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+                       kRouteName, 10,
+                       std::chrono::seconds(1), 100, std::chrono::seconds(1));
+  std::string destination = "127.0.0.1:" + std::to_string(kClosedPort);
+  routing.set_destinations_from_csv(destination);
+  std::thread router_thread(&MySQLRouting::start, &routing);
+
+  EXPECT_TRUE(connect_and_wait_close());
+
+  EXPECT_EQ(1, metric_value("routing_accepted_total", {{"route", kRouteName}}));
+  EXPECT_EQ(1, metric_value("routing_rejected_total",
+                            {{"route", kRouteName}, {"reason", "no_destination"}}));
+  EXPECT_EQ(0, metric_value("routing_rejected_total",
+                            {{"route", kRouteName}, {"reason", "max_connections"}}));
+  EXPECT_EQ(0, metric_value("routing_active_connections", {{"route", kRouteName}}));
+
+  Labels destination_labels{{"route", kRouteName}, {"destination", destination}};
+  EXPECT_EQ(1, metric_value("routing_backend_connect_attempts_total", destination_labels));
+  EXPECT_EQ(1, metric_value("routing_backend_connect_failures_total", destination_labels));
+  EXPECT_EQ(1, metric_value("routing_quarantine_total", destination_labels));
+
+  routing.stop();
+  router_thread.join();
+}
+
+#endif // _WIN32
@@ -0,0 +1,380 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "read_write_splitter.h"
+#include "mysqlrouter/mysql_protocol.h"
+#include "mysqlrouter/routing.h"
+
+#include "gtest/gtest.h"
+
+#ifndef _WIN32
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using Bytes = std::vector<uint8_t>;
+
+static Bytes make_packet(uint8_t seq, const Bytes &payload) {
+  Bytes packet{static_cast<uint8_t>(payload.size()), static_cast<uint8_t>(payload.size() >> 8),
+               static_cast<uint8_t>(payload.size() >> 16), seq};
+  packet.insert(packet.end(), payload.begin(), payload.end());
+  return packet;
+}
+
+static Bytes make_query(const std::string &statement) {
+  Bytes payload{0x03};
+  payload.insert(payload.end(), statement.begin(), statement.end());
+  return make_packet(0, payload);
+}
+
+static Bytes make_ok(uint8_t seq, uint16_t status) {
+  return make_packet(seq, {0x00, 0x00, 0x00, static_cast<uint8_t>(status),
+                           static_cast<uint8_t>(status >> 8), 0x00, 0x00});
+}
+
+// a result set with one column and one row
+static Bytes make_result_set(uint16_t status) {
+  Bytes result = make_packet(1, {0x01});
+  auto add = [&result](const Bytes &packet) { result.insert(result.end(), packet.begin(), packet.end()); };
+  add(make_packet(2, {0x03, 'd', 'e', 'f', 0x00, 0x00, 0x00, 0x01, 'a', 0x00, 0x0c, 0x3f, 0x00,
+                      0x0b, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00}));
+  add(make_packet(3, {0xfe, 0x00, 0x00, static_cast<uint8_t>(status), 0x00}));
+  add(make_packet(4, {0x01, '1'}));
+  add(make_packet(5, {0xfe, 0x00, 0x00, static_cast<uint8_t>(status), 0x00}));
+  return result;
+}
+
+static Bytes make_greeting() {
+  Bytes payload{
+      0x0a, '8', '.', '0', '.', '1', '1', 0x00,  // protocol version, server version
+      0x05, 0x00, 0x00, 0x00,  // connection id
+      'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 0x00,  // salt, first part
+      0xff, 0xf7, 0x21, 0x02, 0x00, 0xff, 0x81, 0x15,  // capabilities, character set, status
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // reserved
+      'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 0x00,  // salt, second part
+      'm', 'y', 's', 'q', 'l', '_', 'n', 'a', 't', 'i', 'v', 'e', '_',
+      'p', 'a', 's', 's', 'w', 'o', 'r', 'd', 0x00,
+  };
+  return make_packet(0, payload);
+}
+
+class ReadWriteSplitterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    make_pair(&client_, &client_peer_);
+    make_pair(&primary_, &primary_peer_);
+    make_pair(&secondary_, &secondary_peer_);
+    connects_ = 0;
+  }
+
+  void TearDown() override {
+    for (int fd : {client_, client_peer_, primary_, primary_peer_, secondary_}) {
+      ::close(fd);
+    }
+    if (connects_ == 0) {
+      ::close(secondary_peer_);
+    }
+  }
+
+  static void make_pair(int *ours, int *splitters) {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    // a broken test fails instead of hanging
+    struct timeval timeout{5, 0};
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    *ours = fds[0];
+    *splitters = fds[1];
+  }
+
+  static void send_bytes(int fd, const Bytes &data) {
+    ASSERT_EQ(static_cast<ssize_t>(data.size()), ::send(fd, data.data(), data.size(), 0));
+  }
+
+  static Bytes receive_packet(int fd) {
+    Bytes packet(4);
+    if (::recv(fd, packet.data(), 4, MSG_WAITALL) != 4) {
+      return Bytes();
+    }
+    size_t size = packet[0] | (packet[1] << 8) | (packet[2] << 16);
+    packet.resize(4 + size);
+    if (size > 0 && ::recv(fd, packet.data() + 4, size, MSG_WAITALL) != static_cast<ssize_t>(size)) {
+      return Bytes();
+    }
+    return packet;
+  }
+
+  static Bytes receive_bytes(int fd, size_t size) {
+    Bytes data(size);
+    ssize_t res = ::recv(fd, data.data(), size, MSG_WAITALL);
+    data.resize(res > 0 ? static_cast<size_t>(res) : 0);
+    return data;
+  }
+
+  static Bytes client_handshake(uint32_t capabilities) {
+    mysql_protocol::HandshakeResponsePacket packet(1, Bytes(20, 0x01), "app", "", "db1", 8,
+                                                   "mysql_native_password", capabilities);
+    return Bytes(packet.begin(), packet.end());
+  }
+
+  // with a shared account, unless the user is empty
+  ReadWriteSplitter *make_splitter(const std::string &user = "router") {
+    return new ReadWriteSplitter(routing::SocketOperations::instance(), client_peer_, primary_peer_,
+        [this]() {
+          ++connects_;
+          return connects_ == 1 ? secondary_peer_ : -1;
+        },
+        [](int) {}, user, user.empty() ? "" : "secret", std::chrono::milliseconds(5000), "test");
+  }
+
+  static const uint32_t kCapabilities = mysql_protocol::kClientProtocol41 |
+      mysql_protocol::kClientSecureConnection | mysql_protocol::kClientPluginAuth |
+      mysql_protocol::kClientConnectWithDb;
+
+  int client_, client_peer_;
+  int primary_, primary_peer_;
+  int secondary_, secondary_peer_;
+  int connects_;
+};
+
+TEST_F(ReadWriteSplitterTest, RefusesSslAndCompression) {
+  std::unique_ptr<ReadWriteSplitter> splitter(make_splitter());
+  Bytes handshake = client_handshake(kCapabilities | mysql_protocol::kClientSSL);
+  EXPECT_FALSE(splitter->set_client_handshake(handshake.data(), handshake.size()));
+  handshake = client_handshake(kCapabilities | 0x20);
+  EXPECT_FALSE(splitter->set_client_handshake(handshake.data(), handshake.size()));
+  handshake = client_handshake(kCapabilities);
+  EXPECT_TRUE(splitter->set_client_handshake(handshake.data(), handshake.size()));
+}
+
+TEST_F(ReadWriteSplitterTest, ReadsGoToSecondary) {
+  std::unique_ptr<ReadWriteSplitter> splitter(make_splitter());
+  Bytes handshake = client_handshake(kCapabilities);
+  ASSERT_TRUE(splitter->set_client_handshake(handshake.data(), handshake.size()));
+  RouteMetrics metrics("rw_split_test");
+  splitter->set_accounting(nullptr, &metrics);
+
+  std::string result = "not run";
+  std::thread thread([&]() { result = splitter->run(true); });
+
+  // a write goes to the primary
+  send_bytes(client_, make_query("INSERT INTO t VALUES (1)"));
+  EXPECT_EQ(make_query("INSERT INTO t VALUES (1)"), receive_packet(primary_));
+  send_bytes(primary_, make_ok(1, 0x0002));
+  EXPECT_EQ(make_ok(1, 0x0002), receive_packet(client_));
+
+  // session state is changed on the primary
+  send_bytes(client_, make_query("SET @a = 1"));
+  EXPECT_EQ(make_query("SET @a = 1"), receive_packet(primary_));
+  send_bytes(primary_, make_ok(1, 0x0002));
+  EXPECT_EQ(make_ok(1, 0x0002), receive_packet(client_));
+
+  // the first read connects the secondary, with the schema of the client
+  send_bytes(secondary_, make_greeting());
+  send_bytes(client_, make_query("SELECT 1"));
+  Bytes response = receive_packet(secondary_);
+  ASSERT_GT(response.size(), 36u + 7u);
+  std::string rest(response.begin() + 36, response.end());
+  EXPECT_EQ(0, rest.compare(0, 7, std::string("router\0", 7)));
+  EXPECT_NE(std::string::npos, rest.find(std::string("db1\0", 4)));
+  send_bytes(secondary_, make_ok(2, 0x0002));
+
+  // the session is replayed before the read
+  EXPECT_EQ(make_query("SET @a = 1"), receive_packet(secondary_));
+  send_bytes(secondary_, make_ok(1, 0x0002));
+  EXPECT_EQ(make_query("SELECT 1"), receive_packet(secondary_));
+  send_bytes(secondary_, make_result_set(0x0002));
+  EXPECT_EQ(make_result_set(0x0002), receive_bytes(client_, make_result_set(0x0002).size()));
+
+  // transactions stay on the primary, even for reads
+  send_bytes(client_, make_query("BEGIN"));
+  EXPECT_EQ(make_query("BEGIN"), receive_packet(primary_));
+  send_bytes(primary_, make_ok(1, 0x0003));
+  EXPECT_EQ(make_ok(1, 0x0003), receive_packet(client_));
+  send_bytes(client_, make_query("SELECT 1"));
+  EXPECT_EQ(make_query("SELECT 1"), receive_packet(primary_));
+  send_bytes(primary_, make_result_set(0x0003));
+  EXPECT_EQ(make_result_set(0x0003), receive_bytes(client_, make_result_set(0x0003).size()));
+
+  // COM_QUIT ends the session
+  Bytes quit = make_packet(0, {0x01});
+  send_bytes(client_, quit);
+  EXPECT_EQ(quit, receive_packet(primary_));
+  thread.join();
+  EXPECT_EQ("", result);
+  EXPECT_EQ(1, connects_);
+  EXPECT_EQ(4u, metrics.statements_to_primary.value());
+  EXPECT_EQ(1u, metrics.statements_to_secondary.value());
+  // the secondary was told to quit
+  EXPECT_EQ(quit, receive_packet(secondary_));
+}
+
+TEST_F(ReadWriteSplitterTest, ClientPasswordOnSecondary) {
+  std::unique_ptr<ReadWriteSplitter> splitter(make_splitter(""));
+  Bytes handshake = client_handshake(kCapabilities);
+  ASSERT_TRUE(splitter->set_client_handshake(handshake.data(), handshake.size()));
+  // the full authentication of caching_sha2_password, sent before the splitter took over
+  Bytes full_auth = make_packet(2, {0x01, 0x04});
+  splitter->set_server_auth_data(full_auth.data(), full_auth.size());
+
+  std::string result = "not run";
+  std::thread thread([&]() { result = splitter->run(false); });
+
+  // the client sends its password in clear text, as over the Unix socket of the route
+  Bytes password = make_packet(3, {'s', 'e', 'c', 'r', 'e', 't', 0x00});
+  send_bytes(client_, password);
+  EXPECT_EQ(password, receive_packet(primary_));
+  send_bytes(primary_, make_ok(4, 0x0002));
+  EXPECT_EQ(make_ok(4, 0x0002), receive_packet(client_));
+
+  // the secondary gets the account and password of the client
+  send_bytes(secondary_, make_greeting());
+  send_bytes(client_, make_query("SELECT 1"));
+  Bytes response = receive_packet(secondary_);
+  ASSERT_GT(response.size(), 36u + 4u + 21u);
+  EXPECT_EQ(std::string("app\0", 4), std::string(response.begin() + 36, response.begin() + 40));
+  std::string salt = "abcdefghijklmnopqrst";
+  Bytes salt_bytes(salt.begin(), salt.end());
+  Bytes scramble = mysql_protocol::HandshakeResponsePacket::scramble_native_password(salt_bytes, "secret");
+  EXPECT_EQ(20, response[40]);
+  EXPECT_EQ(scramble, Bytes(response.begin() + 41, response.begin() + 61));
+
+  // caching_sha2_password, first fast, then full through the Unix socket
+  Bytes auth_switch{0xfe};
+  std::string plugin("caching_sha2_password");
+  auth_switch.insert(auth_switch.end(), plugin.begin(), plugin.end());
+  auth_switch.push_back(0);
+  auth_switch.insert(auth_switch.end(), salt.begin(), salt.end());
+  auth_switch.push_back(0);
+  send_bytes(secondary_, make_packet(2, auth_switch));
+  EXPECT_EQ(make_packet(3, mysql_protocol::HandshakeResponsePacket::scramble_caching_sha2_password(
+                               salt_bytes, "secret")),
+            receive_packet(secondary_));
+  send_bytes(secondary_, make_packet(4, {0x01, 0x04}));
+  EXPECT_EQ(make_packet(5, {'s', 'e', 'c', 'r', 'e', 't', 0x00}), receive_packet(secondary_));
+  send_bytes(secondary_, make_ok(6, 0x0002));
+
+  EXPECT_EQ(make_query("SELECT 1"), receive_packet(secondary_));
+  send_bytes(secondary_, make_result_set(0x0002));
+  EXPECT_EQ(make_result_set(0x0002), receive_bytes(client_, make_result_set(0x0002).size()));
+
+  ::shutdown(client_, SHUT_WR);
+  thread.join();
+  EXPECT_EQ("", result);
+  EXPECT_EQ(1, connects_);
+}
+
+TEST_F(ReadWriteSplitterTest, UnknownClientPasswordStaysOnPrimary) {
+  std::unique_ptr<ReadWriteSplitter> splitter(make_splitter(""));
+  Bytes handshake = client_handshake(kCapabilities);
+  ASSERT_TRUE(splitter->set_client_handshake(handshake.data(), handshake.size()));
+
+  // authenticated with mysql_native_password; the password was never sent
+  std::string result = "not run";
+  std::thread thread([&]() { result = splitter->run(true); });
+
+  send_bytes(client_, make_query("SELECT 1"));
+  EXPECT_EQ(make_query("SELECT 1"), receive_packet(primary_));
+
+  ::shutdown(client_, SHUT_WR);
+  thread.join();
+  EXPECT_EQ(0, connects_);
+}
+
+TEST_F(ReadWriteSplitterTest, UnknownCommandPinsToPrimary) {
+  std::unique_ptr<ReadWriteSplitter> splitter(make_splitter());
+  Bytes handshake = client_handshake(kCapabilities);
+  ASSERT_TRUE(splitter->set_client_handshake(handshake.data(), handshake.size()));
+
+  std::string result = "not run";
+  std::thread thread([&]() { result = splitter->run(true); });
+
+  // COM_STMT_PREPARE
+  Bytes prepare = make_packet(0, {0x16, 'S', 'E', 'L', 'E', 'C', 'T', ' ', '1'});
+  send_bytes(client_, prepare);
+  EXPECT_EQ(prepare, receive_packet(primary_));
+  // from now on, everything is copied
+  send_bytes(client_, make_query("SELECT 1"));
+  EXPECT_EQ(make_query("SELECT 1"), receive_packet(primary_));
+
+  ::shutdown(client_, SHUT_WR);
+  thread.join();
+  EXPECT_EQ(0, connects_);
+}
+
+TEST_F(ReadWriteSplitterTest, TemporaryTablePinsToPrimary) {
+  std::unique_ptr<ReadWriteSplitter> splitter(make_splitter());
+  Bytes handshake = client_handshake(kCapabilities);
+  ASSERT_TRUE(splitter->set_client_handshake(handshake.data(), handshake.size()));
+
+  std::string result = "not run";
+  std::thread thread([&]() { result = splitter->run(true); });
+
+  send_bytes(client_, make_query("CREATE TEMPORARY TABLE t1 (a INT)"));
+  EXPECT_EQ(make_query("CREATE TEMPORARY TABLE t1 (a INT)"), receive_packet(primary_));
+  send_bytes(primary_, make_ok(1, 0x0002));
+  EXPECT_EQ(make_ok(1, 0x0002), receive_packet(client_));
+  // reads of the temporary table stay on the primary
+  send_bytes(client_, make_query("SELECT * FROM t1"));
+  EXPECT_EQ(make_query("SELECT * FROM t1"), receive_packet(primary_));
+
+  ::shutdown(client_, SHUT_WR);
+  thread.join();
+  EXPECT_EQ(0, connects_);
+}
+
+TEST_F(ReadWriteSplitterTest, RefusedReplayKeepsReadsOnPrimary) {
+  std::unique_ptr<ReadWriteSplitter> splitter(make_splitter());
+  Bytes handshake = client_handshake(kCapabilities);
+  ASSERT_TRUE(splitter->set_client_handshake(handshake.data(), handshake.size()));
+
+  std::string result = "not run";
+  std::thread thread([&]() { result = splitter->run(true); });
+
+  send_bytes(client_, make_query("SET sql_mode = 'NO_SUCH_MODE'"));
+  EXPECT_EQ(make_query("SET sql_mode = 'NO_SUCH_MODE'"), receive_packet(primary_));
+  send_bytes(primary_, make_ok(1, 0x0002));
+  EXPECT_EQ(make_ok(1, 0x0002), receive_packet(client_));
+
+  // the secondary refuses the replayed statement; the primary answers the read
+  send_bytes(secondary_, make_greeting());
+  send_bytes(client_, make_query("SELECT 1"));
+  ASSERT_GT(receive_packet(secondary_).size(), 36u);
+  send_bytes(secondary_, make_ok(2, 0x0002));
+  EXPECT_EQ(make_query("SET sql_mode = 'NO_SUCH_MODE'"), receive_packet(secondary_));
+  send_bytes(secondary_, make_packet(1, {0xff, 0x31, 0x04, '#', '4', '2', '0', '0', '0', 'n', 'o'}));
+  EXPECT_EQ(make_query("SELECT 1"), receive_packet(primary_));
+  send_bytes(primary_, make_result_set(0x0002));
+  EXPECT_EQ(make_result_set(0x0002), receive_bytes(client_, make_result_set(0x0002).size()));
+
+  // without connecting and replaying again
+  send_bytes(client_, make_query("SELECT 2"));
+  EXPECT_EQ(make_query("SELECT 2"), receive_packet(primary_));
+  send_bytes(primary_, make_result_set(0x0002));
+  EXPECT_EQ(make_result_set(0x0002), receive_bytes(client_, make_result_set(0x0002).size()));
+
+  ::shutdown(client_, SHUT_WR);
+  thread.join();
+  EXPECT_EQ("", result);
+  EXPECT_EQ(1, connects_);
+}
+
+#endif // _WIN32
@@ -0,0 +1,164 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "response_tracker.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <vector>
+
+using Bytes = std::vector<uint8_t>;
+
+static void add_packet(Bytes *stream, uint8_t seq, const Bytes &payload) {
+  stream->push_back(static_cast<uint8_t>(payload.size()));
+  stream->push_back(static_cast<uint8_t>(payload.size() >> 8));
+  stream->push_back(static_cast<uint8_t>(payload.size() >> 16));
+  stream->push_back(seq);
+  stream->insert(stream->end(), payload.begin(), payload.end());
+}
+
+// OK packet: no affected rows, no insert id, status flags, no warnings
+static Bytes ok_payload(uint16_t status) {
+  return {0x00, 0x00, 0x00, static_cast<uint8_t>(status), static_cast<uint8_t>(status >> 8), 0x00, 0x00};
+}
+
+static Bytes eof_payload(uint16_t status) {
+  return {0xfe, 0x00, 0x00, static_cast<uint8_t>(status), static_cast<uint8_t>(status >> 8)};
+}
+
+static Bytes column_payload() {
+  return {0x03, 'd', 'e', 'f', 0x00, 0x00, 0x00, 0x01, 'a', 0x00, 0x0c, 0x3f, 0x00,
+          0x0b, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00};
+}
+
+class ClassicResponseTrackerTest : public ::testing::Test {
+};
+
+TEST_F(ClassicResponseTrackerTest, Ok) {
+  ClassicResponseTracker tracker(false);
+  EXPECT_TRUE(tracker.is_done());
+  tracker.start();
+  EXPECT_FALSE(tracker.is_done());
+
+  Bytes stream;
+  add_packet(&stream, 1, ok_payload(0x0003));
+  EXPECT_EQ(stream.size(), tracker.feed(stream.data(), stream.size()));
+  EXPECT_TRUE(tracker.is_done());
+  EXPECT_FALSE(tracker.is_error());
+  EXPECT_EQ(0x0003, tracker.get_status_flags());
+}
+
+TEST_F(ClassicResponseTrackerTest, Error) {
+  ClassicResponseTracker tracker(false);
+  tracker.start();
+
+  Bytes stream;
+  add_packet(&stream, 1, {0xff, 0x48, 0x04, '#', '4', '2', '0', '0', '0', 'o', 'o', 'p', 's'});
+  tracker.feed(stream.data(), stream.size());
+  EXPECT_TRUE(tracker.is_done());
+  EXPECT_TRUE(tracker.is_error());
+}
+
+TEST_F(ClassicResponseTrackerTest, ResultSetByteByByte) {
+  ClassicResponseTracker tracker(false);
+  tracker.start();
+
+  Bytes stream;
+  add_packet(&stream, 1, {0x01});
+  add_packet(&stream, 2, column_payload());
+  add_packet(&stream, 3, eof_payload(0x0002));
+  add_packet(&stream, 4, {0x01, '1'});
+  add_packet(&stream, 5, eof_payload(0x0022));
+  for (size_t i = 0; i < stream.size(); ++i) {
+    EXPECT_FALSE(tracker.is_done()) << i;
+    EXPECT_EQ(1u, tracker.feed(&stream[i], 1));
+  }
+  EXPECT_TRUE(tracker.is_done());
+  EXPECT_EQ(0x0022, tracker.get_status_flags());
+}
+
+TEST_F(ClassicResponseTrackerTest, ResultSetDeprecateEof) {
+  ClassicResponseTracker tracker(true);
+  tracker.start();
+
+  Bytes stream;
+  add_packet(&stream, 1, {0x01});
+  add_packet(&stream, 2, column_payload());
+  add_packet(&stream, 3, {0x01, '1'});
+  Bytes end{0xfe, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00};
+  add_packet(&stream, 4, end);
+  tracker.feed(stream.data(), stream.size());
+  EXPECT_TRUE(tracker.is_done());
+  EXPECT_EQ(0x0003, tracker.get_status_flags());
+}
+
+TEST_F(ClassicResponseTrackerTest, MultipleResults) {
+  ClassicResponseTracker tracker(false);
+  tracker.start();
+
+  Bytes stream;
+  add_packet(&stream, 1, ok_payload(0x0002 | 0x0008));
+  tracker.feed(stream.data(), stream.size());
+  EXPECT_FALSE(tracker.is_done());
+
+  stream.clear();
+  add_packet(&stream, 2, ok_payload(0x0002));
+  // data after the response is not taken
+  stream.push_back(0x55);
+  EXPECT_EQ(stream.size() - 1, tracker.feed(stream.data(), stream.size()));
+  EXPECT_TRUE(tracker.is_done());
+}
+
+TEST_F(ClassicResponseTrackerTest, LocalInfile) {
+  ClassicResponseTracker tracker(false);
+  tracker.start();
+
+  Bytes stream;
+  add_packet(&stream, 1, {0xfb, 'f', 'i', 'l', 'e'});
+  tracker.feed(stream.data(), stream.size());
+  EXPECT_TRUE(tracker.is_local_infile());
+  EXPECT_FALSE(tracker.is_done());
+}
+
+TEST_F(ClassicResponseTrackerTest, LargeRow) {
+  ClassicResponseTracker tracker(false);
+  tracker.start();
+
+  Bytes stream;
+  add_packet(&stream, 1, {0x01});
+  add_packet(&stream, 2, column_payload());
+  add_packet(&stream, 3, eof_payload(0x0002));
+  tracker.feed(stream.data(), stream.size());
+
+  // a row of 16M-1 bytes starting with 0xfe, continued by an empty packet
+  Bytes header{0xff, 0xff, 0xff, 4, 0xfe};
+  tracker.feed(header.data(), header.size());
+  Bytes chunk(65536, 'x');
+  size_t left = 0xffffff - 1;
+  while (left > 0) {
+    size_t n = std::min(left, chunk.size());
+    tracker.feed(chunk.data(), n);
+    left -= n;
+  }
+  EXPECT_FALSE(tracker.is_done());
+  stream.clear();
+  add_packet(&stream, 5, {});
+  add_packet(&stream, 6, eof_payload(0x0002));
+  tracker.feed(stream.data(), stream.size());
+  EXPECT_TRUE(tracker.is_done());
+}
@@ -30,6 +30,8 @@
 #  include <winsock2.h>
 #  include <ws2tcpip.h>
 #else
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
 #  include <sys/un.h>
 #  include <sys/socket.h>
 #  ifdef __sun
@@ -80,14 +82,33 @@ TEST_F(RoutingTests, GetAccessLiteralName) {
   ASSERT_THAT(get_access_mode_name(AccessMode::kReadOnly), StrEq("read-only"));
 }
 
+TEST_F(RoutingTests, ParseAffinityKey) {
+  routing::AffinityOptions options;
+  routing::parse_affinity_key("user", &options);
+  ASSERT_THAT(options.key, Eq(routing::AffinityKey::kUser));
+  ASSERT_TRUE(options.needs_handshake());
+  routing::parse_affinity_key("connect_attribute:program_name", &options);
+  ASSERT_THAT(options.key, Eq(routing::AffinityKey::kConnectAttribute));
+  ASSERT_THAT(options.connect_attribute, StrEq("program_name"));
+  routing::parse_affinity_key("client_address", &options);
+  ASSERT_THAT(options.key, Eq(routing::AffinityKey::kClientAddress));
+  ASSERT_FALSE(options.needs_handshake());
+  ASSERT_TRUE(options.connect_attribute.empty());
+  routing::parse_affinity_key("", &options);
+  ASSERT_THAT(options.key, Eq(routing::AffinityKey::kNone));
+
+  ASSERT_THROW(routing::parse_affinity_key("connect_attribute:", &options), std::invalid_argument);
+  ASSERT_THROW(routing::parse_affinity_key("host", &options), std::invalid_argument);
+}
+
 TEST_F(RoutingTests, Defaults) {
   ASSERT_EQ(routing::kDefaultWaitTimeout, 0);
   ASSERT_EQ(routing::kDefaultMaxConnections, 512);
-  ASSERT_EQ(routing::kDefaultDestinationConnectionTimeout, 1);
+  ASSERT_EQ(routing::kDefaultDestinationConnectionTimeout, std::chrono::seconds(1));
   ASSERT_EQ(routing::kDefaultBindAddress, "127.0.0.1");
   ASSERT_EQ(routing::kDefaultNetBufferLength, 16384U);
   ASSERT_EQ(routing::kDefaultMaxConnectErrors, 100ULL);
-  ASSERT_EQ(routing::kDefaultClientConnectTimeout, 9UL);
+  ASSERT_EQ(routing::kDefaultClientConnectTimeout, std::chrono::seconds(9));
 }
 
 #ifndef _WIN32
@@ -105,6 +126,91 @@ TEST_F(RoutingTests, SetSocketBlocking) {
   ASSERT_EQ(fcntl(s, F_GETFL, nullptr) & O_NONBLOCK, O_NONBLOCK);
   ASSERT_EQ(fcntl(s, F_GETFL, nullptr) & O_RDONLY, O_RDONLY);
 }
+
+TEST_F(RoutingTests, ParseLocalSockets) {
+  auto sockets = routing::parse_local_sockets("3306:/var/run/mysqld/mysqld.sock, 33060:/var/run/mysqld/mysqlx.sock");
+  ASSERT_EQ(2u, sockets.size());
+  ASSERT_THAT(sockets[3306], StrEq("/var/run/mysqld/mysqld.sock"));
+  ASSERT_THAT(sockets[33060], StrEq("/var/run/mysqld/mysqlx.sock"));
+
+  ASSERT_THROW(routing::parse_local_sockets("/var/run/mysqld/mysqld.sock"), std::invalid_argument);
+  ASSERT_THROW(routing::parse_local_sockets("0:/var/run/mysqld/mysqld.sock"), std::invalid_argument);
+  ASSERT_THROW(routing::parse_local_sockets("3306:mysqld.sock"), std::invalid_argument);
+  ASSERT_THROW(routing::parse_local_sockets("3306:/a.sock,3306:/b.sock"), std::invalid_argument);
+  ASSERT_THROW(routing::parse_local_sockets("3306:/" + std::string(200, 'a')), std::invalid_argument);
+}
+
+TEST_F(RoutingTests, LocalSocket) {
+  ASSERT_TRUE(routing::is_local_socket(mysqlrouter::TCPAddress("/tmp/mysql.sock", 0)));
+  ASSERT_FALSE(routing::is_local_socket(mysqlrouter::TCPAddress("127.0.0.1", 3306)));
+  ASSERT_TRUE(routing::is_local_host("127.0.0.1"));
+  ASSERT_TRUE(routing::is_local_host("localhost"));
+  ASSERT_FALSE(routing::is_local_host("192.0.2.1"));
+  ASSERT_FALSE(routing::is_local_host(""));
+
+  std::string path = "/tmp/test_routing_local_socket_" + std::to_string(getpid()) + ".sock";
+  mysqlrouter::TCPAddress addr(path, 0);
+  auto sock_ops = routing::SocketOperations::instance();
+  unlink(path.c_str());
+  ASSERT_EQ(-1, sock_ops->get_mysql_socket(addr, std::chrono::milliseconds(100), false));
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un sock_unix;
+  memset(&sock_unix, 0, sizeof(sock_unix));
+  sock_unix.sun_family = AF_UNIX;
+  strncpy(sock_unix.sun_path, path.c_str(), sizeof(sock_unix.sun_path) - 1);
+  ASSERT_EQ(0, bind(listener, reinterpret_cast<struct sockaddr *>(&sock_unix), sizeof(sock_unix)));
+  ASSERT_EQ(0, listen(listener, 1));
+  int fd = sock_ops->get_mysql_socket(addr, std::chrono::milliseconds(100));
+  ASSERT_GE(fd, 0);
+  // blocking, like connections over TCP
+  ASSERT_EQ(0, fcntl(fd, F_GETFL, nullptr) & O_NONBLOCK);
+  // TCP options do not apply
+  routing::SocketOptions options;
+  options.keepalive_idle = std::chrono::seconds(10);
+  ASSERT_TRUE(routing::set_socket_options(fd, options));
+  sock_ops->close(fd);
+  close(listener);
+  unlink(path.c_str());
+}
+#endif
+
+#ifdef __linux__
+static int get_int_option(int sock, int level, int option) {
+  int value = -1;
+  socklen_t size = static_cast<socklen_t>(sizeof(value));
+  getsockopt(sock, level, option, &value, &size);
+  return value;
+}
+
+TEST_F(RoutingTests, SetSocketOptions) {
+  int s = socket(PF_INET, SOCK_STREAM, 6);
+  routing::SocketOptions options;
+  ASSERT_TRUE(options.is_default());
+  options.keepalive_idle = std::chrono::milliseconds(2500);
+  options.keepalive_interval = std::chrono::seconds(2);
+  options.keepalive_count = 4;
+  options.user_timeout = std::chrono::milliseconds(15000);
+  options.receive_buffer = 65536;
+  ASSERT_FALSE(options.is_default());
+
+  ASSERT_TRUE(routing::set_socket_options(s, options));
+  EXPECT_EQ(1, get_int_option(s, SOL_SOCKET, SO_KEEPALIVE));
+  // rounded up to whole seconds
+  EXPECT_EQ(3, get_int_option(s, IPPROTO_TCP, TCP_KEEPIDLE));
+  EXPECT_EQ(2, get_int_option(s, IPPROTO_TCP, TCP_KEEPINTVL));
+  EXPECT_EQ(4, get_int_option(s, IPPROTO_TCP, TCP_KEEPCNT));
+  EXPECT_EQ(15000, get_int_option(s, IPPROTO_TCP, TCP_USER_TIMEOUT));
+  // Linux doubles the value for bookkeeping
+  EXPECT_GE(get_int_option(s, SOL_SOCKET, SO_RCVBUF), 65536);
+
+  routing::ListenOptions listen_options;
+  EXPECT_EQ(routing::kDefaultListenBacklog, listen_options.backlog);
+  listen_options.defer_accept = std::chrono::seconds(5);
+  ASSERT_TRUE(routing::set_listen_options(s, listen_options));
+  EXPECT_GT(get_int_option(s, IPPROTO_TCP, TCP_DEFER_ACCEPT), 0);
+  close(s);
+}
 #endif
 
 TEST_F(RoutingTests, CopyPacketsSingleWrite) {
@@ -124,7 +230,7 @@ TEST_F(RoutingTests, CopyPacketsSingleWrite) {
 
 
   ClassicProtocol cp(&socket_op);
-  int res = cp.copy_packets(1, 2, &readfds,
+  int res = cp.copy_packets(1, 2, FD_ISSET(sender_socket, &readfds) != 0,
                             buffer, &curr_pktnr,
                             handshake_done, &report_bytes_read, false);
 
@@ -156,7 +262,7 @@ TEST_F(RoutingTests, CopyPacketsMultipleWrites) {
   EXPECT_CALL(socket_op, write(receiver_socket, &buffer[100], 100)).WillOnce(Return(100));
 
   ClassicProtocol cp(&socket_op);
-  int res = cp.copy_packets(1, 2, &readfds,
+  int res = cp.copy_packets(1, 2, FD_ISSET(sender_socket, &readfds) != 0,
                             buffer, &curr_pktnr,
                             handshake_done, &report_bytes_read, false);
 
@@ -180,7 +286,7 @@ TEST_F(RoutingTests, CopyPacketsWriteError) {
   EXPECT_CALL(socket_op, write(receiver_socket, &buffer[0], 200)).WillOnce(Return(-1));
 
   ClassicProtocol cp(&socket_op);
-  int res = cp.copy_packets(1, 2, &readfds,
+  int res = cp.copy_packets(1, 2, FD_ISSET(sender_socket, &readfds) != 0,
                             buffer, &curr_pktnr,
                             handshake_done, &report_bytes_read, false);
 
@@ -289,7 +395,7 @@ private:
 
 
 static int connect_local(uint16_t port) {
-  return routing::SocketOperations::instance()->get_mysql_socket(TCPAddress("127.0.0.1", port), 10, true);
+  return routing::SocketOperations::instance()->get_mysql_socket(TCPAddress("127.0.0.1", port), std::chrono::seconds(10), true);
 }
 
 static void disconnect(int sock) {
@@ -486,6 +592,13 @@ TEST_F(RoutingTests, set_destinations_from_cvs) {
     EXPECT_NO_THROW(routing.set_destinations_from_csv(cvs));
   }
 
+  // Unix socket of a server on this host
+  {
+    std::string csv = "/var/run/mysqld/mysqlx.sock,127.0.0.1:2004";
+    EXPECT_NO_THROW(routing.set_destinations_from_csv(csv));
+    EXPECT_THROW(routing.set_destinations_from_csv("/" + std::string(200, 'a')), std::runtime_error);
+  }
+
   // invalid access mode
   {
     MySQLRouting routing_inv(routing::AccessMode::kUndefined, 7001, Protocol::Type::kXProtocol);
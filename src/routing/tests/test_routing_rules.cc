@@ -0,0 +1,201 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "routing_rules.h"
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#  include <arpa/inet.h>
+#  include <netinet/in.h>
+#else
+#  include <ws2tcpip.h>
+#endif
+
+static sockaddr_storage make_address(const char *ip) {
+  sockaddr_storage addr;
+  memset(&addr, 0, sizeof(addr));
+  if (strchr(ip, ':')) {
+    auto in6 = reinterpret_cast<sockaddr_in6 *>(&addr);
+    in6->sin6_family = AF_INET6;
+    EXPECT_EQ(1, inet_pton(AF_INET6, ip, &in6->sin6_addr));
+  } else {
+    auto in4 = reinterpret_cast<sockaddr_in *>(&addr);
+    in4->sin_family = AF_INET;
+    EXPECT_EQ(1, inet_pton(AF_INET, ip, &in4->sin_addr));
+  }
+  return addr;
+}
+
+TEST(RoutingRulesTest, Empty) {
+  RoutingRules rules(" ; ");
+  EXPECT_EQ(0u, rules.size());
+  EXPECT_FALSE(rules.needs_handshake());
+  EXPECT_FALSE(rules.filters_destinations());
+  EXPECT_EQ(RoutingRules::kNoRule, rules.match(RoutingRules::Client()));
+}
+
+TEST(RoutingRulesTest, Actions) {
+  RoutingRules rules("user=etl -> servers=db3:3306| db4:3307, quota=20;"
+                     "user=app -> location=eu-west");
+  ASSERT_EQ(2u, rules.size());
+  EXPECT_TRUE(rules.needs_handshake());
+  EXPECT_FALSE(rules.needs_attributes());
+  EXPECT_TRUE(rules.filters_destinations());
+
+  auto &first = rules.get_action(0);
+  EXPECT_EQ((std::vector<std::string>{"db3:3306", "db4:3307"}), first.servers);
+  EXPECT_EQ("", first.location);
+  EXPECT_EQ(20u, first.quota);
+
+  auto &second = rules.get_action(1);
+  EXPECT_TRUE(second.servers.empty());
+  EXPECT_EQ("eu-west", second.location);
+  EXPECT_EQ(0u, second.quota);
+}
+
+TEST(RoutingRulesTest, UserAndSchema) {
+  RoutingRules rules("user=etl_*, schema=dwh -> quota=5;"
+                     "user=admin -> quota=1;"
+                     "schema=* -> quota=100");
+  RoutingRules::Client client;
+  client.user = "etl_nightly";
+  client.schema = "dwh";
+  EXPECT_EQ(0u, rules.match(client));
+
+  // all conditions have to match
+  client.schema = "shop";
+  EXPECT_EQ(2u, rules.match(client));
+
+  client.user = "admin";
+  EXPECT_EQ(1u, rules.match(client));
+  // exact names are not prefixes
+  client.user = "admin2";
+  EXPECT_EQ(2u, rules.match(client));
+  // * matches the empty schema too
+  client.schema = "";
+  EXPECT_EQ(2u, rules.match(client));
+}
+
+TEST(RoutingRulesTest, FirstMatchWins) {
+  RoutingRules rules("user=* -> quota=1; user=etl -> quota=2");
+  RoutingRules::Client client;
+  client.user = "etl";
+  EXPECT_EQ(0u, rules.match(client));
+}
+
+TEST(RoutingRulesTest, Attributes) {
+  RoutingRules rules("attr:program_name=spark* -> location=analytics;"
+                     "attr:_client_name=* -> quota=10");
+  EXPECT_TRUE(rules.needs_handshake());
+  EXPECT_TRUE(rules.needs_attributes());
+
+  RoutingRules::Client client;
+  EXPECT_EQ(RoutingRules::kNoRule, rules.match(client));  // missing attributes never match
+  client.attributes["_client_name"] = "libmysql";
+  EXPECT_EQ(1u, rules.match(client));
+  client.attributes["program_name"] = "spark-shell";
+  EXPECT_EQ(0u, rules.match(client));
+  client.attributes["program_name"] = "mysql";
+  EXPECT_EQ(1u, rules.match(client));
+}
+
+TEST(RoutingRulesTest, Subnets) {
+  RoutingRules rules("subnet=10.20.0.0/16 -> quota=1;"
+                     "subnet=fd00::/8 -> quota=2;"
+                     "subnet=192.168.1.7 -> quota=3;"
+                     "subnet=172.16.0.0/12 -> quota=4");
+  EXPECT_FALSE(rules.needs_handshake());
+
+  RoutingRules::Client client;
+  EXPECT_EQ(RoutingRules::kNoRule, rules.match(client));
+
+  auto addr = make_address("10.20.30.40");
+  client.address = &addr;
+  EXPECT_EQ(0u, rules.match(client));
+  addr = make_address("10.21.0.1");
+  EXPECT_EQ(RoutingRules::kNoRule, rules.match(client));
+  addr = make_address("fd12:3456::1");
+  EXPECT_EQ(1u, rules.match(client));
+  addr = make_address("fe80::1");
+  EXPECT_EQ(RoutingRules::kNoRule, rules.match(client));
+  addr = make_address("192.168.1.7");
+  EXPECT_EQ(2u, rules.match(client));
+  addr = make_address("192.168.1.8");
+  EXPECT_EQ(RoutingRules::kNoRule, rules.match(client));
+  // bits not on a byte boundary
+  addr = make_address("172.31.255.255");
+  EXPECT_EQ(3u, rules.match(client));
+  addr = make_address("172.32.0.0");
+  EXPECT_EQ(RoutingRules::kNoRule, rules.match(client));
+
+  // IPv4 clients of a dual-stack socket
+  addr = make_address("::ffff:10.20.1.1");
+  EXPECT_EQ(0u, rules.match(client));
+  addr = make_address("::10.20.1.1");
+  EXPECT_EQ(RoutingRules::kNoRule, rules.match(client));
+}
+
+TEST(RoutingRulesTest, Quota) {
+  RoutingRules rules("user=etl -> quota=2; user=app -> servers=db1:3306");
+  EXPECT_TRUE(rules.acquire(0));
+  EXPECT_TRUE(rules.acquire(0));
+  EXPECT_FALSE(rules.acquire(0));
+  EXPECT_EQ(2u, rules.get_connections(0));
+  rules.release(0);
+  EXPECT_EQ(1u, rules.get_connections(0));
+  EXPECT_TRUE(rules.acquire(0));
+
+  // without quota, connections are counted only
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(rules.acquire(1));
+  }
+  EXPECT_EQ(100u, rules.get_connections(1));
+}
+
+TEST(RoutingRulesTest, Invalid) {
+  const std::vector<std::string> specs{
+    "user=etl",                        // no actions
+    "-> quota=1",                      // no conditions
+    "user=etl ->",
+    "host=a -> quota=1",               // unknown condition
+    "attr:=a -> quota=1",
+    "user -> quota=1",
+    "user=e*l -> quota=1",             // * only at the end
+    "subnet=10.0.0.0/33 -> quota=1",
+    "subnet=fd00::/129 -> quota=1",
+    "subnet=10.0.0.0/ -> quota=1",
+    "subnet=db1 -> quota=1",
+    "user=etl -> quota=0",
+    "user=etl -> quota=-1",
+    "user=etl -> quota=65536",
+    "user=etl -> quota=1x",
+    "user=etl -> servers=db1",         // no port
+    "user=etl -> servers=|",
+    "user=etl -> location=",
+    "user=etl -> weight=1",            // unknown action
+    "user=etl -> quota",
+  };
+  for (auto &spec : specs) {
+    EXPECT_THROW(RoutingRules rules(spec), std::invalid_argument) << spec;
+  }
+}
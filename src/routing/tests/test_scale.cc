@@ -0,0 +1,255 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Opens many loopback connections through a single route.
+//
+// By default the test uses a few thousand connections, enough to go past
+// FD_SETSIZE. Set ROUTING_SCALE_CONNECTIONS to run it at a larger scale,
+// for example 100000. Mind that each connection uses a thread in the
+// router and four file descriptors in this process; on Linux, vm.max_map_count
+// and kernel.threads-max usually need to be raised for 100k connections.
+
+#include "mysql_routing.h"
+#include "mysqlrouter/routing.h"
+
+#include "gmock/gmock.h"
+
+#ifndef _WIN32
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int kDefaultScaleConnections = 3000;
+
+// a loopback address gives about 28k connections to a single port; on
+// Linux we spread them over several addresses of 127.0.0.0/8
+static const int kConnectionsPerAddress = 20000;
+
+static std::string loopback_address(int index) {
+#ifdef __linux__
+  return "127.0.0." + std::to_string(1 + index / kConnectionsPerAddress);
+#else
+  (void)index;
+  return "127.0.0.1";
+#endif
+}
+
+static int get_scale_connections() {
+  const char *value = std::getenv("ROUTING_SCALE_CONNECTIONS");
+  if (value != nullptr && std::atoi(value) > 0) {
+    return std::atoi(value);
+  }
+  return kDefaultScaleConnections;
+}
+
+static bool wait_for(std::function<bool()> condition, std::chrono::seconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (condition()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return condition();
+}
+
+// port the system picks for a listening socket; it stays free unless
+// another process takes it before we bind it again
+static uint16_t get_free_port() {
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addr_len = static_cast<socklen_t>(sizeof(addr));
+  if (bind(sock, reinterpret_cast<struct sockaddr*>(&addr), addr_len) == -1 ||
+      getsockname(sock, reinterpret_cast<struct sockaddr*>(&addr), &addr_len) == -1) {
+    close(sock);
+    throw std::runtime_error("get_free_port: " + std::string(strerror(errno)));
+  }
+  close(sock);
+  return ntohs(addr.sin_port);
+}
+
+// accepts connections and keeps them open, without ever sending anything
+class IdleServer {
+ public:
+  IdleServer() : stop_(false), accepted_(0) {
+    sock_ = socket(AF_INET, SOCK_STREAM, 0);
+    int option = 1;
+    setsockopt(sock_, SOL_SOCKET, SO_REUSEADDR, &option, static_cast<socklen_t>(sizeof(option)));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    socklen_t addr_len = static_cast<socklen_t>(sizeof(addr));
+    if (bind(sock_, reinterpret_cast<struct sockaddr*>(&addr), addr_len) == -1 ||
+        listen(sock_, 1024) == -1 ||
+        getsockname(sock_, reinterpret_cast<struct sockaddr*>(&addr), &addr_len) == -1) {
+      throw std::runtime_error("IdleServer: " + std::string(strerror(errno)));
+    }
+    port_ = ntohs(addr.sin_port);
+    thread_ = std::thread(&IdleServer::run, this);
+  }
+
+  ~IdleServer() {
+    stop_ = true;
+    thread_.join();
+    for (int fd : clients_) {
+      close(fd);
+    }
+    close(sock_);
+  }
+
+  int accepted() const {
+    return accepted_.load();
+  }
+
+  uint16_t port() const {
+    return port_;
+  }
+
+ private:
+  void run() {
+    struct pollfd fds[1];
+    fds[0].fd = sock_;
+    fds[0].events = POLLIN;
+    while (!stop_) {
+      if (poll(fds, 1, 100) <= 0) {
+        continue;
+      }
+      int fd = accept(sock_, nullptr, nullptr);
+      if (fd >= 0) {
+        clients_.push_back(fd);
+        ++accepted_;
+      }
+    }
+  }
+
+  int sock_;
+  uint16_t port_;
+  std::atomic<bool> stop_;
+  std::atomic<int> accepted_;
+  std::vector<int> clients_;
+  std::thread thread_;
+};
+
+static int connect_from(const std::string &source, uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  inet_pton(AF_INET, source.c_str(), &addr.sin_addr);
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), static_cast<socklen_t>(sizeof(addr))) == -1) {
+    close(fd);
+    return -1;
+  }
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), static_cast<socklen_t>(sizeof(addr))) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+TEST(RoutingScaleTest, ManyConnectionsThroughOneRoute) {
+  const int connections = get_scale_connections();
+
+  // client and server side of each connection live in this process, and
+  // so do both sockets the router needs for it
+  uint64_t needed = 4 * static_cast<uint64_t>(connections) + 512;
+  if (routing::raise_open_files_limit(needed) < needed) {
+    std::cout << "[ SKIPPED  ] open files limit too low for " << connections << " connections" << std::endl;
+    return;
+  }
+
+  IdleServer server;
+  const uint16_t router_port = get_free_port();
+
+  // the route spreads the connections over several addresses for the
+  // same reason
+  std::string destinations;
+  for (int i = 0; i < connections; i += kConnectionsPerAddress) {
+    if (!destinations.empty()) {
+      destinations += ",";
+    }
+    destinations += loopback_address(i) + ":" + std::to_string(server.port());
+  }
+
+  MySQLRouting routing(routing::AccessMode::kReadOnly, router_port,
+                       Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+                       "routing:scale", connections,
+                       routing::kDefaultDestinationConnectionTimeout,
+                       UINT32_MAX, // max_connect_errors: idle clients never finish the handshake
+                       std::chrono::seconds(3600));
+  routing.set_destinations_from_csv(destinations);
+  std::thread router_thread(&MySQLRouting::start, &routing);
+
+  std::vector<int> clients;
+  clients.reserve(static_cast<size_t>(connections));
+  auto started = std::chrono::steady_clock::now();
+  for (int i = 0; i < connections; ++i) {
+    int fd = -1;
+    // the router might not be listening yet
+    wait_for([&]() { fd = connect_from(loopback_address(i), router_port); return fd >= 0; },
+             std::chrono::seconds(10));
+    if (fd < 0) {
+      ADD_FAILURE() << "connection " << i << ": " << strerror(errno);
+      break;
+    }
+    clients.push_back(fd);
+  }
+
+  const int opened = static_cast<int>(clients.size());
+  EXPECT_TRUE(wait_for([&]() { return routing.get_active_routes() == opened; },
+                       std::chrono::seconds(60 + connections / 1000)));
+  EXPECT_EQ(connections, routing.get_active_routes());
+  EXPECT_EQ(connections, server.accepted());
+  std::cout << connections << " routes active after "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - started).count()
+            << "ms" << std::endl;
+
+  for (int fd : clients) {
+    close(fd);
+  }
+  EXPECT_TRUE(wait_for([&]() { return routing.get_active_routes() == 0; },
+                       std::chrono::seconds(60 + connections / 1000)));
+
+  routing.stop();
+  router_thread.join();
+}
+
+#endif // _WIN32
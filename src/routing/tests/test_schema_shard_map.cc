@@ -0,0 +1,85 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "schema_shard_map.h"
+
+#include "gtest/gtest.h"
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+TEST(SchemaShardMapTest, Empty) {
+  SchemaShardMap map("", "main");
+  EXPECT_EQ("main", map.get_replicaset(""));
+  EXPECT_EQ("main", map.get_replicaset("shop"));
+  EXPECT_EQ(std::vector<std::string>{"main"}, map.get_replicasets());
+}
+
+TEST(SchemaShardMapTest, Schemas) {
+  SchemaShardMap map("shop_eu=eu, shop_us = us", "main");
+  EXPECT_EQ("eu", map.get_replicaset("shop_eu"));
+  EXPECT_EQ("us", map.get_replicaset("shop_us"));
+  // names are case sensitive, and not prefixes
+  EXPECT_EQ("main", map.get_replicaset("SHOP_EU"));
+  EXPECT_EQ("main", map.get_replicaset("shop_eu2"));
+  EXPECT_EQ("main", map.get_replicaset(""));
+}
+
+TEST(SchemaShardMapTest, Prefixes) {
+  SchemaShardMap map("shop_*=shops,shop_eu_*=eu,shop_eu_fr=fr", "main");
+  EXPECT_EQ("shops", map.get_replicaset("shop_us_1"));
+  EXPECT_EQ("eu", map.get_replicaset("shop_eu_de"));  // longest prefix
+  EXPECT_EQ("fr", map.get_replicaset("shop_eu_fr"));  // names first
+  EXPECT_EQ("main", map.get_replicaset("shop"));
+}
+
+TEST(SchemaShardMapTest, Hashed) {
+  SchemaShardMap map("admin=main,*=a|b|c", "main");
+  EXPECT_EQ("main", map.get_replicaset("admin"));
+  EXPECT_EQ("main", map.get_replicaset(""));
+
+  // spread, and always the same
+  std::map<std::string, int> counts;
+  for (int i = 0; i < 300; ++i) {
+    std::string schema = "tenant_" + std::to_string(i);
+    auto &replicaset = map.get_replicaset(schema);
+    EXPECT_EQ(replicaset, map.get_replicaset(schema));
+    ++counts[replicaset];
+  }
+  EXPECT_EQ(3U, counts.size());
+  for (auto &it : counts) {
+    EXPECT_LT(50, it.second) << it.first;
+  }
+
+  EXPECT_EQ((std::vector<std::string>{"main", "a", "b", "c"}), map.get_replicasets());
+}
+
+TEST(SchemaShardMapTest, HashIsFnv1a) {
+  // the same on every router; known values of 32-bit FNV-1a
+  EXPECT_EQ(2166136261u, SchemaShardMap::hash(""));
+  EXPECT_EQ(0xe40c292cu, SchemaShardMap::hash("a"));
+  EXPECT_EQ(0xbf9cf968u, SchemaShardMap::hash("foobar"));
+}
+
+TEST(SchemaShardMapTest, Invalid) {
+  for (auto spec : {"shop", "=eu", "shop=", "*=a|", "*=a,*=b", "sh*op=eu", "*shop=eu",
+                    "shop=eu|us", "shop=eu,shop=us", "shop*=eu,shop*=us"}) {
+    EXPECT_THROW(SchemaShardMap(spec, "main"), std::invalid_argument) << spec;
+  }
+}
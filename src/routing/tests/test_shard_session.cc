@@ -0,0 +1,301 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "shard_session.h"
+#include "mysqlrouter/mysql_protocol.h"
+#include "mysqlrouter/routing.h"
+
+#include "gtest/gtest.h"
+
+#ifndef _WIN32
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <future>
+#include <string>
+#include <vector>
+
+using Bytes = std::vector<uint8_t>;
+using mysql_protocol::PacketReader;
+using mysql_protocol::PacketView;
+
+static const uint32_t kClientCapabilities =
+    mysql_protocol::kClientProtocol41 | mysql_protocol::kClientSecureConnection |
+    mysql_protocol::kClientPluginAuth | mysql_protocol::kClientConnectWithDb;
+
+static Bytes make_packet(uint8_t seq, const Bytes &payload) {
+  Bytes packet{static_cast<uint8_t>(payload.size()), static_cast<uint8_t>(payload.size() >> 8),
+               static_cast<uint8_t>(payload.size() >> 16), seq};
+  packet.insert(packet.end(), payload.begin(), payload.end());
+  return packet;
+}
+
+static Bytes make_greeting() {
+  Bytes payload{
+      0x0a, '5', '.', '7', '.', '1', '9', 0x00,  // protocol version, server version
+      0x05, 0x00, 0x00, 0x00,  // connection id
+      'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 0x00,  // salt, first part
+      0xff, 0xf7, 0x21, 0x02, 0x00, 0xff, 0x81, 0x15,  // capabilities, character set, status
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // reserved
+      'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 0x00,  // salt, second part
+      'm', 'y', 's', 'q', 'l', '_', 'n', 'a', 't', 'i', 'v', 'e', '_',
+      'p', 'a', 's', 's', 'w', 'o', 'r', 'd', 0x00,
+  };
+  return make_packet(0, payload);
+}
+
+class ShardSessionTest : public ::testing::Test {
+ protected:
+  ShardSessionTest() : shard_map_("shop_eu=eu,shop_us=us", "main") {}
+
+  void SetUp() override {
+    make_pair(&client_, &client_peer_);
+    make_pair(&server_, &server_peer_);
+    session_.reset(new ShardSession(routing::SocketOperations::instance(), client_peer_,
+                                    shard_map_, std::chrono::seconds(5), "test"));
+  }
+
+  void TearDown() override {
+    for (int fd : {client_, client_peer_, server_, server_peer_}) {
+      ::close(fd);
+    }
+  }
+
+  static void make_pair(int *ours, int *sessions) {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    // a broken test fails instead of hanging
+    struct timeval timeout{5, 0};
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    *ours = fds[0];
+    *sessions = fds[1];
+  }
+
+  static void send_bytes(int fd, const Bytes &data) {
+    ASSERT_EQ(static_cast<ssize_t>(data.size()), ::send(fd, data.data(), data.size(), 0));
+  }
+
+  static Bytes receive_packet(int fd) {
+    Bytes packet(4);
+    if (::recv(fd, packet.data(), 4, MSG_WAITALL) != 4) {
+      return Bytes();
+    }
+    size_t size = packet[0] | (packet[1] << 8) | (packet[2] << 16);
+    packet.resize(4 + size);
+    if (size > 0 && ::recv(fd, packet.data() + 4, size, MSG_WAITALL) != static_cast<ssize_t>(size)) {
+      return Bytes();
+    }
+    return packet;
+  }
+
+  static Bytes client_handshake(uint32_t capabilities, const std::string &schema) {
+    mysql_protocol::HandshakeResponsePacket packet(1, Bytes(20, 0x01), "app", "", schema, 8,
+                                                   "mysql_native_password", capabilities);
+    return Bytes(packet.begin(), packet.end());
+  }
+
+  // greets the client and reads its handshake response
+  void accept_client(const std::string &schema) {
+    std::string error;
+    auto accepted = std::async(std::launch::async, [this, &error]() {
+      return session_->accept_client("5.7.0", &error);
+    });
+    Bytes greeting = receive_packet(client_);
+    ASSERT_GT(greeting.size(), 5U);
+    EXPECT_EQ(0, greeting[3]);
+    EXPECT_EQ(10, greeting[4]);
+    EXPECT_EQ("5.7.0", PacketView(greeting).get_string(5).str());
+    send_bytes(client_, client_handshake(kClientCapabilities, schema));
+    ASSERT_TRUE(accepted.get()) << error;
+  }
+
+  SchemaShardMap shard_map_;
+  std::unique_ptr<ShardSession> session_;
+  int client_, client_peer_;
+  int server_, server_peer_;
+};
+
+TEST_F(ShardSessionTest, Authenticate) {
+  accept_client("shop_us");
+  EXPECT_EQ("shop_us", session_->get_schema());
+  EXPECT_EQ("us", session_->get_replicaset());
+
+  std::string error;
+  auto result = std::async(std::launch::async, [this, &error]() {
+    return session_->authenticate(server_peer_, &error);
+  });
+  send_bytes(server_, make_greeting());
+
+  // the client is asked to answer the salt of the server
+  Bytes auth_switch = receive_packet(client_);
+  Bytes expected{0xfe};
+  for (const char *part : {"mysql_native_password", "abcdefghijklmnopqrst"}) {
+    expected.insert(expected.end(), part, part + strlen(part));
+    expected.push_back(0);
+  }
+  EXPECT_EQ(make_packet(2, expected), auth_switch);
+  Bytes scramble(20, 0x42);
+  send_bytes(client_, make_packet(3, scramble));
+
+  // which the server gets in the handshake response of the client
+  Bytes response = receive_packet(server_);
+  ASSERT_GT(response.size(), 4U);
+  EXPECT_EQ(1, response[3]);
+  PacketReader reader{PacketView(response), 4};
+  uint32_t capabilities = reader.read_int<uint32_t>();
+  EXPECT_EQ(kClientCapabilities, capabilities);
+  reader.skip(4 + 1 + 23);
+  EXPECT_EQ("app", reader.read_nul_string().str());
+  PacketView auth_response = reader.read_bytes(reader.read_int<uint8_t>());
+  EXPECT_EQ(scramble, Bytes(auth_response.begin(), auth_response.end()));
+  EXPECT_EQ("shop_us", reader.read_nul_string().str());
+  EXPECT_EQ("mysql_native_password", reader.read_nul_string().str());
+
+  // the OK reaches the client with its sequence id
+  send_bytes(server_, make_packet(2, {0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00}));
+  EXPECT_EQ(ShardSession::AuthResult::kAuthenticated, result.get()) << error;
+  EXPECT_EQ(make_packet(4, {0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00}), receive_packet(client_));
+  EXPECT_EQ("5.7.19", session_->get_server_version());
+}
+
+TEST_F(ShardSessionTest, ServerRefusesClient) {
+  accept_client("shop_eu");
+  std::string error;
+  auto result = std::async(std::launch::async, [this, &error]() {
+    return session_->authenticate(server_peer_, &error);
+  });
+  send_bytes(server_, make_greeting());
+  receive_packet(client_);
+  send_bytes(client_, make_packet(3, Bytes(20, 0x42)));
+  receive_packet(server_);
+
+  mysql_protocol::ErrorPacket denied(2, 1045, "Access denied", "28000",
+                                     mysql_protocol::kClientProtocol41);
+  send_bytes(server_, Bytes(denied.begin(), denied.end()));
+  EXPECT_EQ(ShardSession::AuthResult::kRefused, result.get());
+  Bytes packet = receive_packet(client_);
+  ASSERT_GT(packet.size(), 4U);
+  EXPECT_EQ(4, packet[3]);
+  EXPECT_EQ(0xff, packet[4]);
+}
+
+TEST_F(ShardSessionTest, ClientWithoutPluginAuth) {
+  std::string error;
+  auto accepted = std::async(std::launch::async, [this, &error]() {
+    return session_->accept_client("5.7.0", &error);
+  });
+  receive_packet(client_);
+  send_bytes(client_, client_handshake(kClientCapabilities & ~mysql_protocol::kClientPluginAuth,
+                                       "shop_eu"));
+  EXPECT_FALSE(accepted.get());
+
+  Bytes packet = receive_packet(client_);
+  mysql_protocol::ErrorPacket refused(packet, mysql_protocol::kClientProtocol41);
+  EXPECT_EQ(2, refused.get_sequence_id());
+  EXPECT_EQ(1251, refused.get_code());
+}
+
+TEST_F(ShardSessionTest, InitDbToOtherShard) {
+  accept_client("shop_eu");
+  RoutingProtocolBuffer buffer(1024);
+  size_t bytes_read = 0;
+
+  // same replicaset: forwarded
+  Bytes init_db = make_packet(0, {mysql_protocol::kComInitDb, 's', 'h', 'o', 'p', '_', 'e', 'u'});
+  send_bytes(client_, init_db);
+  ASSERT_EQ(0, session_->copy_client_data(server_peer_, true, buffer, &bytes_read));
+  EXPECT_EQ(init_db.size(), bytes_read);
+  EXPECT_EQ(init_db, receive_packet(server_));
+
+  // other replicaset: refused
+  send_bytes(client_, make_packet(0, {mysql_protocol::kComInitDb, 's', 'h', 'o', 'p', '_', 'u', 's'}));
+  ASSERT_EQ(0, session_->copy_client_data(server_peer_, true, buffer, &bytes_read));
+  EXPECT_EQ(0U, bytes_read);
+  Bytes packet = receive_packet(client_);
+  mysql_protocol::ErrorPacket refused(packet, mysql_protocol::kClientProtocol41);
+  EXPECT_EQ(1, refused.get_sequence_id());
+  EXPECT_EQ(1105, refused.get_code());
+
+  // anything else: forwarded
+  Bytes query = make_packet(0, {mysql_protocol::kComQuery, 'S', 'E', 'L', 'E', 'C', 'T', ' ', '1'});
+  send_bytes(client_, query);
+  ASSERT_EQ(0, session_->copy_client_data(server_peer_, true, buffer, &bytes_read));
+  EXPECT_EQ(query, receive_packet(server_));
+}
+
+TEST_F(ShardSessionTest, InitDbAfterQueryInOneRead) {
+  accept_client("shop_eu");
+  RoutingProtocolBuffer buffer(1024);
+  size_t bytes_read = 0;
+
+  // pipelined: the query goes to the server, the COM_INIT_DB is refused
+  Bytes query = make_packet(0, {mysql_protocol::kComQuery, 'S', 'E', 'L', 'E', 'C', 'T', ' ', '1'});
+  Bytes data = query;
+  Bytes init_db = make_packet(0, {mysql_protocol::kComInitDb, 's', 'h', 'o', 'p', '_', 'u', 's'});
+  data.insert(data.end(), init_db.begin(), init_db.end());
+  send_bytes(client_, data);
+  ASSERT_EQ(0, session_->copy_client_data(server_peer_, true, buffer, &bytes_read));
+  EXPECT_EQ(query.size(), bytes_read);
+  EXPECT_EQ(query, receive_packet(server_));
+  Bytes packet = receive_packet(client_);
+  mysql_protocol::ErrorPacket refused(packet, mysql_protocol::kClientProtocol41);
+  EXPECT_EQ(1105, refused.get_code());
+}
+
+TEST_F(ShardSessionTest, InitDbOverSeveralReads) {
+  accept_client("shop_eu");
+  RoutingProtocolBuffer buffer(1024);
+  size_t bytes_read = 0;
+
+  // held until complete, then refused
+  Bytes init_db = make_packet(0, {mysql_protocol::kComInitDb, 's', 'h', 'o', 'p', '_', 'u', 's'});
+  for (size_t split : {2u, 6u}) {
+    send_bytes(client_, Bytes(init_db.begin(), init_db.begin() + split));
+    ASSERT_EQ(0, session_->copy_client_data(server_peer_, true, buffer, &bytes_read));
+    EXPECT_EQ(0U, bytes_read);
+    send_bytes(client_, Bytes(init_db.begin() + split, init_db.end()));
+    ASSERT_EQ(0, session_->copy_client_data(server_peer_, true, buffer, &bytes_read));
+    EXPECT_EQ(0U, bytes_read);
+    Bytes packet = receive_packet(client_);
+    mysql_protocol::ErrorPacket refused(packet, mysql_protocol::kClientProtocol41);
+    EXPECT_EQ(1105, refused.get_code());
+  }
+
+  // same replicaset: sent whole once complete
+  init_db = make_packet(0, {mysql_protocol::kComInitDb, 's', 'h', 'o', 'p', '_', 'e', 'u'});
+  send_bytes(client_, Bytes(init_db.begin(), init_db.begin() + 6));
+  ASSERT_EQ(0, session_->copy_client_data(server_peer_, true, buffer, &bytes_read));
+  EXPECT_EQ(0U, bytes_read);
+  send_bytes(client_, Bytes(init_db.begin() + 6, init_db.end()));
+  ASSERT_EQ(0, session_->copy_client_data(server_peer_, true, buffer, &bytes_read));
+  EXPECT_EQ(init_db.size(), bytes_read);
+  EXPECT_EQ(init_db, receive_packet(server_));
+
+  // another command split in its header: sent once it is known
+  Bytes query = make_packet(0, {mysql_protocol::kComQuery, 'S', 'E', 'L', 'E', 'C', 'T', ' ', '1'});
+  send_bytes(client_, Bytes(query.begin(), query.begin() + 2));
+  ASSERT_EQ(0, session_->copy_client_data(server_peer_, true, buffer, &bytes_read));
+  EXPECT_EQ(0U, bytes_read);
+  send_bytes(client_, Bytes(query.begin() + 2, query.end()));
+  ASSERT_EQ(0, session_->copy_client_data(server_peer_, true, buffer, &bytes_read));
+  EXPECT_EQ(query.size(), bytes_read);
+  EXPECT_EQ(query, receive_packet(server_));
+}
+
+#endif  // _WIN32
@@ -0,0 +1,150 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "destination.h"
+#include "slow_start.h"
+
+#include "routing_mocks.h"
+
+#include <chrono>
+#include <map>
+
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+class SlowStartTest : public ::testing::Test {
+ protected:
+  SlowStart::clock::time_point t0_ = SlowStart::clock::now();
+};
+
+TEST_F(SlowStartTest, DisabledByDefault) {
+  SlowStart slow_start;
+  ASSERT_FALSE(slow_start.enabled());
+
+  // begin() is ignored when slow-start is disabled
+  slow_start.begin("41", t0_);
+  ASSERT_EQ(0u, slow_start.size());
+  ASSERT_DOUBLE_EQ(1.0, slow_start.weight("41", t0_));
+  ASSERT_TRUE(slow_start.admit("41", t0_));
+}
+
+TEST_F(SlowStartTest, LinearRamp) {
+  SlowStart slow_start(seconds(10), SlowStart::Ramp::kLinear);
+  slow_start.begin("41", t0_);
+  ASSERT_EQ(1u, slow_start.size());
+
+  EXPECT_DOUBLE_EQ(SlowStart::kMinWeight, slow_start.weight("41", t0_));
+  EXPECT_DOUBLE_EQ(SlowStart::kMinWeight + (1.0 - SlowStart::kMinWeight) / 2,
+                   slow_start.weight("41", t0_ + seconds(5)));
+  EXPECT_DOUBLE_EQ(1.0, slow_start.weight("41", t0_ + seconds(10)));
+  EXPECT_DOUBLE_EQ(1.0, slow_start.weight("41", t0_ + seconds(60)));
+
+  // other destinations are not affected
+  EXPECT_DOUBLE_EQ(1.0, slow_start.weight("42", t0_));
+}
+
+TEST_F(SlowStartTest, ExponentialRamp) {
+  SlowStart slow_start(seconds(10), SlowStart::Ramp::kExponential);
+  slow_start.begin("41", t0_);
+
+  double start = slow_start.weight("41", t0_);
+  double half = slow_start.weight("41", t0_ + seconds(5));
+  EXPECT_DOUBLE_EQ(SlowStart::kMinWeight, start);
+  // exponential ramp stays below the linear one
+  EXPECT_LT(half, SlowStart::kMinWeight + (1.0 - SlowStart::kMinWeight) / 2);
+  EXPECT_GT(half, start);
+  EXPECT_DOUBLE_EQ(1.0, slow_start.weight("41", t0_ + seconds(10)));
+}
+
+TEST_F(SlowStartTest, AdmitFollowsWeight) {
+  SlowStart slow_start(seconds(10), SlowStart::Ramp::kLinear);
+  slow_start.begin("41", t0_);
+
+  // at kMinWeight, one out of ten picks is admitted
+  int admitted = 0;
+  for (int i = 0; i < 100; ++i) {
+    if (slow_start.admit("41", t0_)) {
+      ++admitted;
+    }
+  }
+  EXPECT_EQ(10, admitted);
+
+  // once the period is over, the destination leaves slow-start
+  EXPECT_TRUE(slow_start.admit("41", t0_ + seconds(10)));
+  EXPECT_EQ(0u, slow_start.size());
+}
+
+TEST_F(SlowStartTest, DisablingClearsRamps) {
+  SlowStart slow_start(seconds(10), SlowStart::Ramp::kLinear);
+  slow_start.begin("41", t0_);
+  slow_start.configure(milliseconds(0), SlowStart::Ramp::kLinear);
+  EXPECT_EQ(0u, slow_start.size());
+  EXPECT_TRUE(slow_start.admit("41", t0_));
+}
+
+TEST_F(SlowStartTest, RampNames) {
+  EXPECT_EQ(SlowStart::Ramp::kLinear, SlowStart::get_ramp("linear"));
+  EXPECT_EQ(SlowStart::Ramp::kExponential, SlowStart::get_ramp("exponential"));
+  EXPECT_THROW(SlowStart::get_ramp("quadratic"), std::invalid_argument);
+}
+
+// RouteDestination which lets us put a server in slow-start without
+// having to go through quarantine
+class SlowStartRouteDestination : public RouteDestination {
+ public:
+  using RouteDestination::RouteDestination;
+
+  void begin_slow_start(const std::string &address, uint16_t port) {
+    slow_start_.begin(mysqlrouter::TCPAddress(address, port).str());
+  }
+};
+
+TEST_F(SlowStartTest, RouteDestinationReducedShare) {
+  MockSocketOperations sock_ops;
+  SlowStartRouteDestination dest(Protocol::Type::kClassicProtocol, &sock_ops);
+  dest.add("41", 1);
+  dest.add("42", 2);
+  dest.set_slow_start(seconds(3600), SlowStart::Ramp::kLinear);
+  dest.begin_slow_start("42", 2);
+  ASSERT_EQ(1u, dest.size_slow_start());
+
+  std::map<int, int> picked;
+  int dummy;
+  for (int i = 0; i < 200; ++i) {
+    picked[dest.get_server_socket(std::chrono::milliseconds::zero(), &dummy)]++;
+  }
+
+  // 42 is admitted only once every ten times round-robin picks it
+  EXPECT_EQ(0, picked[-1]);
+  EXPECT_LE(picked[42], 25);
+  EXPECT_GE(picked[42], 5);
+  EXPECT_EQ(200, picked[41] + picked[42]);
+}
+
+TEST_F(SlowStartTest, RouteDestinationOnlyServerInSlowStart) {
+  MockSocketOperations sock_ops;
+  SlowStartRouteDestination dest(Protocol::Type::kClassicProtocol, &sock_ops);
+  dest.add("42", 2);
+  dest.set_slow_start(seconds(3600), SlowStart::Ramp::kLinear);
+  dest.begin_slow_start("42", 2);
+
+  // with nothing else available, the server in slow-start is used anyway
+  int dummy;
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_EQ(42, dest.get_server_socket(std::chrono::milliseconds::zero(), &dummy));
+  }
+}
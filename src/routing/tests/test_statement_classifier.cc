@@ -0,0 +1,93 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "statement_classifier.h"
+
+#include "gtest/gtest.h"
+
+class StatementClassifierTest : public ::testing::Test {
+};
+
+TEST_F(StatementClassifierTest, Reads) {
+  EXPECT_EQ(StatementClass::kRead, classify_statement("SELECT 1"));
+  EXPECT_EQ(StatementClass::kRead, classify_statement("  select * from t where a = 'x'"));
+  EXPECT_EQ(StatementClass::kRead, classify_statement("(SELECT a FROM t) UNION (SELECT b FROM u)"));
+  EXPECT_EQ(StatementClass::kRead, classify_statement("/* hello */ SELECT 1"));
+  EXPECT_EQ(StatementClass::kRead, classify_statement("-- hello\nSELECT 1"));
+  EXPECT_EQ(StatementClass::kRead, classify_statement("SELECT 1;"));
+}
+
+TEST_F(StatementClassifierTest, SelectsWhichAreNotReads) {
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("SELECT * FROM t FOR UPDATE"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("SELECT * FROM t LOCK IN SHARE MODE"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("SELECT LAST_INSERT_ID()"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("SELECT GET_LOCK('a', 1)"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("SELECT a FROM t INTO OUTFILE '/tmp/a'"));
+}
+
+TEST_F(StatementClassifierTest, Writes) {
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("INSERT INTO t VALUES (1)"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("update t set a = 1"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("BEGIN"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("START TRANSACTION"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("START TRANSACTION READ WRITE"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("SET TRANSACTION READ ONLY"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("SET GLOBAL max_connections = 10"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("SET PASSWORD = 'secret'"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("SET PASSWORD FOR 'u'@'%' = 'secret'"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("SET DEFAULT ROLE ALL TO 'u'@'%'"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("SET RESOURCE GROUP batch"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement(""));
+}
+
+TEST_F(StatementClassifierTest, ReadOnlyTransaction) {
+  EXPECT_EQ(StatementClass::kStartReadOnly, classify_statement("START TRANSACTION READ ONLY"));
+  EXPECT_EQ(StatementClass::kStartReadOnly,
+            classify_statement("start transaction with consistent snapshot, read only"));
+}
+
+TEST_F(StatementClassifierTest, SessionState) {
+  EXPECT_EQ(StatementClass::kSessionState, classify_statement("SET NAMES utf8mb4"));
+  EXPECT_EQ(StatementClass::kSessionState, classify_statement("SET @a = 1"));
+  EXPECT_EQ(StatementClass::kSessionState, classify_statement("USE db1"));
+}
+
+TEST_F(StatementClassifierTest, Pinned) {
+  EXPECT_EQ(StatementClass::kPin, classify_statement("CREATE TEMPORARY TABLE t1 (a INT)"));
+  EXPECT_EQ(StatementClass::kPin, classify_statement("create temporary table t1 select * from t"));
+  EXPECT_EQ(StatementClass::kPin, classify_statement("DROP TEMPORARY TABLE t1"));
+  EXPECT_EQ(StatementClass::kPin, classify_statement("SELECT a INTO @a FROM t"));
+  EXPECT_EQ(StatementClass::kPin, classify_statement("SELECT @a := 1"));
+  EXPECT_EQ(StatementClass::kPin, classify_statement("SET @a = UUID()"));
+  EXPECT_EQ(StatementClass::kPin, classify_statement("SET ROLE 'reader'"));
+  EXPECT_EQ(StatementClass::kPin, classify_statement("set role all"));
+  EXPECT_EQ(StatementClass::kPin, classify_statement("LOCK TABLES t READ"));
+  EXPECT_EQ(StatementClass::kPin, classify_statement("PREPARE s FROM 'SELECT 1'"));
+  EXPECT_EQ(StatementClass::kPin, classify_statement("SELECT 1; DELETE FROM t"));
+  EXPECT_EQ(StatementClass::kPin, classify_statement("/*!40101 SELECT 1 */"));
+}
+
+TEST_F(StatementClassifierTest, Previous) {
+  EXPECT_EQ(StatementClass::kPrevious, classify_statement("SHOW WARNINGS"));
+  EXPECT_EQ(StatementClass::kPrevious, classify_statement("show errors"));
+  EXPECT_EQ(StatementClass::kPrevious, classify_statement("SHOW COUNT(*) WARNINGS"));
+}
+
+TEST_F(StatementClassifierTest, Hints) {
+  EXPECT_EQ(StatementClass::kRead, classify_statement("/* route = secondary */ SELECT LAST_INSERT_ID()"));
+  EXPECT_EQ(StatementClass::kWrite, classify_statement("/* ROUTE=PRIMARY */ SELECT 1"));
+}
@@ -0,0 +1,475 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "tls_session.h"
+#include "mysqlrouter/mysql_protocol.h"
+#include "mysqlrouter/routing.h"
+
+#include "gtest/gtest.h"
+
+#ifndef _WIN32
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef WITH_ROUTING_TLS
+#  include <openssl/evp.h>
+#  include <openssl/pem.h>
+#  include <openssl/ssl.h>
+#  include <openssl/x509.h>
+#endif
+
+TEST(TlsContextTest, Supported) {
+#ifdef WITH_ROUTING_TLS
+  EXPECT_TRUE(TlsServerContext::is_supported());
+  EXPECT_THROW(TlsServerContext("/nonexistent/cert.pem", "/nonexistent/key.pem", 10,
+                                std::chrono::seconds(60), "test"),
+               std::runtime_error);
+#else
+  EXPECT_FALSE(TlsServerContext::is_supported());
+  EXPECT_THROW(TlsServerContext("cert.pem", "key.pem", 10, std::chrono::seconds(60), "test"),
+               std::runtime_error);
+  EXPECT_THROW(TlsClientContext(""), std::runtime_error);
+#endif
+}
+
+#ifdef WITH_ROUTING_TLS
+
+using Bytes = std::vector<uint8_t>;
+using mysql_protocol::PacketView;
+
+static const uint32_t kClientCapabilities =
+    mysql_protocol::kClientProtocol41 | mysql_protocol::kClientSecureConnection |
+    mysql_protocol::kClientPluginAuth;
+
+static Bytes make_packet(uint8_t seq, const Bytes &payload) {
+  Bytes packet{static_cast<uint8_t>(payload.size()), static_cast<uint8_t>(payload.size() >> 8),
+               static_cast<uint8_t>(payload.size() >> 16), seq};
+  packet.insert(packet.end(), payload.begin(), payload.end());
+  return packet;
+}
+
+static Bytes make_greeting(bool ssl) {
+  Bytes payload{
+      0x0a, '5', '.', '7', '.', '1', '9', 0x00,  // protocol version, server version
+      0x05, 0x00, 0x00, 0x00,  // connection id
+      'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 0x00,  // salt, first part
+      0xff, static_cast<uint8_t>(ssl ? 0xff : 0xf7), 0x21, 0x02, 0x00, 0xff, 0x81, 0x15,  // capabilities, character set, status
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // reserved
+      'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 0x00,  // salt, second part
+      'm', 'y', 's', 'q', 'l', '_', 'n', 'a', 't', 'i', 'v', 'e', '_',
+      'p', 'a', 's', 's', 'w', 'o', 'r', 'd', 0x00,
+  };
+  return make_packet(0, payload);
+}
+
+// capabilities, maximum packet size, character set and filler
+static Bytes make_ssl_request(uint8_t seq, uint32_t capabilities) {
+  Bytes payload(32, 0);
+  for (int i = 0; i < 4; ++i) {
+    payload[static_cast<size_t>(i)] = static_cast<uint8_t>(capabilities >> (8 * i));
+  }
+  payload[8] = 8;
+  return make_packet(seq, payload);
+}
+
+static Bytes make_ok(uint8_t seq) {
+  return make_packet(seq, {0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00});
+}
+
+// a self-signed certificate and its key, in PEM files
+class TestCertificate {
+ public:
+  TestCertificate()
+      : cert_file_(make_name("cert")), key_file_(make_name("key")) {
+    EVP_PKEY *pkey = nullptr;
+    EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    if (pctx == nullptr || EVP_PKEY_keygen_init(pctx) != 1 ||
+        EVP_PKEY_CTX_set_rsa_keygen_bits(pctx, 2048) != 1 || EVP_PKEY_keygen(pctx, &pkey) != 1) {
+      throw std::runtime_error("generating key failed");
+    }
+    EVP_PKEY_CTX_free(pctx);
+    X509 *x509 = X509_new();
+    X509_set_version(x509, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_get_notBefore(x509), 0);
+    X509_gmtime_adj(X509_get_notAfter(x509), 3600);
+    X509_set_pubkey(x509, pkey);
+    X509_NAME *name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               reinterpret_cast<const unsigned char *>("router"), -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    X509_sign(x509, pkey, EVP_sha256());
+
+    FILE *file = fopen(cert_file_.c_str(), "w");
+    PEM_write_X509(file, x509);
+    fclose(file);
+    file = fopen(key_file_.c_str(), "w");
+    PEM_write_PrivateKey(file, pkey, nullptr, nullptr, 0, nullptr, nullptr);
+    fclose(file);
+    X509_free(x509);
+    EVP_PKEY_free(pkey);
+  }
+
+  ~TestCertificate() {
+    unlink(cert_file_.c_str());
+    unlink(key_file_.c_str());
+  }
+
+  const std::string &cert_file() const { return cert_file_; }
+  const std::string &key_file() const { return key_file_; }
+
+ private:
+  static std::string make_name(const char *what) {
+    return "/tmp/test_tls_session_" + std::to_string(getpid()) + "_" + what + ".pem";
+  }
+
+  std::string cert_file_;
+  std::string key_file_;
+};
+
+class TlsSessionTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    certificate_ = new TestCertificate();
+  }
+
+  static void TearDownTestCase() {
+    delete certificate_;
+  }
+
+  void SetUp() override {
+    contexts_.reset(new TlsServerContext(certificate_->cert_file(), certificate_->key_file(),
+                                         100, std::chrono::seconds(60), "routing:test"));
+    client_ctx_ = SSL_CTX_new(SSLv23_client_method());
+    SSL_CTX_set_session_cache_mode(client_ctx_, SSL_SESS_CACHE_CLIENT);
+  }
+
+  void TearDown() override {
+    if (client_session_) {
+      SSL_SESSION_free(client_session_);
+    }
+    SSL_CTX_free(client_ctx_);
+  }
+
+  static void make_pair(int *ours, int *sessions) {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    // a broken test fails instead of hanging
+    struct timeval timeout{5, 0};
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    *ours = fds[0];
+    *sessions = fds[1];
+  }
+
+  // a connection over loopback TCP
+  static void make_tcp_pair(int *ours, int *sessions) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(listener, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    ASSERT_EQ(0, bind(listener, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)));
+    ASSERT_EQ(0, listen(listener, 1));
+    ASSERT_EQ(0, getsockname(listener, reinterpret_cast<struct sockaddr *>(&addr), &addr_len));
+    *sessions = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_EQ(0, connect(*sessions, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)));
+    *ours = accept(listener, nullptr, nullptr);
+    ::close(listener);
+    ASSERT_GE(*ours, 0);
+    struct timeval timeout{5, 0};
+    setsockopt(*ours, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  }
+
+  static void send_bytes(int fd, const Bytes &data) {
+    ASSERT_EQ(static_cast<ssize_t>(data.size()), ::send(fd, data.data(), data.size(), 0));
+  }
+
+  static Bytes receive_packet(int fd) {
+    Bytes packet(4);
+    if (::recv(fd, packet.data(), 4, MSG_WAITALL) != 4) {
+      return Bytes();
+    }
+    size_t size = packet[0] | (packet[1] << 8) | (packet[2] << 16);
+    packet.resize(4 + size);
+    if (size > 0 && ::recv(fd, packet.data() + 4, size, MSG_WAITALL) != static_cast<ssize_t>(size)) {
+      return Bytes();
+    }
+    return packet;
+  }
+
+  static Bytes ssl_receive_packet(SSL *ssl) {
+    Bytes packet(4);
+    size_t have = 0;
+    while (have < packet.size()) {
+      int res = SSL_read(ssl, packet.data() + have, static_cast<int>(packet.size() - have));
+      if (res <= 0) {
+        return Bytes();
+      }
+      have += static_cast<size_t>(res);
+      if (have == 4) {
+        packet.resize(4 + (packet[0] | (packet[1] << 8) | (packet[2] << 16)));
+      }
+    }
+    return packet;
+  }
+
+  // runs a session of a client whose server answers plaintext, or with
+  // TLS when server_context is given
+  void run_client(TlsClientContext *server_context, TlsServerContext *server_tls,
+                  RouteMetrics *metrics) {
+    int client, client_peer, server, server_peer;
+    make_pair(&client, &client_peer);
+    make_pair(&server, &server_peer);
+    TlsSession session(routing::SocketOperations::instance(), client_peer, server_peer,
+                       *contexts_, server_context, "db1:3306", std::chrono::seconds(5),
+                       16384, "test");
+    session.set_accounting(nullptr, metrics);
+    std::string error;
+    auto routed = std::async(std::launch::async, [&session, &error]() {
+      auto result = session.start(&error);
+      if (result == TlsSession::Result::kTls) {
+        error = session.run();
+      }
+      return result;
+    });
+
+    auto served = std::async(std::launch::async, [server, server_tls]() {
+      send_bytes(server, make_greeting(server_tls != nullptr));
+      std::unique_ptr<TlsConnection> tls;
+      Bytes response = receive_packet(server);
+      if (server_tls) {
+        // the SSL request of the client, then TLS
+        EXPECT_EQ(1, response[3]);
+        std::string tls_error;
+        tls = server_tls->accept(server, std::chrono::seconds(5), &tls_error);
+        EXPECT_NE(nullptr, tls) << tls_error;
+        routing::set_socket_blocking(server, true);
+        if (!tls) {
+          return;
+        }
+        Bytes packet(4096);
+        ssize_t size;
+        while ((size = tls->read(packet.data(), packet.size())) == TlsConnection::kWouldBlock) {}
+        ASSERT_GT(size, 4);
+        EXPECT_EQ(2, packet[3]);
+        Bytes ok = make_ok(3);
+        while (tls->write(ok.data(), ok.size()) == TlsConnection::kWouldBlock) {}
+        while ((size = tls->read(packet.data(), packet.size())) == TlsConnection::kWouldBlock) {}
+        ASSERT_EQ(5, size);
+        EXPECT_EQ(0, packet[3]);
+        Bytes answer = make_ok(1);
+        while (tls->write(answer.data(), answer.size()) == TlsConnection::kWouldBlock) {}
+      } else {
+        // the handshake response, as if the client never asked for SSL
+        ASSERT_GT(response.size(), 8U);
+        EXPECT_EQ(1, response[3]);
+        EXPECT_EQ(0u, PacketView(response).get_int<uint32_t>(4) & mysql_protocol::kClientSSL);
+        send_bytes(server, make_ok(2));
+        Bytes command = receive_packet(server);
+        ASSERT_EQ(5U, command.size());
+        EXPECT_EQ(0, command[3]);
+        send_bytes(server, make_ok(1));
+      }
+    });
+
+    Bytes greeting = receive_packet(client);
+    ASSERT_GT(greeting.size(), 30U);
+    // offered by the router, whether or not the server does
+    EXPECT_NE(0u, greeting[4 + 1 + 7 + 4 + 8 + 1 + 1] & (mysql_protocol::kClientSSL >> 8));
+    send_bytes(client, make_ssl_request(1, kClientCapabilities | mysql_protocol::kClientSSL));
+
+    SSL *ssl = SSL_new(client_ctx_);
+    SSL_set_fd(ssl, client);
+    if (client_session_) {
+      SSL_set_session(ssl, client_session_);
+    }
+    ASSERT_EQ(1, SSL_connect(ssl));
+
+    mysql_protocol::HandshakeResponsePacket response(2, Bytes(20, 0x01), "app", "", "", 8,
+        "mysql_native_password", kClientCapabilities | mysql_protocol::kClientSSL);
+    ASSERT_EQ(static_cast<int>(response.size()), SSL_write(ssl, response.data(), static_cast<int>(response.size())));
+    Bytes ok = ssl_receive_packet(ssl);
+    ASSERT_EQ(11U, ok.size());
+    EXPECT_EQ(3, ok[3]);
+    Bytes ping = make_packet(0, {0x0e});
+    ASSERT_EQ(5, SSL_write(ssl, ping.data(), 5));
+    Bytes answer = ssl_receive_packet(ssl);
+    ASSERT_EQ(11U, answer.size());
+    EXPECT_EQ(1, answer[3]);
+
+    if (client_session_) {
+      SSL_SESSION_free(client_session_);
+    }
+    client_session_ = SSL_get1_session(ssl);
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    ::shutdown(client, SHUT_RDWR);
+
+    EXPECT_EQ(TlsSession::Result::kTls, routed.get()) << error;
+    served.get();
+    EXPECT_LE(response.size() + 5, session.get_bytes_client_to_server());
+    for (int fd : {client, client_peer, server, server_peer}) {
+      ::close(fd);
+    }
+  }
+
+  static TestCertificate *certificate_;
+  std::unique_ptr<TlsServerContext> contexts_;
+  SSL_CTX *client_ctx_ = nullptr;
+  SSL_SESSION *client_session_ = nullptr;
+};
+
+TestCertificate *TlsSessionTest::certificate_ = nullptr;
+
+TEST_F(TlsSessionTest, PlaintextServerAndResumption) {
+  RouteMetrics metrics("routing:tls_plaintext");
+  run_client(nullptr, nullptr, &metrics);
+  EXPECT_EQ(1u, metrics.tls_client_handshakes.value());
+  EXPECT_EQ(0u, metrics.tls_client_resumed.value());
+
+  // the session is resumed from the cache of the route
+  run_client(nullptr, nullptr, &metrics);
+  EXPECT_EQ(1u, metrics.tls_client_handshakes.value());
+  EXPECT_EQ(1u, metrics.tls_client_resumed.value());
+}
+
+TEST_F(TlsSessionTest, TlsServer) {
+  RouteMetrics metrics("routing:tls_server");
+  TlsServerContext server_tls(certificate_->cert_file(), certificate_->key_file(),
+                              100, std::chrono::seconds(60), "server");
+  TlsClientContext server_context("");
+  run_client(&server_context, &server_tls, &metrics);
+  EXPECT_EQ(1u, metrics.tls_server_handshakes.value());
+
+  // the session with the server is resumed too
+  run_client(&server_context, &server_tls, &metrics);
+  EXPECT_EQ(1u, metrics.tls_server_handshakes.value());
+  EXPECT_EQ(1u, metrics.tls_server_resumed.value());
+  EXPECT_EQ(1u, metrics.tls_client_resumed.value());
+}
+
+TEST_F(TlsSessionTest, VerifiesServerHostName) {
+  TlsServerContext server_tls(certificate_->cert_file(), certificate_->key_file(),
+                              100, std::chrono::seconds(60), "server");
+  // the test certificate is self-signed, for CN=router
+  TlsClientContext server_context(certificate_->cert_file());
+  for (auto &destination : {std::make_pair("db1:3306", false), std::make_pair("router:3306", true),
+                            std::make_pair("127.0.0.1:3306", false)}) {
+    int server, server_peer;
+    make_pair(&server, &server_peer);
+    auto served = std::async(std::launch::async, [&server_tls, server]() {
+      std::string tls_error;
+      return server_tls.accept(server, std::chrono::seconds(5), &tls_error) != nullptr;
+    });
+    std::string error;
+    auto connection = server_context.connect(server_peer, destination.first, std::chrono::seconds(5),
+                                             &error);
+    EXPECT_EQ(destination.second, connection != nullptr) << destination.first << ": " << error;
+    connection.reset();
+    // a refused server fails with the alert of the client
+    served.get();
+    for (int fd : {server, server_peer}) {
+      ::close(fd);
+    }
+  }
+}
+
+TEST_F(TlsSessionTest, PlainClient) {
+  int client, client_peer, server, server_peer;
+  make_pair(&client, &client_peer);
+  make_pair(&server, &server_peer);
+  TlsSession session(routing::SocketOperations::instance(), client_peer, server_peer,
+                     *contexts_, nullptr, "db1:3306", std::chrono::seconds(5), 16384, "test");
+  std::string error;
+  auto started = std::async(std::launch::async, [&session, &error]() {
+    return session.start(&error);
+  });
+  send_bytes(server, make_greeting(false));
+  ASSERT_GT(receive_packet(client).size(), 30U);
+  mysql_protocol::HandshakeResponsePacket response(1, Bytes(20, 0x01), "app", "", "", 8,
+                                                   "mysql_native_password", kClientCapabilities);
+  send_bytes(client, Bytes(response.begin(), response.end()));
+  EXPECT_EQ(TlsSession::Result::kPlain, started.get()) << error;
+  // passed on as it was
+  EXPECT_EQ(Bytes(response.begin(), response.end()), receive_packet(server));
+  for (int fd : {client, client_peer, server, server_peer}) {
+    ::close(fd);
+  }
+}
+
+TEST_F(TlsSessionTest, ServerWithoutSsl) {
+  int client, client_peer, server, server_peer;
+  make_pair(&client, &client_peer);
+  make_pair(&server, &server_peer);
+  TlsClientContext server_context("");
+  TlsSession session(routing::SocketOperations::instance(), client_peer, server_peer,
+                     *contexts_, &server_context, "db1:3306", std::chrono::seconds(5), 16384, "test");
+  std::string error;
+  auto started = std::async(std::launch::async, [&session, &error]() {
+    return session.start(&error);
+  });
+  send_bytes(server, make_greeting(false));
+  Bytes server_error = receive_packet(client);
+  ASSERT_GT(server_error.size(), 5U);
+  EXPECT_EQ(0xff, server_error[4]);
+  EXPECT_EQ(TlsSession::Result::kFailed, started.get());
+  EXPECT_EQ("server db1:3306 does not support SSL", error);
+  for (int fd : {client, client_peer, server, server_peer}) {
+    ::close(fd);
+  }
+}
+
+TEST_F(TlsSessionTest, PlaintextServerOverTcp) {
+  int client, client_peer, server, server_peer;
+  make_pair(&client, &client_peer);
+  make_tcp_pair(&server, &server_peer);
+  TlsSession session(routing::SocketOperations::instance(), client_peer, server_peer,
+                     *contexts_, nullptr, "db1:3306", std::chrono::seconds(5), 16384, "test");
+  std::string error;
+  auto started = std::async(std::launch::async, [&session, &error]() {
+    return session.start(&error);
+  });
+  send_bytes(server, make_greeting(false));
+  ASSERT_GT(receive_packet(client).size(), 30U);
+  send_bytes(client, make_ssl_request(1, kClientCapabilities | mysql_protocol::kClientSSL));
+  // refused before the TLS handshake
+  Bytes client_error = receive_packet(client);
+  ASSERT_GT(client_error.size(), 5U);
+  EXPECT_EQ(2, client_error[3]);
+  EXPECT_EQ(0xff, client_error[4]);
+  EXPECT_EQ(TlsSession::Result::kFailed, started.get());
+  EXPECT_NE(std::string::npos, error.find("not connected through a Unix socket")) << error;
+  for (int fd : {client, client_peer, server, server_peer}) {
+    ::close(fd);
+  }
+}
+
+#endif  // WITH_ROUTING_TLS
+
+#endif  // _WIN32
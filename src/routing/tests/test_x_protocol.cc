@@ -145,7 +145,7 @@ TEST_F(XProtocolTest, CopyPacketsFdNotSet)
 
   FD_CLR(sender_socket_, &readfds_);
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   ASSERT_TRUE(result==0);
@@ -161,7 +161,7 @@ TEST_F(XProtocolTest, CopyPacketsReadError)
 
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_,_,_)).WillOnce(Return(-1));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   ASSERT_FALSE(handshake_done_);
@@ -179,7 +179,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeDoneOK)
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, &network_buffer_[0], network_buffer_.size())).WillOnce(Return(MSG_SIZE));
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], 20)).WillOnce(Return(MSG_SIZE));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   ASSERT_TRUE(handshake_done_);
@@ -199,7 +199,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeDoneWriteError)
                                                                   WillOnce(Return(MSG_SIZE));
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], 20)).WillOnce(Return(-1));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   ASSERT_TRUE(handshake_done_);
@@ -221,7 +221,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsIvalidData)
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, &network_buffer_[0], network_buffer_.size())).
                                                                               WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, false);
 
   ASSERT_FALSE(handshake_done_);
@@ -241,7 +241,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsWrongMessage)
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, &network_buffer_[0], network_buffer_.size())).
                                                      WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, false);
 
   ASSERT_FALSE(handshake_done_);
@@ -262,7 +262,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsAuthStart)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], network_buffer_offset_)).
                                                      WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, false);
 
   ASSERT_TRUE(handshake_done_);
@@ -283,7 +283,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsCapabilitiesGet)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], network_buffer_offset_)).
                                                      WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, false);
 
   ASSERT_TRUE(handshake_done_);
@@ -304,7 +304,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsConnectionClose)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], network_buffer_offset_)).
                                                      WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, false);
 
   ASSERT_TRUE(handshake_done_);
@@ -325,7 +325,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsCapabilitiesSet)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], network_buffer_offset_)).
                                                      WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, false);
 
   ASSERT_TRUE(handshake_done_);
@@ -347,7 +347,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeClientSendsBrokenMessage)
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, &network_buffer_[0], network_buffer_.size())).
                                                      WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, false);
 
   ASSERT_FALSE(handshake_done_);
@@ -368,7 +368,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeServerSendsError)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], network_buffer_offset_)).
                                                      WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   ASSERT_TRUE(handshake_done_);
@@ -389,7 +389,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeServerSendsOtherMessage)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], network_buffer_offset_)).
                                                      WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   ASSERT_FALSE(handshake_done_);
@@ -414,7 +414,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeReadTwoMessages)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], network_buffer_offset_)).
                                                                   WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   // handshake_done_ should be set after the second message
@@ -440,7 +440,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeReadPartialHeader)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], network_buffer_offset_)).
                                                 WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, false);
 
   // handshake_done_ should bet set
@@ -466,7 +466,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeReadPartialMessage)
   EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, &network_buffer_[0], network_buffer_offset_)).
                                                 WillOnce(Return(network_buffer_offset_));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   ASSERT_FALSE(handshake_done_);
@@ -489,7 +489,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeReadPartialMessageFails)
                                                WillOnce(Return(network_buffer_offset_-8)).
                                                WillOnce(Return(-1));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   ASSERT_FALSE(handshake_done_);
@@ -523,7 +523,7 @@ TEST_F(XProtocolTest, CopyPacketsHandshakeMsgBiggerThanBuffer)
   EXPECT_CALL(*mock_socket_operations_, read(sender_socket_, _, _)).Times(1).
                                              WillOnce(Return(network_buffer_.size()));
 
-  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, &readfds_, network_buffer_, &curr_pktnr_,
+  int result = x_protocol_->copy_packets(sender_socket_, receiver_socket_, FD_ISSET(sender_socket_, &readfds_) != 0, network_buffer_, &curr_pktnr_,
                                          handshake_done_, &report_bytes_read, true);
 
   // the size of buffer passed to copy_packets should be untouched
@@ -544,6 +544,26 @@ TEST_F(XProtocolTest, SendErrorOKMultipleWrites)
   ASSERT_TRUE(res);
 }
 
+TEST_F(XProtocolTest, OnIdleTimeout)
+{
+  // warning notice to the client, Close to the server
+  Mysqlx::Notice::Warning warning;
+  warning.set_level(Mysqlx::Notice::Warning::ERROR);
+  warning.set_code(4031);
+  warning.set_msg("idle");
+  Mysqlx::Notice::Frame notice;
+  notice.set_type(1);
+  notice.set_scope(Mysqlx::Notice::Frame::GLOBAL);
+  notice.set_payload(warning.SerializeAsString());
+  const size_t notice_size = notice.ByteSize() + 5;
+  const size_t close_size = Mysqlx::Connection::Close().ByteSize() + 5;
+
+  EXPECT_CALL(*mock_socket_operations_, write(sender_socket_, _, notice_size)).WillOnce(Return(notice_size));
+  EXPECT_CALL(*mock_socket_operations_, write(receiver_socket_, _, close_size)).WillOnce(Return(close_size));
+
+  x_protocol_->on_idle_timeout(sender_socket_, receiver_socket_, 4031, "idle", "routing");
+}
+
 TEST_F(XProtocolTest, SendErrorWriteFail)
 {
   EXPECT_CALL(*mock_socket_operations_, write(1, _, _)).WillOnce(Return(-1));
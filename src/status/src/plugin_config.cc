@@ -0,0 +1,64 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "plugin_config.h"
+
+#include <map>
+#include <stdexcept>
+
+static const char *kDefaultBindAddress = "127.0.0.1";
+
+StatusPluginConfig::StatusPluginConfig(const mysql_harness::ConfigSection *section)
+    : BasePluginConfig(section),
+      bind_address(get_option_loopback_address(section, "bind_address")),
+      named_socket(get_option_named_socket(section, "socket")) {
+  if (bind_address.port == 0 && !named_socket.is_set()) {
+    throw std::invalid_argument("in [" + section_name + "]: one of bind_port or socket is required");
+  }
+}
+
+std::string StatusPluginConfig::get_default(const std::string &option) {
+  static const std::map<std::string, std::string> defaults{
+      {"bind_address", kDefaultBindAddress},
+  };
+  auto it = defaults.find(option);
+  if (it == defaults.end()) {
+    return std::string();
+  }
+  return it->second;
+}
+
+bool StatusPluginConfig::is_required(const std::string &) {
+  return false;
+}
+
+mysqlrouter::TCPAddress StatusPluginConfig::get_option_loopback_address(
+    const mysql_harness::ConfigSection *section, const std::string &option) {
+  mysqlrouter::TCPAddress address = get_option_tcp_address(section, option);
+  int port = get_option_tcp_port(section, "bind_port");
+  if (port > 0) {
+    address = mysqlrouter::TCPAddress(address.addr, static_cast<uint32_t>(port));
+  }
+
+  // the endpoint has no authentication; keep it on the local host
+  const std::string &host = address.addr;
+  if (host != "localhost" && host != "::1" && host.compare(0, 4, "127.") != 0) {
+    throw std::invalid_argument(get_log_prefix(option) + " has to be a loopback address, was '" +
+                                host + "'");
+  }
+  return address;
+}
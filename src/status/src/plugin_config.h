@@ -0,0 +1,62 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef STATUS_PLUGIN_CONFIG_INCLUDED
+#define STATUS_PLUGIN_CONFIG_INCLUDED
+
+#include "config_parser.h"
+#include "filesystem.h"
+#include "mysqlrouter/datatypes.h"
+#include "mysqlrouter/plugin_config.h"
+
+#include <string>
+
+/** @class StatusPluginConfig
+ * @brief Configuration of the status endpoint
+ *
+ *     [status]
+ *     bind_address = 127.0.0.1
+ *     bind_port = 8081
+ *     socket = /tmp/mysqlrouter-status.sock
+ *
+ * At least one of bind_port and socket is required. The endpoint is only
+ * meant for the local host: bind_address has to be a loopback address.
+ */
+class StatusPluginConfig final : public mysqlrouter::BasePluginConfig {
+public:
+  /** @brief Constructor
+   *
+   * Throws std::invalid_argument on errors.
+   *
+   * @param section from configuration file provided as ConfigSection
+   */
+  StatusPluginConfig(const mysql_harness::ConfigSection *section);
+
+  std::string get_default(const std::string &option);
+  bool is_required(const std::string &option);
+
+  /** @brief TCP address to listen on; port is 0 when not listening on TCP */
+  const mysqlrouter::TCPAddress bind_address;
+  /** @brief Unix socket to listen on */
+  const mysql_harness::Path named_socket;
+
+private:
+  mysqlrouter::TCPAddress get_option_loopback_address(const mysql_harness::ConfigSection *section,
+                                                      const std::string &option);
+};
+
+#endif // STATUS_PLUGIN_CONFIG_INCLUDED
@@ -0,0 +1,87 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * Status Plugin
+ *
+ * Serves the metrics of routes, destinations and the metadata cache in
+ * the Prometheus text format (/metrics) and as JSON (/status), on a
+ * loopback address or a Unix socket.
+ *
+ * [status]
+ * bind_port = 8081
+ */
+
+#include "plugin_config.h"
+#include "status_server.h"
+
+#include "config_parser.h"
+#include "logger.h"
+#include "mysql/harness/plugin.h"
+
+#include <stdexcept>
+
+#if defined(_MSC_VER) && defined(status_EXPORTS)
+/* We are building this library */
+#  define STATUS_API __declspec(dllexport)
+#else
+#  define STATUS_API
+#endif
+
+static const char *kSectionName = "status";
+
+static const char *kStatusRequires[] = {
+    "logger",
+};
+
+static int init(const mysql_harness::AppInfo *info) {
+  if (info->config != nullptr) {
+    for (const mysql_harness::ConfigSection *section : info->config->sections()) {
+      if (section->name == kSectionName) {
+        StatusPluginConfig config(section);  // throws std::invalid_argument
+      }
+    }
+  }
+  return 0;
+}
+
+static void start(const mysql_harness::ConfigSection *section) {
+  try {
+    StatusPluginConfig config(section);
+    status::StatusServer server(config.bind_address, config.named_socket);
+    server.start();
+  } catch (const std::invalid_argument &exc) {
+    log_error(exc.what());
+  } catch (const std::runtime_error &exc) {
+    log_error("[%s] %s", kSectionName, exc.what());
+  }
+}
+
+extern "C" {
+  mysql_harness::Plugin STATUS_API harness_plugin_status = {
+      mysql_harness::PLUGIN_ABI_VERSION,
+      mysql_harness::ARCHITECTURE_DESCRIPTOR,
+      "Status endpoint serving metrics of the router",
+      VERSION_NUMBER(0, 0, 1),
+      sizeof(kStatusRequires) / sizeof(*kStatusRequires), kStatusRequires, // Requires
+      0, nullptr, // Conflicts
+      init,       // init
+      nullptr,    // deinit
+      start,      // start
+      nullptr     // stop
+  };
+}
@@ -0,0 +1,462 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "status_server.h"
+#include "common.h"
+#include "logger.h"
+#include "mysqlrouter/utils.h"
+
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+# include <netdb.h>
+# include <poll.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <unistd.h>
+#else
+# define NOMINMAX
+# include <windows.h>
+# include <winsock2.h>
+# include <ws2tcpip.h>
+#endif
+
+using mysql_harness::metrics::MetricSample;
+using mysql_harness::metrics::MetricType;
+using mysql_harness::get_strerror;
+using mysqlrouter::string_format;
+
+namespace status {
+
+// how often start() checks whether it has to stop
+static const int kStopPollInterval_ms = 1000;
+// how long a client has to send its request
+static const std::chrono::milliseconds kRequestTimeout(1000);
+// requests are a request line and a few headers; anything larger is not a scraper
+static const size_t kMaxRequestSize = 8192;
+static const int kListenQueueSize = 16;
+
+static void close_socket(int sock) noexcept {
+#ifndef _WIN32
+  ::close(sock);
+#else
+  ::closesocket(sock);
+#endif
+}
+
+static int poll_socket(struct pollfd *fds, unsigned long nfds, int timeout_ms) {
+#ifndef _WIN32
+  return ::poll(fds, nfds, timeout_ms);
+#else
+  return ::WSAPoll(fds, nfds, timeout_ms);
+#endif
+}
+
+static const char *prometheus_type(MetricType type) {
+  switch (type) {
+    case MetricType::kCounter:
+      return "counter";
+    case MetricType::kGauge:
+    case MetricType::kInfo:
+      return "gauge";
+    case MetricType::kHistogram:
+      return "histogram";
+  }
+  return "untyped";
+}
+
+static std::string escape_prometheus(const std::string &value, bool quoted) {
+  std::string result;
+  result.reserve(value.size());
+  for (char c : value) {
+    if (c == '\\') {
+      result += "\\\\";
+    } else if (c == '\n') {
+      result += "\\n";
+    } else if (c == '"' && quoted) {
+      result += "\\\"";
+    } else {
+      result += c;
+    }
+  }
+  return result;
+}
+
+static std::string prometheus_labels(const mysql_harness::metrics::Labels &labels,
+                                     const std::string &le = "") {
+  if (labels.empty() && le.empty()) {
+    return "";
+  }
+  std::string result = "{";
+  for (const auto &label : labels) {
+    if (result.size() > 1) {
+      result += ",";
+    }
+    result += label.first + "=\"" + escape_prometheus(label.second, true) + "\"";
+  }
+  if (!le.empty()) {
+    if (result.size() > 1) {
+      result += ",";
+    }
+    result += "le=\"" + le + "\"";
+  }
+  return result + "}";
+}
+
+std::string render_prometheus(const std::vector<MetricSample> &samples) {
+  std::ostringstream os;
+  const std::string *last_name = nullptr;
+  for (const auto &sample : samples) {
+    if (last_name == nullptr || *last_name != sample.name) {
+      if (!sample.help.empty()) {
+        os << "# HELP " << sample.name << " " << escape_prometheus(sample.help, false) << "\n";
+      }
+      os << "# TYPE " << sample.name << " " << prometheus_type(sample.type) << "\n";
+      last_name = &sample.name;
+    }
+    if (sample.type != MetricType::kHistogram) {
+      os << sample.name << prometheus_labels(sample.labels) << " " << sample.value << "\n";
+      continue;
+    }
+    // buckets are cumulative in the exposition format
+    const auto &histogram = sample.histogram;
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < histogram.bounds.size(); ++i) {
+      cumulative += histogram.counts[i];
+      os << sample.name << "_bucket"
+         << prometheus_labels(sample.labels, std::to_string(histogram.bounds[i]))
+         << " " << cumulative << "\n";
+    }
+    os << sample.name << "_bucket" << prometheus_labels(sample.labels, "+Inf") << " "
+       << histogram.count << "\n";
+    os << sample.name << "_sum" << prometheus_labels(sample.labels) << " " << histogram.sum << "\n";
+    os << sample.name << "_count" << prometheus_labels(sample.labels) << " " << histogram.count << "\n";
+  }
+  return os.str();
+}
+
+static std::string json_string(const std::string &value) {
+  std::string result = "\"";
+  for (char c : value) {
+    switch (c) {
+      case '"':
+        result += "\\\"";
+        break;
+      case '\\':
+        result += "\\\\";
+        break;
+      case '\n':
+        result += "\\n";
+        break;
+      case '\r':
+        result += "\\r";
+        break;
+      case '\t':
+        result += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          result += string_format("\\u%04x", static_cast<unsigned int>(c));
+        } else {
+          result += c;
+        }
+    }
+  }
+  return result + "\"";
+}
+
+std::string render_json(const std::vector<MetricSample> &samples) {
+  std::ostringstream os;
+  os << "{";
+  const std::string *last_name = nullptr;
+  for (const auto &sample : samples) {
+    if (last_name == nullptr || *last_name != sample.name) {
+      if (last_name != nullptr) {
+        os << "]},";
+      }
+      os << "\n  " << json_string(sample.name) << ": {"
+         << "\"type\": " << json_string(sample.type == MetricType::kInfo ? "info" : prometheus_type(sample.type))
+         << ", \"help\": " << json_string(sample.help) << ", \"samples\": [";
+      last_name = &sample.name;
+    } else {
+      os << ",";
+    }
+    os << "\n    {\"labels\": {";
+    bool first = true;
+    for (const auto &label : sample.labels) {
+      os << (first ? "" : ", ") << json_string(label.first) << ": " << json_string(label.second);
+      first = false;
+    }
+    os << "}";
+    if (sample.type != MetricType::kHistogram) {
+      os << ", \"value\": " << sample.value << "}";
+      continue;
+    }
+    const auto &histogram = sample.histogram;
+    os << ", \"buckets\": [";
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < histogram.bounds.size(); ++i) {
+      cumulative += histogram.counts[i];
+      os << "{\"le\": " << histogram.bounds[i] << ", \"count\": " << cumulative << "}, ";
+    }
+    os << "{\"le\": \"+Inf\", \"count\": " << histogram.count << "}]"
+       << ", \"sum\": " << histogram.sum << ", \"count\": " << histogram.count << "}";
+  }
+  if (last_name != nullptr) {
+    os << "]}";
+  }
+  os << "\n}\n";
+  return os.str();
+}
+
+static std::string http_response(const std::string &status, const std::string &content_type,
+                                 const std::string &body, const std::string &extra_headers = "") {
+  std::ostringstream os;
+  os << "HTTP/1.0 " << status << "\r\n"
+     << "Content-Type: " << content_type << "\r\n"
+     << "Content-Length: " << body.size() << "\r\n"
+     << extra_headers
+     << "Connection: close\r\n"
+     << "\r\n"
+     << body;
+  return os.str();
+}
+
+StatusServer::StatusServer(const mysqlrouter::TCPAddress &bind_address,
+                           const mysql_harness::Path &named_socket,
+                           const mysql_harness::metrics::MetricsRegistry &registry)
+    : bind_address_(bind_address),
+      named_socket_(named_socket),
+      registry_(registry),
+      service_tcp_(-1),
+      service_named_socket_(-1),
+      stopping_(false) {}
+
+StatusServer::~StatusServer() {
+  close_services();
+}
+
+std::string StatusServer::handle_request(const std::string &request) const {
+  // request line: method SP path SP version
+  std::string line = request.substr(0, request.find("\r\n"));
+  std::istringstream is(line);
+  std::string method, path, version;
+  is >> method >> path >> version;
+  if (method.empty() || path.empty() || version.compare(0, 5, "HTTP/") != 0) {
+    return http_response("400 Bad Request", "text/plain", "Bad Request\n");
+  }
+  if (method != "GET") {
+    return http_response("405 Method Not Allowed", "text/plain", "Method Not Allowed\n",
+                         "Allow: GET\r\n");
+  }
+  path = path.substr(0, path.find('?'));
+
+  if (path == "/metrics") {
+    return http_response("200 OK", "text/plain; version=0.0.4",
+                         render_prometheus(registry_.collect()));
+  }
+  if (path == "/status") {
+    return http_response("200 OK", "application/json", render_json(registry_.collect()));
+  }
+  return http_response("404 Not Found", "text/plain", "Not Found\n");
+}
+
+void StatusServer::serve_client(int sock) const noexcept {
+  std::string request;
+  char buffer[1024];
+  auto deadline = std::chrono::steady_clock::now() + kRequestTimeout;
+  // read the whole request, so that closing does not reset the connection
+  // while the client still sends
+  while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequestSize) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0) {
+      break;
+    }
+    struct pollfd fds[1];
+    fds[0].fd = sock;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    if (poll_socket(fds, 1, static_cast<int>(remaining.count())) <= 0) {
+      break;
+    }
+    auto size = ::recv(sock, buffer, sizeof(buffer), 0);
+    if (size <= 0) {
+      break;
+    }
+    request.append(buffer, static_cast<size_t>(size));
+  }
+  if (request.find("\r\n") == std::string::npos) {
+    close_socket(sock);
+    return;
+  }
+
+  std::string response;
+  try {
+    response = handle_request(request);
+  } catch (const std::exception &exc) {
+    log_error("[status] Failed handling request: %s", exc.what());
+    response = http_response("500 Internal Server Error", "text/plain", "Internal Server Error\n");
+  }
+
+  int flags = 0;
+#ifdef MSG_NOSIGNAL
+  flags = MSG_NOSIGNAL;
+#endif
+  size_t sent = 0;
+  while (sent < response.size()) {
+    auto size = ::send(sock, response.data() + sent, response.size() - sent, flags);
+    if (size <= 0) {
+      break;
+    }
+    sent += static_cast<size_t>(size);
+  }
+  close_socket(sock);
+}
+
+void StatusServer::setup_tcp_service() {
+  struct addrinfo *servinfo, *info, hints;
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+
+  int err = getaddrinfo(bind_address_.addr.c_str(), std::to_string(bind_address_.port).c_str(),
+                        &hints, &servinfo);
+  if (err != 0) {
+    throw std::runtime_error(string_format("Failed getting address information (%s)", gai_strerror(err)));
+  }
+
+  std::string error;
+  for (info = servinfo; info != nullptr; info = info->ai_next) {
+    int sock = static_cast<int>(socket(info->ai_family, info->ai_socktype, info->ai_protocol));
+    if (sock == -1) {
+      error = get_strerror(errno);
+      continue;
+    }
+#ifndef _WIN32
+    int option_value = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&option_value),
+               static_cast<socklen_t>(sizeof(int)));
+#endif
+    if (::bind(sock, info->ai_addr, static_cast<socklen_t>(info->ai_addrlen)) == -1 ||
+        listen(sock, kListenQueueSize) == -1) {
+      error = get_strerror(errno);
+      close_socket(sock);
+      continue;
+    }
+    service_tcp_ = sock;
+    break;
+  }
+  freeaddrinfo(servinfo);
+
+  if (service_tcp_ == -1) {
+    throw std::runtime_error(string_format("Failed listening on %s: %s", bind_address_.str().c_str(),
+                                           error.c_str()));
+  }
+}
+
+void StatusServer::setup_named_socket_service() {
+#ifndef _WIN32
+  struct sockaddr_un sock_unix;
+  std::string socket_file = named_socket_.str();
+  if (socket_file.size() >= sizeof(sock_unix.sun_path)) {
+    throw std::runtime_error("Socket file path too long: " + socket_file);
+  }
+  memset(&sock_unix, 0, sizeof(sock_unix));
+  sock_unix.sun_family = AF_UNIX;
+  std::strncpy(sock_unix.sun_path, socket_file.c_str(), sizeof(sock_unix.sun_path) - 1);
+
+  // a socket file left behind by a previous run
+  if (unlink(socket_file.c_str()) == -1 && errno != ENOENT) {
+    throw std::runtime_error("Failed removing socket file " + socket_file + ": " + get_strerror(errno));
+  }
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock == -1) {
+    throw std::runtime_error(get_strerror(errno));
+  }
+  if (::bind(sock, reinterpret_cast<struct sockaddr *>(&sock_unix),
+             static_cast<socklen_t>(sizeof(sock_unix))) == -1 ||
+      listen(sock, kListenQueueSize) == -1) {
+    std::string error = get_strerror(errno);
+    close_socket(sock);
+    throw std::runtime_error("Failed listening on socket file " + socket_file + ": " + error);
+  }
+  service_named_socket_ = sock;
+#endif
+}
+
+void StatusServer::close_services() noexcept {
+  if (service_tcp_ != -1) {
+    close_socket(service_tcp_);
+    service_tcp_ = -1;
+  }
+  if (service_named_socket_ != -1) {
+    close_socket(service_named_socket_);
+    service_named_socket_ = -1;
+#ifndef _WIN32
+    unlink(named_socket_.c_str());
+#endif
+  }
+}
+
+void StatusServer::start() {
+  try {
+    if (bind_address_.port > 0) {
+      setup_tcp_service();
+      log_info("[status] listening on %s", bind_address_.str().c_str());
+    }
+    if (named_socket_.is_set()) {
+      setup_named_socket_service();
+      log_info("[status] listening using %s", named_socket_.c_str());
+    }
+  } catch (...) {
+    close_services();
+    throw;
+  }
+
+  struct pollfd fds[2];
+  fds[0].fd = service_tcp_;
+  fds[0].events = POLLIN;
+  fds[1].fd = service_named_socket_;
+  fds[1].events = POLLIN;
+
+  while (!stopping_) {
+    fds[0].revents = 0;
+    fds[1].revents = 0;
+    int ready = poll_socket(fds, 2, kStopPollInterval_ms);
+    if (ready <= 0) {
+      continue;
+    }
+    for (auto &fd : fds) {
+      if (fd.fd == -1 || fd.revents == 0) {
+        continue;
+      }
+      int sock = static_cast<int>(accept(fd.fd, nullptr, nullptr));
+      if (sock >= 0) {
+        serve_client(sock);
+      }
+    }
+  }
+  close_services();
+  log_info("[status] stopped");
+}
+
+} // namespace status
@@ -0,0 +1,110 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef STATUS_SERVER_INCLUDED
+#define STATUS_SERVER_INCLUDED
+
+#include "filesystem.h"
+#include "metrics.h"
+#include "mysqlrouter/datatypes.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace status {
+
+/** @brief Renders metrics in the Prometheus text exposition format
+ *
+ * @param samples metrics as returned by MetricsRegistry::collect()
+ * @return std::string
+ */
+std::string render_prometheus(const std::vector<mysql_harness::metrics::MetricSample> &samples);
+
+/** @brief Renders metrics as a JSON object keyed by metric name
+ *
+ * @param samples metrics as returned by MetricsRegistry::collect()
+ * @return std::string
+ */
+std::string render_json(const std::vector<mysql_harness::metrics::MetricSample> &samples);
+
+/** @class StatusServer
+ * @brief Serves the metrics registry over HTTP
+ *
+ * The server is read-only and answers one request at a time:
+ *
+ *  - `GET /metrics`: Prometheus text format
+ *  - `GET /status`: JSON
+ *
+ * Requests only read the metrics registry, so that scraping does not
+ * take any lock used while routing connections.
+ */
+class StatusServer {
+ public:
+  /** @brief Constructor
+   *
+   * @param bind_address TCP address to listen on; port 0 to not use TCP
+   * @param named_socket Unix socket to listen on; unset to not use one
+   * @param registry metrics to serve
+   */
+  StatusServer(const mysqlrouter::TCPAddress &bind_address,
+               const mysql_harness::Path &named_socket,
+               const mysql_harness::metrics::MetricsRegistry &registry =
+                   mysql_harness::metrics::MetricsRegistry::instance());
+
+  StatusServer(const StatusServer &) = delete;
+  StatusServer &operator=(const StatusServer &) = delete;
+
+  ~StatusServer();
+
+  /** @brief Listens and serves requests until stop() is called
+   *
+   * Throws std::runtime_error when listening fails.
+   */
+  void start();
+
+  /** @brief Makes start() return */
+  void stop() noexcept {
+    stopping_ = true;
+  }
+
+  /** @brief Returns the HTTP response to a request
+   *
+   * @param request the request, at least up to the end of the request line
+   * @return std::string
+   */
+  std::string handle_request(const std::string &request) const;
+
+ private:
+  /** @brief Reads a request from a client and sends the response */
+  void serve_client(int sock) const noexcept;
+
+  void setup_tcp_service();
+  void setup_named_socket_service();
+  void close_services() noexcept;
+
+  mysqlrouter::TCPAddress bind_address_;
+  mysql_harness::Path named_socket_;
+  const mysql_harness::metrics::MetricsRegistry &registry_;
+  int service_tcp_;
+  int service_named_socket_;
+  std::atomic_bool stopping_;
+};
+
+} // namespace status
+
+#endif // STATUS_SERVER_INCLUDED
@@ -0,0 +1,176 @@
+/*
+  Copyright (c) 2017, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "plugin_config.h"
+#include "status_server.h"
+
+#include "gmock/gmock.h"
+
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <unistd.h>
+#endif
+
+using mysql_harness::metrics::MetricsRegistry;
+using ::testing::HasSubstr;
+using ::testing::StartsWith;
+
+class StatusServerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    registry.counter("routing_accepted_total", {{"route", "routing:rw"}}, "Clients accepted").inc(3);
+    registry.gauge("routing_active_connections", {{"route", "routing:rw"}}).add(2);
+    auto &histogram = registry.histogram("routing_connection_duration_ms", {10, 100},
+                                         {{"route", "routing:rw"}});
+    histogram.observe(5);
+    histogram.observe(50);
+    histogram.observe(500);
+    registry.set_info("routing_blocked_host", {{"route", "routing:rw"}},
+                      {{{"host", "192.168.1.\"1\""}}});
+  }
+
+  MetricsRegistry registry;
+};
+
+TEST_F(StatusServerTest, RenderPrometheus) {
+  std::string text = status::render_prometheus(registry.collect());
+
+  EXPECT_THAT(text, HasSubstr("# HELP routing_accepted_total Clients accepted\n"
+                              "# TYPE routing_accepted_total counter\n"
+                              "routing_accepted_total{route=\"routing:rw\"} 3\n"));
+  EXPECT_THAT(text, HasSubstr("# TYPE routing_active_connections gauge\n"
+                              "routing_active_connections{route=\"routing:rw\"} 2\n"));
+  // buckets are cumulative
+  EXPECT_THAT(text, HasSubstr(
+      "# TYPE routing_connection_duration_ms histogram\n"
+      "routing_connection_duration_ms_bucket{route=\"routing:rw\",le=\"10\"} 1\n"
+      "routing_connection_duration_ms_bucket{route=\"routing:rw\",le=\"100\"} 2\n"
+      "routing_connection_duration_ms_bucket{route=\"routing:rw\",le=\"+Inf\"} 3\n"
+      "routing_connection_duration_ms_sum{route=\"routing:rw\"} 555\n"
+      "routing_connection_duration_ms_count{route=\"routing:rw\"} 3\n"));
+  EXPECT_THAT(text, HasSubstr(
+      "# TYPE routing_blocked_host gauge\n"
+      "routing_blocked_host{host=\"192.168.1.\\\"1\\\"\",route=\"routing:rw\"} 1\n"));
+}
+
+TEST_F(StatusServerTest, RenderJson) {
+  std::string json = status::render_json(registry.collect());
+
+  EXPECT_THAT(json, StartsWith("{"));
+  EXPECT_THAT(json, HasSubstr("\"routing_accepted_total\": {\"type\": \"counter\", "
+                              "\"help\": \"Clients accepted\", \"samples\": [\n"
+                              "    {\"labels\": {\"route\": \"routing:rw\"}, \"value\": 3}]}"));
+  EXPECT_THAT(json, HasSubstr("\"buckets\": [{\"le\": 10, \"count\": 1}, {\"le\": 100, \"count\": 2}, "
+                              "{\"le\": \"+Inf\", \"count\": 3}], \"sum\": 555, \"count\": 3}"));
+  EXPECT_THAT(json, HasSubstr("\"type\": \"info\""));
+  EXPECT_THAT(json, HasSubstr("\"host\": \"192.168.1.\\\"1\\\"\""));
+}
+
+TEST_F(StatusServerTest, HandleRequest) {
+  status::StatusServer server(mysqlrouter::TCPAddress(), mysql_harness::Path(), registry);
+
+  std::string response = server.handle_request("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  EXPECT_THAT(response, StartsWith("HTTP/1.0 200 OK\r\n"));
+  EXPECT_THAT(response, HasSubstr("Content-Type: text/plain; version=0.0.4\r\n"));
+  EXPECT_THAT(response, HasSubstr("routing_accepted_total{route=\"routing:rw\"} 3\n"));
+
+  response = server.handle_request("GET /status?pretty HTTP/1.1\r\n\r\n");
+  EXPECT_THAT(response, StartsWith("HTTP/1.0 200 OK\r\n"));
+  EXPECT_THAT(response, HasSubstr("Content-Type: application/json\r\n"));
+
+  EXPECT_THAT(server.handle_request("GET / HTTP/1.1\r\n\r\n"), StartsWith("HTTP/1.0 404 Not Found"));
+  EXPECT_THAT(server.handle_request("POST /metrics HTTP/1.1\r\n\r\n"),
+              StartsWith("HTTP/1.0 405 Method Not Allowed"));
+  EXPECT_THAT(server.handle_request("hello\r\n\r\n"), StartsWith("HTTP/1.0 400 Bad Request"));
+}
+
+#ifndef _WIN32
+TEST_F(StatusServerTest, ServesUnixSocket) {
+  std::string socket_file = "/tmp/status_server_test_" + std::to_string(getpid()) + ".sock";
+  status::StatusServer server(mysqlrouter::TCPAddress(), mysql_harness::Path(socket_file), registry);
+  std::thread server_thread(&status::StatusServer::start, &server);
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_file.c_str(), sizeof(addr.sun_path) - 1);
+
+  int sock = -1;
+  for (int i = 0; i < 100 && sock < 0; ++i) {
+    // the server might not be listening yet
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1) {
+      close(sock);
+      sock = -1;
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+  }
+  ASSERT_GE(sock, 0);
+
+  std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+  ASSERT_EQ(static_cast<ssize_t>(request.size()), write(sock, request.data(), request.size()));
+  std::string response;
+  char buffer[1024];
+  ssize_t size;
+  while ((size = read(sock, buffer, sizeof(buffer))) > 0) {
+    response.append(buffer, static_cast<size_t>(size));
+  }
+  close(sock);
+
+  EXPECT_THAT(response, StartsWith("HTTP/1.0 200 OK\r\n"));
+  EXPECT_THAT(response, HasSubstr("routing_active_connections{route=\"routing:rw\"} 2\n"));
+
+  server.stop();
+  server_thread.join();
+  EXPECT_NE(0, access(socket_file.c_str(), F_OK));
+}
+#endif
+
+TEST(StatusPluginConfigTest, LoopbackOnly) {
+  mysql_harness::Config config;
+  mysql_harness::ConfigSection &section = config.add("status", "");
+  section.add("bind_port", "8081");
+
+  StatusPluginConfig plugin_config(&section);
+  EXPECT_EQ("127.0.0.1", plugin_config.bind_address.addr);
+  EXPECT_EQ(8081, plugin_config.bind_address.port);
+
+  section.add("bind_address", "192.168.1.10");
+  try {
+    StatusPluginConfig invalid(&section);
+    FAIL() << "Expected std::invalid_argument";
+  } catch (const std::invalid_argument &exc) {
+    EXPECT_STREQ("option bind_address in [status] has to be a loopback address, was '192.168.1.10'",
+                 exc.what());
+  }
+}
+
+TEST(StatusPluginConfigTest, PortOrSocketRequired) {
+  mysql_harness::Config config;
+  mysql_harness::ConfigSection &section = config.add("status", "");
+
+  try {
+    StatusPluginConfig invalid(&section);
+    FAIL() << "Expected std::invalid_argument";
+  } catch (const std::invalid_argument &exc) {
+    EXPECT_STREQ("in [status]: one of bind_port or socket is required", exc.what());
+  }
+}